@@ -1,8 +1,12 @@
 from fastai.vision import *
 
+from image_codecs import read_image
+
+PATCH_SIZE = 32  # the autoencoder looks at a 32x32px patch around each cell
+BATCH_SIZE = 256  # patches that are encoded at once
+
 
 class TrainedAutoencoder(object):
-    progress = 0.0
 
     def __init__(self, model_path: str):
         """
@@ -10,20 +14,45 @@ class TrainedAutoencoder(object):
         """
         self.learn = load_learner(model_path)
         self.learn.model.decode = False
+        self.learn.model.eval()
+
+    def open_image(self, img_path):
+        """ Returns the image with a black border of half a patch, so that cells at the edge get complete patches. """
+        half = PATCH_SIZE // 2
+        return torch.nn.functional.pad(torch.from_numpy(read_image(img_path)), (half, half, half, half))
 
-    def get_feature_vectors(self, img_path, cell_positions):
-        img = open_image(img_path)
-        feature_vectors = []
+    def encode_batch(self, image, cell_positions):
+        """ Returns the feature vectors of the cells (one row each) as float32 array, image is from open_image(). """
+        _, height, width = image.shape
+        # the patch of a cell starts half a patch before it, i.e. at its position in the padded image:
+        xs = np.clip(cell_positions[:, 0].astype(int), 0, width - PATCH_SIZE)
+        ys = np.clip(cell_positions[:, 1].astype(int), 0, height - PATCH_SIZE)
+        patches = torch.stack([image[:, y:y + PATCH_SIZE, x:x + PATCH_SIZE] for x, y in zip(xs, ys)])
+        device = next(self.learn.model.parameters()).device
+        with torch.no_grad():
+            output = self.learn.model(patches.to(device))
+        return output.cpu().numpy().reshape(len(cell_positions), -1).astype(np.float32)
 
-        for i, pos in enumerate(cell_positions):
-            TrainedAutoencoder.progress = i / len(cell_positions)
-            x = int(pos[0])
-            y = int(pos[1])
-            p, prediction, b = self.learn.predict(img.data[:, y-16:y+16, x-16:x+16])
-            feature_vectors.append([float(x) for x in prediction])
+    def get_feature_vectors(self, img_path, cell_positions, on_progress=lambda progress: None):
+        """ Returns a float32 array with one row per cell. """
+        if len(cell_positions) == 0:
+            return np.empty((0, 0), dtype=np.float32)
+        image = self.open_image(img_path)
+        batches = []
+        for start in range(0, len(cell_positions), BATCH_SIZE):
+            on_progress(start / len(cell_positions))
+            batches.append(self.encode_batch(image, cell_positions[start:start + BATCH_SIZE]))
+        return np.concatenate(batches)
 
-        TrainedAutoencoder.progress = 0.0
-        return feature_vectors
+    def encode_cells_of_session(self, img_path, session, on_progress=lambda progress: None):
+        """ Like get_feature_vectors() for cell positions that are still streamed (see cell_batches.py). """
+        image = self.open_image(img_path)
+        for start in range(0, session.cell_count, BATCH_SIZE):
+            progress = start / session.cell_count
+            on_progress(progress)
+            end = min(start + BATCH_SIZE, session.cell_count)
+            positions = session.wait_for(end, on_progress, progress)[start:end]
+            session.add_features(start, self.encode_batch(image, positions))
 
     def destroy(self):
         self.learn.destroy()
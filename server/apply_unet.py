@@ -10,12 +10,13 @@ import io
 from copy import deepcopy
 import time
 
+from image_codecs import read_image
+
 print("Fast.ai:", fastai.version.__version__)
 print("OpenCV:", cv2.__version__)
 
 
 class NeuralNetwork(object):
-    progress = 0.0
 
     def __init__(self, model_path: str) -> object:
         """
@@ -23,59 +24,78 @@ class NeuralNetwork(object):
         """
         self.learn = load_learner(model_path)
 
-    def get_output_and_centers(self, img_path, left, top, right, bottom):
-        img = open_image(img_path)
+    def get_output_and_centers(self, img_path, left, top, right, bottom, on_progress=lambda progress: None):
+        img = Image(torch.from_numpy(read_image(img_path)))
         print("Input image:", img)
-        output_img_raw_data = img_to_buffer(self.predict_image(img, left, top, right, bottom))
+        result = deepcopy(img)
+        self.predict(img.data, result.data, left, top, right, bottom, on_progress)
+        output_img_raw_data = img_to_buffer(result)
+        centers = get_cell_centers(output_img_raw_data)
+        return output_img_raw_data, centers
+
+    def get_output_and_centers_of_tiles(self, session, left, top, right, bottom, on_progress=lambda progress: None):
+        """ Like get_output_and_centers() for an image that is still uploaded tile by tile (see tile_inference.py). """
+        data = torch.from_numpy(session.data)
+        result = torch.zeros_like(data)
+        self.predict(data, result, left, top, right, bottom, on_progress, wait_for=session.wait_for,
+                     on_rows_final=lambda rows: session.add_output(result.numpy(), rows))
+        output_img_raw_data = img_to_buffer(Image(result))
         centers = get_cell_centers(output_img_raw_data)
-        NeuralNetwork.progress = 0.0
         return output_img_raw_data, centers
 
-    def predict_image(self, img, left, top, right, bottom):
+    def predict(self, data, result, left, top, right, bottom, on_progress, wait_for=None, on_rows_final=None):
+        """
+        Writes the prediction of data (channel, y, x) to result, patch by patch.
+        :param wait_for: called with the area of each patch before it is read
+        :param on_rows_final: called with the number of rows from the top that won't change anymore
+        """
         area_given = any((left, top, right, bottom))
-        result = deepcopy(img)
         patch_size = 256
         overlap = 0.25
         stride = int(patch_size * (1 - overlap))
-        x_patches = math.ceil(img.shape[1] / stride)
-        y_patches = math.ceil(img.shape[2] / stride)
+        x_patches = math.ceil(data.shape[1] / stride)
+        y_patches = math.ceil(data.shape[2] / stride)
         start = time.time()
         print(f"Predicting full image by splitting it up into {x_patches * y_patches} patches...")
         for px in range(x_patches):
-            NeuralNetwork.progress = px / x_patches
-            print(f"Progress: {int(NeuralNetwork.progress * 100)}%")
+            on_progress(px / x_patches)
+            print(f"Progress: {int(px / x_patches * 100)}%")
             for py in range(y_patches):
                 x = px * stride
                 y = py * stride
-                ex = min(x + patch_size, img.shape[1])
-                ey = min(y + patch_size, img.shape[2])
+                ex = min(x + patch_size, data.shape[1])
+                ey = min(y + patch_size, data.shape[2])
                 # Note: x and y are swapped here:
                 if area_given and (ey < left or ex < top or y > right or x > bottom):
                     # outside of relevant area
-                    result.data[:, x:ex, y:ey] = 0.0
+                    result[:, x:ex, y:ey] = 0.0
                     continue
 
-                patch = img.data[:, x:ex, y:ey]
+                if wait_for:
+                    wait_for(x, ex, y, ey, on_progress, px / x_patches)
+                patch = data[:, x:ex, y:ey]
                 if patch.shape != (3, patch_size, patch_size):
                     patch = torch.zeros(3, patch_size, patch_size)
-                    patch[:, :ex-x, :ey-y] = img.data[:, x:ex, y:ey]
+                    patch[:, :ex-x, :ey-y] = data[:, x:ex, y:ey]
 
                 try:
                     p, prediction, b = self.learn.predict(patch)
-                    if x < stride or ex == img.shape[1] or y < stride or ey == img.shape[2]:
+                    if x < stride or ex == data.shape[1] or y < stride or ey == data.shape[2]:
                         # this is at the border, use full prediction:
                         # FIXME: there will be a border patch_size px from the left and bottom
-                        result.data[:, x:ex, y:ey] = prediction[:, :ex-x, :ey-y]
+                        result[:, x:ex, y:ey] = prediction[:, :ex-x, :ey-y]
                     else:
                         # use only middle part to avoid border artifacts:
                         b = int((patch_size - stride) / 2)
                         e = int(patch_size - b)
-                        result.data[:, x + b:x + e, y + b:y + e] = prediction[:, b:e, b:e]
+                        result[:, x + b:x + e, y + b:y + e] = prediction[:, b:e, b:e]
                 except RuntimeError:
                     print("An error occurred during prediction of patch at", x, y, ex, ey)
-                    result.data[:, x:ex, y:ey] = 0.0
+                    result[:, x:ex, y:ey] = 0.0
+            if on_rows_final:
+                # the patches of the next row start writing at its top:
+                on_rows_final(min((px + 1) * stride, data.shape[1]))
         print("Prediction Time: ", time.time() - start)
-        return result
 
     def destroy(self):
         self.learn.destroy()
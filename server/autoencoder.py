@@ -1,6 +1,9 @@
-from fastai.vision import ImageImageList, open_image, Image
+from fastai.vision import ImageImageList, Image
 from fastai.layers import PixelShuffle_ICNR, conv_layer, Flatten, ResizeBatch
 from torch import nn
+import torch
+
+from image_codecs import read_image
 
 
 class Autoencoder(nn.Module):
@@ -45,7 +48,7 @@ class CellAutoencoderItemList(ImageImageList):
     def open(self, item):
         filename, pos = item
         if self.current_image_filename != filename:
-            self.current_image = open_image(filename)
+            self.current_image = Image(torch.from_numpy(read_image(filename)))
             self.current_image_filename = filename
         # pos is (x, y) center position of a cell on the provided image,
         # we will take a 32x32px patch from this location:
@@ -0,0 +1,116 @@
+from flask import Blueprint, abort
+import cbor2
+import numpy as np
+
+import threading
+import time
+
+from inference_queue import inference_queue
+from job_events import job_events
+from typed_arrays import encode_matrix, decode_matrix, request_data, compressed_response
+
+# Streamed autoencoder inference:
+# The client submits a job of type 'autoencoder_batches' (see main.py) with the number of cells and
+# sends their positions in chunks while the job runs. The server encodes the cells in batches as soon
+# as enough positions arrived, the feature vectors can be fetched before the job is finished:
+#   POST /jobs/<id>/cells/<offset>     CBOR {cellPositions}, a typed matrix with one row (x, y) per cell,
+#                                      starting at cell offset, the chunks have to be sent in order
+#   GET  /jobs/<id>/features/<start>   typed matrix of the feature vectors from cell start up to the
+#                                      'outputCells' field of the job events (409 if there are none yet)
+
+cell_batches = Blueprint('cell_batches', __name__)
+
+# seconds without new positions until the job fails, short because it blocks the single worker
+# if the client went away (cancelled jobs stop within a second, see wait_for):
+CHUNK_TIMEOUT = 20
+
+
+class CellBatchSession(object):
+
+    def __init__(self, job_id, cell_count):
+        self.job_id = job_id
+        self.cell_count = cell_count
+        self.positions = np.zeros((cell_count, 2), dtype=np.float32)
+        self.received = 0
+        self.last_chunk_time = time.time()
+        self.features = None
+        self.output_cells = 0
+        self.condition = threading.Condition()
+
+    def add_positions(self, offset, positions):
+        with self.condition:
+            if offset + len(positions) <= self.received:
+                return  # repeated chunk
+            if offset != self.received or offset + len(positions) > self.cell_count:
+                raise ValueError(f"Unexpected chunk at {offset} with {len(positions)} cells.")
+            self.positions[offset:offset + len(positions)] = positions
+            self.received += len(positions)
+            self.last_chunk_time = time.time()
+            self.condition.notify_all()
+
+    def wait_for(self, count, on_progress, progress):
+        """ Blocks until the positions of the first count cells arrived, on_progress raises if the job is cancelled. """
+        started = time.time()  # the job may have been queued for longer than the timeout
+        with self.condition:
+            while self.received < count:
+                if time.time() - max(self.last_chunk_time, started) > CHUNK_TIMEOUT:
+                    raise TimeoutError("No cell positions received for too long.")
+                self.condition.wait(1.0)
+                on_progress(progress)
+        return self.positions[:count]
+
+    def add_features(self, start, features):
+        if self.features is None:
+            self.features = np.empty((self.cell_count, features.shape[1]), dtype=np.float32)
+        self.features[start:start + len(features)] = features
+        self.output_cells = start + len(features)
+        job_events.update(self.job_id, outputCells=self.output_cells)
+
+
+_sessions = {}
+_sessions_lock = threading.Lock()
+
+
+def create_session(job_id, cell_count):
+    """ The session is only used by requests after add_session() was called. """
+    return CellBatchSession(job_id, cell_count)
+
+
+def add_session(session):
+    with _sessions_lock:
+        # sessions are kept as long as the job, so that the feature vectors can be fetched:
+        for stale_id in [i for i in _sessions if not inference_queue.get(i)]:
+            del _sessions[stale_id]
+        _sessions[session.job_id] = session
+
+
+def get_session(job_id):
+    with _sessions_lock:
+        session = _sessions.get(job_id)
+    if not session:
+        abort(404)
+    return session
+
+
+@cell_batches.route('/jobs/<job_id>/cells/<int:offset>', methods=['POST'])
+def upload_cells(job_id, offset):
+    session = get_session(job_id)
+    job = inference_queue.get(job_id)
+    if not job or job.finished.is_set():
+        abort(410)
+    try:
+        params = cbor2.loads(request_data())
+        session.add_positions(offset, decode_matrix(params['cellPositions'], columns=2))
+    except (ValueError, KeyError, cbor2.CBORDecodeError) as error:
+        print("Invalid cell positions:", error)
+        abort(422)
+    return '', 204
+
+
+@cell_batches.route('/jobs/<job_id>/features/<int:start>', methods=['GET'])
+def features(job_id, start):
+    session = get_session(job_id)
+    end = session.output_cells
+    if start >= end:
+        abort(409)
+    return compressed_response(cbor2.dumps(encode_matrix(session.features[start:end])))
@@ -0,0 +1,163 @@
+from flask import Blueprint
+from flask import request, abort, current_app
+import cbor2
+
+from hashlib import md5
+import os
+import os.path
+import re
+import threading
+
+# Content addressed storage of uploaded files (images, training data, inference results).
+#
+# Large files are uploaded in chunks:
+#   POST /data/uploads                  CBOR {hash, size}, returns CBOR {received}
+#   PUT  /data/uploads/<hash>?offset=N  one chunk, header X-Chunk-Hash is the md5 of the chunk,
+#                                       returns CBOR {received[, complete]}
+# The chunks are appended to a partial file, so that an interrupted upload can be resumed
+# from the number of received bytes. The complete file is checked against its hash before
+# it is moved to the upload folder. If all bytes were already received (an empty file, or the
+# server stopped before the file was moved), the client sends an empty chunk at offset == size.
+#
+# The existence of many files is checked at once with:
+#   POST /data/check                    CBOR {hashes}, returns CBOR {exists} with one bool per hash
+
+data_store = Blueprint('data_store', __name__)
+
+# chunks of the same upload must not be appended concurrently:
+_upload_locks = {}
+_upload_locks_guard = threading.Lock()
+
+
+def _upload_lock(file_hash):
+    with _upload_locks_guard:
+        return _upload_locks.setdefault(file_hash, threading.Lock())
+
+
+def _checked_hash(file_hash):
+    if not re.fullmatch(r'[0-9a-f]{32}', file_hash):
+        abort(400)
+    return file_hash
+
+
+def upload_path(file_hash):
+    return os.path.join(current_app.config['UPLOAD_FOLDER'], file_hash)
+
+
+def _partial_path(file_hash):
+    folder = os.path.join(current_app.config['UPLOAD_FOLDER'], 'partial')
+    if not os.path.exists(folder):
+        os.makedirs(folder, exist_ok=True)
+    return os.path.join(folder, file_hash)
+
+
+def _file_md5(path):
+    result = md5()
+    with open(path, 'rb') as file:
+        for block in iter(lambda: file.read(1 << 20), b''):
+            result.update(block)
+    return result.hexdigest()
+
+
+def store_in_uploads(raw_data):
+    hash = md5(raw_data).hexdigest()
+    path = upload_path(hash)
+    with open(path, 'wb') as file:
+        file.write(raw_data)
+    return hash
+
+
+def get_upload_path(file_hash):
+    data_path = upload_path(_checked_hash(file_hash))
+    if not os.path.isfile(data_path):
+        abort(404)
+    return data_path
+
+
+def get_upload(file_hash):
+    data_path = get_upload_path(file_hash)
+    with open(data_path, 'rb') as file:
+        content = file.read()
+    return content
+
+
+@data_store.route('/data', methods=['POST'])
+def upload():
+    raw_data = request.get_data()
+    hash = store_in_uploads(raw_data)
+    return hash, 200
+
+
+@data_store.route('/data/uploads', methods=['POST'])
+def start_chunked_upload():
+    params = cbor2.loads(request.get_data())
+    file_hash = _checked_hash(params['hash'])
+    if os.path.isfile(upload_path(file_hash)):
+        return cbor2.dumps({'received': params['size'], 'complete': True}), 200
+
+    path = _partial_path(file_hash)
+    received = os.path.getsize(path) if os.path.isfile(path) else 0
+    if received > params['size']:
+        os.remove(path)
+        received = 0
+    return cbor2.dumps({'received': received}), 200
+
+
+@data_store.route('/data/uploads/<hash>', methods=['PUT'])
+def upload_chunk(hash):
+    file_hash = _checked_hash(hash)
+    offset = request.args.get('offset', type=int)
+    size = request.args.get('size', type=int)
+    chunk = request.get_data()
+    if offset is None or size is None:
+        abort(400)
+
+    with _upload_lock(file_hash):
+        path = _partial_path(file_hash)
+        received = os.path.getsize(path) if os.path.isfile(path) else 0
+        if offset != received:
+            # i.e. the acknowledgement of the previous chunk got lost, the client resumes from here:
+            return cbor2.dumps({'received': received}), 409
+        if md5(chunk).hexdigest() != request.headers.get('X-Chunk-Hash', ''):
+            return cbor2.dumps({'received': received}), 422
+
+        with open(path, 'ab') as file:
+            file.write(chunk)
+        received += len(chunk)
+        if received < size:
+            return cbor2.dumps({'received': received}), 200
+
+        if _file_md5(path) != file_hash:
+            print("Upload corrupted, restarting it:", file_hash)
+            os.remove(path)
+            return cbor2.dumps({'received': 0}), 422
+        os.replace(path, upload_path(file_hash))
+        return cbor2.dumps({'received': received, 'complete': True}), 200
+
+
+@data_store.route('/data/check', methods=['POST'])
+def check_many():
+    hashes = cbor2.loads(request.get_data())['hashes']
+    return cbor2.dumps({'exists': [os.path.isfile(upload_path(_checked_hash(file_hash))) for file_hash in hashes]}), 200
+
+
+@data_store.route('/data/check/<hash>', methods=['GET'])
+def check(hash):
+    path = upload_path(_checked_hash(hash))
+    return ("1" if os.path.isfile(path) else "0"), 200
+
+
+@data_store.route('/data/<hash>', methods=['GET'])
+def download(hash):
+    content = get_upload(hash)
+    return content, 200
+
+
+@data_store.route('/data/<hash>', methods=['DELETE'])
+def delete_data(hash):
+    path = upload_path(_checked_hash(hash))
+    if not os.path.isfile(path):
+        abort(404)
+
+    os.remove(path)
+    return '', 204
@@ -0,0 +1,54 @@
+from fastai.vision import *
+
+import os
+import threading
+
+from apply_unet import NeuralNetwork
+
+# U-Net models as ONNX file, for the inference on the client without the server
+# (see src/microscopy/manager/LocalUnet.cpp):
+#   input  'input'  float32 (batch, 3, 256, 256), RGB from 0.0 to 1.0
+#   output 'output' float32 (batch, 3, 256, 256), the same as the output image of apply_unet.py
+# The normalization of the input (if any) and the clamping of the output are part of the model.
+
+ONNX_FILENAME = 'model.onnx'
+PATCH_SIZE = 256
+
+_export_lock = threading.Lock()
+
+
+class ExportedUnet(torch.nn.Module):
+
+    def __init__(self, learn):
+        super().__init__()
+        self.model = learn.model
+        self.mean = None
+        norm = getattr(learn.data, 'norm', None)
+        if norm is not None and norm.keywords.get('do_x', True):
+            self.mean = torch.as_tensor(norm.keywords['mean']).cpu().view(1, 3, 1, 1)
+            self.std = torch.as_tensor(norm.keywords['std']).cpu().view(1, 3, 1, 1)
+
+    def forward(self, x):
+        if self.mean is not None:
+            x = (x - self.mean) / self.std
+        # like Image.reconstruct() of fast.ai:
+        return self.model(x).clamp(0.0, 1.0)
+
+
+def export_unet(model_path):
+    """ Returns the path of the ONNX file of the model in model_path (the folder of 'export.pkl'), exports it if necessary. """
+    onnx_path = os.path.join(model_path, ONNX_FILENAME)
+    with _export_lock:
+        if os.path.isfile(onnx_path):
+            return onnx_path
+        model = NeuralNetwork(model_path)
+        exported = ExportedUnet(model.learn).cpu().eval()
+        dummy_input = torch.zeros(1, 3, PATCH_SIZE, PATCH_SIZE)
+        with torch.no_grad():
+            torch.onnx.export(exported, dummy_input, onnx_path + '.partial', opset_version=11,
+                              input_names=['input'], output_names=['output'],
+                              dynamic_axes={'input': {0: 'batch'}, 'output': {0: 'batch'}})
+        os.replace(onnx_path + '.partial', onnx_path)
+        model.destroy()
+        print("Exported model as ONNX file:", onnx_path)
+    return onnx_path
@@ -1,14 +1,20 @@
 from fastai.vision import Callback
 
+from job_events import ProgressThrottle
+
 
 class ProgressUpdateCallback(Callback):
+    """ Reports the training progress and the losses of one job as events. """
 
-    def __init__(self):
-        self.progress = 0.0
+    def __init__(self, job_id):
+        self.report = ProgressThrottle(job_id)
         self.dataset_size = 1
 
     def on_batch_end(self, n_epochs, epoch, num_batch, **kwargs):
-        self.progress = (epoch * self.dataset_size + num_batch) / (n_epochs * self.dataset_size)
-
+        self.report((epoch * self.dataset_size + num_batch) / (n_epochs * self.dataset_size))
 
-training_tracker = ProgressUpdateCallback()
+    def on_epoch_end(self, n_epochs, epoch, smooth_loss, last_metrics, **kwargs):
+        fields = {'epoch': epoch + 1, 'epochs': n_epochs, 'loss': float(smooth_loss)}
+        if last_metrics and last_metrics[0] is not None:
+            fields['validLoss'] = float(last_metrics[0])
+        self.report((epoch + 1) / n_epochs, **fields)
@@ -0,0 +1,52 @@
+import PIL.Image
+import numpy as np
+
+import io
+import struct
+import zlib
+
+# Images uploaded by the client are PNG, QOI or "raw deflate" (see src/microscopy/manager/ImageEncoder.cpp),
+# the original image files can also be in any other format Pillow reads. Raw deflate is:
+#   'RIMG', width, height, rows per stripe, number of stripes (uint32 little endian),
+#   the compressed size of each stripe (uint32 little endian), the zlib streams of the stripes
+# Each stripe contains the RGB values (uint8) of its rows. QOI needs Pillow >= 9.5.
+
+RAW_DEFLATE_MAGIC = b'RIMG'
+PNG_SIGNATURE = b'\x89PNG\r\n\x1a\n'
+
+
+def decode_raw_deflate(data):
+    width, height, stripe_rows, stripe_count = struct.unpack_from('<4I', data, 4)
+    sizes = struct.unpack_from(f'<{stripe_count}I', data, 20)
+    image = np.empty((height, width, 3), dtype=np.uint8)
+    offset = 20 + 4 * stripe_count
+    for i, size in enumerate(sizes):
+        top = i * stripe_rows
+        bottom = min(top + stripe_rows, height)
+        stripe = np.frombuffer(zlib.decompress(data[offset:offset + size]), dtype=np.uint8)
+        image[top:bottom] = stripe.reshape((bottom - top, width, 3))
+        offset += size
+    return image
+
+
+def decode_image(data):
+    """ Returns the image as uint8 array with the shape (height, width, 3). """
+    if data[:4] == RAW_DEFLATE_MAGIC:
+        return decode_raw_deflate(data)
+    return np.asarray(PIL.Image.open(io.BytesIO(data)).convert('RGB'))
+
+
+def read_image(path):
+    """ Returns the image file as float32 array in the layout of a fast.ai image: (channel, y, x), 0.0 to 1.0 """
+    with open(path, 'rb') as file:
+        image = decode_image(file.read())
+    return image.transpose(2, 0, 1).astype(np.float32) / 255.0
+
+
+def write_png(path, data):
+    """ Stores an encoded image as PNG file, i.e. to be read by fast.ai later. """
+    if data[:8] == PNG_SIGNATURE:
+        with open(path, 'wb') as file:
+            file.write(data)
+        return
+    PIL.Image.fromarray(decode_image(data)).save(path, compress_level=1)
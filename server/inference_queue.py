@@ -0,0 +1,190 @@
+from flask import Blueprint, abort
+import cbor2
+
+from collections import OrderedDict
+import queue
+import threading
+import time
+import traceback
+
+from job_events import job_events, ProgressThrottle
+from typed_arrays import compressed_response
+
+# Asynchronous inference jobs:
+#   POST   /jobs                submits a job (see main.py), returns 202 or 503 if the queue is full
+#   GET    /jobs/<id>           CBOR {state[, error]}, state is queued, running, done, failed or cancelled
+#   GET    /jobs/<id>/result    the CBOR result of a finished job, 409 if it is not finished yet
+#   DELETE /jobs/<id>           cancels a queued or running job
+# Progress and state changes are also pushed through the /events channel.
+# The jobs are processed one after another by a single worker that keeps the
+# recently used models loaded.
+
+jobs = Blueprint('jobs', __name__)
+
+MAX_QUEUED_JOBS = 16
+MAX_RESIDENT_MODELS = 2
+RESULT_TTL = 600  # seconds a result is kept after the job finished
+
+
+class JobCancelled(Exception):
+    pass
+
+
+class InferenceJob(object):
+
+    def __init__(self, job_id, kind, run):
+        self.id = job_id
+        self.kind = kind
+        self.run = run  # run(models, on_progress) returns the CBOR encoded result
+        self.state = 'queued'
+        self.cancelled = False
+        self.result = None
+        self.error = None
+        self.finished_at = None
+        self.finished = threading.Event()
+
+
+class ModelCache(object):
+    """ Keeps the most recently used models loaded instead of loading them for every request. """
+
+    def __init__(self, max_models):
+        self.max_models = max_models
+        self._models = OrderedDict()
+
+    def get(self, model_class, model_path):
+        key = (model_class, model_path)
+        if key in self._models:
+            self._models.move_to_end(key)
+            return self._models[key]
+        while len(self._models) >= self.max_models:
+            _, unused_model = self._models.popitem(last=False)
+            unused_model.destroy()
+        model = model_class(model_path)
+        self._models[key] = model
+        return model
+
+
+class InferenceQueue(object):
+
+    def __init__(self, max_queued_jobs=MAX_QUEUED_JOBS, max_resident_models=MAX_RESIDENT_MODELS):
+        self.models = ModelCache(max_resident_models)
+        self.max_queued_jobs = max_queued_jobs
+        # cancelled jobs stay in the queue until the worker skips them, they are not counted:
+        self._queue = queue.Queue()
+        self._queued_count = 0
+        self._jobs = {}
+        self._lock = threading.Lock()
+        self._app = None
+
+    def start(self, app):
+        """ Starts the worker, the jobs run in the application context of app. """
+        self._app = app
+        threading.Thread(target=self._work, daemon=True).start()
+
+    def submit(self, job_id, kind, run):
+        """ Returns the new job or None if the queue is full. """
+        self._remove_expired_jobs()
+        with self._lock:
+            if job_id in self._jobs:
+                raise ValueError(f"Job {job_id} already exists.")
+            if self._queued_count >= self.max_queued_jobs:
+                return None
+            job = InferenceJob(job_id, kind, run)
+            self._jobs[job_id] = job
+            job_events.update(job_id, kind=kind, state='queued', progress=0.0)
+            self._queued_count += 1
+            self._queue.put_nowait(job)
+        return job
+
+    def get(self, job_id):
+        with self._lock:
+            return self._jobs.get(job_id)
+
+    def cancel(self, job_id):
+        with self._lock:
+            job = self._jobs.get(job_id)
+            if not job or job.finished.is_set():
+                return job
+            job.cancelled = True
+            if job.state == 'queued':
+                # the worker skips it:
+                self._queued_count -= 1
+                self._finish(job, 'cancelled')
+        return job
+
+    def _finish(self, job, state):
+        job.state = state
+        job.finished_at = time.time()
+        job_events.finish(job.id, state=state)
+        job.finished.set()
+
+    def _remove_expired_jobs(self):
+        now = time.time()
+        with self._lock:
+            expired = [job_id for job_id, job in self._jobs.items()
+                       if job.finished_at and now - job.finished_at > RESULT_TTL]
+            for job_id in expired:
+                del self._jobs[job_id]
+
+    def _work(self):
+        while True:
+            job = self._queue.get()
+            with self._lock:
+                if job.cancelled:
+                    continue
+                self._queued_count -= 1
+                job.state = 'running'
+            job_events.update(job.id, state='running')
+            report = ProgressThrottle(job.id)
+
+            def on_progress(progress):
+                if job.cancelled:
+                    raise JobCancelled()
+                report(progress)
+
+            try:
+                with self._app.app_context():
+                    job.result = job.run(self.models, on_progress)
+                state = 'done'
+            except JobCancelled:
+                print("Job cancelled:", job.id)
+                state = 'cancelled'
+            except Exception as error:
+                traceback.print_exc()
+                job.error = str(error)
+                state = 'failed'
+            with self._lock:
+                self._finish(job, state)
+
+
+inference_queue = InferenceQueue()
+
+
+@jobs.route('/jobs/<job_id>', methods=['GET'])
+def job_state(job_id):
+    job = inference_queue.get(job_id)
+    if not job:
+        abort(404)
+    state = {'state': job.state}
+    if job.error:
+        state['error'] = job.error
+    return cbor2.dumps(state), 200
+
+
+@jobs.route('/jobs/<job_id>/result', methods=['GET'])
+def job_result(job_id):
+    job = inference_queue.get(job_id)
+    if not job:
+        abort(404)
+    if job.state == 'done':
+        return compressed_response(job.result)
+    if job.finished.is_set():
+        return cbor2.dumps({'state': job.state}), 410
+    return cbor2.dumps({'state': job.state}), 409
+
+
+@jobs.route('/jobs/<job_id>', methods=['DELETE'])
+def cancel_job(job_id):
+    if not inference_queue.cancel(job_id):
+        abort(404)
+    return '', 204
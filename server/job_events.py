@@ -0,0 +1,119 @@
+from flask import Blueprint, Response
+
+import json
+import queue
+import threading
+
+# State of the running jobs (trainings and inferences) and a Server-Sent-Events channel
+# that pushes every change to the connected clients:
+#   GET /events
+# Each event is a JSON object like {"id": ..., "kind": "unet_training", "state": "running",
+# "progress": 0.42, "loss": 0.013}. New subscribers first get the state of all active jobs.
+
+events = Blueprint('events', __name__)
+
+KEEPALIVE_INTERVAL = 15  # seconds
+
+
+class Subscriber(queue.Queue):
+
+    def __init__(self):
+        super().__init__(maxsize=1000)
+        self.closed = False
+
+
+class JobEvents(object):
+
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._jobs = {}
+        self._subscribers = []
+
+    def update(self, job_id, **fields):
+        with self._lock:
+            job = self._jobs.setdefault(job_id, {'id': job_id, 'state': 'running', 'progress': 0.0})
+            changed = {key: value for key, value in fields.items() if job.get(key) != value}
+            if not changed:
+                return
+            job.update(changed)
+            self._publish(dict(job))
+
+    def finish(self, job_id, state='done', **fields):
+        self.update(job_id, state=state, **fields)
+        with self._lock:
+            self._jobs.pop(job_id, None)
+
+    def max_progress(self, kinds):
+        with self._lock:
+            running = [job['progress'] for job in self._jobs.values() if job.get('kind') in kinds]
+        return max(running, default=0.0)
+
+    def subscribe(self):
+        subscriber = Subscriber()
+        with self._lock:
+            for job in self._jobs.values():
+                subscriber.put_nowait(dict(job))
+            self._subscribers.append(subscriber)
+        return subscriber
+
+    def unsubscribe(self, subscriber):
+        with self._lock:
+            if subscriber in self._subscribers:
+                self._subscribers.remove(subscriber)
+
+    def _publish(self, event):
+        for subscriber in list(self._subscribers):
+            try:
+                subscriber.put_nowait(event)
+            except queue.Full:
+                # client doesn't read fast enough, it reconnects and gets the current state:
+                subscriber.closed = True
+                self._subscribers.remove(subscriber)
+
+
+job_events = JobEvents()
+
+
+def run_job(job_id, kind, target, *args):
+    """ Runs target(*args) and reports the start and the end of it as events. """
+    job_events.update(job_id, kind=kind, state='running', progress=0.0)
+    try:
+        result = target(*args)
+    except Exception:
+        job_events.finish(job_id, state='failed')
+        raise
+    job_events.finish(job_id, state='done', progress=1.0)
+    return result
+
+
+class ProgressThrottle(object):
+    """ Reports the progress of a job only if it changed by at least one percent. """
+
+    def __init__(self, job_id):
+        self.job_id = job_id
+        self.last_progress = -1.0
+
+    def __call__(self, progress, **fields):
+        if fields or progress - self.last_progress >= 0.01 or progress == 0.0:
+            self.last_progress = progress
+            job_events.update(self.job_id, progress=progress, **fields)
+
+
+@events.route('/events', methods=['GET'])
+def event_stream():
+    subscriber = job_events.subscribe()
+
+    def generate():
+        try:
+            while not subscriber.closed:
+                try:
+                    event = subscriber.get(timeout=KEEPALIVE_INTERVAL)
+                except queue.Empty:
+                    yield ': keepalive\n\n'
+                    continue
+                yield f'event: job\ndata: {json.dumps(event)}\n\n'
+        finally:
+            job_events.unsubscribe(subscriber)
+
+    return Response(generate(), mimetype='text/event-stream',
+                    headers={'Cache-Control': 'no-cache', 'X-Accel-Buffering': 'no'})
@@ -0,0 +1,86 @@
+# Stand-in for the backend server that only provides the data endpoints.
+# It doesn't need the neural network dependencies and can be used to test
+# uploads and downloads locally:
+#   python3 local_server.py --port 55712 --drop-chunks 0.2
+# With --drop-chunks a part of the chunk requests fails randomly, before
+# or after the chunk was stored, to check that uploads are resumed correctly.
+# POST /debug/job/<kind> queues a job that only reports progress for five seconds and returns
+# an empty result, it can be followed and cancelled through /jobs/<id>.
+
+from flask import Flask, request, abort
+
+import argparse
+import os
+import random
+import cbor2
+import time
+import uuid
+
+from data_store import data_store
+from job_events import events, job_events
+from inference_queue import jobs, inference_queue
+
+app = Flask(__name__)
+app.register_blueprint(data_store)
+app.register_blueprint(events)
+app.register_blueprint(jobs)
+inference_queue.start(app)
+
+drop_probability = 0.0
+
+
+@app.before_request
+def drop_chunk_before_storing():
+    if request.endpoint == 'data_store.upload_chunk' and random.random() < drop_probability / 2:
+        abort(503)
+
+
+@app.after_request
+def drop_chunk_after_storing(response):
+    if request.endpoint == 'data_store.upload_chunk' and random.random() < drop_probability / 2:
+        return app.response_class('', status=503)
+    return response
+
+
+@app.route('/version', methods=['GET'])
+def version():
+    return "1.1", 200
+
+
+@app.route('/training_progress', methods=['GET'])
+def training_progress():
+    return str(job_events.max_progress(['unet_training', 'autoencoder_training'])), 200
+
+
+@app.route('/inference_progress', methods=['GET'])
+def inference_progress():
+    return str(job_events.max_progress(['unet_inference', 'autoencoder_inference'])), 200
+
+
+@app.route('/debug/job/<kind>', methods=['POST'])
+def fake_job(kind):
+    job_id = request.args.get('job') or uuid.uuid4().hex
+
+    def run(models, on_progress):
+        for step in range(100):
+            time.sleep(0.05)
+            on_progress(step / 100)
+        return cbor2.dumps({})
+
+    if not inference_queue.submit(job_id, kind, run):
+        abort(503)
+    return job_id, 202
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--port', type=int, default=55712)
+    parser.add_argument('--uploads', default='uploads')
+    parser.add_argument('--drop-chunks', type=float, default=0.0)
+    args = parser.parse_args()
+
+    drop_probability = args.drop_chunks
+    app.config['UPLOAD_FOLDER'] = args.uploads
+    if not os.path.exists(args.uploads):
+        os.makedirs(args.uploads)
+    app.run(host='::', port=args.port, threaded=True)
@@ -11,15 +11,22 @@ import sys
 import threading
 import uuid
 
+from data_store import data_store, get_upload_path, store_in_uploads
+from job_events import events, job_events, run_job
+from inference_queue import jobs, inference_queue
+from tile_inference import tiles, create_session, add_session, TILE_SIZE
+from cell_batches import cell_batches, create_session as create_cell_session, add_session as add_cell_session
+from typed_arrays import encode_matrix, decode_matrix, request_data, compressed_response
 from apply_unet import NeuralNetwork
-from train_unet import unpack_data_and_train, training_tracker
+from train_unet import unpack_data_and_train
+from export_onnx import export_unet
 
 from apply_autoencoder import TrainedAutoencoder
 from train_autoencoder import prepare_and_train_autoencoder
 
 print("Python version:", sys.version)
 
-default_network = NeuralNetwork('models/7c0c7084ac8007ab0c24a3ee563e349c/input')
+DEFAULT_UNET_PATH = 'models/7c0c7084ac8007ab0c24a3ee563e349c/input'
 
 UPLOAD_FOLDER = 'uploads'
 if not os.path.exists(UPLOAD_FOLDER):
@@ -28,11 +35,20 @@ if not os.path.exists(UPLOAD_FOLDER):
 app = Flask(__name__)
 CORS(app)
 app.config['UPLOAD_FOLDER'] = UPLOAD_FOLDER
+app.register_blueprint(data_store)
+app.register_blueprint(events)
+app.register_blueprint(jobs)
+app.register_blueprint(tiles)
+app.register_blueprint(cell_batches)
+
+# load the default model before the first request:
+inference_queue.models.get(NeuralNetwork, DEFAULT_UNET_PATH)
+inference_queue.start(app)
 
 
 def log_request(self, *args, **kwargs):
     # don't log progress requests:
-    filters = ['training_progress', 'inference_progress']
+    filters = ['training_progress', 'inference_progress', '/events']
     if any(filter in self.requestline for filter in filters):
         return
     _log_request(self, *args, **kwargs)
@@ -48,7 +64,13 @@ def secure_filename(filename):
 
 @app.route('/version', methods=['GET'])
 def version():
-    return "1.0", 200
+    # 1.1: typed arrays and compressed request bodies (see typed_arrays.py)
+    # 1.2: tile-streamed inference (see tile_inference.py)
+    # 1.3: QOI and raw deflate compressed images (see image_codecs.py)
+    # 1.4: streamed autoencoder inference (see cell_batches.py)
+    # 1.5: U-Net models as ONNX file (see export_onnx.py)
+    # 1.6: training data files uploaded shard by shard (see training_data.py)
+    return "1.6", 200
 
 
 @app.route('/<path:path>', methods=['GET'])
@@ -61,52 +83,6 @@ def projects(path):
     return send_from_directory('projects', path), 200
 
 
-def store_in_uploads(raw_data):
-    hash = md5(raw_data).hexdigest()
-    path = os.path.join(app.config['UPLOAD_FOLDER'], hash)
-    with open(path, 'wb') as file:
-        file.write(raw_data)
-    return hash
-
-
-@app.route('/data', methods=['POST'])
-def upload():
-    raw_data = request.get_data()
-    hash = store_in_uploads(raw_data)
-    return hash, 200
-
-
-@app.route('/data/check/<hash>', methods=['GET'])
-def check(hash):
-    path = os.path.join(app.config['UPLOAD_FOLDER'], hash)
-    return ("1" if os.path.isfile(path) else "0"), 200
-
-
-def get_upload(file_hash):
-    data_path = os.path.join(app.config['UPLOAD_FOLDER'], file_hash)
-    if not os.path.isfile(data_path):
-        abort(404)
-    with open(data_path, 'rb') as file:
-        content = file.read()
-    return content
-
-
-@app.route('/data/<hash>', methods=['GET'])
-def download(hash):
-    content = get_upload(hash)
-    return content, 200
-
-
-@app.route('/data/<hash>', methods=['DELETE'])
-def delete_data(hash):
-    path = os.path.join(app.config['UPLOAD_FOLDER'], hash)
-    if not os.path.isfile(path):
-        abort(404)
-
-    os.remove(path)
-    return '', 204
-
-
 # @app.route('/model', methods=['GET'])
 # def all_models(model_id):
 #    # get list of models
@@ -120,16 +96,22 @@ def train_unet():
     print(params)
 
     base_model = params['baseModel']
+    # clients since version 1.6 send a list of shards (or old CBOR files), older ones a single file:
+    train_hashes = params.get('trainDataHashes') or [params['trainDataHash']]
+    valid_hashes = params.get('validDataHashes') or [params['validDataHash']]
+    train_id = train_hashes[0] if len(train_hashes) == 1 else md5(''.join(train_hashes).encode()).hexdigest()
     if base_model:
-        model_id = f"{base_model}-{params['trainDataHash']}"
+        model_id = f"{base_model}-{train_id}"
     else:
-        model_id = params['trainDataHash']
+        model_id = train_id
 
-    train_data = cbor2.loads(get_upload(params['trainDataHash']))
-    valid_data = cbor2.loads(get_upload(params['validDataHash']))
+    # the files are read record by record while they are unpacked:
+    train_paths = [get_upload_path(file_hash) for file_hash in train_hashes]
+    valid_paths = [get_upload_path(file_hash) for file_hash in valid_hashes]
 
-    thread = threading.Thread(target=unpack_data_and_train,
-                              args=(params, model_id, base_model, train_data, valid_data))
+    thread = threading.Thread(target=run_job,
+                              args=(model_id, 'unet_training', unpack_data_and_train,
+                                    params, model_id, base_model, train_paths, valid_paths))
     thread.start()
 
     return model_id, 200
@@ -138,8 +120,8 @@ def train_unet():
 @app.route('/model/autoencoder', methods=['POST'])
 def train_autoencoder():
     # unpack arguments:
-    raw_data = request.get_data()
-    params = cbor2.loads(raw_data)
+    params = cbor2.loads(request_data())
+    params['cellPositions'] = decode_matrix(params['cellPositions'], columns=2)
 
     # check parameters to be valid:
     img_path = os.path.join(app.config['UPLOAD_FOLDER'], params['imgHash'])
@@ -147,7 +129,7 @@ def train_autoencoder():
         print("Image not found:", params['imgHash'])
         abort(404)
 
-    if not params['cellPositions']:
+    if len(params['cellPositions']) == 0:
         print("No cells provided.")
         abort(400)
 
@@ -159,16 +141,18 @@ def train_autoencoder():
         model_id = uuid.uuid1().hex
 
     # start training:
-    thread = threading.Thread(target=prepare_and_train_autoencoder,
-                              args=(params, model_id, img_path))
+    thread = threading.Thread(target=run_job,
+                              args=(model_id, 'autoencoder_training', prepare_and_train_autoencoder,
+                                    params, model_id, img_path))
     thread.start()
 
     return model_id, 200
 
 
+# progress of all jobs of a kind, for clients without the /events channel:
 @app.route('/training_progress', methods=['GET'])
 def training_progress():
-    return str(training_tracker.progress), 200
+    return str(job_events.max_progress(['unet_training', 'autoencoder_training'])), 200
 
 
 # @app.route('/model/<model_id>', methods=['GET'])
@@ -177,59 +161,148 @@ def training_progress():
 #    return model_metadata
 
 
+def unet_model_path(model_id):
+    return DEFAULT_UNET_PATH if model_id == "default" else 'models/' + model_id + '/input'
+
+
+@app.route('/model/unet/<model_id>/onnx', methods=['GET'])
+def unet_onnx(model_id):
+    # for the inference on the client without the server
+    model_path = unet_model_path(secure_filename(model_id))
+    if not os.path.isfile(os.path.join(model_path, 'export.pkl')):
+        abort(404)
+    directory, filename = os.path.split(export_unet(model_path))
+    return send_from_directory(directory, filename, mimetype='application/octet-stream')
+
+
+def unet_job(model_id, img_path, left, top, right, bottom):
+    def run(models, on_progress):
+        model = models.get(NeuralNetwork, unet_model_path(model_id))
+        print(f"Doing inference with model '{model_id}' and file {img_path}...")
+        output_img_data, centers = model.get_output_and_centers(img_path, left, top, right, bottom, on_progress)
+        output_hash = store_in_uploads(output_img_data)
+        print(f"Inference complete, result stored as {output_hash}.")
+        return cbor2.dumps({'outputImageHash': output_hash, 'cellCenters': centers})
+    return run
+
+
+def unet_tiles_job(model_id, session, left, top, right, bottom):
+    def run(models, on_progress):
+        model = models.get(NeuralNetwork, unet_model_path(model_id))
+        print(f"Doing inference with model '{model_id}' on {len(session.expected)} streamed tiles...")
+        output_img_data, centers = model.get_output_and_centers_of_tiles(session, left, top, right, bottom, on_progress)
+        output_hash = store_in_uploads(output_img_data)
+        print(f"Inference complete, result stored as {output_hash}.")
+        return cbor2.dumps({'outputImageHash': output_hash, 'cellCenters': centers})
+    return run
+
+
+def autoencoder_job(model_id, img_path, cell_positions, typed_result=True):
+    def run(models, on_progress):
+        model = models.get(TrainedAutoencoder, 'models/' + model_id + '/input')
+        print(f"Apply autoencoder with model '{model_id}' on file {img_path} with {len(cell_positions)} cells...")
+        feature_vectors = model.get_feature_vectors(img_path, cell_positions, on_progress)
+        if not typed_result:
+            return cbor2.dumps(feature_vectors.tolist())
+        return cbor2.dumps(encode_matrix(feature_vectors))
+    return run
+
+
+def autoencoder_batches_job(model_id, img_path, session):
+    def run(models, on_progress):
+        model = models.get(TrainedAutoencoder, 'models/' + model_id + '/input')
+        print(f"Apply autoencoder with model '{model_id}' on file {img_path} with {session.cell_count} streamed cells...")
+        model.encode_cells_of_session(img_path, session, on_progress)
+        # the feature vectors were already fetched by the client:
+        return cbor2.dumps({'cellCount': session.cell_count})
+    return run
+
+
+@app.route('/jobs', methods=['POST'])
+def submit_job():
+    params = cbor2.loads(request_data())
+    job_id = params.get('jobId') or uuid.uuid4().hex
+    model_id = secure_filename(params['modelId'])
+    if inference_queue.get(job_id):
+        abort(409)
+    if params['type'] not in ('unet_tiles', 'unet', 'autoencoder', 'autoencoder_batches'):
+        abort(400)
+
+    # the session of a streamed job is only registered if the job was accepted:
+    add = None
+    if params['type'] == 'unet_tiles':
+        # the image is uploaded while the job runs:
+        left, top, right, bottom = map(int, params.get('area', (0, 0, 0, 0)))
+        if params['tileSize'] != TILE_SIZE:
+            abort(400)
+        session = create_session(job_id, int(params['width']), int(params['height']), params['tiles'])
+        add = add_session
+        kind, run = 'unet_inference', unet_tiles_job(model_id, session, left, top, right, bottom)
+    else:
+        img_path = os.path.join(app.config['UPLOAD_FOLDER'], secure_filename(params['imageHash']))
+        if not os.path.isfile(img_path):
+            print("Image not found:", params['imageHash'])
+            return cbor2.dumps({'error': 'image not found'}), 422
+
+        if params['type'] == 'unet':
+            left, top, right, bottom = map(int, params.get('area', (0, 0, 0, 0)))
+            kind, run = 'unet_inference', unet_job(model_id, img_path, left, top, right, bottom)
+        elif params['type'] == 'autoencoder':
+            cell_positions = decode_matrix(params['cellPositions'], columns=2)
+            kind, run = 'autoencoder_inference', autoencoder_job(model_id, img_path, cell_positions)
+        else:
+            # the cell positions are sent while the job runs:
+            session = create_cell_session(job_id, int(params['cellCount']))
+            add = add_cell_session
+            kind, run = 'autoencoder_inference', autoencoder_batches_job(model_id, img_path, session)
+
+    try:
+        job = inference_queue.submit(job_id, kind, run)
+    except ValueError:
+        abort(409)
+    if not job:
+        return cbor2.dumps({'error': 'too many jobs'}), 503
+    if add:
+        add(session)
+    return cbor2.dumps({'jobId': job_id, 'state': job.state}), 202
+
+
+def run_and_wait(kind, run):
+    """ For the synchronous endpoints of older clients. """
+    job_id = request.args.get('job') or uuid.uuid4().hex
+    job = inference_queue.submit(job_id, kind, run)
+    if not job:
+        abort(503)
+    job.finished.wait()
+    if job.state != 'done':
+        abort(500)
+    return compressed_response(job.result)
+
+
 @app.route('/model/<model_id>/prediction/<img_hash>/<left>/<top>/<right>/<bottom>', methods=['GET'])
 def predict(model_id, img_hash, left, top, right, bottom):
     left, top, right, bottom = map(int, (left, top, right, bottom))
-    model = default_network
-    if model_id != "default":
-        model = NeuralNetwork('models/' + model_id + '/input')
-
-    path = os.path.join(app.config['UPLOAD_FOLDER'], img_hash)
+    path = os.path.join(app.config['UPLOAD_FOLDER'], secure_filename(img_hash))
     if not os.path.isfile(path):
         print("Image not found:", img_hash)
         abort(404)
-
-    print(f"Doing inference with model '{model_id}' and file {img_hash}...")
-
-    output_img_data, centers = model.get_output_and_centers(path, left, top, right, bottom)
-
-    if model_id != "default":
-        model.destroy()
-
-    print(f"Inference complete, now storing result and sending it back...")
-
-    output_hash = store_in_uploads(output_img_data)
-
-    result = {'outputImageHash': output_hash,
-              'cellCenters': centers}
-
-    result_cbor = cbor2.dumps(result)
-    return result_cbor, 200
+    return run_and_wait('unet_inference', unet_job(secure_filename(model_id), path, left, top, right, bottom))
 
 
 @app.route('/model/<model_id>/encode/<img_hash>', methods=['POST'])
 def apply_autoencoder(model_id, img_hash):
-    model = TrainedAutoencoder('models/' + model_id + '/input')
-    raw_data = request.get_data()
-    params = cbor2.loads(raw_data)
-
-    path = os.path.join(app.config['UPLOAD_FOLDER'], img_hash)
+    params = cbor2.loads(request_data())
+    path = os.path.join(app.config['UPLOAD_FOLDER'], secure_filename(img_hash))
     if not os.path.isfile(path):
         print("Image not found:", img_hash)
         abort(404)
-
-    print(f"Apply autoencoder with model '{model_id}' on file {img_hash} with {len(params['cellPositions'])} cells...")
-
-    feature_vectors = model.get_feature_vectors(path, params['cellPositions'])
-
-    model.destroy()
-
-    print(f"Autoencoder applied, now sending result back...")
-
-    result_cbor = cbor2.dumps(feature_vectors)
-    return result_cbor, 200
+    cell_positions = decode_matrix(params['cellPositions'], columns=2)
+    # older clients expect nested arrays:
+    typed_result = not isinstance(params['cellPositions'], list)
+    return run_and_wait('autoencoder_inference',
+                        autoencoder_job(secure_filename(model_id), path, cell_positions, typed_result))
 
 
 @app.route('/inference_progress', methods=['GET'])
 def inference_progress():
-    return str(max(NeuralNetwork.progress, TrainedAutoencoder.progress)), 200
+    return str(job_events.max_progress(['unet_inference', 'autoencoder_inference'])), 200
@@ -0,0 +1,142 @@
+from flask import Blueprint, Response, abort, request
+import numpy as np
+import PIL.Image
+
+import io
+import math
+import threading
+import time
+
+from image_codecs import decode_image
+from inference_queue import inference_queue
+from job_events import job_events
+
+# Tile-streamed inference:
+# The client submits a job of type 'unet_tiles' (see main.py) with the size of the image and the
+# list of tiles it is going to send. The job starts before the image is complete, each patch of
+# the network waits only for the tiles it covers. The output is sent back tile row by tile row:
+#   PUT /jobs/<id>/tiles/<tx>/<ty>    the input tile in column tx and row ty (PNG, QOI or raw deflate,
+#                                     see image_codecs.py)
+#   GET /jobs/<id>/output/<tx>/<ty>   PNG of the output tile, available as soon as the 'outputRows'
+#                                     field of the job events is larger than ty (409 before)
+# Tiles are TILE_SIZE px large, the ones at the right and bottom border are smaller.
+
+tiles = Blueprint('tiles', __name__)
+
+TILE_SIZE = 256
+# seconds without a new tile until the job fails, short because it blocks the single worker
+# if the client went away (cancelled jobs stop within a second, see wait_for):
+TILE_TIMEOUT = 20
+
+
+class TileSession(object):
+
+    def __init__(self, job_id, width, height, tile_list):
+        self.job_id = job_id
+        self.width = width
+        self.height = height
+        self.columns = math.ceil(width / TILE_SIZE)
+        self.rows = math.ceil(height / TILE_SIZE)
+        # same layout as the data of a fast.ai image: (channel, y, x)
+        self.data = np.zeros((3, height, width), dtype=np.float32)
+        self.expected = {(tx, ty) for tx, ty in tile_list if 0 <= tx < self.columns and 0 <= ty < self.rows}
+        self.received = set()
+        self.last_tile_time = time.time()
+        self.outputs = {}
+        self.output_rows = 0
+        self.condition = threading.Condition()
+
+    def tile_rect(self, tx, ty):
+        left = tx * TILE_SIZE
+        top = ty * TILE_SIZE
+        return left, top, min(left + TILE_SIZE, self.width), min(top + TILE_SIZE, self.height)
+
+    def add_tile(self, tx, ty, image_data):
+        left, top, right, bottom = self.tile_rect(tx, ty)
+        tile = decode_image(image_data).astype(np.float32)
+        if tile.shape != (bottom - top, right - left, 3):
+            raise ValueError(f"Tile {tx}, {ty} has the wrong size {tile.shape}.")
+        self.data[:, top:bottom, left:right] = tile.transpose(2, 0, 1) / 255.0
+        with self.condition:
+            self.received.add((tx, ty))
+            self.last_tile_time = time.time()
+            self.condition.notify_all()
+
+    def wait_for(self, top, bottom, left, right, on_progress, progress):
+        """ Blocks until all expected tiles of the area arrived, on_progress raises if the job is cancelled. """
+        needed = {(tx, ty)
+                  for ty in range(top // TILE_SIZE, (bottom - 1) // TILE_SIZE + 1)
+                  for tx in range(left // TILE_SIZE, (right - 1) // TILE_SIZE + 1)} & self.expected
+        started = time.time()  # the job may have been queued for longer than the timeout
+        with self.condition:
+            while not needed <= self.received:
+                if time.time() - max(self.last_tile_time, started) > TILE_TIMEOUT:
+                    raise TimeoutError("No tiles received for too long.")
+                self.condition.wait(1.0)
+                on_progress(progress)
+
+    def add_output(self, result, final_rows):
+        """ Stores the output tiles of all rows above final_rows, result is a (3, height, width) array. """
+        rows = self.rows if final_rows >= self.height else final_rows // TILE_SIZE
+        for ty in range(self.output_rows, rows):
+            for tx in range(self.columns):
+                if (tx, ty) not in self.expected:
+                    continue
+                left, top, right, bottom = self.tile_rect(tx, ty)
+                tile = np.clip(result[:, top:bottom, left:right] * 255, 0, 255).astype(np.uint8).transpose(1, 2, 0)
+                with io.BytesIO() as output:
+                    PIL.Image.fromarray(tile).save(output, format="PNG", compress_level=1)
+                    self.outputs[(tx, ty)] = output.getvalue()
+        if rows > self.output_rows:
+            self.output_rows = rows
+            job_events.update(self.job_id, outputRows=rows)
+
+
+_sessions = {}
+_sessions_lock = threading.Lock()
+
+
+def create_session(job_id, width, height, tile_list):
+    """ The session is only used by requests after add_session() was called. """
+    return TileSession(job_id, width, height, tile_list)
+
+
+def add_session(session):
+    with _sessions_lock:
+        # sessions are kept as long as the job, so that the output can be fetched:
+        for stale_id in [i for i in _sessions if not inference_queue.get(i)]:
+            del _sessions[stale_id]
+        _sessions[session.job_id] = session
+
+
+def get_session(job_id):
+    with _sessions_lock:
+        session = _sessions.get(job_id)
+    if not session:
+        abort(404)
+    return session
+
+
+@tiles.route('/jobs/<job_id>/tiles/<int:tx>/<int:ty>', methods=['PUT'])
+def upload_tile(job_id, tx, ty):
+    session = get_session(job_id)
+    job = inference_queue.get(job_id)
+    if not job or job.finished.is_set():
+        abort(410)
+    if (tx, ty) not in session.expected:
+        abort(422)
+    try:
+        session.add_tile(tx, ty, request.get_data())
+    except (ValueError, OSError) as error:
+        print("Invalid tile:", error)
+        abort(422)
+    return '', 204
+
+
+@tiles.route('/jobs/<job_id>/output/<int:tx>/<int:ty>', methods=['GET'])
+def output_tile(job_id, tx, ty):
+    session = get_session(job_id)
+    data = session.outputs.get((tx, ty))
+    if data is None:
+        abort(409)
+    return Response(data, mimetype='image/png')
@@ -1,5 +1,5 @@
 from autoencoder import Autoencoder, CellAutoencoderItemList
-from global_training_tracker import training_tracker
+from global_training_tracker import ProgressUpdateCallback
 
 from fastai.vision import Learner, MSELossFlat, apply_init, models
 from fastai.vision.transform import dihedral, brightness, contrast
@@ -38,10 +38,11 @@ def prepare_and_train_autoencoder(params, model_id, img_path):
 
     # TODO: store model name
 
-    train_unet_autoencoder(model_path, base_model_weights, databunch, epochs=params['epochs'])
+    train_unet_autoencoder(model_path, base_model_weights, databunch, epochs=params['epochs'], job_id=model_id)
 
 
-def train_unet_autoencoder(path, base_model_weights, databunch, epochs):
+def train_unet_autoencoder(path, base_model_weights, databunch, epochs, job_id):
+    training_tracker = ProgressUpdateCallback(job_id)
     training_tracker.dataset_size = len(databunch.train_dl)
 
     wd = 1e-3
@@ -73,6 +74,5 @@ def train_unet_autoencoder(path, base_model_weights, databunch, epochs):
     with open(path/'trained_model.pth', 'wb') as file:
         learn.save(file)  # save for later finetuning
     learn.export()  # export for simple inference
-    training_tracker.progress = 0.0
     print("Finished training and exported the model.")
 
@@ -1,14 +1,17 @@
-from global_training_tracker import training_tracker
+from global_training_tracker import ProgressUpdateCallback
 
 from fastai.vision import *
 from fastai.callbacks import *
 
+from image_codecs import write_png
+from training_data import iter_records
+
 from pathlib import Path
 import os
 import shutil
 
 
-def unpack_data_and_train(params, model_id, base_model, train_data, valid_data):
+def unpack_data_and_train(params, model_id, base_model, train_paths, valid_paths):
 
     model_path = Path("models")/model_id
     if os.path.exists(model_path):
@@ -25,34 +28,19 @@ def unpack_data_and_train(params, model_id, base_model, train_data, valid_data):
     else:
         base_model_weights = ""
 
-    # unpack train data:
-    for i, jpg_data in enumerate(train_data['inputImages']):
-        path = input_folder/f"train_{i}.png"
-        with open(path, 'wb') as file:
-            file.write(jpg_data)
-
-    for i, jpg_data in enumerate(train_data['targetImages']):
-        path = target_folder/f"train_{i}.png"
-        with open(path, 'wb') as file:
-            file.write(jpg_data)
-
-    # unpack validation data:
-    for i, jpg_data in enumerate(valid_data['inputImages']):
-        path = input_folder/f"valid_{i}.png"
-        with open(path, 'wb') as file:
-            file.write(jpg_data)
-
-    for i, jpg_data in enumerate(valid_data['targetImages']):
-        path = target_folder/f"valid_{i}.png"
-        with open(path, 'wb') as file:
-            file.write(jpg_data)
+    # unpack train and validation data (the shards or old CBOR files, see training_data.py):
+    for prefix, paths in (('train', train_paths), ('valid', valid_paths)):
+        records = (record for path in paths for record in iter_records(path))
+        for i, (input_data, target_data) in enumerate(records):
+            write_png(input_folder/f"{prefix}_{i}.png", input_data)
+            write_png(target_folder/f"{prefix}_{i}.png", target_data)
 
     # TODO: store model name
 
-    train_unet(model_path, base_model_weights, epochs=params['epochs'])
+    train_unet(model_path, base_model_weights, epochs=params['epochs'], job_id=model_id)
 
 
-def train_unet(path, base_model_weights, epochs):
+def train_unet(path, base_model_weights, epochs, job_id):
     item_list = ImageImageList.from_folder(path/'input')
     item_lists = item_list.split_by_valid_func(lambda x: x.name.startswith('valid_'))
     label_lists = item_lists.label_from_func(lambda x: path/'target'/x.name)
@@ -65,6 +53,7 @@ def train_unet(path, base_model_weights, epochs):
     databunch = label_lists.databunch(bs=1)
     databunch.c = 3
 
+    training_tracker = ProgressUpdateCallback(job_id)
     training_tracker.dataset_size = len(databunch.train_dl)
 
     wd = 1e-3
@@ -105,5 +94,4 @@ def train_unet(path, base_model_weights, epochs):
     with open(path/'trained_model.pth', 'wb') as file:
         learn.save(file)  # save for later finetuning
     learn.export()  # export for simple inference
-    training_tracker.progress = 0.0
     print("Finished training and exported the model.")
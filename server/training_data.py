@@ -0,0 +1,79 @@
+import cbor2
+
+import struct
+import zlib
+
+# Training data as written by the client (see src/microscopy/manager/TrainingDataFile.h),
+# all numbers are little endian:
+#   header (32 bytes): 'LTDF', version, flags, record count, shard count, reserved (uint32),
+#                      offset of the index (uint64, 0 until the file is complete)
+#   shards:            'LTDS', version, flags, record count (uint32), followed by the records:
+#                      size of input and target image (uint32), input image, target image
+#   index:             offset, size (uint64), record count, reserved (uint32) of each shard,
+#                      followed by the offset (uint64) of each record
+# The client uploads each shard as a separate file. If flags & COMPRESSED, the images are zlib streams.
+# The old format is one CBOR map with the arrays 'inputImages' and 'targetImages'.
+
+FILE_MAGIC = b'LTDF'
+SHARD_MAGIC = b'LTDS'
+VERSION = 1
+COMPRESSED = 0x1
+
+_HEADER = struct.Struct('<4s5IQ')
+_SHARD_HEADER = struct.Struct('<4s3I')
+_RECORD_HEADER = struct.Struct('<2I')
+_SHARD_INDEX_ENTRY = struct.Struct('<2Q2I')
+
+
+def _read_exactly(file, size):
+    data = file.read(size)
+    if len(data) != size:
+        raise ValueError("Training data is truncated")
+    return data
+
+
+def _read_shard(file):
+    """ Yields the records of the shard at the current position of the file. """
+    magic, version, flags, record_count = _SHARD_HEADER.unpack(_read_exactly(file, _SHARD_HEADER.size))
+    if magic != SHARD_MAGIC or version > VERSION:
+        raise ValueError("Unknown training data shard")
+    for _ in range(record_count):
+        input_size, target_size = _RECORD_HEADER.unpack(_read_exactly(file, _RECORD_HEADER.size))
+        input_image = _read_exactly(file, input_size)
+        target_image = _read_exactly(file, target_size)
+        if flags & COMPRESSED:
+            input_image = zlib.decompress(input_image)
+            target_image = zlib.decompress(target_image)
+        yield input_image, target_image
+
+
+def read_index(path):
+    """ Returns the shards (offset, size, record count) and record offsets of a complete training data file. """
+    with open(path, 'rb') as file:
+        magic, version, _, record_count, shard_count, _, index_offset = _HEADER.unpack(_read_exactly(file, _HEADER.size))
+        if magic != FILE_MAGIC or version > VERSION or index_offset == 0:
+            raise ValueError("Incomplete or unknown training data file")
+        file.seek(index_offset)
+        shards = [_SHARD_INDEX_ENTRY.unpack(_read_exactly(file, _SHARD_INDEX_ENTRY.size))[:3] for _ in range(shard_count)]
+        record_offsets = struct.unpack(f'<{record_count}Q', _read_exactly(file, 8 * record_count))
+    return shards, record_offsets
+
+
+def iter_records(path):
+    """ Yields (input image, target image) of a shard, a complete training data file or an old CBOR file,
+    only one record is in memory at a time (except for old files). """
+    with open(path, 'rb') as file:
+        magic = file.read(4)
+    if magic == SHARD_MAGIC:
+        with open(path, 'rb') as file:
+            yield from _read_shard(file)
+    elif magic == FILE_MAGIC:
+        shards, _ = read_index(path)
+        with open(path, 'rb') as file:
+            for offset, _, _ in shards:
+                file.seek(offset)
+                yield from _read_shard(file)
+    else:
+        with open(path, 'rb') as file:
+            data = cbor2.load(file)
+        yield from zip(data['inputImages'], data['targetImages'])
@@ -0,0 +1,51 @@
+from flask import request, Response
+import cbor2
+import numpy as np
+
+import gzip
+import zlib
+
+# Matrices like cell positions and feature vectors are transferred as RFC 8746 typed arrays:
+# a multi-dimensional array (tag 40) of the shape and the row-major float32 values in a
+# single byte string (tag 85, little endian), instead of one CBOR item per value.
+# Large request and response bodies are additionally compressed (Content-Encoding).
+
+TAG_MULTI_DIM_ARRAY = 40
+TAG_FLOAT32_BE = 81
+TAG_FLOAT32_LE = 85
+
+COMPRESSION_THRESHOLD = 64 * 1024  # bytes
+
+
+def encode_matrix(matrix):
+    matrix = np.ascontiguousarray(matrix, dtype='<f4')
+    if matrix.ndim != 2:
+        matrix = matrix.reshape(len(matrix), -1)
+    return cbor2.CBORTag(TAG_MULTI_DIM_ARRAY, [list(matrix.shape), cbor2.CBORTag(TAG_FLOAT32_LE, matrix.tobytes())])
+
+
+def decode_matrix(value, columns=None):
+    """ Returns a float32 numpy array, value can also be nested lists of numbers (older clients). """
+    if isinstance(value, cbor2.CBORTag) and value.tag == TAG_MULTI_DIM_ARRAY:
+        shape, data = value.value
+        if isinstance(data, cbor2.CBORTag) and data.tag in (TAG_FLOAT32_LE, TAG_FLOAT32_BE):
+            dtype = '<f4' if data.tag == TAG_FLOAT32_LE else '>f4'
+            return np.frombuffer(data.value, dtype=dtype).astype(np.float32).reshape(shape)
+        return np.asarray(data, dtype=np.float32).reshape(shape)
+    matrix = np.asarray(value, dtype=np.float32)
+    if matrix.ndim != 2:
+        matrix = matrix.reshape(-1, columns or 1)
+    return matrix
+
+
+def request_data():
+    data = request.get_data()
+    if request.headers.get('Content-Encoding') == 'deflate':
+        data = zlib.decompress(data)
+    return data
+
+
+def compressed_response(data, status=200):
+    if len(data) >= COMPRESSION_THRESHOLD and 'gzip' in request.headers.get('Accept-Encoding', ''):
+        return Response(gzip.compress(data, compresslevel=1), status, headers={'Content-Encoding': 'gzip'})
+    return data, status
@@ -0,0 +1,321 @@
+#include "CellComparison.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using SegmentationMetrics::Outline;
+
+
+namespace {
+
+    // grid cell size in the order of a nucleus diameter
+    float gridCellSize(const std::vector<Outline>& cells) {
+        if (cells.empty()) return 20.0f;
+        std::vector<float> extents;
+        extents.reserve(cells.size());
+        for (const Outline& cell: cells) extents.push_back(SegmentationMetrics::extent(cell));
+        std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+        return std::max(1.0f, 2.0f * extents[extents.size() / 2]);
+    }
+
+    template<typename Edge>
+    void removeEdge(std::vector<Edge>& edges, int other) {
+        edges.erase(std::remove_if(edges.begin(), edges.end(), [other](const Edge& edge) {
+            return edge.other == other;
+        }), edges.end());
+    }
+
+}  // namespace
+
+
+void CellComparison::reset(const std::vector<Outline>& reference, const std::vector<Outline>& candidates) {
+    const std::vector<Outline>* inputs[2] = {&reference, &candidates};
+    for (int side = 0; side < 2; ++side) {
+        const std::vector<Outline>& cells = *inputs[side];
+        SideData& data = m_sides[side];
+        data = SideData();
+        data.cells = cells;
+        data.masks = SegmentationMetrics::rasterize(cells);
+        data.alive.assign(cells.size(), true);
+        data.match.assign(cells.size(), -1);
+        data.pairs.resize(cells.size());
+        data.overlaps.resize(cells.size());
+        data.slotOfIndex.resize(cells.size());
+        std::iota(data.slotOfIndex.begin(), data.slotOfIndex.end(), 0);
+        data.grid = SpatialGrid(gridCellSize(cells));
+        for (std::size_t i = 0; i < cells.size(); ++i) {
+            data.grid.insert(int(i), cells[i].x, cells[i].y);
+            data.maxRadius = std::max(data.maxRadius, cells[i].radius);
+            data.maxExtent = std::max(data.maxExtent, SegmentationMetrics::extent(cells[i]));
+        }
+        m_dirty[side].clear();
+    }
+    SideData& ref = m_sides[Reference];
+    SideData& cand = m_sides[Candidate];
+
+    // initial graph with the bulk (parallel) functions:
+    std::vector<CellMatching::Cell> referenceCells;
+    for (const Outline& cell: reference) referenceCells.push_back({cell.x, cell.y, cell.radius});
+    std::vector<CellMatching::Cell> candidateCells;
+    for (const Outline& cell: candidates) candidateCells.push_back({cell.x, cell.y, cell.radius});
+    const std::vector<CellMatching::Match> pairs = CellMatching::candidatePairs(referenceCells, candidateCells);
+    for (const CellMatching::Match& pair: pairs) {
+        ref.pairs[std::size_t(pair.reference)].push_back({pair.candidate, pair.distance});
+        cand.pairs[std::size_t(pair.candidate)].push_back({pair.reference, pair.distance});
+    }
+    for (const CellMatching::Match& match: CellMatching::optimalAssignment(pairs)) {
+        ref.match[std::size_t(match.reference)] = match.candidate;
+        cand.match[std::size_t(match.candidate)] = match.reference;
+    }
+
+    const SegmentationMetrics::Overlaps overlaps = SegmentationMetrics::computeOverlaps(reference, candidates, ref.masks, cand.masks);
+    for (const SegmentationMetrics::Overlap& overlap: overlaps.pairs) {
+        ref.overlaps[std::size_t(overlap.reference)].push_back({overlap.candidate, overlap.intersection});
+        cand.overlaps[std::size_t(overlap.candidate)].push_back({overlap.reference, overlap.intersection});
+    }
+}
+
+void CellComparison::insert(Side side, const Outline& cell) {
+    const int slot = addSlot(side, cell);
+    m_sides[side].slotOfIndex.push_back(slot);
+    connect(side, slot);
+}
+
+void CellComparison::remove(Side side, int index) {
+    SideData& data = m_sides[side];
+    if (index < 0 || index >= int(data.slotOfIndex.size())) return;
+    const int slot = data.slotOfIndex[std::size_t(index)];
+    disconnect(side, slot);
+    data.grid.remove(slot, data.cells[std::size_t(slot)].x, data.cells[std::size_t(slot)].y);
+    data.alive[std::size_t(slot)] = false;
+    data.masks[std::size_t(slot)] = SegmentationMetrics::Mask();
+    data.slotOfIndex.erase(data.slotOfIndex.begin() + index);
+}
+
+void CellComparison::modify(Side side, int index, const Outline& cell) {
+    SideData& data = m_sides[side];
+    if (index < 0 || index >= int(data.slotOfIndex.size())) return;
+    const int slot = data.slotOfIndex[std::size_t(index)];
+    disconnect(side, slot);
+    data.grid.remove(slot, data.cells[std::size_t(slot)].x, data.cells[std::size_t(slot)].y);
+    data.cells[std::size_t(slot)] = cell;
+    data.masks[std::size_t(slot)] = SegmentationMetrics::rasterize(cell);
+    data.grid.insert(slot, cell.x, cell.y);
+    data.maxRadius = std::max(data.maxRadius, cell.radius);
+    data.maxExtent = std::max(data.maxExtent, SegmentationMetrics::extent(cell));
+    connect(side, slot);
+}
+
+CellComparison::Result CellComparison::evaluate() {
+    assignDirtyComponents();
+
+    const SideData& ref = m_sides[Reference];
+    const SideData& cand = m_sides[Candidate];
+    std::vector<int> candidateIndexOfSlot(cand.cells.size(), -1);
+    for (std::size_t i = 0; i < cand.slotOfIndex.size(); ++i) {
+        candidateIndexOfSlot[std::size_t(cand.slotOfIndex[i])] = int(i);
+    }
+
+    Result result;
+    std::vector<CellMatching::Match> matches;
+    SegmentationMetrics::Overlaps overlaps;
+    overlaps.referenceAreas.resize(ref.slotOfIndex.size());
+    overlaps.candidateAreas.resize(cand.slotOfIndex.size());
+    double positionSquareErrorSum = 0.0;
+    double radiusSquareErrorSum = 0.0;
+    double shapeSquareErrorSum = 0.0;
+
+    for (std::size_t i = 0; i < ref.slotOfIndex.size(); ++i) {
+        const int slot = ref.slotOfIndex[i];
+        const Outline& gt = ref.cells[std::size_t(slot)];
+        overlaps.referenceAreas[i] = ref.masks[std::size_t(slot)].area;
+
+        const std::size_t firstOverlap = overlaps.pairs.size();
+        for (const OverlapEdge& edge: ref.overlaps[std::size_t(slot)]) {
+            overlaps.pairs.push_back({int(i), candidateIndexOfSlot[std::size_t(edge.other)], edge.intersection});
+        }
+        std::sort(overlaps.pairs.begin() + long(firstOverlap), overlaps.pairs.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.candidate < rhs.candidate;
+        });
+
+        const int matchSlot = ref.match[std::size_t(slot)];
+        if (matchSlot < 0) {
+            result.falseNegatives.push_back(int(i));
+            continue;
+        }
+        const int candidateIndex = candidateIndexOfSlot[std::size_t(matchSlot)];
+        const Outline& cn = cand.cells[std::size_t(matchSlot)];
+        result.truePositives.push_back(candidateIndex);
+
+        const double dx = double(gt.x - cn.x);
+        const double dy = double(gt.y - cn.y);
+        const double distanceSquared = dx * dx + dy * dy;
+        matches.push_back({int(i), candidateIndex, float(std::sqrt(distanceSquared))});
+        positionSquareErrorSum += distanceSquared;
+        radiusSquareErrorSum += std::pow(double(gt.radius - cn.radius), 2);
+        double cellShapeSquareErrorSum = 0.0;
+        for (std::size_t j = 0; j < gt.shape.size(); ++j) {
+            cellShapeSquareErrorSum += std::pow(double(gt.shape[j] - cn.shape[j]), 2);
+        }
+        shapeSquareErrorSum += cellShapeSquareErrorSum / gt.shape.size();
+    }
+
+    for (std::size_t i = 0; i < cand.slotOfIndex.size(); ++i) {
+        const int slot = cand.slotOfIndex[i];
+        overlaps.candidateAreas[i] = cand.masks[std::size_t(slot)].area;
+        if (cand.match[std::size_t(slot)] < 0) {
+            result.falsePositives.push_back(int(i));
+        }
+    }
+
+    if (!result.truePositives.empty()) {
+        result.meanSquarePositionError = positionSquareErrorSum / result.truePositives.size();
+        result.meanSquareRadiusError = radiusSquareErrorSum / result.truePositives.size();
+        result.meanSquareShapeError = shapeSquareErrorSum / result.truePositives.size();
+    }
+    result.overlaps = SegmentationMetrics::summarize(overlaps, matches);
+    return result;
+}
+
+int CellComparison::addSlot(Side side, const Outline& cell) {
+    SideData& data = m_sides[side];
+    const int slot = int(data.cells.size());
+    data.cells.push_back(cell);
+    data.masks.push_back(SegmentationMetrics::rasterize(cell));
+    data.alive.push_back(true);
+    data.match.push_back(-1);
+    data.pairs.emplace_back();
+    data.overlaps.emplace_back();
+    data.grid.insert(slot, cell.x, cell.y);
+    data.maxRadius = std::max(data.maxRadius, cell.radius);
+    data.maxExtent = std::max(data.maxExtent, SegmentationMetrics::extent(cell));
+    return slot;
+}
+
+void CellComparison::connect(Side side, int slot) {
+    const Side otherSide = side == Reference ? Candidate : Reference;
+    SideData& self = m_sides[side];
+    SideData& other = m_sides[otherSide];
+    const Outline& cell = self.cells[std::size_t(slot)];
+
+    // candidate pairs, the distance has to be smaller or equal the reference radius:
+    const float pairQueryRadius = side == Reference ? cell.radius : other.maxRadius;
+    other.grid.forEachNear(cell.x, cell.y, pairQueryRadius, [&](int o) {
+        const Outline& otherCell = other.cells[std::size_t(o)];
+        const float referenceRadius = side == Reference ? cell.radius : otherCell.radius;
+        const float dx = cell.x - otherCell.x;
+        const float dy = cell.y - otherCell.y;
+        const float distanceSquared = dx * dx + dy * dy;
+        if (distanceSquared <= referenceRadius * referenceRadius) {
+            const float distance = std::sqrt(distanceSquared);
+            self.pairs[std::size_t(slot)].push_back({o, distance});
+            other.pairs[std::size_t(o)].push_back({slot, distance});
+        }
+    });
+
+    // overlaps:
+    const float cellExtent = SegmentationMetrics::extent(cell);
+    other.grid.forEachNear(cell.x, cell.y, cellExtent + other.maxExtent, [&](int o) {
+        const Outline& otherCell = other.cells[std::size_t(o)];
+        const float maxDistance = cellExtent + SegmentationMetrics::extent(otherCell) + 1.0f;
+        const float dx = cell.x - otherCell.x;
+        const float dy = cell.y - otherCell.y;
+        if (dx * dx + dy * dy > maxDistance * maxDistance) return;
+        const int pixels = SegmentationMetrics::intersection(self.masks[std::size_t(slot)], other.masks[std::size_t(o)]);
+        if (pixels > 0) {
+            self.overlaps[std::size_t(slot)].push_back({o, pixels});
+            other.overlaps[std::size_t(o)].push_back({slot, pixels});
+        }
+    });
+
+    m_dirty[side].push_back(slot);
+}
+
+void CellComparison::disconnect(Side side, int slot) {
+    const Side otherSide = side == Reference ? Candidate : Reference;
+    SideData& self = m_sides[side];
+    SideData& other = m_sides[otherSide];
+
+    // the former neighbours are not reachable from this cell anymore,
+    // their components have to be assigned again separately:
+    for (const PairEdge& edge: self.pairs[std::size_t(slot)]) {
+        removeEdge(other.pairs[std::size_t(edge.other)], slot);
+        m_dirty[otherSide].push_back(edge.other);
+    }
+    self.pairs[std::size_t(slot)].clear();
+    for (const OverlapEdge& edge: self.overlaps[std::size_t(slot)]) {
+        removeEdge(other.overlaps[std::size_t(edge.other)], slot);
+    }
+    self.overlaps[std::size_t(slot)].clear();
+
+    const int matchSlot = self.match[std::size_t(slot)];
+    if (matchSlot >= 0) {
+        other.match[std::size_t(matchSlot)] = -1;
+        self.match[std::size_t(slot)] = -1;
+    }
+}
+
+void CellComparison::assignDirtyComponents() {
+    SideData& ref = m_sides[Reference];
+    SideData& cand = m_sides[Candidate];
+    std::vector<char> visited[2] = {std::vector<char>(ref.cells.size(), false),
+                                    std::vector<char>(cand.cells.size(), false)};
+
+    // the components are assigned by cell index instead of slot, so that ties
+    // are broken in the same way as by a complete recomputation:
+    std::vector<int> indexOfSlot[2];
+    for (int side = 0; side < 2; ++side) {
+        indexOfSlot[side].assign(m_sides[side].cells.size(), -1);
+        for (std::size_t i = 0; i < m_sides[side].slotOfIndex.size(); ++i) {
+            indexOfSlot[side][std::size_t(m_sides[side].slotOfIndex[i])] = int(i);
+        }
+    }
+
+    std::vector<std::pair<int, int>> queue;  // side, slot
+    std::vector<int> componentReferences;
+    std::vector<int> componentCandidates;
+    std::vector<CellMatching::Match> componentPairs;
+    for (int startSide = 0; startSide < 2; ++startSide) {
+        for (int startSlot: m_dirty[startSide]) {
+            if (!m_sides[startSide].alive[std::size_t(startSlot)] || visited[startSide][std::size_t(startSlot)]) continue;
+
+            // collect the connected component:
+            queue.assign(1, {startSide, startSlot});
+            visited[startSide][std::size_t(startSlot)] = true;
+            componentReferences.clear();
+            componentCandidates.clear();
+            for (std::size_t q = 0; q < queue.size(); ++q) {
+                const int side = queue[q].first;
+                const int slot = queue[q].second;
+                (side == Reference ? componentReferences : componentCandidates).push_back(slot);
+                for (const PairEdge& edge: m_sides[side].pairs[std::size_t(slot)]) {
+                    const int otherSide = 1 - side;
+                    if (visited[otherSide][std::size_t(edge.other)]) continue;
+                    visited[otherSide][std::size_t(edge.other)] = true;
+                    queue.push_back({otherSide, edge.other});
+                }
+            }
+
+            componentPairs.clear();
+            for (int slot: componentReferences) {
+                ref.match[std::size_t(slot)] = -1;
+                for (const PairEdge& edge: ref.pairs[std::size_t(slot)]) {
+                    componentPairs.push_back({indexOfSlot[Reference][std::size_t(slot)],
+                                              indexOfSlot[Candidate][std::size_t(edge.other)], edge.distance});
+                }
+            }
+            for (int slot: componentCandidates) {
+                cand.match[std::size_t(slot)] = -1;
+            }
+            if (componentPairs.empty()) continue;
+            for (const CellMatching::Match& match: CellMatching::assignComponent(componentPairs)) {
+                const int referenceSlot = ref.slotOfIndex[std::size_t(match.reference)];
+                const int candidateSlot = cand.slotOfIndex[std::size_t(match.candidate)];
+                ref.match[std::size_t(referenceSlot)] = candidateSlot;
+                cand.match[std::size_t(candidateSlot)] = referenceSlot;
+            }
+        }
+        m_dirty[startSide].clear();
+    }
+}
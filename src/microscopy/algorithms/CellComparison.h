@@ -0,0 +1,91 @@
+#ifndef CELLCOMPARISON_H
+#define CELLCOMPARISON_H
+
+#include "microscopy/algorithms/CellMatching.h"
+#include "microscopy/algorithms/SegmentationMetrics.h"
+#include "microscopy/algorithms/SpatialGrid.h"
+
+#include <vector>
+
+
+/**
+ * @brief The CellComparison class matches reference (ground truth) and candidate cells
+ * and computes the benchmark metrics from it.
+ *
+ * After an initial reset() it can be updated cell by cell: only the candidate pairs and
+ * overlaps around a changed cell are recomputed and only the connected components of the
+ * pair graph that were touched are assigned again. The result is the same as with a
+ * complete recomputation.
+ *
+ * Cells are addressed by their index, which behaves like the index in a CellDatabaseBlock:
+ * insert() appends a cell and remove() shifts all later indices by one. Ties in the assignment
+ * are broken by these indices, not by the internal slots.
+ */
+class CellComparison {
+
+public:
+    enum Side {
+        Reference = 0,
+        Candidate = 1
+    };
+
+    struct Result {
+        std::vector<int> truePositives;  // candidate indices, ordered by reference index
+        std::vector<int> falseNegatives;  // reference indices
+        std::vector<int> falsePositives;  // candidate indices
+        double meanSquarePositionError = 0.0;
+        double meanSquareRadiusError = 0.0;
+        double meanSquareShapeError = 0.0;
+        SegmentationMetrics::Summary overlaps;
+    };
+
+    void reset(const std::vector<SegmentationMetrics::Outline>& reference,
+               const std::vector<SegmentationMetrics::Outline>& candidates);
+
+    int count(Side side) const { return int(m_sides[side].slotOfIndex.size()); }
+
+    void insert(Side side, const SegmentationMetrics::Outline& cell);
+    void remove(Side side, int index);
+    void modify(Side side, int index, const SegmentationMetrics::Outline& cell);
+
+    // assigns the touched components again and computes the metrics
+    Result evaluate();
+
+protected:
+    struct PairEdge {
+        int other;  // slot on the other side
+        float distance;
+    };
+
+    struct OverlapEdge {
+        int other;  // slot on the other side
+        int intersection;
+    };
+
+    // cells are stored in slots that never move, so that removing a cell
+    // doesn't require to update the edges of all later cells
+    struct SideData {
+        std::vector<SegmentationMetrics::Outline> cells;
+        std::vector<SegmentationMetrics::Mask> masks;
+        std::vector<char> alive;
+        std::vector<int> match;  // slot on the other side or -1
+        std::vector<std::vector<PairEdge>> pairs;
+        std::vector<std::vector<OverlapEdge>> overlaps;
+        std::vector<int> slotOfIndex;
+        SpatialGrid grid;
+        float maxRadius = 0.0f;
+        float maxExtent = 0.0f;
+    };
+
+    int addSlot(Side side, const SegmentationMetrics::Outline& cell);
+    void connect(Side side, int slot);
+    void disconnect(Side side, int slot);
+    void assignDirtyComponents();
+
+protected:
+    SideData m_sides[2];
+    std::vector<int> m_dirty[2];  // slots whose component has to be assigned again
+
+};
+
+#endif // CELLCOMPARISON_H
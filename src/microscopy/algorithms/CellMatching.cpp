@@ -0,0 +1,250 @@
+#include "CellMatching.h"
+
+#include "microscopy/algorithms/ParallelFor.h"
+#include "microscopy/algorithms/SpatialGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+
+namespace CellMatching {
+
+namespace {
+
+    // components with more cells on the smaller side are solved greedily instead,
+    // the Hungarian algorithm is O(n²m) and this only happens for degenerate data
+    const int MAX_HUNGARIAN_SIZE = 500;
+
+    // cost of an assignment that is not a candidate pair, larger than any sum of distances
+    const double NO_EDGE = 1e12;
+
+    int findRoot(std::vector<int>& parent, int i) {
+        while (parent[std::size_t(i)] != i) {
+            parent[std::size_t(i)] = parent[std::size_t(parent[std::size_t(i)])];
+            i = parent[std::size_t(i)];
+        }
+        return i;
+    }
+
+    /**
+     * @brief hungarian solves the rectangular assignment problem for the row-major
+     * cost matrix with rows <= cols (Kuhn-Munkres with potentials, O(rows² * cols)).
+     * @return the assigned column for each row
+     */
+    std::vector<int> hungarian(const std::vector<double>& cost, int rows, int cols) {
+        const double inf = std::numeric_limits<double>::max();
+        std::vector<double> u(std::size_t(rows + 1), 0.0);
+        std::vector<double> v(std::size_t(cols + 1), 0.0);
+        std::vector<int> rowOfCol(std::size_t(cols + 1), 0);
+        std::vector<int> way(std::size_t(cols + 1), 0);
+        std::vector<double> minValue(std::size_t(cols + 1));
+        std::vector<char> used(std::size_t(cols + 1));
+
+        for (int i = 1; i <= rows; ++i) {
+            rowOfCol[0] = i;
+            int col = 0;
+            std::fill(minValue.begin(), minValue.end(), inf);
+            std::fill(used.begin(), used.end(), false);
+            do {
+                used[std::size_t(col)] = true;
+                const int row = rowOfCol[std::size_t(col)];
+                double delta = inf;
+                int nextCol = 0;
+                for (int j = 1; j <= cols; ++j) {
+                    if (used[std::size_t(j)]) continue;
+                    const double reduced = cost[std::size_t(row - 1) * std::size_t(cols) + std::size_t(j - 1)]
+                            - u[std::size_t(row)] - v[std::size_t(j)];
+                    if (reduced < minValue[std::size_t(j)]) {
+                        minValue[std::size_t(j)] = reduced;
+                        way[std::size_t(j)] = col;
+                    }
+                    if (minValue[std::size_t(j)] < delta) {
+                        delta = minValue[std::size_t(j)];
+                        nextCol = j;
+                    }
+                }
+                for (int j = 0; j <= cols; ++j) {
+                    if (used[std::size_t(j)]) {
+                        u[std::size_t(rowOfCol[std::size_t(j)])] += delta;
+                        v[std::size_t(j)] -= delta;
+                    } else {
+                        minValue[std::size_t(j)] -= delta;
+                    }
+                }
+                col = nextCol;
+            } while (rowOfCol[std::size_t(col)] != 0);
+            // augment along the alternating path:
+            do {
+                const int previous = way[std::size_t(col)];
+                rowOfCol[std::size_t(col)] = rowOfCol[std::size_t(previous)];
+                col = previous;
+            } while (col != 0);
+        }
+
+        std::vector<int> result(std::size_t(rows), -1);
+        for (int j = 1; j <= cols; ++j) {
+            if (rowOfCol[std::size_t(j)] > 0) {
+                result[std::size_t(rowOfCol[std::size_t(j)] - 1)] = j - 1;
+            }
+        }
+        return result;
+    }
+
+    // deterministic fallback for very large components: shortest pairs first
+    std::vector<Match> greedyAssignment(std::vector<Match> pairs) {
+        std::sort(pairs.begin(), pairs.end(), [](const Match& lhs, const Match& rhs) {
+            if (lhs.distance != rhs.distance) return lhs.distance < rhs.distance;
+            if (lhs.reference != rhs.reference) return lhs.reference < rhs.reference;
+            return lhs.candidate < rhs.candidate;
+        });
+        std::vector<int> references;
+        std::vector<int> candidates;
+        std::vector<Match> result;
+        for (const Match& pair: pairs) {
+            if (std::find(references.begin(), references.end(), pair.reference) != references.end()) continue;
+            if (std::find(candidates.begin(), candidates.end(), pair.candidate) != candidates.end()) continue;
+            references.push_back(pair.reference);
+            candidates.push_back(pair.candidate);
+            result.push_back(pair);
+        }
+        return result;
+    }
+
+}  // namespace
+
+
+std::vector<Match> assignComponent(const std::vector<Match>& pairs) {
+    if (pairs.size() == 1) return pairs;
+
+    // local, sorted indices so that the result doesn't depend on the order of the pairs:
+    std::vector<int> references;
+    std::vector<int> candidates;
+    for (const Match& pair: pairs) {
+        references.push_back(pair.reference);
+        candidates.push_back(pair.candidate);
+    }
+    std::sort(references.begin(), references.end());
+    references.erase(std::unique(references.begin(), references.end()), references.end());
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    // the Hungarian algorithm needs rows <= cols:
+    const bool transposed = references.size() > candidates.size();
+    const int rows = int(transposed ? candidates.size() : references.size());
+    const int cols = int(transposed ? references.size() : candidates.size());
+    if (rows > MAX_HUNGARIAN_SIZE) {
+        return greedyAssignment(pairs);
+    }
+
+    std::vector<double> cost(std::size_t(rows) * std::size_t(cols), NO_EDGE);
+    for (const Match& pair: pairs) {
+        const int r = int(std::lower_bound(references.begin(), references.end(), pair.reference) - references.begin());
+        const int c = int(std::lower_bound(candidates.begin(), candidates.end(), pair.candidate) - candidates.begin());
+        const std::size_t index = transposed ? std::size_t(c) * std::size_t(cols) + std::size_t(r)
+                                             : std::size_t(r) * std::size_t(cols) + std::size_t(c);
+        cost[index] = std::min(cost[index], double(pair.distance));
+    }
+
+    const std::vector<int> assignment = hungarian(cost, rows, cols);
+    std::vector<Match> result;
+    for (int row = 0; row < rows; ++row) {
+        const int col = assignment[std::size_t(row)];
+        if (col < 0) continue;
+        const double value = cost[std::size_t(row) * std::size_t(cols) + std::size_t(col)];
+        if (value >= NO_EDGE) continue;  // row is not matched
+        const int r = transposed ? col : row;
+        const int c = transposed ? row : col;
+        result.push_back({references[std::size_t(r)], candidates[std::size_t(c)], float(value)});
+    }
+    return result;
+}
+
+std::vector<Match> candidatePairs(const std::vector<Cell>& reference, const std::vector<Cell>& candidates) {
+    if (reference.empty() || candidates.empty()) return {};
+
+    // cell size in the order of a nucleus diameter, so that a query touches only a few cells:
+    std::vector<float> radii;
+    radii.reserve(reference.size());
+    for (const Cell& cell: reference) radii.push_back(cell.radius);
+    std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+    SpatialGrid grid(std::max(1.0f, 2.0f * radii[radii.size() / 2]));
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+        grid.insert(int(i), candidates[i].x, candidates[i].y);
+    }
+
+    const int count = int(reference.size());
+    std::vector<std::vector<Match>> chunkPairs(std::size_t(parallelChunkCount(count)));
+    parallelForChunks(count, [&](int chunk, int begin, int end) {
+        std::vector<Match>& pairs = chunkPairs[std::size_t(chunk)];
+        for (int i = begin; i < end; ++i) {
+            const Cell& cell = reference[std::size_t(i)];
+            const float radiusSquared = cell.radius * cell.radius;
+            grid.forEachNear(cell.x, cell.y, cell.radius, [&](int j) {
+                const float dx = cell.x - candidates[std::size_t(j)].x;
+                const float dy = cell.y - candidates[std::size_t(j)].y;
+                const float distanceSquared = dx * dx + dy * dy;
+                if (distanceSquared <= radiusSquared) {
+                    pairs.push_back({i, j, std::sqrt(distanceSquared)});
+                }
+            });
+        }
+    });
+
+    std::vector<Match> pairs;
+    for (const std::vector<Match>& chunk: chunkPairs) {
+        pairs.insert(pairs.end(), chunk.begin(), chunk.end());
+    }
+    return pairs;
+}
+
+std::vector<Match> optimalAssignment(const std::vector<Match>& pairs) {
+    if (pairs.empty()) return {};
+
+    // union-find over reference and candidate nodes (candidates after the references):
+    int referenceCount = 0;
+    int candidateCount = 0;
+    for (const Match& pair: pairs) {
+        referenceCount = std::max(referenceCount, pair.reference + 1);
+        candidateCount = std::max(candidateCount, pair.candidate + 1);
+    }
+    std::vector<int> parent(std::size_t(referenceCount + candidateCount));
+    std::iota(parent.begin(), parent.end(), 0);
+    for (const Match& pair: pairs) {
+        const int a = findRoot(parent, pair.reference);
+        const int b = findRoot(parent, referenceCount + pair.candidate);
+        if (a != b) parent[std::size_t(std::max(a, b))] = std::min(a, b);
+    }
+
+    // group the pairs by component:
+    std::vector<int> componentOfRoot(parent.size(), -1);
+    std::vector<std::vector<Match>> components;
+    for (const Match& pair: pairs) {
+        const int root = findRoot(parent, pair.reference);
+        int& component = componentOfRoot[std::size_t(root)];
+        if (component < 0) {
+            component = int(components.size());
+            components.emplace_back();
+        }
+        components[std::size_t(component)].push_back(pair);
+    }
+
+    std::vector<std::vector<Match>> componentMatches(components.size());
+    parallelForChunks(int(components.size()), [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            componentMatches[std::size_t(i)] = assignComponent(components[std::size_t(i)]);
+        }
+    }, 64);
+
+    std::vector<Match> result;
+    for (const std::vector<Match>& matches: componentMatches) {
+        result.insert(result.end(), matches.begin(), matches.end());
+    }
+    std::sort(result.begin(), result.end(), [](const Match& lhs, const Match& rhs) {
+        return lhs.reference < rhs.reference;
+    });
+    return result;
+}
+
+}  // namespace CellMatching
@@ -0,0 +1,51 @@
+#ifndef CELLMATCHING_H
+#define CELLMATCHING_H
+
+#include <vector>
+
+
+namespace CellMatching {
+
+    struct Cell {
+        float x = 0.0f;
+        float y = 0.0f;
+        float radius = 0.0f;
+    };
+
+    // a pair of a reference (ground truth) and a candidate (predicted) cell, by their index
+    struct Match {
+        int reference;
+        int candidate;
+        float distance;
+    };
+
+    /**
+     * @brief candidatePairs returns all pairs whose center distance is smaller or equal
+     * the radius of the reference cell. A uniform grid over the candidates is used,
+     * so that only nearby cells are compared.
+     */
+    std::vector<Match> candidatePairs(const std::vector<Cell>& reference, const std::vector<Cell>& candidates);
+
+    /**
+     * @brief optimalAssignment selects a one-to-one subset of the given pairs that has
+     * the maximum number of matches and, among those, the smallest summed distance.
+     * The pair graph is split into connected components (usually only a few cells each)
+     * that are solved independently with the Hungarian algorithm.
+     * The result does not depend on the order of the pairs, ties between assignments with the same
+     * summed distance are broken by the cell indices. It is sorted by reference index.
+     */
+    std::vector<Match> optimalAssignment(const std::vector<Match>& pairs);
+
+    /**
+     * @brief assignComponent solves the assignment for the pairs of one connected component,
+     * used by optimalAssignment() and to update only a part of an existing assignment.
+     */
+    std::vector<Match> assignComponent(const std::vector<Match>& pairs);
+
+    inline std::vector<Match> matchCells(const std::vector<Cell>& reference, const std::vector<Cell>& candidates) {
+        return optimalAssignment(candidatePairs(reference, candidates));
+    }
+
+}  // namespace CellMatching
+
+#endif // CELLMATCHING_H
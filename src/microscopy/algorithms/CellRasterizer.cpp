@@ -0,0 +1,214 @@
+#include "CellRasterizer.h"
+
+#include "microscopy/algorithms/ParallelFor.h"
+
+#include <QRect>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace CellRasterizer {
+
+namespace {
+
+    const static float ANGLE_STEP = float(2 * M_PI) / SHAPE_RADII;
+
+    struct PreparedShape {
+        float x;
+        float y;
+        // vertices relative to the center:
+        std::array<float, SHAPE_RADII> vx;
+        std::array<float, SHAPE_RADII> vy;
+        // 1 / cross product of the vertices of each sector, 0 if the sector is empty
+        std::array<float, SHAPE_RADII> inverseCross;
+        // premultiplied:
+        float innerValue;
+        float outerValue;
+        float innerAlpha;
+        float outerAlpha;
+        QRect bounds;
+    };
+
+    PreparedShape prepare(const Shape& shape) {
+        PreparedShape result;
+        result.x = shape.x;
+        result.y = shape.y;
+        float extent = 0.0f;
+        for (int k = 0; k < SHAPE_RADII; ++k) {
+            const float length = std::max(shape.radii[std::size_t(k)], 0.0f) * shape.radius;
+            result.vx[std::size_t(k)] = std::sin(k * ANGLE_STEP) * length;
+            result.vy[std::size_t(k)] = std::cos(k * ANGLE_STEP) * length;
+            extent = std::max(extent, length);
+        }
+        for (std::size_t k = 0; k < SHAPE_RADII; ++k) {
+            const std::size_t next = (k + 1) % SHAPE_RADII;
+            const float cross = result.vx[k] * result.vy[next] - result.vy[k] * result.vx[next];
+            result.inverseCross[k] = std::abs(cross) > 1e-12f ? 1.0f / cross : 0.0f;
+        }
+        result.innerAlpha = shape.innerAlpha;
+        result.outerAlpha = shape.outerAlpha;
+        result.innerValue = shape.innerValue * shape.innerAlpha;
+        result.outerValue = shape.outerValue * shape.outerAlpha;
+        const int left = int(std::floor(shape.x - extent));
+        const int top = int(std::floor(shape.y - extent));
+        result.bounds = QRect(QPoint(left, top), QPoint(int(std::ceil(shape.x + extent)), int(std::ceil(shape.y + extent))));
+        return result;
+    }
+
+    // draws the shape inside of clip over the premultiplied planes of the region
+    void draw(const PreparedShape& shape, const QRect& clip, const QRect& region, float* value, float* alpha) {
+        const QRect pixels = shape.bounds.intersected(clip);
+        for (int py = pixels.top(); py <= pixels.bottom(); ++py) {
+            const float dy = py + 0.5f - shape.y;
+            const int rowOffset = (py - region.top()) * region.width() - region.left();
+            for (int px = pixels.left(); px <= pixels.right(); ++px) {
+                const float dx = px + 0.5f - shape.x;
+                float angle = std::atan2(dx, dy);
+                if (angle < 0.0f) angle += float(2 * M_PI);
+                const std::size_t k = std::size_t(std::min(int(angle / ANGLE_STEP), SHAPE_RADII - 1));
+                if (shape.inverseCross[k] == 0.0f) continue;
+                const std::size_t next = (k + 1) % SHAPE_RADII;
+                // relative distance between center (0.0) and outline (1.0) in this sector:
+                const float t = (dx * (shape.vy[next] - shape.vy[k]) - dy * (shape.vx[next] - shape.vx[k])) * shape.inverseCross[k];
+                if (!(t <= 1.0f)) continue;
+                const float sourceValue = shape.innerValue + (shape.outerValue - shape.innerValue) * t;
+                const float sourceAlpha = shape.innerAlpha + (shape.outerAlpha - shape.innerAlpha) * t;
+                const int i = rowOffset + px;
+                value[i] = sourceValue + value[i] * (1.0f - sourceAlpha);
+                alpha[i] = sourceAlpha + alpha[i] * (1.0f - sourceAlpha);
+            }
+        }
+    }
+
+    // the default deviation of the GaussianBlur QML item
+    std::vector<float> gaussianKernel(int radius) {
+        const float deviation = (radius + 1) / 3.3333f;
+        std::vector<float> kernel(std::size_t(2 * radius + 1));
+        float sum = 0.0f;
+        for (int i = -radius; i <= radius; ++i) {
+            kernel[std::size_t(i + radius)] = std::exp(-(i * i) / (2.0f * deviation * deviation));
+            sum += kernel[std::size_t(i + radius)];
+        }
+        for (float& weight: kernel) weight /= sum;
+        return kernel;
+    }
+
+    // separable blur of the plane (width x height), only the inner part without the margin is valid afterwards
+    void blur(std::vector<float>& plane, int width, int height, int radius, const std::vector<float>& kernel) {
+        std::vector<float> temp(plane.size(), 0.0f);
+        for (int y = 0; y < height; ++y) {
+            const float* source = plane.data() + y * width;
+            float* target = temp.data() + y * width;
+            for (int x = radius; x < width - radius; ++x) {
+                float sum = 0.0f;
+                for (int i = -radius; i <= radius; ++i) {
+                    sum += source[x + i] * kernel[std::size_t(i + radius)];
+                }
+                target[x] = sum;
+            }
+        }
+        for (int y = radius; y < height - radius; ++y) {
+            float* target = plane.data() + y * width;
+            for (int x = radius; x < width - radius; ++x) {
+                float sum = 0.0f;
+                for (int i = -radius; i <= radius; ++i) {
+                    sum += temp[std::size_t((y + i) * width + x)] * kernel[std::size_t(i + radius)];
+                }
+                target[x] = sum;
+            }
+        }
+    }
+
+}  // namespace
+
+
+QImage render(QSize size, const std::vector<Layer>& layers, QImage::Format format) {
+    QImage image(size, format);
+    if (image.isNull()) return image;
+    image.fill(0);
+    const QRect imageRect = image.rect();
+    const int columns = (size.width() + TILE_SIZE - 1) / TILE_SIZE;
+    const int rows = (size.height() + TILE_SIZE - 1) / TILE_SIZE;
+    const int tileCount = columns * rows;
+
+    // the shapes of each layer that are relevant for each tile, in drawing order:
+    std::vector<PreparedShape> shapes;
+    std::vector<std::vector<std::vector<int>>> tileShapes(layers.size(), std::vector<std::vector<int>>(std::size_t(tileCount)));
+    std::vector<std::vector<float>> kernels;
+    for (std::size_t l = 0; l < layers.size(); ++l) {
+        const int margin = layers[l].blurRadius;
+        kernels.push_back(margin > 0 ? gaussianKernel(margin) : std::vector<float>());
+        for (const Shape& shape: layers[l].shapes) {
+            const PreparedShape prepared = prepare(shape);
+            // shapes outside of the image are not visible, even if blurred:
+            QRect bounds = prepared.bounds.intersected(imageRect);
+            if (bounds.isEmpty()) continue;
+            bounds.adjust(-margin, -margin, margin, margin);
+            const int index = int(shapes.size());
+            shapes.push_back(prepared);
+            const int firstColumn = std::max(0, bounds.left() / TILE_SIZE);
+            const int lastColumn = std::min(columns - 1, bounds.right() / TILE_SIZE);
+            const int firstRow = std::max(0, bounds.top() / TILE_SIZE);
+            const int lastRow = std::min(rows - 1, bounds.bottom() / TILE_SIZE);
+            for (int row = firstRow; row <= lastRow; ++row) {
+                for (int column = firstColumn; column <= lastColumn; ++column) {
+                    tileShapes[l][std::size_t(row * columns + column)].push_back(index);
+                }
+            }
+        }
+    }
+
+    // the tiles write to different pixels, but must not detach the image in parallel:
+    uchar* bits = image.bits();
+    const int bytesPerLine = image.bytesPerLine();
+    const bool sixteenBit = format == QImage::Format_Grayscale16;
+
+    parallelForChunks(tileCount, [&](int, int first, int end) {
+        for (int tileIndex = first; tileIndex < end; ++tileIndex) {
+            const QRect tile = QRect((tileIndex % columns) * TILE_SIZE, (tileIndex / columns) * TILE_SIZE,
+                                     TILE_SIZE, TILE_SIZE).intersected(imageRect);
+            std::vector<float> result(std::size_t(tile.width() * tile.height()), 0.0f);
+            for (std::size_t l = 0; l < layers.size(); ++l) {
+                const std::vector<int>& indexes = tileShapes[l][std::size_t(tileIndex)];
+                if (indexes.empty()) continue;
+                // the blur needs the pixels around the tile, outside of the image is transparent:
+                const int margin = layers[l].blurRadius;
+                const QRect region = tile.adjusted(-margin, -margin, margin, margin);
+                const QRect drawable = region.intersected(imageRect);
+                std::vector<float> value(std::size_t(region.width() * region.height()), 0.0f);
+                std::vector<float> alpha(value.size(), 0.0f);
+                for (int index: indexes) {
+                    draw(shapes[std::size_t(index)], drawable, region, value.data(), alpha.data());
+                }
+                if (margin > 0) {
+                    blur(value, region.width(), region.height(), margin, kernels[l]);
+                    blur(alpha, region.width(), region.height(), margin, kernels[l]);
+                }
+                for (int y = 0; y < tile.height(); ++y) {
+                    for (int x = 0; x < tile.width(); ++x) {
+                        const std::size_t i = std::size_t((y + margin) * region.width() + x + margin);
+                        float& target = result[std::size_t(y * tile.width() + x)];
+                        target = value[i] + target * (1.0f - alpha[i]);
+                    }
+                }
+            }
+            for (int y = 0; y < tile.height(); ++y) {
+                uchar* line = bits + (tile.top() + y) * bytesPerLine;
+                const float* source = result.data() + y * tile.width();
+                for (int x = 0; x < tile.width(); ++x) {
+                    const float v = std::min(std::max(source[x], 0.0f), 1.0f);
+                    if (sixteenBit) {
+                        reinterpret_cast<quint16*>(line)[tile.left() + x] = quint16(std::lround(v * 65535.0f));
+                    } else {
+                        line[tile.left() + x] = uchar(std::lround(v * 255.0f));
+                    }
+                }
+            }
+        }
+    }, /*minChunkSize*/ 1);
+    return image;
+}
+
+}  // namespace CellRasterizer
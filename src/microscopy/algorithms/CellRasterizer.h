@@ -0,0 +1,51 @@
+#ifndef CELLRASTERIZER_H
+#define CELLRASTERIZER_H
+
+#include <QImage>
+#include <QSize>
+
+#include <array>
+#include <vector>
+
+
+namespace CellRasterizer {
+
+    // has to be equal to CellDatabaseConstants::RADII_COUNT
+    const static int SHAPE_RADII = 24;
+    // the image is rendered in tiles of this size in parallel
+    const static int TILE_SIZE = 256;
+
+    /**
+     * @brief The Shape struct is a star-shaped polygon like the IrregularCircle QML item: vertex k
+     * is at the angle k / SHAPE_RADII * 2pi (measured with atan2(dx, dy), like SegmentationMetrics)
+     * and radii[k] * radius pixels away from the center. The gray value and alpha are interpolated
+     * linearly from the center to the outline.
+     */
+    struct Shape {
+        float x = 0.0f;
+        float y = 0.0f;
+        float radius = 0.0f;
+        std::array<float, SHAPE_RADII> radii;
+        float innerValue = 1.0f;  // from 0.0 to 1.0
+        float outerValue = 1.0f;
+        float innerAlpha = 1.0f;
+        float outerAlpha = 1.0f;
+    };
+
+    struct Layer {
+        std::vector<Shape> shapes;  // drawn in this order
+        // blurred like the GaussianBlur QML item with this radius and the default deviation, 0 is no blur
+        int blurRadius = 0;
+    };
+
+    /**
+     * @brief render draws the layers on a black background on the CPU, tile by tile in parallel.
+     * Each layer is blurred on its own before it is drawn over the previous ones.
+     * Pixels are sampled at their centers without antialiasing, so that label values stay exact.
+     * @param format Format_Grayscale8 or Format_Grayscale16
+     */
+    QImage render(QSize size, const std::vector<Layer>& layers, QImage::Format format);
+
+}
+
+#endif // CELLRASTERIZER_H
@@ -0,0 +1,399 @@
+#include "Clustering.h"
+
+#include "microscopy/algorithms/DistanceKernels.h"
+#include "microscopy/algorithms/ParallelFor.h"
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+
+
+namespace Clustering {
+
+namespace {
+
+    const int MIN_CHUNK_SIZE = 512;
+
+    // index of the nearest center and the squared distances to the nearest and second nearest
+    struct NearestCenters {
+        int index = 0;
+        float best = std::numeric_limits<float>::max();
+        float second = std::numeric_limits<float>::max();
+    };
+
+    inline NearestCenters findNearestCenters(const float* point, const std::vector<float>& centers, int k, int dims) {
+        NearestCenters result;
+        for (int c = 0; c < k; ++c) {
+            const float distance = squaredDistance(point, centers.data() + std::size_t(c) * std::size_t(dims), dims);
+            if (distance < result.best) {
+                result.second = result.best;
+                result.best = distance;
+                result.index = c;
+            } else if (distance < result.second) {
+                result.second = distance;
+            }
+        }
+        return result;
+    }
+
+    std::vector<float> kMeansPlusPlusSeeds(const FeatureMatrix& data, int k, std::mt19937& engine) {
+        const int n = data.rows;
+        const int dims = data.cols;
+        std::vector<float> centers(std::size_t(k) * std::size_t(dims));
+        std::uniform_int_distribution<int> indexDist(0, n - 1);
+
+        const int first = indexDist(engine);
+        std::copy_n(data.row(first), dims, centers.begin());
+
+        std::vector<float> minDistance(static_cast<std::size_t>(n));
+        parallelForChunks(n, [&](int, int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                minDistance[std::size_t(i)] = squaredDistance(data.row(i), centers.data(), dims);
+            }
+        }, MIN_CHUNK_SIZE);
+
+        for (int c = 1; c < k; ++c) {
+            double total = 0.0;
+            for (float distance: minDistance) {
+                total += double(distance);
+            }
+            int chosen = n - 1;
+            if (total <= 0.0) {
+                // all points are already centers, duplicate a random one:
+                chosen = indexDist(engine);
+            } else {
+                // D² sampling: choose a point with a probability proportional
+                // to its squared distance to the nearest existing center
+                std::uniform_real_distribution<double> targetDist(0.0, total);
+                const double target = targetDist(engine);
+                double cumulative = 0.0;
+                for (int i = 0; i < n; ++i) {
+                    cumulative += double(minDistance[std::size_t(i)]);
+                    if (cumulative >= target) {
+                        chosen = i;
+                        break;
+                    }
+                }
+            }
+            float* center = centers.data() + std::size_t(c) * std::size_t(dims);
+            std::copy_n(data.row(chosen), dims, center);
+
+            parallelForChunks(n, [&](int, int begin, int end) {
+                for (int i = begin; i < end; ++i) {
+                    const float distance = squaredDistance(data.row(i), center, dims);
+                    minDistance[std::size_t(i)] = std::min(minDistance[std::size_t(i)], distance);
+                }
+            }, MIN_CHUNK_SIZE);
+        }
+        return centers;
+    }
+
+    void assignToNearest(const FeatureMatrix& data, const std::vector<float>& centers, int k, std::vector<int>& labels) {
+        parallelForChunks(data.rows, [&](int, int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                labels[std::size_t(i)] = findNearestCenters(data.row(i), centers, k, data.cols).index;
+            }
+        }, MIN_CHUNK_SIZE);
+    }
+
+}  // namespace
+
+void FeatureMatrix::standardize() {
+    for (int col = 0; col < cols; ++col) {
+        double sum = 0.0;
+        double squareSum = 0.0;
+        for (int i = 0; i < rows; ++i) {
+            const double value = double(row(i)[col]);
+            sum += value;
+            squareSum += value * value;
+        }
+        const double mean = sum / std::max(rows, 1);
+        const double variance = squareSum / std::max(rows, 1) - mean * mean;
+        const double stdDev = variance > 0.0 ? std::sqrt(variance) : 1.0;
+        for (int i = 0; i < rows; ++i) {
+            row(i)[col] = float((double(row(i)[col]) - mean) / stdDev);
+        }
+    }
+}
+
+std::vector<int> kMeans(const FeatureMatrix& data, int k, int maxIterations, unsigned int seed, const ProgressCallback& onProgress) {
+    const int n = data.rows;
+    const int dims = data.cols;
+    if (n == 0 || dims == 0) return std::vector<int>(std::size_t(n), 0);
+    k = qBound(1, k, n);
+
+    std::mt19937 engine(seed);
+    std::vector<float> centers = kMeansPlusPlusSeeds(data, k, engine);
+
+    std::vector<int> labels(std::size_t(n), 0);
+    std::vector<float> upperBound(static_cast<std::size_t>(n));
+    std::vector<float> lowerBound(static_cast<std::size_t>(n));
+
+    // initial assignment, also initializes the bounds:
+    parallelForChunks(n, [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const NearestCenters nearest = findNearestCenters(data.row(i), centers, k, dims);
+            labels[std::size_t(i)] = nearest.index;
+            upperBound[std::size_t(i)] = std::sqrt(nearest.best);
+            lowerBound[std::size_t(i)] = std::sqrt(nearest.second);
+        }
+    }, MIN_CHUNK_SIZE);
+
+    const int chunkCount = parallelChunkCount(n, MIN_CHUNK_SIZE);
+    std::vector<double> chunkSums(std::size_t(chunkCount) * std::size_t(k) * std::size_t(dims));
+    std::vector<int> chunkCounts(std::size_t(chunkCount) * std::size_t(k));
+    std::vector<int> chunkChanges(static_cast<std::size_t>(chunkCount));
+    std::vector<float> newCenters(centers.size());
+    std::vector<float> movement(static_cast<std::size_t>(k));
+    std::vector<float> halfMinCenterDistance(static_cast<std::size_t>(k));
+
+    for (int iteration = 0; iteration < maxIterations; ++iteration) {
+        // 1. move centers to the mean of their points (per-chunk partial sums):
+        std::fill(chunkSums.begin(), chunkSums.end(), 0.0);
+        std::fill(chunkCounts.begin(), chunkCounts.end(), 0);
+        parallelForChunks(n, [&](int chunk, int begin, int end) {
+            double* sums = chunkSums.data() + std::size_t(chunk) * std::size_t(k) * std::size_t(dims);
+            int* counts = chunkCounts.data() + std::size_t(chunk) * std::size_t(k);
+            for (int i = begin; i < end; ++i) {
+                const int c = labels[std::size_t(i)];
+                const float* point = data.row(i);
+                double* sum = sums + std::size_t(c) * std::size_t(dims);
+                for (int d = 0; d < dims; ++d) {
+                    sum[d] += double(point[d]);
+                }
+                counts[c]++;
+            }
+        }, MIN_CHUNK_SIZE);
+
+        float maxMovement = 0.0f;
+        for (int c = 0; c < k; ++c) {
+            int count = 0;
+            for (int chunk = 0; chunk < chunkCount; ++chunk) {
+                count += chunkCounts[std::size_t(chunk) * std::size_t(k) + std::size_t(c)];
+            }
+            float* newCenter = newCenters.data() + std::size_t(c) * std::size_t(dims);
+            const float* oldCenter = centers.data() + std::size_t(c) * std::size_t(dims);
+            for (int d = 0; d < dims; ++d) {
+                if (count == 0) {
+                    // empty cluster, keep its previous position
+                    newCenter[d] = oldCenter[d];
+                    continue;
+                }
+                double sum = 0.0;
+                for (int chunk = 0; chunk < chunkCount; ++chunk) {
+                    sum += chunkSums[(std::size_t(chunk) * std::size_t(k) + std::size_t(c)) * std::size_t(dims) + std::size_t(d)];
+                }
+                newCenter[d] = float(sum / count);
+            }
+            movement[std::size_t(c)] = std::sqrt(squaredDistance(oldCenter, newCenter, dims));
+            maxMovement = std::max(maxMovement, movement[std::size_t(c)]);
+        }
+        centers.swap(newCenters);
+
+        // 2. half of the distance from each center to its nearest other center:
+        for (int c = 0; c < k; ++c) {
+            float minDistance = std::numeric_limits<float>::max();
+            for (int other = 0; other < k; ++other) {
+                if (other == c) continue;
+                minDistance = std::min(minDistance, squaredDistance(centers.data() + std::size_t(c) * std::size_t(dims),
+                                                                    centers.data() + std::size_t(other) * std::size_t(dims), dims));
+            }
+            halfMinCenterDistance[std::size_t(c)] = k > 1 ? std::sqrt(minDistance) / 2 : std::numeric_limits<float>::max();
+        }
+
+        // 3. update the bounds and reassign only where they don't rule out a change:
+        std::fill(chunkChanges.begin(), chunkChanges.end(), 0);
+        parallelForChunks(n, [&](int chunk, int begin, int end) {
+            int changes = 0;
+            for (int i = begin; i < end; ++i) {
+                const std::size_t idx = std::size_t(i);
+                const int assigned = labels[idx];
+                upperBound[idx] += movement[std::size_t(assigned)];
+                lowerBound[idx] -= maxMovement;
+
+                const float bound = std::max(halfMinCenterDistance[std::size_t(assigned)], lowerBound[idx]);
+                if (upperBound[idx] <= bound) continue;
+                // tighten the upper bound and test again:
+                upperBound[idx] = std::sqrt(squaredDistance(data.row(i), centers.data() + std::size_t(assigned) * std::size_t(dims), dims));
+                if (upperBound[idx] <= bound) continue;
+
+                const NearestCenters nearest = findNearestCenters(data.row(i), centers, k, dims);
+                if (nearest.index != assigned) {
+                    labels[idx] = nearest.index;
+                    ++changes;
+                }
+                upperBound[idx] = std::sqrt(nearest.best);
+                lowerBound[idx] = std::sqrt(nearest.second);
+            }
+            chunkChanges[std::size_t(chunk)] = changes;
+        }, MIN_CHUNK_SIZE);
+
+        if (onProgress) onProgress(double(iteration + 1) / maxIterations);
+
+        int changes = 0;
+        for (int chunkChange: chunkChanges) {
+            changes += chunkChange;
+        }
+        if (changes == 0) break;
+    }
+    return labels;
+}
+
+std::vector<int> miniBatchKMeans(const FeatureMatrix& data, int k, int batchSize, int iterations, unsigned int seed, const ProgressCallback& onProgress) {
+    const int n = data.rows;
+    const int dims = data.cols;
+    if (n == 0 || dims == 0) return std::vector<int>(std::size_t(n), 0);
+    k = qBound(1, k, n);
+    batchSize = qBound(1, batchSize, n);
+
+    std::mt19937 engine(seed);
+    std::vector<float> centers = kMeansPlusPlusSeeds(data, k, engine);
+    std::vector<int> centerCounts(std::size_t(k), 0);
+
+    std::uniform_int_distribution<int> indexDist(0, n - 1);
+    std::vector<int> batch(static_cast<std::size_t>(batchSize));
+    std::vector<int> batchLabels(static_cast<std::size_t>(batchSize));
+
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        for (int& idx: batch) {
+            idx = indexDist(engine);
+        }
+        // cache the nearest centers for the whole batch before moving any of them:
+        parallelForChunks(batchSize, [&](int, int begin, int end) {
+            for (int j = begin; j < end; ++j) {
+                batchLabels[std::size_t(j)] = findNearestCenters(data.row(batch[std::size_t(j)]), centers, k, dims).index;
+            }
+        }, MIN_CHUNK_SIZE);
+        // gradient step with a per-center learning rate of 1 / count:
+        for (int j = 0; j < batchSize; ++j) {
+            const int c = batchLabels[std::size_t(j)];
+            const float learningRate = 1.0f / float(++centerCounts[std::size_t(c)]);
+            float* center = centers.data() + std::size_t(c) * std::size_t(dims);
+            const float* point = data.row(batch[std::size_t(j)]);
+            for (int d = 0; d < dims; ++d) {
+                center[d] += learningRate * (point[d] - center[d]);
+            }
+        }
+        if (onProgress) onProgress(double(iteration + 1) / (iterations + 1));
+    }
+
+    std::vector<int> labels(std::size_t(n), 0);
+    assignToNearest(data, centers, k, labels);
+    if (onProgress) onProgress(1.0);
+    return labels;
+}
+
+std::vector<int> dbscan(const FeatureMatrix& data, float epsilon, int minPoints, const ProgressCallback& onProgress) {
+    const int n = data.rows;
+    const int dims = data.cols;
+    if (n == 0 || dims == 0 || epsilon <= 0.0f) return std::vector<int>(std::size_t(n), NOISE);
+
+    // grid over the first two columns, the cell size equals epsilon
+    // so that all neighbours are within the surrounding 3x3 cells:
+    const int yCol = dims >= 2 ? 1 : 0;
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    for (int i = 0; i < n; ++i) {
+        minX = std::min(minX, data.row(i)[0]);
+        minY = std::min(minY, data.row(i)[yCol]);
+    }
+    auto cellOf = [&](const float* point) {
+        return std::make_pair(qint64((point[0] - minX) / epsilon), qint64((point[yCol] - minY) / epsilon));
+    };
+    auto cellKey = [](qint64 cx, qint64 cy) {
+        return (cy << 32) | (cx & 0xffffffff);
+    };
+
+    std::vector<qint64> keys(static_cast<std::size_t>(n));
+    std::vector<int> sortedPoints(static_cast<std::size_t>(n));
+    std::iota(sortedPoints.begin(), sortedPoints.end(), 0);
+    for (int i = 0; i < n; ++i) {
+        const auto cell = cellOf(data.row(i));
+        keys[std::size_t(i)] = cellKey(cell.first, cell.second);
+    }
+    std::sort(sortedPoints.begin(), sortedPoints.end(), [&keys](int lhs, int rhs) {
+        return keys[std::size_t(lhs)] < keys[std::size_t(rhs)];
+    });
+    // cell key -> range in sortedPoints:
+    std::unordered_map<qint64, std::pair<int, int>> cells;
+    cells.reserve(std::size_t(n));
+    for (int start = 0; start < n;) {
+        const qint64 key = keys[std::size_t(sortedPoints[std::size_t(start)])];
+        int end = start + 1;
+        while (end < n && keys[std::size_t(sortedPoints[std::size_t(end)])] == key) ++end;
+        cells[key] = {start, end};
+        start = end;
+    }
+
+    const float epsilonSquared = epsilon * epsilon;
+    auto forEachNeighbour = [&](int i, auto fn) {
+        const float* point = data.row(i);
+        const auto cell = cellOf(point);
+        for (qint64 cy = cell.second - 1; cy <= cell.second + 1; ++cy) {
+            for (qint64 cx = cell.first - 1; cx <= cell.first + 1; ++cx) {
+                const auto it = cells.find(cellKey(cx, cy));
+                if (it == cells.end()) continue;
+                for (int s = it->second.first; s < it->second.second; ++s) {
+                    const int j = sortedPoints[std::size_t(s)];
+                    if (squaredDistance(point, data.row(j), dims) <= epsilonSquared) {
+                        fn(j);
+                    }
+                }
+            }
+        }
+    };
+
+    // 1. find core points (neighbour count includes the point itself):
+    std::vector<char> isCore(std::size_t(n), 0);
+    parallelForChunks(n, [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            int count = 0;
+            forEachNeighbour(i, [&count](int) { ++count; });
+            isCore[std::size_t(i)] = count >= minPoints;
+        }
+    }, MIN_CHUNK_SIZE);
+    if (onProgress) onProgress(0.5);
+
+    // 2. expand clusters from core points:
+    const int unvisited = -2;
+    std::vector<int> labels(std::size_t(n), unvisited);
+    std::vector<int> queue;
+    int clusterCount = 0;
+    for (int i = 0; i < n; ++i) {
+        if (labels[std::size_t(i)] != unvisited) continue;
+        if (!isCore[std::size_t(i)]) {
+            // may later be relabeled as border point of a cluster
+            labels[std::size_t(i)] = NOISE;
+            continue;
+        }
+        const int cluster = clusterCount++;
+        labels[std::size_t(i)] = cluster;
+        queue.clear();
+        queue.push_back(i);
+        while (!queue.empty()) {
+            const int p = queue.back();
+            queue.pop_back();
+            forEachNeighbour(p, [&](int q) {
+                int& label = labels[std::size_t(q)];
+                if (label == NOISE) {
+                    label = cluster;  // border point
+                } else if (label == unvisited) {
+                    label = cluster;
+                    if (isCore[std::size_t(q)]) {
+                        queue.push_back(q);
+                    }
+                }
+            });
+        }
+        if (onProgress) onProgress(0.5 + 0.5 * double(i) / n);
+    }
+    if (onProgress) onProgress(1.0);
+    return labels;
+}
+
+}  // namespace Clustering
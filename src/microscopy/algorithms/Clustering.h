@@ -0,0 +1,63 @@
+#ifndef CLUSTERING_H
+#define CLUSTERING_H
+
+#include <functional>
+#include <vector>
+
+
+namespace Clustering {
+
+    // label of points that DBSCAN regards as noise
+    const static int NOISE = -1;
+
+    /**
+     * @brief The FeatureMatrix struct stores one row of features per point in a
+     * contiguous row-major float buffer, which is what the distance kernels expect.
+     */
+    struct FeatureMatrix {
+        std::vector<float> values;
+        int rows = 0;
+        int cols = 0;
+
+        FeatureMatrix() = default;
+        FeatureMatrix(int rows, int cols)
+            : values(std::size_t(rows) * std::size_t(cols), 0.0f), rows(rows), cols(cols) {}
+
+        float* row(int i) { return values.data() + std::size_t(i) * std::size_t(cols); }
+        const float* row(int i) const { return values.data() + std::size_t(i) * std::size_t(cols); }
+
+        // scales every column to zero mean and unit variance
+        void standardize();
+    };
+
+    using ProgressCallback = std::function<void(double)>;
+
+    /**
+     * @brief kMeans runs k-means with k-means++ seeding and Lloyd iterations that
+     * skip distance computations using Hamerly's upper / lower bounds (a variant of
+     * Elkan's algorithm with one lower bound per point instead of k).
+     * @return the cluster index for each row
+     */
+    std::vector<int> kMeans(const FeatureMatrix& data, int k, int maxIterations,
+                            unsigned int seed, const ProgressCallback& onProgress = {});
+
+    /**
+     * @brief miniBatchKMeans runs the mini-batch variant by Sculley (2010) that only
+     * looks at a random subset in each iteration, followed by one full assignment pass.
+     * Useful for very large datasets.
+     */
+    std::vector<int> miniBatchKMeans(const FeatureMatrix& data, int k, int batchSize, int iterations,
+                                     unsigned int seed, const ProgressCallback& onProgress = {});
+
+    /**
+     * @brief dbscan runs density based clustering. Neighbourhood queries use a uniform
+     * grid over the first two columns with a cell size of epsilon (ideal for t-SNE space),
+     * the exact distance is then checked on all columns.
+     * @return the cluster index for each row or NOISE
+     */
+    std::vector<int> dbscan(const FeatureMatrix& data, float epsilon, int minPoints,
+                            const ProgressCallback& onProgress = {});
+
+}  // namespace Clustering
+
+#endif // CLUSTERING_H
@@ -0,0 +1,212 @@
+#include "ConnectedComponents.h"
+
+#include "microscopy/algorithms/ParallelFor.h"
+
+#include <algorithm>
+#include <limits>
+
+
+namespace ConnectedComponents {
+
+namespace {
+
+    // the image is labeled in strips of at least this many rows in parallel
+    const static int MIN_STRIP_HEIGHT = 64;
+
+    struct Statistics {
+        qint64 area = 0;
+        qint64 sumX = 0;
+        qint64 sumY = 0;
+        int left = std::numeric_limits<int>::max();
+        int top = std::numeric_limits<int>::max();
+        int right = -1;
+        int bottom = -1;
+
+        void add(int x, int y) {
+            area += 1;
+            sumX += x;
+            sumY += y;
+            left = std::min(left, x);
+            top = std::min(top, y);
+            right = std::max(right, x);
+            bottom = std::max(bottom, y);
+        }
+
+        void merge(const Statistics& other) {
+            area += other.area;
+            sumX += other.sumX;
+            sumY += other.sumY;
+            left = std::min(left, other.left);
+            top = std::min(top, other.top);
+            right = std::max(right, other.right);
+            bottom = std::max(bottom, other.bottom);
+        }
+    };
+
+    int root(std::vector<int>& parents, int label) {
+        while (parents[std::size_t(label)] != label) {
+            // path halving:
+            parents[std::size_t(label)] = parents[std::size_t(parents[std::size_t(label)])];
+            label = parents[std::size_t(label)];
+        }
+        return label;
+    }
+
+    void unite(std::vector<int>& parents, int a, int b) {
+        a = root(parents, a);
+        b = root(parents, b);
+        // the smaller label is the root, so that the components keep the order of their first pixel:
+        if (a < b) {
+            parents[std::size_t(b)] = a;
+        } else if (b < a) {
+            parents[std::size_t(a)] = b;
+        }
+    }
+
+    int channelValue(QRgb pixel, Channel channel) {
+        switch (channel) {
+        case Channel::Red: return qRed(pixel);
+        case Channel::Green: return qGreen(pixel);
+        case Channel::Blue: return qBlue(pixel);
+        }
+        return 0;
+    }
+
+}  // namespace
+
+
+std::vector<Component> find(const std::vector<uchar>& mask, int width, int height) {
+    if (width <= 0 || height <= 0 || mask.size() < std::size_t(width) * std::size_t(height)) return {};
+
+    // first pass per strip: provisional labels (0 is background, starting at 1 in each strip)
+    // and their equivalences
+    const int stripCount = parallelChunkCount(height, MIN_STRIP_HEIGHT);
+    std::vector<int> labels(std::size_t(width) * std::size_t(height), 0);
+    std::vector<std::vector<int>> stripParents(static_cast<std::size_t>(stripCount));
+    std::vector<int> stripBegin(std::size_t(stripCount), 0);
+    parallelForChunks(height, [&](int strip, int begin, int end) {
+        std::vector<int>& parents = stripParents[std::size_t(strip)];
+        parents = {0};
+        stripBegin[std::size_t(strip)] = begin;
+        for (int y = begin; y < end; ++y) {
+            const uchar* line = mask.data() + std::size_t(y) * std::size_t(width);
+            int* row = labels.data() + std::size_t(y) * std::size_t(width);
+            const int* previousRow = y > begin ? row - width : nullptr;
+            for (int x = 0; x < width; ++x) {
+                if (line[x] == 0) continue;
+                int label = 0;
+                auto join = [&](int neighbor) {
+                    if (neighbor == 0) return;
+                    if (label == 0) {
+                        label = neighbor;
+                    } else {
+                        unite(parents, label, neighbor);
+                    }
+                };
+                if (x > 0) join(row[x - 1]);
+                if (previousRow) {
+                    if (x > 0) join(previousRow[x - 1]);
+                    join(previousRow[x]);
+                    if (x + 1 < width) join(previousRow[x + 1]);
+                }
+                if (label == 0) {
+                    label = int(parents.size());
+                    parents.push_back(label);
+                }
+                row[x] = label;
+            }
+        }
+    }, MIN_STRIP_HEIGHT);
+
+    // the labels of the strips are made unique by adding the label count of the previous strips,
+    // so that they are still in the order of their first pixel:
+    std::vector<int> stripOffset(std::size_t(stripCount), 0);
+    std::vector<int> parents = {0};
+    for (int strip = 0; strip < stripCount; ++strip) {
+        const std::vector<int>& localParents = stripParents[std::size_t(strip)];
+        const int offset = int(parents.size()) - 1;
+        stripOffset[std::size_t(strip)] = offset;
+        for (std::size_t label = 1; label < localParents.size(); ++label) {
+            parents.push_back(localParents[label] + offset);
+        }
+    }
+    stripParents.clear();
+    parallelForChunks(height, [&](int strip, int begin, int end) {
+        const int offset = stripOffset[std::size_t(strip)];
+        if (offset == 0) return;
+        int* row = labels.data() + std::size_t(begin) * std::size_t(width);
+        for (std::size_t i = 0; i < std::size_t(end - begin) * std::size_t(width); ++i) {
+            if (row[i] != 0) row[i] += offset;
+        }
+    }, MIN_STRIP_HEIGHT);
+
+    // merge the components touching at the borders of the strips:
+    for (int strip = 1; strip < stripCount; ++strip) {
+        const int y = stripBegin[std::size_t(strip)];
+        const int* row = labels.data() + std::size_t(y) * std::size_t(width);
+        const int* previousRow = row - width;
+        for (int x = 0; x < width; ++x) {
+            if (row[x] == 0) continue;
+            if (x > 0 && previousRow[x - 1] != 0) unite(parents, row[x], previousRow[x - 1]);
+            if (previousRow[x] != 0) unite(parents, row[x], previousRow[x]);
+            if (x + 1 < width && previousRow[x + 1] != 0) unite(parents, row[x], previousRow[x + 1]);
+        }
+    }
+
+    // resolve the equivalences to consecutive component indices:
+    std::vector<int> componentIndex(parents.size(), -1);
+    int componentCount = 0;
+    for (int label = 1; label < int(parents.size()); ++label) {
+        const int rootLabel = root(parents, label);
+        if (componentIndex[std::size_t(rootLabel)] < 0) {
+            componentIndex[std::size_t(rootLabel)] = componentCount++;
+        }
+        componentIndex[std::size_t(label)] = componentIndex[std::size_t(rootLabel)];
+    }
+
+    // second pass per strip: statistics of the provisional labels of the strip
+    // (there are only as many of them as labels in total), then combined per component
+    std::vector<Statistics> labelStatistics(parents.size());
+    parallelForChunks(height, [&](int, int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const int* row = labels.data() + std::size_t(y) * std::size_t(width);
+            for (int x = 0; x < width; ++x) {
+                if (row[x] == 0) continue;
+                labelStatistics[std::size_t(row[x])].add(x, y);
+            }
+        }
+    }, MIN_STRIP_HEIGHT);
+    std::vector<Statistics> statistics(static_cast<std::size_t>(componentCount));
+    for (std::size_t label = 1; label < labelStatistics.size(); ++label) {
+        statistics[std::size_t(componentIndex[label])].merge(labelStatistics[label]);
+    }
+
+    std::vector<Component> components(statistics.size());
+    for (std::size_t i = 0; i < components.size(); ++i) {
+        const Statistics& stats = statistics[i];
+        components[i].area = int(stats.area);
+        components[i].x = double(stats.sumX) / stats.area;
+        components[i].y = double(stats.sumY) / stats.area;
+        components[i].bounds = QRect(QPoint(stats.left, stats.top), QPoint(stats.right, stats.bottom));
+    }
+    return components;
+}
+
+std::vector<Component> find(const QImage& image, Channel channel, int threshold) {
+    const QImage rgbImage = image.convertToFormat(QImage::Format_RGB32);
+    const int width = rgbImage.width();
+    const int height = rgbImage.height();
+    std::vector<uchar> mask(std::size_t(width) * std::size_t(height), 0);
+    parallelForChunks(height, [&](int, int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(rgbImage.constScanLine(y));
+            uchar* maskLine = mask.data() + std::size_t(y) * std::size_t(width);
+            for (int x = 0; x < width; ++x) {
+                maskLine[x] = channelValue(line[x], channel) > threshold ? 1 : 0;
+            }
+        }
+    }, MIN_STRIP_HEIGHT);
+    return find(mask, width, height);
+}
+
+}  // namespace ConnectedComponents
@@ -0,0 +1,36 @@
+#ifndef CONNECTEDCOMPONENTS_H
+#define CONNECTEDCOMPONENTS_H
+
+#include <QImage>
+#include <QRect>
+
+#include <vector>
+
+
+namespace ConnectedComponents {
+
+    enum class Channel { Red, Green, Blue };
+
+    struct Component {
+        double x = 0.0;  // centroid
+        double y = 0.0;
+        int area = 0;  // in pixels
+        QRect bounds;  // bounding box
+    };
+
+    /**
+     * @brief find returns the 8-connected components of the non-zero pixels of the mask
+     * (width x height, row by row), in the order of their first pixel (row by row).
+     * This is equivalent to cv2.connectedComponentsWithStats() used by the server.
+     *
+     * The image is labeled in strips of rows in parallel, the labels of neighbouring strips
+     * are merged with union-find afterwards. The result doesn't depend on the number of threads.
+     */
+    std::vector<Component> find(const std::vector<uchar>& mask, int width, int height);
+
+    // the components of the pixels whose value in the given channel is larger than threshold
+    std::vector<Component> find(const QImage& image, Channel channel, int threshold = 127);
+
+}  // namespace ConnectedComponents
+
+#endif // CONNECTEDCOMPONENTS_H
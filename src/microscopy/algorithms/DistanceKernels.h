@@ -0,0 +1,49 @@
+#ifndef DISTANCEKERNELS_H
+#define DISTANCEKERNELS_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MICROSCOPY_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MICROSCOPY_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+
+/**
+ * @brief squaredDistance computes the squared euclidean distance of two float vectors.
+ * Uses 4-wide SSE2 or NEON lanes where available (both are part of the baseline
+ * of the x86_64 and arm64 targets, so no runtime dispatch is needed) and a scalar tail.
+ */
+inline float squaredDistance(const float* a, const float* b, int dims) {
+    int d = 0;
+    float sum = 0.0f;
+#if defined(MICROSCOPY_SIMD_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (; d + 4 <= dims; d += 4) {
+        const __m128 diff = _mm_sub_ps(_mm_loadu_ps(a + d), _mm_loadu_ps(b + d));
+        acc = _mm_add_ps(acc, _mm_mul_ps(diff, diff));
+    }
+    // horizontal add of the four lanes:
+    __m128 shuffled = _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1));
+    acc = _mm_add_ps(acc, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, acc);
+    acc = _mm_add_ss(acc, shuffled);
+    sum = _mm_cvtss_f32(acc);
+#elif defined(MICROSCOPY_SIMD_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; d + 4 <= dims; d += 4) {
+        const float32x4_t diff = vsubq_f32(vld1q_f32(a + d), vld1q_f32(b + d));
+        acc = vmlaq_f32(acc, diff, diff);
+    }
+    sum = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1)
+            + vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3);
+#endif
+    for (; d < dims; ++d) {
+        const float diff = a[d] - b[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+#endif // DISTANCEKERNELS_H
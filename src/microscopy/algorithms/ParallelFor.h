@@ -0,0 +1,59 @@
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <QThread>
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+
+/**
+ * @brief parallelChunkCount returns the number of chunks parallelForChunks() will use
+ * for the given count, so that per-chunk accumulators can be allocated up-front.
+ */
+inline int parallelChunkCount(int count, int minChunkSize = 512) {
+    if (count <= 0) return 0;
+    int chunkCount = 1;
+#ifdef THREADS_ENABLED
+    const int threads = std::max(1, QThread::idealThreadCount());
+    chunkCount = std::max(1, std::min(threads * 4, count / std::max(1, minChunkSize)));
+#else
+    Q_UNUSED(minChunkSize)
+#endif
+    const int chunkSize = (count + chunkCount - 1) / chunkCount;
+    return (count + chunkSize - 1) / chunkSize;
+}
+
+/**
+ * @brief parallelForChunks splits the range [0, count) into chunks and calls
+ * fn(chunkIndex, begin, end) for each of them using the global thread pool.
+ * Falls back to a single chunk if threads are not available.
+ * The calling thread participates, so it is safe to call this from a pool thread.
+ * @return the number of chunks that were used
+ */
+template<typename Fn>
+inline int parallelForChunks(int count, Fn fn, int minChunkSize = 512) {
+    const int chunkCount = parallelChunkCount(count, minChunkSize);
+    if (chunkCount == 0) return 0;
+    if (chunkCount == 1) {
+        fn(0, 0, count);
+        return 1;
+    }
+#ifdef THREADS_ENABLED
+    const int chunkSize = (count + chunkCount - 1) / chunkCount;
+    std::vector<int> chunks(std::size_t(chunkCount), 0);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    QtConcurrent::blockingMap(chunks, [&fn, chunkSize, count](const int& chunk) {
+        const int begin = chunk * chunkSize;
+        fn(chunk, begin, std::min(begin + chunkSize, count));
+    });
+#endif
+    return chunkCount;
+}
+
+#endif // PARALLELFOR_H
@@ -0,0 +1,159 @@
+#include "PatchAugmentation.h"
+
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace PatchAugmentation {
+
+namespace {
+
+    // the texel values are stored in an 8 bit buffer (the ShaderEffectSource) before they are sampled
+    quint8 toByte(float value) {
+        return quint8(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+    }
+
+    // rand() of input_preprocessing_shader.frag
+    float shaderRandom(float x, float y) {
+        const float value = std::sin(x * 12.9898f + y * 78.233f) * 43758.5453f;
+        return value - std::floor(value);
+    }
+
+}  // namespace
+
+
+Parameters randomParameters(std::mt19937& random, double maxNoise, double maxBrightnessChange) {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    Parameters parameters;
+    parameters.xOffset = uniform(random);
+    parameters.yOffset = uniform(random);
+    parameters.rotation = uniform(random);
+    parameters.noise = uniform(random) * 0.6 * maxNoise;
+    parameters.brightness = 1 - (uniform(random) * 1.3 - 0.3) * maxBrightnessChange;
+    return parameters;
+}
+
+Renderer::Renderer(const std::array<ChannelSource, 3>& inputs, const std::array<ChannelSource, 3>& targets, QRect area)
+    : m_area(area)
+{
+    for (int i = 0; i < 3; ++i) {
+        m_inputs[std::size_t(i)] = createChannel(inputs[std::size_t(i)], i);
+        m_targets[std::size_t(i)] = createChannel(targets[std::size_t(i)], i);
+        // the shader effects of inputs and targets have the size of the largest input image:
+        m_canvasSize = m_canvasSize.expandedTo(inputs[std::size_t(i)].image.size());
+    }
+}
+
+QImage Renderer::renderInput(const Parameters& parameters) const {
+    return render(m_inputs, parameters, /*augment*/ true);
+}
+
+QImage Renderer::renderTarget(const Parameters& parameters) const {
+    return render(m_targets, parameters, /*augment*/ false);
+}
+
+Renderer::Channel Renderer::createChannel(const ChannelSource& source, int channel) const {
+    Channel result;
+    result.channel = channel;
+    if (source.image.isNull()) return result;
+    // the format of textures, the premultiplied values are used by the shaders:
+    result.image = source.image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    result.interpretAs16Bit = source.interpretAs16Bit;
+    if (source.image.format() == QImage::Format_Grayscale16) {
+        // a channel of an image stack, the view shows it with the MSB in red and the LSB in green:
+        for (int y = 0; y < source.image.height(); ++y) {
+            const quint16* s = reinterpret_cast<const quint16*>(source.image.constScanLine(y));
+            QRgb* t = reinterpret_cast<QRgb*>(result.image.scanLine(y));
+            for (int x = 0; x < source.image.width(); ++x) {
+                t[x] = qRgba(s[x] / 256, s[x] % 256, 0, 255);
+            }
+        }
+        result.interpretAs16Bit = true;
+    }
+
+    // rgb8_tissue_shader_alpha_blended.frag and grayscale16_tissue_shader_alpha_blended.frag:
+    const float range = std::max(source.whiteLevel - source.blackLevel, 1e-6f);
+    const float factor = source.color[std::size_t(channel)] * source.opacity;
+    result.lookupTable.resize(source.interpretAs16Bit ? 256 * 256 : 256);
+    for (int i = 0; i < int(result.lookupTable.size()); ++i) {
+        const float texel = source.interpretAs16Bit ? (i / 256) / 255.0f + (i % 256) / 255.0f / 256.0f : i / 255.0f;
+        const float value = std::pow(std::max((texel - source.blackLevel) / range, 0.0f), source.gamma);
+        result.lookupTable[std::size_t(i)] = toByte(value * factor);
+    }
+    return result;
+}
+
+float Renderer::sample(const Channel& channel, float x, float y) const {
+    auto texel = [&channel, this](int tx, int ty) -> int {
+        // clamped to the edge of the buffer, which is transparent outside of the image:
+        tx = std::min(std::max(tx, 0), m_canvasSize.width() - 1);
+        ty = std::min(std::max(ty, 0), m_canvasSize.height() - 1);
+        if (tx >= channel.image.width() || ty >= channel.image.height()) return 0;
+        const QRgb pixel = reinterpret_cast<const QRgb*>(channel.image.constScanLine(ty))[tx];
+        if (channel.interpretAs16Bit) {
+            return channel.lookupTable[std::size_t(qRed(pixel) * 256 + qGreen(pixel))];
+        }
+        const int value = channel.channel == 0 ? qRed(pixel) : (channel.channel == 1 ? qGreen(pixel) : qBlue(pixel));
+        return channel.lookupTable[std::size_t(value)];
+    };
+    // bilinear filtering, texel centers are at .5:
+    const float u = x - 0.5f;
+    const float v = y - 0.5f;
+    const int x0 = int(std::floor(u));
+    const int y0 = int(std::floor(v));
+    const float fx = u - x0;
+    const float fy = v - y0;
+    const float top = texel(x0, y0) * (1.0f - fx) + texel(x0 + 1, y0) * fx;
+    const float bottom = texel(x0, y0 + 1) * (1.0f - fx) + texel(x0 + 1, y0 + 1) * fx;
+    return (top * (1.0f - fy) + bottom * fy) / 255.0f;
+}
+
+QImage Renderer::render(const std::array<Channel, 3>& channels, const Parameters& parameters, bool augment) const {
+    QImage result(PATCH_SIZE, PATCH_SIZE, QImage::Format_RGB32);
+    const int width = m_canvasSize.width();
+    const int height = m_canvasSize.height();
+    // position of the shader effect relative to the patch, see InputDataPreprocessing.qml:
+    const double left = m_area.x() + (std::min(m_area.width(), width) - PATCH_SIZE) * parameters.xOffset;
+    const double top = m_area.y() + (std::min(m_area.height(), height) - PATCH_SIZE) * parameters.yOffset;
+    // the shader effect is rotated clockwise around the center of the patch,
+    // the inverse rotation maps the patch pixels to the canvas:
+    const double angle = parameters.rotation * 2.0 * M_PI;
+    const double cosine = std::cos(angle);
+    const double sine = std::sin(angle);
+    const double center = PATCH_SIZE / 2.0;
+    const float noise = float(parameters.noise);
+    const float brightness = float(parameters.brightness);
+
+    for (int py = 0; py < PATCH_SIZE; ++py) {
+        QRgb* line = reinterpret_cast<QRgb*>(result.scanLine(py));
+        const double dy = py + 0.5 - center;
+        for (int px = 0; px < PATCH_SIZE; ++px) {
+            const double dx = px + 0.5 - center;
+            const float x = float(left + center + cosine * dx + sine * dy);
+            const float y = float(top + center - sine * dx + cosine * dy);
+            if (x < 0.0f || y < 0.0f || x >= width || y >= height) {
+                // outside of the shader effect, the black background is visible
+                line[px] = qRgb(0, 0, 0);
+                continue;
+            }
+            float rgb[3];
+            for (int i = 0; i < 3; ++i) {
+                const Channel& channel = channels[std::size_t(i)];
+                rgb[i] = channel.image.isNull() ? 0.0f : sample(channel, x, y);
+            }
+            if (augment) {
+                // input_preprocessing_shader.frag, the texture coordinate is relative to the shader effect:
+                const float random = shaderRandom(x / width, y / height) * noise;
+                for (float& value: rgb) {
+                    value = value * brightness + random;
+                }
+            }
+            line[px] = qRgb(toByte(rgb[0]), toByte(rgb[1]), toByte(rgb[2]));
+        }
+    }
+    return result;
+}
+
+}  // namespace PatchAugmentation
@@ -0,0 +1,81 @@
+#ifndef PATCHAUGMENTATION_H
+#define PATCHAUGMENTATION_H
+
+#include <QImage>
+#include <QRect>
+
+#include <array>
+#include <random>
+#include <vector>
+
+
+namespace PatchAugmentation {
+
+    // size of the training patches, the same as in TrainingDataPreprocessingBlock.qml
+    const static int PATCH_SIZE = 256;
+
+    // the display settings of a TissueImageBlock, applied like in TissueChannelUi.qml
+    struct ChannelSource {
+        QImage image;  // 16 bit images with the MSB in red and the LSB in green (see TissueImageBlock)
+        bool interpretAs16Bit = false;
+        float blackLevel = 0.0f;  // already squared like in TissueChannelUi.qml
+        float whiteLevel = 1.0f;
+        float gamma = 1.0f;
+        std::array<float, 3> color = {{1.0f, 1.0f, 1.0f}};
+        float opacity = 1.0f;
+    };
+
+    struct Parameters {
+        double xOffset = 0.5;  // position of the patch in the area, 0.0 to 1.0
+        double yOffset = 0.5;
+        double rotation = 0.0;  // in turns
+        double noise = 0.0;
+        double brightness = 1.0;
+    };
+
+    // the same distribution as setNewRandomValues() in TrainingDataPreprocessingBlock.qml
+    Parameters randomParameters(std::mt19937& random, double maxNoise, double maxBrightnessChange);
+
+    /**
+     * @brief The Renderer class creates the augmented input and target patches on the CPU,
+     * the same way InputDataPreprocessing.qml and TargetDataPreprocessing.qml render them
+     * with shaders: each source is rendered with its display settings into an 8 bit buffer,
+     * which is then sampled bilinearly at the rotated patch position. The noise uses the
+     * same hash function as input_preprocessing_shader.frag.
+     * The results only differ from the GPU in rounding and the precision of sin().
+     *
+     * All methods are const and can be called from several threads at the same time.
+     */
+    class Renderer {
+
+    public:
+        // channel i of the input (red, green, blue) is taken from the same channel of inputs[i],
+        // the same for the targets, sources with a null image are black
+        Renderer(const std::array<ChannelSource, 3>& inputs, const std::array<ChannelSource, 3>& targets, QRect area);
+
+        QImage renderInput(const Parameters& parameters) const;
+        QImage renderTarget(const Parameters& parameters) const;
+
+    protected:
+        struct Channel {
+            QImage image;
+            int channel = 0;  // 0: red, 1: green, 2: blue
+            bool interpretAs16Bit = false;
+            // display settings of every possible texel value, as stored in the 8 bit buffer:
+            std::vector<quint8> lookupTable;
+        };
+
+        Channel createChannel(const ChannelSource& source, int channel) const;
+        float sample(const Channel& channel, float x, float y) const;
+        QImage render(const std::array<Channel, 3>& channels, const Parameters& parameters, bool augment) const;
+
+    protected:
+        std::array<Channel, 3> m_inputs;
+        std::array<Channel, 3> m_targets;
+        QSize m_canvasSize;  // the size of the shader effects, i.e. of the largest input image
+        QRect m_area;
+    };
+
+}  // namespace PatchAugmentation
+
+#endif // PATCHAUGMENTATION_H
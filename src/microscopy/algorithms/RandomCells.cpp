@@ -0,0 +1,247 @@
+#include "RandomCells.h"
+
+#include "microscopy/algorithms/ParallelFor.h"
+
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+
+namespace RandomCells {
+
+namespace {
+
+    // the area is filled in tiles of about this size in pixels
+    const static float TILE_SIZE = 256.0f;
+    // more grid cells would only cost memory, the grid cells are larger in that case
+    const static int MAX_GRID_SIZE = 4096;
+    // how often a position is tried for a cell before it is skipped
+    const static int MAX_ATTEMPTS = 30;
+
+    struct Cell {
+        float x;
+        float y;
+        float radius;
+        bool elongated;
+        Shape shape;
+    };
+
+    struct Placed {
+        float x;
+        float y;
+        float radius;
+    };
+
+    // from https://math.stackexchange.com/a/432907 with a = 1 and b = ellipseFactor
+    Shape ellipseShape(std::mt19937& random, float ellipseFactor, float rotation, float angleFactor) {
+        std::uniform_real_distribution<float> roughnessDist(0.9f, 1.0f);
+        Shape shape;
+        for (std::size_t j = 0; j < SHAPE_RADII; ++j) {
+            const float pos = j / float(SHAPE_RADII - 1);
+            const float angle = (rotation + pos) * float(M_PI) * 2 * angleFactor;
+            const float ellipseRadius = ellipseFactor / std::sqrt(std::pow(std::sin(angle), 2.0f) + std::pow(ellipseFactor, 2.0f) * std::pow(std::cos(angle), 2.0f));
+            shape[j] = ellipseRadius * roughnessDist(random);
+        }
+        return shape;
+    }
+
+    // the example shape rotated by a random number of steps, with some roughness
+    Shape exampleShape(std::mt19937& random, const Example& example) {
+        std::uniform_int_distribution<int> rotationDist(0, SHAPE_RADII - 1);
+        std::uniform_real_distribution<float> roughnessDist(0.9f, 1.0f);
+        const std::size_t rotation = std::size_t(rotationDist(random));
+        Shape shape;
+        for (std::size_t j = 0; j < SHAPE_RADII; ++j) {
+            shape[j] = example.shape[(j + rotation) % SHAPE_RADII] * roughnessDist(random);
+        }
+        return shape;
+    }
+
+    bool isElongated(const Shape& shape) {
+        const auto minMax = std::minmax_element(shape.begin(), shape.end());
+        return *minMax.first < *minMax.second * 0.5f;
+    }
+
+    // draws the radius and shape of a cell and of its twins
+    struct CellGenerator {
+        const Parameters& parameters;
+        const std::vector<Example>& examples;
+
+        Cell cell(std::mt19937& random, std::size_t& example, float& ellipseFactor, float& rotation) const {
+            Cell cell;
+            if (!examples.empty()) {
+                std::uniform_int_distribution<std::size_t> exampleDist(0, examples.size() - 1);
+                std::uniform_real_distribution<float> sizeDist(0.9f, 1.1f);
+                example = exampleDist(random);
+                cell.radius = examples[example].radius * sizeDist(random);
+                cell.shape = exampleShape(random, examples[example]);
+                cell.elongated = isElongated(cell.shape);
+                return cell;
+            }
+            std::uniform_real_distribution<float> sizeDist(std::min(parameters.minRadius, parameters.maxRadius),
+                                                           std::max(parameters.minRadius, parameters.maxRadius));
+            std::uniform_real_distribution<float> roundEllipseDist(0.7f, 1.0f);
+            std::uniform_real_distribution<float> elongatedEllipseDist(0.17f, 0.4f);
+            std::uniform_real_distribution<float> normDist(0.0f, 1.0f);
+            cell.elongated = normDist(random) < parameters.elongated;
+            cell.radius = cell.elongated ? sizeDist(random) * 1.3f : sizeDist(random);
+            ellipseFactor = cell.elongated ? elongatedEllipseDist(random) : roundEllipseDist(random);
+            rotation = normDist(random);
+            cell.shape = ellipseShape(random, ellipseFactor, rotation, 1.0f);
+            return cell;
+        }
+
+        Cell twin(std::mt19937& random, const Cell& cell, std::size_t example, float ellipseFactor, float rotation, float offset) const {
+            Cell twin = cell;
+            if (!examples.empty()) {
+                twin.shape = exampleShape(random, examples[example]);
+            } else {
+                twin.shape = ellipseShape(random, ellipseFactor, rotation, offset);
+            }
+            return twin;
+        }
+
+        // the largest radius a cell can have
+        float maxRadius() const {
+            if (examples.empty()) return std::max(parameters.minRadius, parameters.maxRadius) * 1.3f;
+            float maxRadius = 0.0f;
+            for (const Example& example: examples) {
+                maxRadius = std::max(maxRadius, example.radius);
+            }
+            return maxRadius * 1.1f;
+        }
+    };
+
+}  // namespace
+
+
+Cells generate(const Parameters& parameters, const std::vector<Example>& examples) {
+    const float areaSize = parameters.areaSize;
+    if (parameters.count <= 0 || areaSize <= 0.0f) return {};
+    const float overlap = std::min(std::max(parameters.overlap, 0.0f), 1.0f);
+    const CellGenerator generator{parameters, examples};
+
+    // two cells can only collide if they are in neighbouring grid cells:
+    const float gridCellSize = std::max({1.0f, 2.0f * generator.maxRadius() * (1.0f - overlap), areaSize / MAX_GRID_SIZE});
+    const int gridSize = int(std::ceil(areaSize / gridCellSize));
+    std::vector<std::vector<Placed>> grid(std::size_t(gridSize * gridSize));
+    // the tiles consist of whole grid cells, each grid cell is only written by the tile it belongs to:
+    const int tileCells = std::max(1, int(TILE_SIZE / gridCellSize));
+    const int tileCount = (gridSize + tileCells - 1) / tileCells;
+    const float tilePixels = tileCells * gridCellSize;
+    std::vector<std::vector<Cell>> tileResults(std::size_t(tileCount * tileCount));
+
+    auto fits = [&](float x, float y, float radius) {
+        const int gx = int(x / gridCellSize);
+        const int gy = int(y / gridCellSize);
+        for (int cy = std::max(0, gy - 1); cy <= std::min(gridSize - 1, gy + 1); ++cy) {
+            for (int cx = std::max(0, gx - 1); cx <= std::min(gridSize - 1, gx + 1); ++cx) {
+                for (const Placed& other: grid[std::size_t(cy * gridSize + cx)]) {
+                    const float minDistance = (radius + other.radius) * (1.0f - overlap);
+                    const float dx = x - other.x;
+                    const float dy = y - other.y;
+                    if (dx * dx + dy * dy < minDistance * minDistance) return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    auto fillTile = [&](int tileX, int tileY) {
+        const int tileIndex = tileY * tileCount + tileX;
+        std::vector<Cell>& result = tileResults[std::size_t(tileIndex)];
+        const float left = tileX * tilePixels;
+        const float top = tileY * tilePixels;
+        const float right = std::min(areaSize, left + tilePixels);
+        const float bottom = std::min(areaSize, top + tilePixels);
+        // grid cells of this tile:
+        const int firstColumn = tileX * tileCells;
+        const int lastColumn = std::min(gridSize, firstColumn + tileCells) - 1;
+        const int firstRow = tileY * tileCells;
+        const int lastRow = std::min(gridSize, firstRow + tileCells) - 1;
+
+        std::seed_seq seedSequence{parameters.seed, quint32(tileIndex)};
+        std::mt19937 random(seedSequence);
+        std::uniform_real_distribution<float> xDist(left, right);
+        std::uniform_real_distribution<float> yDist(top, bottom);
+        std::uniform_real_distribution<float> normDist(0.0f, 1.0f);
+        std::uniform_int_distribution<int> twinDist(0, std::max(0, parameters.maxTwins));
+        std::uniform_real_distribution<float> twinOffsetDist(0.9f, 1.3f);
+
+        auto add = [&](const Cell& cell) {
+            const int gx = std::min(std::max(int(cell.x / gridCellSize), firstColumn), lastColumn);
+            const int gy = std::min(std::max(int(cell.y / gridCellSize), firstRow), lastRow);
+            grid[std::size_t(gy * gridSize + gx)].push_back({cell.x, cell.y, cell.radius});
+            result.push_back(cell);
+        };
+
+        const double expectedCount = double(parameters.count) * double(right - left) * double(bottom - top) / double(areaSize * areaSize);
+        const int count = int(expectedCount) + (normDist(random) < expectedCount - std::floor(expectedCount) ? 1 : 0);
+        for (int i = 0; i < count; ++i) {
+            std::size_t example = 0;
+            float ellipseFactor = 1.0f;
+            float rotation = 0.0f;
+            Cell cell = generator.cell(random, example, ellipseFactor, rotation);
+            bool placed = false;
+            for (int attempt = 0; attempt < MAX_ATTEMPTS && !placed; ++attempt) {
+                cell.x = xDist(random);
+                cell.y = yDist(random);
+                placed = fits(cell.x, cell.y, cell.radius);
+            }
+            if (!placed) continue;
+            add(cell);
+
+            const int twinCount = twinDist(random);
+            for (int j = 0; j < twinCount; ++j) {
+                const float twinAngle = normDist(random) * float(M_PI) * 2;
+                const float offset = twinOffsetDist(random);
+                Cell twin = generator.twin(random, cell, example, ellipseFactor, rotation, offset);
+                twin.x = cell.x + std::cos(twinAngle) * cell.radius * 2 * offset;
+                twin.y = cell.y + std::sin(twinAngle) * cell.radius * 2 * offset;
+                // twins outside of the tile would write to the grid of another tile:
+                if (twin.x < left || twin.x >= right || twin.y < top || twin.y >= bottom) continue;
+                if (!fits(twin.x, twin.y, twin.radius)) continue;
+                add(twin);
+            }
+        }
+    };
+
+    // tiles of the same phase are not adjacent, so that they only read grid cells of
+    // their own or of tiles of previous phases:
+    for (int phase = 0; phase < 4; ++phase) {
+        std::vector<int> tiles;
+        for (int tileY = phase / 2; tileY < tileCount; tileY += 2) {
+            for (int tileX = phase % 2; tileX < tileCount; tileX += 2) {
+                tiles.push_back(tileY * tileCount + tileX);
+            }
+        }
+        parallelForChunks(int(tiles.size()), [&](int, int first, int end) {
+            for (int i = first; i < end; ++i) {
+                fillTile(tiles[std::size_t(i)] % tileCount, tiles[std::size_t(i)] / tileCount);
+            }
+        }, /*minChunkSize*/ 1);
+    }
+
+    Cells cells;
+    std::size_t total = 0;
+    for (const auto& tile: tileResults) total += tile.size();
+    cells.x.reserve(total);
+    cells.y.reserve(total);
+    cells.radius.reserve(total);
+    cells.elongated.reserve(total);
+    cells.shapes.reserve(total);
+    for (const auto& tile: tileResults) {
+        for (const Cell& cell: tile) {
+            cells.x.push_back(cell.x);
+            cells.y.push_back(cell.y);
+            cells.radius.push_back(cell.radius);
+            cells.elongated.push_back(cell.elongated ? 1 : 0);
+            cells.shapes.push_back(cell.shape);
+        }
+    }
+    return cells;
+}
+
+}  // namespace RandomCells
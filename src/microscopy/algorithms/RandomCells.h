@@ -0,0 +1,57 @@
+#ifndef RANDOMCELLS_H
+#define RANDOMCELLS_H
+
+#include <QtGlobal>
+
+#include <array>
+#include <vector>
+
+
+namespace RandomCells {
+
+    // has to be equal to CellDatabaseConstants::RADII_COUNT
+    const static int SHAPE_RADII = 24;
+    using Shape = std::array<float, SHAPE_RADII>;
+
+    // a cell of the examples dataset, its shape is normalized to a maximum of 1.0
+    struct Example {
+        float radius = 0.0f;
+        Shape shape;
+    };
+
+    struct Parameters {
+        float areaSize = 2000.0f;  // the cells are created in the square from 0 to areaSize
+        int count = 0;  // number of cells without twins, less if not enough fit into the area
+        float minRadius = 5.0f;  // only used without examples
+        float maxRadius = 25.0f;
+        int maxTwins = 2;
+        float elongated = 0.3f;  // ratio of elongated cells, only used without examples
+        // relative to the sum of the radii of two cells, 0.0 means no overlap, 1.0 any overlap
+        float overlap = 0.1f;
+        quint32 seed = 0;
+    };
+
+    // the generated cells as columns:
+    struct Cells {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> radius;
+        std::vector<char> elongated;
+        std::vector<Shape> shapes;
+
+        int size() const { return int(x.size()); }
+    };
+
+    /**
+     * @brief generate places the cells with Poisson-disk sampling (dart throwing with rejection
+     * of overlapping cells) on a uniform grid. The area is split into tiles that are filled in
+     * four phases, so that tiles of the same phase can be processed in parallel without touching
+     * each other. Each tile has its own random generator seeded from Parameters::seed and the
+     * tile index, so that the result only depends on the seed and not on the number of threads.
+     * If examples are given, the shapes and radii are drawn from them (randomly rotated).
+     */
+    Cells generate(const Parameters& parameters, const std::vector<Example>& examples);
+
+}  // namespace RandomCells
+
+#endif // RANDOMCELLS_H
@@ -0,0 +1,268 @@
+#include "SegmentationMetrics.h"
+
+#include "microscopy/algorithms/ParallelFor.h"
+#include "microscopy/algorithms/SpatialGrid.h"
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+namespace SegmentationMetrics {
+
+namespace {
+
+    // reference cells are grouped into square tiles of this size before they are
+    // distributed to the threads, so that each thread works on a compact area
+    const int TILE_SIZE = 256;
+
+    const float ANGLE_STEP = float(2 * M_PI) / OUTLINE_RADII;
+
+    using Vertices = std::array<std::pair<float, float>, OUTLINE_RADII>;
+
+    Vertices vertices(const Outline& outline) {
+        Vertices result;
+        for (int k = 0; k < OUTLINE_RADII; ++k) {
+            const float length = outline.shape[std::size_t(k)] * outline.radius;
+            result[std::size_t(k)] = {outline.x + std::sin(k * ANGLE_STEP) * length,
+                                      outline.y + std::cos(k * ANGLE_STEP) * length};
+        }
+        return result;
+    }
+
+    double iou(int intersection, int areaA, int areaB) {
+        const int unionArea = areaA + areaB - intersection;
+        return unionArea > 0 ? double(intersection) / unionArea : 0.0;
+    }
+
+}  // namespace
+
+
+float extent(const Outline& outline) {
+    return outline.radius * std::max(1.0f, *std::max_element(outline.shape.begin(), outline.shape.end()));
+}
+
+Mask rasterize(const Outline& outline) {
+    Mask mask;
+    if (outline.radius <= 0.0f) return mask;
+    const Vertices polygon = vertices(outline);
+    const float e = extent(outline);
+    const int top = int(std::ceil(outline.y - e));
+    const int bottom = int(std::floor(outline.y + e));
+    std::vector<float> crossings;
+    for (int py = top; py <= bottom; ++py) {
+        crossings.clear();
+        for (int k = 0; k < OUTLINE_RADII; ++k) {
+            const auto& a = polygon[std::size_t(k)];
+            const auto& b = polygon[std::size_t((k + 1) % OUTLINE_RADII)];
+            if ((a.second <= py) == (b.second <= py)) continue;
+            crossings.push_back(a.first + (py - a.second) / (b.second - a.second) * (b.first - a.first));
+        }
+        std::sort(crossings.begin(), crossings.end());
+        for (std::size_t c = 0; c + 1 < crossings.size(); c += 2) {
+            const int left = int(std::ceil(crossings[c]));
+            const int right = int(std::ceil(crossings[c + 1]));
+            if (right > left) {
+                mask.spans.push_back({py, left, right});
+                mask.area += right - left;
+            }
+        }
+    }
+    return mask;
+}
+
+int intersection(const Mask& a, const Mask& b) {
+    int count = 0;
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < a.spans.size() && j < b.spans.size()) {
+        const Span& sa = a.spans[i];
+        const Span& sb = b.spans[j];
+        if (sa.y < sb.y) { ++i; continue; }
+        if (sb.y < sa.y) { ++j; continue; }
+        count += std::max(0, std::min(sa.right, sb.right) - std::max(sa.left, sb.left));
+        // advance the span that ends first, the other one may overlap the next span:
+        if (sa.right < sb.right) ++i; else ++j;
+    }
+    return count;
+}
+
+std::vector<Mask> rasterize(const std::vector<Outline>& outlines) {
+    std::vector<Mask> masks(outlines.size());
+    parallelForChunks(int(outlines.size()), [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            masks[std::size_t(i)] = rasterize(outlines[std::size_t(i)]);
+        }
+    }, 256);
+    return masks;
+}
+
+bool contains(const Outline& outline, int px, int py) {
+    if (outline.radius <= 0.0f) return false;
+    const Vertices polygon = vertices(outline);
+    bool inside = false;
+    for (int k = 0; k < OUTLINE_RADII; ++k) {
+        const auto& a = polygon[std::size_t(k)];
+        const auto& b = polygon[std::size_t((k + 1) % OUTLINE_RADII)];
+        if ((a.second <= py) == (b.second <= py)) continue;
+        const float crossing = a.first + (py - a.second) / (b.second - a.second) * (b.first - a.first);
+        if (crossing <= px) inside = !inside;
+    }
+    return inside;
+}
+
+Overlaps computeOverlaps(const std::vector<Outline>& reference, const std::vector<Outline>& candidates) {
+    return computeOverlaps(reference, candidates, rasterize(reference), rasterize(candidates));
+}
+
+Overlaps computeOverlaps(const std::vector<Outline>& reference, const std::vector<Outline>& candidates,
+                         const std::vector<Mask>& referenceMasks, const std::vector<Mask>& candidateMasks) {
+    Overlaps result;
+    result.referenceAreas.resize(reference.size());
+    result.candidateAreas.resize(candidates.size());
+
+    for (std::size_t i = 0; i < reference.size(); ++i) {
+        result.referenceAreas[i] = referenceMasks[i].area;
+    }
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+        result.candidateAreas[i] = candidateMasks[i].area;
+    }
+    if (reference.empty() || candidates.empty()) return result;
+
+    std::vector<float> extents;
+    float maxCandidateExtent = 0.0f;
+    for (const Outline& outline: candidates) {
+        extents.push_back(extent(outline));
+        maxCandidateExtent = std::max(maxCandidateExtent, extents.back());
+    }
+    std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+    SpatialGrid grid(std::max(1.0f, 2.0f * extents[extents.size() / 2]));
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+        grid.insert(int(i), candidates[i].x, candidates[i].y);
+    }
+
+    // order the reference cells by tile:
+    std::vector<int> order(reference.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto tileKey = [&reference](int i) {
+        const qint64 tx = qint64(std::floor(reference[std::size_t(i)].x / TILE_SIZE));
+        const qint64 ty = qint64(std::floor(reference[std::size_t(i)].y / TILE_SIZE));
+        return (ty << 32) | (tx & 0xffffffff);
+    };
+    std::stable_sort(order.begin(), order.end(), [&tileKey](int lhs, int rhs) {
+        return tileKey(lhs) < tileKey(rhs);
+    });
+
+    const int count = int(order.size());
+    std::vector<std::vector<Overlap>> chunkPairs(std::size_t(parallelChunkCount(count, 256)));
+    parallelForChunks(count, [&](int chunk, int begin, int end) {
+        std::vector<Overlap>& pairs = chunkPairs[std::size_t(chunk)];
+        for (int o = begin; o < end; ++o) {
+            const int i = order[std::size_t(o)];
+            const Outline& ref = reference[std::size_t(i)];
+            const float refExtent = extent(ref);
+            grid.forEachNear(ref.x, ref.y, refExtent + maxCandidateExtent, [&](int j) {
+                const Outline& candidate = candidates[std::size_t(j)];
+                const float maxDistance = refExtent + extent(candidate) + 1.0f;
+                const float dx = ref.x - candidate.x;
+                const float dy = ref.y - candidate.y;
+                if (dx * dx + dy * dy > maxDistance * maxDistance) return;
+                const int pixels = intersection(referenceMasks[std::size_t(i)], candidateMasks[std::size_t(j)]);
+                if (pixels > 0) {
+                    pairs.push_back({i, j, pixels});
+                }
+            });
+        }
+    }, 256);
+
+    for (const std::vector<Overlap>& chunk: chunkPairs) {
+        result.pairs.insert(result.pairs.end(), chunk.begin(), chunk.end());
+    }
+    std::sort(result.pairs.begin(), result.pairs.end(), [](const Overlap& lhs, const Overlap& rhs) {
+        if (lhs.reference != rhs.reference) return lhs.reference < rhs.reference;
+        return lhs.candidate < rhs.candidate;
+    });
+    return result;
+}
+
+Summary summarize(const Overlaps& overlaps, const std::vector<CellMatching::Match>& matches, int histogramBins) {
+    Summary summary;
+    const std::vector<int>& refAreas = overlaps.referenceAreas;
+    const std::vector<int>& cnAreas = overlaps.candidateAreas;
+
+    // Aggregated Jaccard Index: each reference cell is paired with the candidate
+    // of the highest IoU, unused candidates only add to the union:
+    double aggregatedIntersection = 0.0;
+    double aggregatedUnion = 0.0;
+    std::vector<bool> candidateUsed(cnAreas.size(), false);
+    std::size_t p = 0;
+    for (std::size_t i = 0; i < refAreas.size(); ++i) {
+        const Overlap* best = nullptr;
+        double bestIoU = -1.0;
+        for (; p < overlaps.pairs.size() && overlaps.pairs[p].reference == int(i); ++p) {
+            const Overlap& pair = overlaps.pairs[p];
+            const double value = iou(pair.intersection, refAreas[i], cnAreas[std::size_t(pair.candidate)]);
+            if (value > bestIoU) {
+                bestIoU = value;
+                best = &pair;
+            }
+        }
+        if (best) {
+            aggregatedIntersection += best->intersection;
+            aggregatedUnion += refAreas[i] + cnAreas[std::size_t(best->candidate)] - best->intersection;
+            candidateUsed[std::size_t(best->candidate)] = true;
+        } else {
+            aggregatedUnion += refAreas[i];
+        }
+    }
+    for (std::size_t j = 0; j < cnAreas.size(); ++j) {
+        if (!candidateUsed[j]) aggregatedUnion += cnAreas[j];
+    }
+    summary.aggregatedJaccardIndex = aggregatedUnion > 0.0 ? aggregatedIntersection / aggregatedUnion : 0.0;
+
+    // Panoptic Quality: pairs with IoU > 0.5 are unique without any assignment step
+    int truePositives = 0;
+    double iouSum = 0.0;
+    for (const Overlap& pair: overlaps.pairs) {
+        const double value = iou(pair.intersection, refAreas[std::size_t(pair.reference)], cnAreas[std::size_t(pair.candidate)]);
+        if (value > 0.5) {
+            ++truePositives;
+            iouSum += value;
+        }
+    }
+    const int falsePositives = int(cnAreas.size()) - truePositives;
+    const int falseNegatives = int(refAreas.size()) - truePositives;
+    const double dqDenominator = truePositives + 0.5 * falsePositives + 0.5 * falseNegatives;
+    summary.segmentationQuality = truePositives > 0 ? iouSum / truePositives : 0.0;
+    summary.detectionQuality = dqDenominator > 0.0 ? truePositives / dqDenominator : 0.0;
+    summary.panopticQuality = summary.segmentationQuality * summary.detectionQuality;
+
+    // IoU and Dice of the given matches:
+    summary.iouHistogram.assign(std::size_t(std::max(1, histogramBins)), 0);
+    double matchIoUSum = 0.0;
+    double matchDiceSum = 0.0;
+    for (const CellMatching::Match& match: matches) {
+        const Overlap key {match.reference, match.candidate, 0};
+        const auto it = std::lower_bound(overlaps.pairs.begin(), overlaps.pairs.end(), key, [](const Overlap& lhs, const Overlap& rhs) {
+            if (lhs.reference != rhs.reference) return lhs.reference < rhs.reference;
+            return lhs.candidate < rhs.candidate;
+        });
+        const bool found = it != overlaps.pairs.end() && it->reference == match.reference && it->candidate == match.candidate;
+        const int pixels = found ? it->intersection : 0;
+        const int areaSum = refAreas[std::size_t(match.reference)] + cnAreas[std::size_t(match.candidate)];
+        const double value = iou(pixels, refAreas[std::size_t(match.reference)], cnAreas[std::size_t(match.candidate)]);
+        matchIoUSum += value;
+        matchDiceSum += areaSum > 0 ? 2.0 * pixels / areaSum : 0.0;
+        const int bin = std::min(int(value * summary.iouHistogram.size()), int(summary.iouHistogram.size()) - 1);
+        summary.iouHistogram[std::size_t(bin)]++;
+    }
+    if (!matches.empty()) {
+        summary.meanIoU = matchIoUSum / matches.size();
+        summary.meanDice = matchDiceSum / matches.size();
+    }
+    return summary;
+}
+
+}  // namespace SegmentationMetrics
@@ -0,0 +1,94 @@
+#ifndef SEGMENTATIONMETRICS_H
+#define SEGMENTATIONMETRICS_H
+
+#include "microscopy/algorithms/CellMatching.h"
+
+#include <array>
+#include <vector>
+
+
+namespace SegmentationMetrics {
+
+    // has to be equal to CellDatabaseConstants::RADII_COUNT
+    const static int OUTLINE_RADII = 24;
+
+    /**
+     * @brief The Outline struct describes the star-shaped polygon of a nucleus in the
+     * same way the CellDatabaseBlock does: vertex k is at the angle k / OUTLINE_RADII * 2pi
+     * (measured with atan2(dx, dy)) and shape[k] * radius pixels away from the center.
+     */
+    struct Outline {
+        float x = 0.0f;
+        float y = 0.0f;
+        float radius = 0.0f;
+        std::array<float, OUTLINE_RADII> shape;
+    };
+
+    // horizontal run of pixels [left, right) in one row
+    struct Span {
+        int y;
+        int left;
+        int right;
+    };
+
+    // a rasterized outline as one or more spans per row, sorted by row
+    struct Mask {
+        std::vector<Span> spans;
+        int area = 0;
+    };
+
+    // intersection area (in pixels) of a reference and a candidate mask
+    struct Overlap {
+        int reference;
+        int candidate;
+        int intersection;
+    };
+
+    struct Overlaps {
+        std::vector<int> referenceAreas;
+        std::vector<int> candidateAreas;
+        std::vector<Overlap> pairs;  // sorted by reference, then candidate
+    };
+
+    struct Summary {
+        double aggregatedJaccardIndex = 0.0;
+        double panopticQuality = 0.0;
+        double segmentationQuality = 0.0;
+        double detectionQuality = 0.0;
+        double meanIoU = 0.0;  // of the given matches
+        double meanDice = 0.0;  // of the given matches
+        std::vector<int> iouHistogram;  // of the given matches
+    };
+
+    // radius of the circle around the center that contains the whole outline
+    float extent(const Outline& outline);
+
+    // true if the pixel with the given integer coordinates is inside of the outline (even-odd rule)
+    bool contains(const Outline& outline, int px, int py);
+
+    // scanline rasterization, contains the same pixels as contains() returns true for
+    Mask rasterize(const Outline& outline);
+    std::vector<Mask> rasterize(const std::vector<Outline>& outlines);  // in parallel
+
+    int intersection(const Mask& a, const Mask& b);
+
+    /**
+     * @brief computeOverlaps rasterizes all outlines into row spans on the integer pixel grid and returns
+     * their areas and the intersections of all overlapping reference / candidate pairs.
+     * The reference cells are processed tile by tile in parallel.
+     */
+    Overlaps computeOverlaps(const std::vector<Outline>& reference, const std::vector<Outline>& candidates);
+    Overlaps computeOverlaps(const std::vector<Outline>& reference, const std::vector<Outline>& candidates,
+                             const std::vector<Mask>& referenceMasks, const std::vector<Mask>& candidateMasks);
+
+    /**
+     * @brief summarize computes the Aggregated Jaccard Index (Kumar et al. 2017) and the
+     * Panoptic Quality (Kirillov et al. 2019, pairs with IoU > 0.5) from all overlaps, as well
+     * as mean IoU, mean Dice and an IoU histogram for the given one-to-one matches.
+     */
+    Summary summarize(const Overlaps& overlaps, const std::vector<CellMatching::Match>& matches,
+                      int histogramBins = 10);
+
+}  // namespace SegmentationMetrics
+
+#endif // SEGMENTATIONMETRICS_H
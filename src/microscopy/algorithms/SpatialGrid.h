@@ -0,0 +1,79 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * @brief The SpatialGrid class is a uniform 2D grid of point indices used to find
+ * nearby points without comparing every pair. Points can be inserted and removed
+ * individually, so that it can be kept up-to-date with a changing dataset.
+ *
+ * Queries return all points in the grid cells overlapping the query square,
+ * the caller has to check the exact distance.
+ */
+class SpatialGrid {
+
+public:
+    explicit SpatialGrid(float cellSize = 1.0f)
+        : m_cellSize(std::max(cellSize, 0.0001f))
+    {}
+
+    float cellSize() const { return m_cellSize; }
+
+    void clear() { m_cells.clear(); }
+
+    void insert(int index, float x, float y) {
+        m_cells[key(cellCoord(x), cellCoord(y))].push_back(index);
+    }
+
+    void remove(int index, float x, float y) {
+        const auto it = m_cells.find(key(cellCoord(x), cellCoord(y)));
+        if (it == m_cells.end()) return;
+        std::vector<int>& points = it->second;
+        const auto pos = std::find(points.begin(), points.end(), index);
+        if (pos == points.end()) return;
+        *pos = points.back();
+        points.pop_back();
+        if (points.empty()) m_cells.erase(it);
+    }
+
+    // calls fn(index) for each point in the cells overlapping the square around (x, y)
+    template<typename Fn>
+    void forEachNear(float x, float y, float radius, Fn fn) const {
+        const qint64 minX = cellCoord(x - radius);
+        const qint64 maxX = cellCoord(x + radius);
+        const qint64 minY = cellCoord(y - radius);
+        const qint64 maxY = cellCoord(y + radius);
+        for (qint64 cy = minY; cy <= maxY; ++cy) {
+            for (qint64 cx = minX; cx <= maxX; ++cx) {
+                const auto it = m_cells.find(key(cx, cy));
+                if (it == m_cells.end()) continue;
+                for (int index: it->second) {
+                    fn(index);
+                }
+            }
+        }
+    }
+
+protected:
+    qint64 cellCoord(float value) const {
+        return qint64(std::floor(value / m_cellSize));
+    }
+
+    static qint64 key(qint64 cx, qint64 cy) {
+        return (cy << 32) | (cx & 0xffffffff);
+    }
+
+protected:
+    float m_cellSize;
+    std::unordered_map<qint64, std::vector<int>> m_cells;
+
+};
+
+#endif // SPATIALGRID_H
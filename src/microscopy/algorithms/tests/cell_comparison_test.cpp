@@ -0,0 +1,94 @@
+/*
+ *  Randomized check of CellComparison: after every edit, the incrementally
+ *  updated result has to be equal to a complete recomputation.
+ *
+ *  Usage: cell_comparison_test [edits] [seed]
+ */
+
+#include "microscopy/algorithms/CellComparison.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using SegmentationMetrics::Outline;
+
+
+namespace {
+
+    // cells on a coarse integer grid with few radii, so that there are many pairs with the same distance
+    Outline randomCell(std::mt19937& generator) {
+        std::uniform_int_distribution<int> position(0, 40);
+        std::uniform_int_distribution<int> radius(2, 4);
+        std::uniform_real_distribution<float> shape(0.7f, 1.0f);
+        Outline cell;
+        cell.x = float(position(generator) * 5);
+        cell.y = float(position(generator) * 5);
+        cell.radius = float(radius(generator) * 3);
+        for (float& value: cell.shape) value = shape(generator);
+        return cell;
+    }
+
+    bool sameMetric(double a, double b) {
+        return a == b || (std::isnan(a) && std::isnan(b));
+    }
+
+    bool sameResult(const CellComparison::Result& a, const CellComparison::Result& b) {
+        return a.truePositives == b.truePositives
+                && a.falseNegatives == b.falseNegatives
+                && a.falsePositives == b.falsePositives
+                && sameMetric(a.meanSquarePositionError, b.meanSquarePositionError)
+                && sameMetric(a.meanSquareRadiusError, b.meanSquareRadiusError)
+                && sameMetric(a.meanSquareShapeError, b.meanSquareShapeError)
+                && sameMetric(a.overlaps.aggregatedJaccardIndex, b.overlaps.aggregatedJaccardIndex)
+                && sameMetric(a.overlaps.panopticQuality, b.overlaps.panopticQuality)
+                && sameMetric(a.overlaps.meanIoU, b.overlaps.meanIoU)
+                && sameMetric(a.overlaps.meanDice, b.overlaps.meanDice)
+                && a.overlaps.iouHistogram == b.overlaps.iouHistogram;
+    }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int edits = argc > 1 ? atoi(argv[1]) : 2000;
+    const unsigned seed = argc > 2 ? unsigned(atoi(argv[2])) : 0;
+    std::mt19937 generator(seed);
+
+    std::vector<Outline> cells[2];
+    for (int side = 0; side < 2; ++side) {
+        for (int i = 0; i < 300; ++i) cells[side].push_back(randomCell(generator));
+    }
+    CellComparison incremental;
+    incremental.reset(cells[CellComparison::Reference], cells[CellComparison::Candidate]);
+
+    for (int edit = 0; edit < edits; ++edit) {
+        const CellComparison::Side side = generator() % 2 ? CellComparison::Candidate : CellComparison::Reference;
+        std::vector<Outline>& sideCells = cells[side];
+        const int operation = int(generator() % 4);
+        if (operation == 0 || sideCells.empty()) {
+            // added cells arrive as placeholders that are modified afterwards, as in CellDatabaseComparison:
+            sideCells.push_back(randomCell(generator));
+            incremental.insert(side, Outline());
+            incremental.modify(side, int(sideCells.size()) - 1, sideCells.back());
+        } else if (operation == 1) {
+            const int index = int(generator() % sideCells.size());
+            sideCells.erase(sideCells.begin() + index);
+            incremental.remove(side, index);
+        } else {
+            const int index = int(generator() % sideCells.size());
+            sideCells[std::size_t(index)] = randomCell(generator);
+            incremental.modify(side, index, sideCells[std::size_t(index)]);
+        }
+
+        CellComparison full;
+        full.reset(cells[CellComparison::Reference], cells[CellComparison::Candidate]);
+        if (!sameResult(incremental.evaluate(), full.evaluate())) {
+            fprintf(stderr, "FAILED: edit %d differs from the complete recomputation (seed %u)\n", edit, seed);
+            return 1;
+        }
+    }
+    printf("OK: %d edits equal to the complete recomputation (seed %u)\n", edits, seed);
+    return 0;
+}
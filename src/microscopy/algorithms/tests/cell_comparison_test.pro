@@ -0,0 +1,20 @@
+# Randomized equivalence check of the incremental CellComparison, it is not part of the app.
+# Build and run with: qmake cell_comparison_test.pro && make && ./cell_comparison_test
+
+QT -= gui
+QT += concurrent
+
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+DEFINES += THREADS_ENABLED
+
+TARGET = cell_comparison_test
+
+INCLUDEPATH += $$PWD/../../..
+
+SOURCES += \
+    $$PWD/cell_comparison_test.cpp \
+    $$PWD/../CellComparison.cpp \
+    $$PWD/../CellMatching.cpp \
+    $$PWD/../SegmentationMetrics.cpp
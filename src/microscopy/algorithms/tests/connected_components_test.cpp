@@ -0,0 +1,100 @@
+/*
+ *  Randomized check of ConnectedComponents::find(): the components of random masks
+ *  have to be equal to the ones of a sequential flood-fill reference, in the same order.
+ *
+ *  Usage: connected_components_test [masks] [seed]
+ */
+
+#include "microscopy/algorithms/ConnectedComponents.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using ConnectedComponents::Component;
+
+
+namespace {
+
+    // 8-connected components by flood fill, started at the pixels in row order,
+    // so that they are in the order of their first pixel as well
+    std::vector<Component> floodFill(const std::vector<uchar>& mask, int width, int height) {
+        std::vector<char> visited(mask.size(), false);
+        std::vector<Component> components;
+        std::vector<int> stack;
+        for (int start = 0; start < width * height; ++start) {
+            if (mask[std::size_t(start)] == 0 || visited[std::size_t(start)]) continue;
+            visited[std::size_t(start)] = true;
+            stack.assign(1, start);
+            qint64 sumX = 0;
+            qint64 sumY = 0;
+            int area = 0;
+            QRect bounds;
+            while (!stack.empty()) {
+                const int pixel = stack.back();
+                stack.pop_back();
+                const int x = pixel % width;
+                const int y = pixel / width;
+                sumX += x;
+                sumY += y;
+                area += 1;
+                bounds |= QRect(x, y, 1, 1);
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        const int nx = x + dx;
+                        const int ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+                        const std::size_t neighbor = std::size_t(ny) * std::size_t(width) + std::size_t(nx);
+                        if (mask[neighbor] == 0 || visited[neighbor]) continue;
+                        visited[neighbor] = true;
+                        stack.push_back(int(neighbor));
+                    }
+                }
+            }
+            Component component;
+            component.area = area;
+            component.x = double(sumX) / area;
+            component.y = double(sumY) / area;
+            component.bounds = bounds;
+            components.push_back(component);
+        }
+        return components;
+    }
+
+    bool sameComponents(const std::vector<Component>& a, const std::vector<Component>& b) {
+        if (a.size() != b.size()) return false;
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            if (a[i].area != b[i].area || a[i].x != b[i].x || a[i].y != b[i].y || a[i].bounds != b[i].bounds) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int masks = argc > 1 ? atoi(argv[1]) : 200;
+    const unsigned seed = argc > 2 ? unsigned(atoi(argv[2])) : 0;
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<int> size(1, 700);
+    std::uniform_real_distribution<double> density(0.05, 0.7);
+
+    for (int i = 0; i < masks; ++i) {
+        // tall masks are split into many strips, components often span several of them:
+        const int width = size(generator);
+        const int height = size(generator) + (i % 4 == 0 ? 2000 : 0);
+        std::bernoulli_distribution foreground(density(generator));
+        std::vector<uchar> mask(std::size_t(width) * std::size_t(height));
+        for (uchar& value: mask) value = foreground(generator) ? 255 : 0;
+
+        if (!sameComponents(ConnectedComponents::find(mask, width, height), floodFill(mask, width, height))) {
+            fprintf(stderr, "FAILED: mask %d (%d x %d) differs from the flood-fill reference (seed %u)\n",
+                    i, width, height, seed);
+            return 1;
+        }
+    }
+    printf("OK: %d masks equal to the flood-fill reference (seed %u)\n", masks, seed);
+    return 0;
+}
@@ -0,0 +1,17 @@
+# Randomized check of the parallel connected-component labelling against a flood fill, it is not part of the app.
+# Build and run with: qmake connected_components_test.pro && make && ./connected_components_test
+
+QT += concurrent
+
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+DEFINES += THREADS_ENABLED
+
+TARGET = connected_components_test
+
+INCLUDEPATH += $$PWD/../../..
+
+SOURCES += \
+    $$PWD/connected_components_test.cpp \
+    $$PWD/../ConnectedComponents.cpp
@@ -2,14 +2,143 @@
 
 #include "core/CoreController.h"
 #include "core/manager/BlockList.h"
+#include "core/manager/GuiManager.h"
+#include "core/manager/StatusManager.h"
 #include "core/connections/Nodes.h"
 
+#include "microscopy/algorithms/Clustering.h"
+#include "microscopy/blocks/basic/CellDatabaseBlock.h"
+
+#include "core/helpers/utils.h"
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
 
 bool ClusteringBlock::s_registered = BlockList::getInstance().addBlock(ClusteringBlock::info());
 
 ClusteringBlock::ClusteringBlock(CoreController* controller, QString uid)
     : InOutBlock(controller, uid)
+    , m_method(this, "method", "k-means")
+    , m_clusterCount(this, "clusterCount", 5, 1, 1000)
+    , m_epsilon(this, "epsilon", 1.0, 0.0001, 100000.0)
+    , m_minPoints(this, "minPoints", 10, 1, 10000)
+    , m_normalize(this, "normalize", true)
+    , m_featureName(this, "featureName", "Cluster")
+    , m_running(this, "running", false, /*persistent*/ false)
 {
     m_featuresNode = createInputNode("features");
     m_featuresOutNode = createOutputNode("featuresOut");
 }
+
+void ClusteringBlock::run() {
+    if (m_running) return;
+    if (!m_inputNode->isConnected()) return;
+    const QVector<int> cells = m_inputNode->constData().ids();
+    if (cells.isEmpty()) return;
+    CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
+    if (!db) return;
+    QVector<int> featureIds = selectedFeatureIds();
+    featureIds.erase(std::remove_if(featureIds.begin(), featureIds.end(), [db](int featureId) {
+        return featureId < 0 || featureId >= db->features().size();
+    }), featureIds.end());
+    if (featureIds.isEmpty()) return;
+
+    // copy the selected columns into a row-major float matrix (in the main thread,
+    // so that the dataset can't change while reading it):
+    Clustering::FeatureMatrix data(cells.size(), featureIds.size());
+    for (int i = 0; i < cells.size(); ++i) {
+        float* row = data.row(i);
+        for (int j = 0; j < featureIds.size(); ++j) {
+            row[j] = float(db->getFeature(featureIds.at(j), cells.at(i)));
+        }
+    }
+
+    m_running = true;
+    m_runningDb = db;
+    m_runningCells = cells;
+
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    status->m_title = "Clustering...";
+    status->m_progress = 0.0;
+
+    const QString method = m_method;
+    const int clusterCount = m_clusterCount;
+    const float epsilon = float(m_epsilon.getValue());
+    const int minPoints = m_minPoints;
+    const bool normalize = m_normalize;
+
+    auto work = [this, data, method, clusterCount, epsilon, minPoints, normalize, status]() mutable {
+        auto begin = HighResTime::now();
+        if (normalize) {
+            data.standardize();
+        }
+        auto onProgress = [status](double progress) {
+            status->m_progress = progress;
+        };
+
+        const unsigned int seed = 42;  // deterministic results for the same input
+        std::vector<int> labels;
+        if (method == "DBSCAN") {
+            labels = Clustering::dbscan(data, epsilon, minPoints, onProgress);
+        } else if (method == "Mini-Batch k-means") {
+            const int batchSize = std::min(data.rows, 4096);
+            labels = Clustering::miniBatchKMeans(data, clusterCount, batchSize, 200, seed, onProgress);
+        } else {
+            labels = Clustering::kMeans(data, clusterCount, 300, seed, onProgress);
+        }
+        qDebug() << "Clustering" << method << data.rows << "cells:" << HighResTime::getElapsedSecAndUpdate(begin);
+
+        // the dataset needs to be modified in the main thread:
+        QMetaObject::invokeMethod(this,
+                                  "applyResult",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(QVector<int>, QVector<int>(labels.begin(), labels.end())));
+    };
+
+#ifdef THREADS_ENABLED
+    QtConcurrent::run(work);
+#else
+    work();
+#endif
+}
+
+void ClusteringBlock::applyResult(QVector<int> labels) {
+    m_running = false;
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    CellDatabaseBlock* db = m_runningDb;
+    if (!db || labels.size() != m_runningCells.size() || db->getCount() <= *std::max_element(m_runningCells.begin(), m_runningCells.end())) {
+        // dataset was deleted or modified in the meantime
+        status->m_title = "Clustering Failed ✗";
+        status->closeIn(3000);
+        return;
+    }
+
+    const int clusterFeatureId = db->getOrCreateFeatureId(m_featureName.getValue().isEmpty() ? "Cluster" : m_featureName);
+    db->setFeatureValues(clusterFeatureId, m_runningCells, QVector<double>(labels.begin(), labels.end()));
+
+    QVector<int> featuresOut = selectedFeatureIds();
+    featuresOut.append(clusterFeatureId);
+    m_featuresOutNode->data().setIds(featuresOut);
+    m_featuresOutNode->data().setReferenceObject(db);
+    m_featuresOutNode->dataWasModifiedByBlock();
+
+    const int clusterCount = *std::max_element(labels.begin(), labels.end()) + 1;
+    m_runningCells.clear();
+    status->m_title = "Clustering Complete ✓";
+    status->m_progress = 1.0;
+    status->closeIn(3000);
+    m_controller->guiManager()->showToast(QString("%1 clusters found ✓").arg(clusterCount));
+}
+
+QVector<int> ClusteringBlock::selectedFeatureIds() const {
+    if (m_featuresNode->isConnected() && !m_featuresNode->constData().ids().isEmpty()) {
+        return m_featuresNode->constData().ids();
+    }
+    CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
+    if (db && db->features().contains("t-SNE 1") && db->features().contains("t-SNE 2")) {
+        return {db->features().indexOf("t-SNE 1"), db->features().indexOf("t-SNE 2")};
+    }
+    return {CellDatabaseConstants::X_POS, CellDatabaseConstants::Y_POS};
+}
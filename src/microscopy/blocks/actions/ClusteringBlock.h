@@ -3,6 +3,8 @@
 
 #include "core/block_basics/InOutBlock.h"
 
+class CellDatabaseBlock;
+
 
 class ClusteringBlock : public InOutBlock {
 
@@ -13,12 +15,19 @@ public:
     static bool s_registered;
     static BlockInfo info() {
         static BlockInfo info;
-        info.typeName = "Clustering [n/a]";
+        info.typeName = "Clustering [n/a]";  // kept for compatibility with existing projects
+        info.nameInUi = "Clustering";
         info.category << "Actions";
-        info.helpText = "[Not implmeneted yet, only manual clustering with areas is possible]<br>"
-                        "Applies a clustering algorithm to the incoming cells and the selected "
+        info.helpText = "Applies a clustering algorithm to the incoming cells and the selected "
                         "features. Stores the resulting clusters as a new feature back into "
-                        "the connected dataset.";
+                        "the connected dataset.<br><br>"
+                        "If no features are selected, the t-SNE dimensions are used if available, "
+                        "otherwise the position.<br><br>"
+                        "<i>k-means</i> finds the given number of clusters, <i>Mini-Batch "
+                        "k-means</i> does the same faster but less exact for very large datasets. "
+                        "<i>DBSCAN</i> finds clusters of any shape by their density (i.e. in "
+                        "t-SNE space), cells that are not part of a dense region get the "
+                        "cluster -1.";
         info.qmlFile = "qrc:/microscopy/blocks/actions/ClusteringBlock.qml";
         info.orderHint = 1000 + 100 + 6;
         info.complete<ClusteringBlock>();
@@ -32,10 +41,30 @@ signals:
 public slots:
     virtual BlockInfo getBlockInfo() const override { return info(); }
 
+    void run();
+
+protected slots:
+    void applyResult(QVector<int> labels);
+
+protected:
+    QVector<int> selectedFeatureIds() const;
+
 protected:
     QPointer<NodeBase> m_featuresNode;
     QPointer<NodeBase> m_featuresOutNode;
 
+    StringAttribute m_method;
+    IntegerAttribute m_clusterCount;
+    DoubleAttribute m_epsilon;
+    IntegerAttribute m_minPoints;
+    BoolAttribute m_normalize;
+    StringAttribute m_featureName;
+
+    // runtime:
+    BoolAttribute m_running;
+    QPointer<CellDatabaseBlock> m_runningDb;
+    QVector<int> m_runningCells;
+
 };
 
 #endif // CLUSTERINGBLOCK_H
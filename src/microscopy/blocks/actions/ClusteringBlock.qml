@@ -6,15 +6,97 @@ import "qrc:/core/ui/controls"
 
 BlockBase {
     id: root
-    width: 130*dp
-    height: 120*dp
+    width: 180*dp
+    height: mainColumn.implicitHeight
 
     StretchColumn {
+        id: mainColumn
         anchors.fill: parent
+        defaultSize: 30*dp
 
         ButtonBottomLine {
-            text: "Run k-means ▻"
+            text: block.attr("running").val ? "Running..." : "Run ▻"
             allUpperCase: false
+            onPress: block.run()
+        }
+
+        BlockRow {
+            AttributeOptionPicker {
+                attr: block.attr("method")
+                optionListGetter: function () { return ["k-means", "Mini-Batch k-means", "DBSCAN"] }
+            }
+        }
+
+        BlockRow {
+            visible: block.attr("method").val !== "DBSCAN"
+            onVisibleChanged: block.positionChanged()
+            leftMargin: 5*dp
+            StretchText {
+                text: "Clusters:"
+            }
+            AttributeNumericInput {
+                width: 50*dp
+                implicitWidth: 0
+                attr: block.attr("clusterCount")
+            }
+        }
+
+        BlockRow {
+            visible: block.attr("method").val === "DBSCAN"
+            onVisibleChanged: block.positionChanged()
+            leftMargin: 5*dp
+            StretchText {
+                text: "Epsilon:"
+            }
+            AttributeNumericInput {
+                width: 60*dp
+                implicitWidth: 0
+                attr: block.attr("epsilon")
+                decimals: 2
+            }
+        }
+
+        BlockRow {
+            visible: block.attr("method").val === "DBSCAN"
+            leftMargin: 5*dp
+            StretchText {
+                text: "Min. Cells:"
+            }
+            AttributeNumericInput {
+                width: 50*dp
+                implicitWidth: 0
+                attr: block.attr("minPoints")
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            StretchText {
+                text: "Normalize:"
+            }
+            AttributeCheckbox {
+                width: 30*dp
+                attr: block.attr("normalize")
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            rightMargin: 5*dp
+            Item {
+                implicitWidth: -1
+                TextInput {
+                    anchors.fill: parent
+                    text: block.attr("featureName").val
+                    inputMethodHints: Qt.ImhPreferLatin
+                    onDisplayTextChanged: {
+                        if (block.attr("featureName").val !== displayText) {
+                            block.attr("featureName").val = displayText
+                        }
+                    }
+                    hintText: "Result Feature"
+                }
+            }
         }
 
         BlockRow {
@@ -44,4 +126,3 @@ BlockBase {
         }
     }
 }
-
@@ -23,9 +23,5 @@ void FeatureSetterBlock::run() {
     }
     const QVector<int>& cells = m_inputNode->constData().ids();
     const int featureId = db->getOrCreateFeatureId(m_featureName);
-    for (int idx: cells) {
-        db->setFeature(featureId, idx, m_featureValue);
-    }
-    db->dataWasModified();
-    emit db->existingDataChanged();
+    db->setFeatureValues(featureId, cells, QVector<double>(cells.size(), m_featureValue));
 }
@@ -9,14 +9,13 @@
 #include "microscopy/multicore_tsne/tsne.h"
 #include "microscopy/multicore_tsne/splittree.h"
 #include "microscopy/manager/BackendManager.h"
+#include "microscopy/manager/ImageEncoder.h"
 #include "microscopy/blocks/basic/CellDatabaseBlock.h"
 #include "microscopy/blocks/basic/TissueImageBlock.h"
 #include "microscopy/blocks/ai/CnnModelBlock.h"
 
 #include "core/helpers/utils.h"
 
-#include <QBuffer>
-
 #ifdef THREADS_ENABLED
 #include <QtConcurrent>
 #endif
@@ -43,13 +42,11 @@ AutoencoderInferenceBlock::AutoencoderInferenceBlock(CoreController* controller,
 }
 
 void AutoencoderInferenceBlock::runInference(QImage image) {
+    const ImageEncoder::Codec codec = m_backend->imageCodec();
 #ifdef THREADS_ENABLED
-    QtConcurrent::run([this, image]() {
+    QtConcurrent::run([this, image, codec]() {
         m_networkProgress = 0.1;
-        QByteArray imageData;
-        QBuffer buffer(&imageData);
-        buffer.open(QIODevice::WriteOnly);
-        image.save(&buffer, "PNG", 80);  // 80 is the compression level here, 100 is uncompressed
+        const QByteArray imageData = ImageEncoder::encode(image, codec);
 
         // backend->uploadFile() needs to be called in main thread:
         QMetaObject::invokeMethod(this,
@@ -69,6 +66,13 @@ void AutoencoderInferenceBlock::updateSources() {
     m_inputSources.valueChanged();
 }
 
+void AutoencoderInferenceBlock::cancel() {
+    if (m_jobId.isEmpty()) return;
+    m_backend->cancelJob(m_jobId);
+    m_jobId.clear();
+    m_running = false;
+}
+
 QRect AutoencoderInferenceBlock::area() const {
     // for compatibility with TrainingDataPreprocessingBlock and shader code
     QRect area(0, 0, std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
@@ -96,47 +100,58 @@ void AutoencoderInferenceBlock::doInference(QByteArray imageData) {
         CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
         if (!db) return;
 
-        QCborArray cellPositions;
-        for (int cellId: cells) {
-            const double x = db->getFeature(CellDatabaseConstants::X_POS, cellId);
-            const double y = db->getFeature(CellDatabaseConstants::Y_POS, cellId);
-            cellPositions.append(QCborArray({x, y}));
+        FloatMatrix cellPositions(cells.size(), 2);  // (x, y) in pixels
+        for (int i = 0; i < cells.size(); ++i) {
+            cellPositions(i, 0) = float(db->getFeature(CellDatabaseConstants::X_POS, cells.at(i)));
+            cellPositions(i, 1) = float(db->getFeature(CellDatabaseConstants::Y_POS, cells.at(i)));
         }
 
-        m_backend->applyAutoencoder(hashOfUploadedImage, modelId, cellPositions, [this, cells, db](QCborArray cbor) {
+        // only the result of the latest run is used:
+        cancel();
+        m_running = true;
+        const int cellCount = cells.size();
+        m_jobId = m_backend->applyAutoencoder(hashOfUploadedImage, modelId, cellPositions, [this, cellCount](int firstRow, FloatMatrix featureVectors) {
+            // the feature vectors arrive batch by batch, t-SNE starts as soon as the last one is received:
+            m_networkProgress = 0.3 * (firstRow + featureVectors.rows) / cellCount;
+        }, [this, cells, db](FloatMatrix featureVectors) {
+            m_jobId.clear();
+            if (featureVectors.isEmpty() || featureVectors.rows != cells.size()) {
+                m_running = false;
+                m_controller->guiManager()->showToast("Autoencoder Inference failed.");
+                return;
+            }
 
 #ifdef THREADS_ENABLED
-            QtConcurrent::run([this, cbor, cells, db]() {
+            QtConcurrent::run([this, featureVectors, cells, dbPointer = QPointer<CellDatabaseBlock>(db)]() {
                 m_networkProgress = 0.3;
-                const int featureVectorSize = int(cbor.at(0).toArray().size());
-                const int cellCount = int(cbor.size());
-                QVector<double> inputData(cellCount * featureVectorSize);
-
-                for (int i = 0; i < cbor.size(); ++i) {
-                    const QCborArray featureVector = cbor.at(i).toArray();
-                    for (int j = 0; j < featureVectorSize; ++j) {
-                        inputData[i*featureVectorSize + j] = featureVector.at(j).toDouble();
-                    }
-                }
+                const int featureVectorSize = featureVectors.cols;
+                const int cellCount = featureVectors.rows;
 
                 const int outputDimensions = 2;
                 QVector<double> tsneOutput(cellCount * outputDimensions);
                 TSNE<SplitTree, euclidean_distance_squared> tsne;
-                tsne.run(inputData.data(), cellCount, featureVectorSize, tsneOutput.data(), outputDimensions);
+                // the row-major matrix is the input format of t-SNE:
+                tsne.run(featureVectors.values.constData(), cellCount, featureVectorSize, tsneOutput.data(), outputDimensions);
                 qDebug() << "t-SNE completed";
 
-                const int tsneFeatureId1 = db->getOrCreateFeatureId("t-SNE 1");
-                const int tsneFeatureId2 = db->getOrCreateFeatureId("t-SNE 2");
-
-                for (int i = 0; i < cells.size(); ++i) {
-                    const QCborArray featureVector = cbor.at(i).toArray();
-                    db->setFeature(tsneFeatureId1, cells.at(i), tsneOutput.at(i*outputDimensions));
-                    db->setFeature(tsneFeatureId2, cells.at(i), tsneOutput.at(i*outputDimensions + 1));
+                QVector<double> tsne1(cellCount);
+                QVector<double> tsne2(cellCount);
+                for (int i = 0; i < cellCount; ++i) {
+                    tsne1[i] = tsneOutput.at(i*outputDimensions);
+                    tsne2[i] = tsneOutput.at(i*outputDimensions + 1);
                 }
-                emit db->existingDataChanged();
-                m_running = false;
-                m_networkProgress = 0.0;
-                m_controller->guiManager()->showToast("t-SNE completed");
+
+                // the dataset has to be modified in the main thread:
+                QMetaObject::invokeMethod(this, [this, dbPointer, cells, tsne1, tsne2]() {
+                    if (dbPointer) {
+                        CellDatabaseBlock::Transaction transaction(dbPointer);
+                        dbPointer->setFeatureValues(dbPointer->getOrCreateFeatureId("t-SNE 1"), cells, tsne1);
+                        dbPointer->setFeatureValues(dbPointer->getOrCreateFeatureId("t-SNE 2"), cells, tsne2);
+                    }
+                    m_running = false;
+                    m_networkProgress = 0.0;
+                    m_controller->guiManager()->showToast("t-SNE completed");
+                }, Qt::QueuedConnection);
             });
 #endif
         });
@@ -41,6 +41,7 @@ public slots:
     virtual BlockInfo getBlockInfo() const override { return info(); }
 
     void runInference(QImage image);
+    void cancel();
 
     void updateSources();
 
@@ -61,6 +62,7 @@ protected:
     VariantListAttribute m_inputSources;
     DoubleAttribute m_networkProgress;
     BoolAttribute m_running;
+    QString m_jobId;
 
 };
 
@@ -7,14 +7,13 @@
 #include "core/connections/Nodes.h"
 
 #include "microscopy/manager/BackendManager.h"
+#include "microscopy/manager/ImageEncoder.h"
 #include "microscopy/blocks/ai/TrainingDataBlock.h"
 #include "microscopy/blocks/ai/CnnModelBlock.h"
 #include "microscopy/blocks/basic/CellDatabaseBlock.h"
 #include "microscopy/blocks/basic/TissueImageBlock.h"
 
 #include <QtConcurrent>
-#include <QBuffer>
-#include <QCborArray>
 
 
 bool AutoencoderTrainingBlock::s_registered = BlockList::getInstance().addBlock(AutoencoderTrainingBlock::info());
@@ -39,15 +38,13 @@ AutoencoderTrainingBlock::AutoencoderTrainingBlock(CoreController* controller, Q
 }
 
 void AutoencoderTrainingBlock::run(QImage image) {
+    const ImageEncoder::Codec codec = m_backend->imageCodec();
 #ifdef THREADS_ENABLED
-    QtConcurrent::run([this, image]() {
+    QtConcurrent::run([this, image, codec]() {
         qDebug() << "autoencoder training";
         auto begin = HighResTime::now();
         m_networkProgress = 0.1;
-        QByteArray imageData;
-        QBuffer buffer(&imageData);
-        buffer.open(QIODevice::WriteOnly);
-        image.save(&buffer, "PNG", 80);  // 80 is the compression level here, 100 is uncompressed
+        const QByteArray imageData = ImageEncoder::encode(image, codec);
         qDebug() << "Save image to buffer:" << HighResTime::getElapsedSecAndUpdate(begin);
 
         // backend->uploadFile() needs to be called in main thread:
@@ -71,11 +68,10 @@ void AutoencoderTrainingBlock::doTraining(QByteArray imageData) {
         CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
         if (!db) return;
 
-        QCborArray cellPositions;
-        for (int cellId: cells) {
-            const double x = db->getFeature(CellDatabaseConstants::X_POS, cellId);
-            const double y = db->getFeature(CellDatabaseConstants::Y_POS, cellId);
-            cellPositions.append(QCborArray({x, y}));
+        FloatMatrix cellPositions(cells.size(), 2);  // (x, y) in pixels
+        for (int i = 0; i < cells.size(); ++i) {
+            cellPositions(i, 0) = float(db->getFeature(CellDatabaseConstants::X_POS, cells.at(i)));
+            cellPositions(i, 1) = float(db->getFeature(CellDatabaseConstants::Y_POS, cells.at(i)));
         }
 
         QString baseModel = "";
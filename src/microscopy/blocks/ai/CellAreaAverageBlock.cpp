@@ -35,6 +35,7 @@ void CellAreaAverageBlock::fillInMidpointValues() {
     const QString featureName = label->getValue().isEmpty() ? imageBlock->filename() : label->getValue();
     const int featureId = db->getOrCreateFeatureId(featureName);
 
+    CellDatabaseBlock::Transaction transaction(db);
     for (int nucleusIdx: cells) {
         const int centerX = int(db->getFeature(CellDatabaseConstants::X_POS, nucleusIdx));
         const int centerY = int(db->getFeature(CellDatabaseConstants::Y_POS, nucleusIdx));
@@ -63,6 +64,7 @@ void CellAreaAverageBlock::fillInAverageValues() {
     const QString featureName = label->getValue().isEmpty() ? imageBlock->filename() : label->getValue();
     const int featureId = db->getOrCreateFeatureId(featureName + " Avg.");
 
+    CellDatabaseBlock::Transaction transaction(db);
     for (int nucleusIdx: cells) {
         const int centerX = int(db->getFeature(CellDatabaseConstants::X_POS, nucleusIdx));
         const int centerY = int(db->getFeature(CellDatabaseConstants::Y_POS, nucleusIdx));
@@ -6,11 +6,82 @@
 #include "core/connections/Nodes.h"
 #include "microscopy/blocks/basic/CellDatabaseBlock.h"
 
+#ifdef THREADS_ENABLED
 #include <QtConcurrent>
+#endif
 
+#include <algorithm>
+
+
+static_assert(SegmentationMetrics::OUTLINE_RADII == CellDatabaseConstants::RADII_COUNT, "shape size mismatch");
 
 bool CellDatabaseComparison::s_registered = BlockList::getInstance().addBlock(CellDatabaseComparison::info());
 
+namespace {
+
+    SegmentationMetrics::Outline outlineOf(const CellDatabaseBlock* db, int cellId) {
+        SegmentationMetrics::Outline outline;
+        outline.x = float(db->getFeature(CellDatabaseConstants::X_POS, cellId));
+        outline.y = float(db->getFeature(CellDatabaseConstants::Y_POS, cellId));
+        outline.radius = float(db->getFeature(CellDatabaseConstants::RADIUS, cellId));
+        outline.shape = db->getShape(cellId);
+        return outline;
+    }
+
+    // true if the ids are exactly all cells of the dataset, so that ids and indices are the same
+    bool isWholeDataset(const QVector<int>& cells, const CellDatabaseBlock* db) {
+        if (cells.size() != db->getCount()) return false;
+        for (int i = 0; i < cells.size(); ++i) {
+            if (cells.at(i) != i) return false;
+        }
+        return true;
+    }
+
+    // changes of one dataset since the last comparison, in a form that can be applied in another thread
+    struct SideUpdate {
+        QVector<CellChange> changes;  // cells are added as placeholders and removed in this order
+        std::vector<std::pair<int, SegmentationMetrics::Outline>> outlines;  // final index and outline of touched cells
+    };
+
+    bool collectChanges(const CellDatabaseBlock* db, qint64 revision, SideUpdate& update) {
+        if (!db->geometryChangesSince(revision, update.changes)) return false;
+
+        // the final index of each added or modified cell, tracked while later cells are removed:
+        std::vector<int> touched;
+        for (const CellChange& change: update.changes) {
+            if (change.type == CellChange::Removed) {
+                touched.erase(std::remove(touched.begin(), touched.end(), change.index), touched.end());
+                for (int& index: touched) {
+                    if (index > change.index) --index;
+                }
+            } else {
+                touched.push_back(change.index);
+            }
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (int index: touched) {
+            if (index < 0 || index >= db->getCount()) return false;
+            update.outlines.push_back({index, outlineOf(db, index)});
+        }
+        return true;
+    }
+
+    void applyChanges(CellComparison& comparison, CellComparison::Side side, const SideUpdate& update) {
+        for (const CellChange& change: update.changes) {
+            if (change.type == CellChange::Added) {
+                comparison.insert(side, SegmentationMetrics::Outline());
+            } else if (change.type == CellChange::Removed) {
+                comparison.remove(side, change.index);
+            }
+        }
+        for (const auto& indexAndOutline: update.outlines) {
+            comparison.modify(side, indexAndOutline.first, indexAndOutline.second);
+        }
+    }
+
+}  // namespace
+
 CellDatabaseComparison::CellDatabaseComparison(CoreController* controller, QString uid)
     : OneInputBlock(controller, uid)
     , m_instanceCountDifference(this, "instanceCountDifference", 0, std::numeric_limits<int>::min(), std::numeric_limits<int>::max())
@@ -24,6 +95,11 @@ CellDatabaseComparison::CellDatabaseComparison(CoreController* controller, QStri
     , m_meanSquarePositionError(this, "meanSquarePositionError", 0.0, 0.0, std::numeric_limits<double>::max())
     , m_meanSquareRadiusError(this, "meanSquareRadiusError", 0.0, 0.0, std::numeric_limits<double>::max())
     , m_meanSquareShapeError(this, "meanSquareShapeError", 0.0, 0.0, std::numeric_limits<double>::max())
+    , m_meanIoU(this, "meanIoU", 0.0)
+    , m_meanDice(this, "meanDice", 0.0)
+    , m_aggregatedJaccardIndex(this, "aggregatedJaccardIndex", 0.0)
+    , m_panopticQuality(this, "panopticQuality", 0.0)
+    , m_iouHistogram(this, "iouHistogram")
 {
     m_groundTruthNode = createInputNode("groundTruth");
     m_truePositivesNode = createOutputNode("truePositives");
@@ -32,94 +108,148 @@ CellDatabaseComparison::CellDatabaseComparison(CoreController* controller, QStri
 
     m_updateTimer.setSingleShot(true);
     m_updateTimer.setInterval(200);
-    connect(&m_updateTimer, &QTimer::timeout, this, [this]() {
-        const bool locked = m_updateMutex.tryLock();
-        if (!locked) return;
-        QtConcurrent::run([this](){
-            update();
-            m_updateMutex.unlock();
-        });
-    });
+    connect(&m_updateTimer, &QTimer::timeout, this, &CellDatabaseComparison::update);
 
     connect(m_inputNode, &NodeBase::connectionChanged, this, [this]() { m_updateTimer.start(); });
     connect(m_groundTruthNode, &NodeBase::connectionChanged, this, [this]() { m_updateTimer.start(); });
-    connect(m_inputNode, &NodeBase::dataChanged, this, [this]() { m_updateTimer.start(); });
-    connect(m_groundTruthNode, &NodeBase::dataChanged, this, [this]() { m_updateTimer.start(); });
+    connect(m_inputNode, &NodeBase::dataChanged, this, &CellDatabaseComparison::onInputDataChanged);
+    connect(m_groundTruthNode, &NodeBase::dataChanged, this, &CellDatabaseComparison::onInputDataChanged);
+}
+
+void CellDatabaseComparison::onInputDataChanged() {
+    // modifications of datasets that are compared as a whole are handled by onCellsChanged():
+    if (inputsAreSyncedDatasets()) return;
+    m_updateTimer.start();
+}
+
+void CellDatabaseComparison::onCellsChanged(QVector<int>, QVector<int> featureIds, bool allCells) {
+    const auto* db = qobject_cast<CellDatabaseBlock*>(sender());
+    if (!db || (db != m_syncedReferenceDb && db != m_syncedCandidateDb)) return;
+    // only the position, radius and shape of the cells are compared (the feature ids are sorted):
+    if (allCells || (!featureIds.isEmpty() && featureIds.first() <= CellDatabaseConstants::RADIUS)) {
+        m_updateTimer.start();
+    }
+}
+
+bool CellDatabaseComparison::inputsAreSyncedDatasets() const {
+    if (!m_syncedReferenceDb || !m_syncedCandidateDb) return false;
+    if (!m_groundTruthNode->isConnected() || !m_inputNode->isConnected()) return false;
+    const CellDatabaseBlock* gtDb = m_groundTruthNode->constData().referenceObject<CellDatabaseBlock>();
+    const CellDatabaseBlock* candidateDb = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
+    return gtDb == m_syncedReferenceDb && candidateDb == m_syncedCandidateDb
+            && isWholeDataset(m_groundTruthNode->constData().ids(), gtDb)
+            && isWholeDataset(m_inputNode->constData().ids(), candidateDb);
 }
 
 void CellDatabaseComparison::update() {
+    if (m_updateRunning) {
+        // the datasets are read again when the current comparison is done:
+        m_updatePending = true;
+        return;
+    }
     if (!m_groundTruthNode->isConnected() || !m_inputNode->isConnected()) return;
 
-    const QVector<int> gtCells = m_groundTruthNode->constData().ids();
+    // sorted, so that ties in the matching are broken by the cell ids and not by their order in the input:
+    QVector<int> gtCells = m_groundTruthNode->constData().ids();
+    std::sort(gtCells.begin(), gtCells.end());
     CellDatabaseBlock* gtDb = m_groundTruthNode->constData().referenceObject<CellDatabaseBlock>();
     if (!gtDb) return;
 
-    const QVector<int> candidateCells = m_inputNode->constData().ids();
+    QVector<int> candidateCells = m_inputNode->constData().ids();
+    std::sort(candidateCells.begin(), candidateCells.end());
     CellDatabaseBlock* candidateDb = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
     if (!candidateDb) return;
 
-    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
-    status->m_title = "Comparing Datasets...";
-    status->m_running = true;
-
     m_instanceCountDifference = candidateCells.size() - gtCells.size();
 
-    QVector<int> truePositives;
-    QVector<int> falseNegatives;
-    QVector<bool> alreadyUsed(candidateCells.size());
-    double positionSquareErrorSum = 0.0;
-    double radiusSquareErrorSum = 0.0;
-    double shapeSquareErrorSum = 0.0;
-
-    for (int gtCellId: gtCells) {
-        const double gtX = gtDb->getFeature(CellDatabaseConstants::X_POS, gtCellId);
-        const double gtY = gtDb->getFeature(CellDatabaseConstants::Y_POS, gtCellId);
-        const double gtRadius = gtDb->getFeature(CellDatabaseConstants::RADIUS, gtCellId);
-
-        QVector<QPair<int, double>> similarNuclei;
-        for (int i = 0; i < candidateCells.size(); ++i) {
-            if (alreadyUsed.at(i)) continue;
-            const int cnCellId = candidateCells.at(i);
-            const double cnX = candidateDb->getFeature(CellDatabaseConstants::X_POS, cnCellId);
-            const double cnY = candidateDb->getFeature(CellDatabaseConstants::Y_POS, cnCellId);
-            const double distance = std::sqrt(std::pow(gtX - cnX, 2) + std::pow(gtY - cnY, 2));
-
-            if (distance <= gtRadius) {
-                similarNuclei.append({i, distance});
-            }
-        }
+    // the datasets can only be read in the main thread, only the changed cells are read
+    // if the previous comparison was done with the same, whole datasets:
+    SideUpdate referenceUpdate;
+    SideUpdate candidateUpdate;
+    const bool incremental = gtDb == m_syncedReferenceDb && candidateDb == m_syncedCandidateDb
+            && isWholeDataset(gtCells, gtDb) && isWholeDataset(candidateCells, candidateDb)
+            && collectChanges(gtDb, m_syncedReferenceRevision, referenceUpdate)
+            && collectChanges(candidateDb, m_syncedCandidateRevision, candidateUpdate);
 
-        if (!similarNuclei.isEmpty()) {
-            const auto [i, distance] = *std::min_element(similarNuclei.begin(), similarNuclei.end(),
-                    [](const auto& lhs, const auto& rhs) {
-                return lhs.second < rhs.second;
-            });
+    std::vector<SegmentationMetrics::Outline> referenceOutlines;
+    std::vector<SegmentationMetrics::Outline> candidateOutlines;
+    if (!incremental) {
+        Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+        status->m_title = "Comparing Datasets...";
+        status->m_running = true;
 
-            const int cnCellId = candidateCells.at(i);
-            const double cnRadius = candidateDb->getFeature(CellDatabaseConstants::RADIUS, cnCellId);
+        referenceOutlines.reserve(std::size_t(gtCells.size()));
+        for (int cellId: gtCells) {
+            referenceOutlines.push_back(outlineOf(gtDb, cellId));
+        }
+        candidateOutlines.reserve(std::size_t(candidateCells.size()));
+        for (int cellId: candidateCells) {
+            candidateOutlines.push_back(outlineOf(candidateDb, cellId));
+        }
+    }
 
-            truePositives.append(cnCellId);
-            alreadyUsed[i] = true;
+    m_syncedReferenceDb = isWholeDataset(gtCells, gtDb) ? gtDb : nullptr;
+    m_syncedCandidateDb = isWholeDataset(candidateCells, candidateDb) ? candidateDb : nullptr;
+    m_syncedReferenceRevision = gtDb->geometryRevision();
+    m_syncedCandidateRevision = candidateDb->geometryRevision();
+    // further edits of whole datasets are reported once per update of the dataset:
+    for (CellDatabaseBlock* db: {m_syncedReferenceDb.data(), m_syncedCandidateDb.data()}) {
+        if (db) connect(db, &CellDatabaseBlock::cellsChanged, this, &CellDatabaseComparison::onCellsChanged, Qt::UniqueConnection);
+    }
 
-            positionSquareErrorSum += std::pow(distance, 2);
-            radiusSquareErrorSum += std::pow(gtRadius - cnRadius, 2);
+    m_updateRunning = true;
+    m_runningReferenceDb = gtDb;
+    m_runningCandidateDb = candidateDb;
+    m_runningReferenceCells = gtCells;
+    m_runningCandidateCells = candidateCells;
 
-            const CellShape& gtShape = gtDb->getShape(gtCellId);
-            const CellShape& cnShape = candidateDb->getShape(cnCellId);
-            double cellShapeSquareErrorSum = 0.0;
-            for (std::size_t j = 0; j < gtShape.size(); ++j) {
-                cellShapeSquareErrorSum += std::pow(gtShape.at(j) - cnShape.at(j), 2);
-            }
-            shapeSquareErrorSum += cellShapeSquareErrorSum / gtShape.size();
+    auto work = [this, incremental, referenceUpdate, candidateUpdate, referenceOutlines, candidateOutlines]() {
+        if (incremental) {
+            applyChanges(m_comparison, CellComparison::Reference, referenceUpdate);
+            applyChanges(m_comparison, CellComparison::Candidate, candidateUpdate);
         } else {
-            falseNegatives.append(gtCellId);
+            m_comparison.reset(referenceOutlines, candidateOutlines);
         }
+        m_result = m_comparison.evaluate();
+
+        // the attributes and outputs need to be modified in the main thread:
+        QMetaObject::invokeMethod(this, "applyResult", Qt::QueuedConnection);
+    };
+
+#ifdef THREADS_ENABLED
+    QtConcurrent::run(work);
+#else
+    work();
+#endif
+}
+
+void CellDatabaseComparison::applyResult() {
+    m_updateRunning = false;
+    m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+
+    CellDatabaseBlock* gtDb = m_runningReferenceDb;
+    CellDatabaseBlock* candidateDb = m_runningCandidateDb;
+    if (!gtDb || !candidateDb) {
+        // a dataset was deleted in the meantime
+        m_syncedReferenceDb = nullptr;
+        m_syncedCandidateDb = nullptr;
+        return;
+    }
+
+    QVector<int> truePositives;
+    truePositives.reserve(int(m_result.truePositives.size()));
+    for (int index: m_result.truePositives) {
+        truePositives.append(m_runningCandidateCells.at(index));
+    }
+    QVector<int> falseNegatives;
+    falseNegatives.reserve(int(m_result.falseNegatives.size()));
+    for (int index: m_result.falseNegatives) {
+        falseNegatives.append(m_runningReferenceCells.at(index));
     }
     QVector<int> falsePositives;
-    for (int i = 0; i < candidateCells.size(); ++i) {
-        if (!alreadyUsed.at(i)) {
-            falsePositives.append(candidateCells.at(i));
-        }
+    falsePositives.reserve(int(m_result.falsePositives.size()));
+    for (int index: m_result.falsePositives) {
+        falsePositives.append(m_runningCandidateCells.at(index));
     }
 
     m_truePositives = truePositives.size();
@@ -132,9 +262,19 @@ void CellDatabaseComparison::update() {
     m_recall = double(m_truePositives) / (m_truePositives + m_falseNegatives);
     m_f1 = 2.0 * ((m_precision * m_recall) / (m_precision + m_recall));
 
-    m_meanSquarePositionError = positionSquareErrorSum / m_truePositives;
-    m_meanSquareRadiusError = radiusSquareErrorSum / m_truePositives;
-    m_meanSquareShapeError = shapeSquareErrorSum / m_truePositives;
+    m_meanSquarePositionError = m_result.meanSquarePositionError;
+    m_meanSquareRadiusError = m_result.meanSquareRadiusError;
+    m_meanSquareShapeError = m_result.meanSquareShapeError;
+
+    m_meanIoU = m_result.overlaps.meanIoU;
+    m_meanDice = m_result.overlaps.meanDice;
+    m_aggregatedJaccardIndex = m_result.overlaps.aggregatedJaccardIndex;
+    m_panopticQuality = m_result.overlaps.panopticQuality;
+    QVariantList histogram;
+    for (int count: m_result.overlaps.iouHistogram) {
+        histogram.append(count);
+    }
+    m_iouHistogram = histogram;
 
     m_truePositivesNode->data().setReferenceObject(candidateDb);
     m_truePositivesNode->data().setIds(truePositives);
@@ -148,5 +288,8 @@ void CellDatabaseComparison::update() {
     m_falsePositivesNode->data().setIds(falsePositives);
     m_falsePositivesNode->dataWasModifiedByBlock();
 
-    m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+    if (m_updatePending) {
+        m_updatePending = false;
+        update();
+    }
 }
@@ -2,8 +2,9 @@
 #define CELLDATABASECOMPARISON_H
 
 #include "core/block_basics/OneInputBlock.h"
+#include "microscopy/algorithms/CellComparison.h"
 
-#include <QMutex>
+class CellDatabaseBlock;
 
 
 class CellDatabaseComparison : public OneInputBlock {
@@ -22,15 +23,23 @@ public:
                         "By connecting a Visualize block to the outputs next to TP, FP an FN "
                         "those sets can be analysed visually.\n\n"
                         "The metrics are calculated as follows:\n"
-                        "For each ground truth nucleus the nearest predicted nucleus will be "
-                        "marked as a true positive (TP) if the distance between their centers "
-                        "is smaller or equal the radius of the ground truth nucleus. Only one "
-                        "predicted nucleus can be marked as a true positive for each ground truth "
-                        "nucleus. The rest of the predicted nuclei are regarded as false "
-                        "positives (FP). The ground truth nuclei that have no predicted "
+                        "A predicted nucleus can be matched to a ground truth nucleus if the "
+                        "distance between their centers is smaller or equal the radius of the "
+                        "ground truth nucleus. Each nucleus is part of at most one match. "
+                        "Among all possible matchings the one with the most matches and the "
+                        "smallest total distance is chosen, the matched predicted nuclei are "
+                        "marked as true positives (TP). The rest of the predicted nuclei are "
+                        "regarded as false positives (FP). The ground truth nuclei that have no predicted "
                         "counterpart form the group of the false negatives (FN). The category of "
                         "the true negatives (TN) is not applicable to the problem of finding one "
-                        "type of instances on an image, it is therefore always regarded as zero.";
+                        "type of instances on an image, it is therefore always regarded as zero.\n\n"
+                        "The overlap metrics are computed from the rasterized shapes: mean IoU and "
+                        "Dice of the true positives, the Aggregated Jaccard Index (AJI) and the "
+                        "Panoptic Quality (PQ, pairs with an IoU above 0.5). The histogram shows "
+                        "the IoU distribution of the true positives from 0 to 1.\n\n"
+                        "When whole datasets are connected, only the cells around changed "
+                        "nuclei are matched again after an edit, changes of other features "
+                        "than the position and shape don't start a new comparison.";
         info.qmlFile = "qrc:/microscopy/blocks/ai/CellDatabaseComparison.qml";
         info.orderHint = 1000 + 200 + 6;
         info.complete<CellDatabaseComparison>();
@@ -46,7 +55,15 @@ public slots:
 
     void update();
 
+protected slots:
+    void applyResult();
+    void onInputDataChanged();
+    void onCellsChanged(QVector<int> cells, QVector<int> featureIds, bool allCells);
+
 protected:
+    // true if the inputs are still the whole datasets the last comparison was done with
+    bool inputsAreSyncedDatasets() const;
+
     QPointer<NodeBase> m_groundTruthNode;
     QPointer<NodeBase> m_truePositivesNode;
     QPointer<NodeBase> m_falseNegativesNode;
@@ -68,7 +85,28 @@ protected:
     DoubleAttribute m_meanSquareRadiusError;
     DoubleAttribute m_meanSquareShapeError;
 
-    QMutex m_updateMutex;
+    DoubleAttribute m_meanIoU;
+    DoubleAttribute m_meanDice;
+    DoubleAttribute m_aggregatedJaccardIndex;
+    DoubleAttribute m_panopticQuality;
+    VariantListAttribute m_iouHistogram;  // TP count per IoU bin of 0.1
+
+    // only used by the worker thread while m_updateRunning is true:
+    CellComparison m_comparison;
+    CellComparison::Result m_result;
+
+    bool m_updateRunning = false;
+    bool m_updatePending = false;
+    QPointer<CellDatabaseBlock> m_runningReferenceDb;
+    QPointer<CellDatabaseBlock> m_runningCandidateDb;
+    QVector<int> m_runningReferenceCells;
+    QVector<int> m_runningCandidateCells;
+
+    // datasets and their revision m_comparison is in sync with, null if it can't be updated incrementally
+    QPointer<CellDatabaseBlock> m_syncedReferenceDb;
+    QPointer<CellDatabaseBlock> m_syncedCandidateDb;
+    qint64 m_syncedReferenceRevision = 0;
+    qint64 m_syncedCandidateRevision = 0;
 };
 
 #endif // CELLDATABASECOMPARISON_H
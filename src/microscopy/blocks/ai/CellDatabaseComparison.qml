@@ -200,6 +200,93 @@ BlockBase {
             }
         }
 
+        BlockRow {
+            leftMargin: 5*dp
+            rightMargin: 5*dp
+            StretchText {
+                text: "Mean IoU:"
+            }
+            TextInput {
+                width: 70*dp
+                text: block.attr("meanIoU").val.toFixed(3)
+                font.family: "Courier"
+                horizontalAlignment: Text.AlignRight
+                color: "#bbb"
+                readOnly: true
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            rightMargin: 5*dp
+            StretchText {
+                text: "Dice:"
+            }
+            TextInput {
+                width: 70*dp
+                text: block.attr("meanDice").val.toFixed(3)
+                font.family: "Courier"
+                horizontalAlignment: Text.AlignRight
+                color: "#bbb"
+                readOnly: true
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            rightMargin: 5*dp
+            StretchText {
+                text: "AJI:"
+            }
+            TextInput {
+                width: 70*dp
+                text: block.attr("aggregatedJaccardIndex").val.toFixed(3)
+                font.family: "Courier"
+                horizontalAlignment: Text.AlignRight
+                color: "#bbb"
+                readOnly: true
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            rightMargin: 5*dp
+            StretchText {
+                text: "PQ:"
+            }
+            TextInput {
+                width: 70*dp
+                text: block.attr("panopticQuality").val.toFixed(3)
+                font.family: "Courier"
+                horizontalAlignment: Text.AlignRight
+                color: "#bbb"
+                readOnly: true
+            }
+        }
+
+        Item {
+            id: histogram
+            property var bins: block.attr("iouHistogram").val
+            property real maxCount: Math.max.apply(null, [1].concat(bins))
+            implicitHeight: 40*dp
+
+            Row {
+                anchors.fill: parent
+                anchors.margins: 5*dp
+                Repeater {
+                    model: histogram.bins.length
+                    Rectangle {
+                        width: parent.width / histogram.bins.length
+                        height: parent.height * (histogram.bins[index] / histogram.maxCount)
+                        anchors.bottom: parent.bottom
+                        color: "#bbb"
+                        border.width: 1
+                        border.color: "#333"
+                    }
+                }
+            }
+        }
+
         Rectangle {
             height: 1*dp
             color: Style.primaryActionColor
@@ -4,22 +4,199 @@
 #include "core/manager/BlockList.h"
 #include "core/manager/BlockManager.h"
 #include "core/manager/FileSystemManager.h"
+#include "core/manager/GuiManager.h"
+#include "core/manager/StatusManager.h"
 #include "core/connections/Nodes.h"
+#include "core/helpers/utils.h"
 
+#include "microscopy/algorithms/CellRasterizer.h"
 #include "microscopy/blocks/basic/TissueImageBlock.h"
 #include "microscopy/blocks/basic/CellDatabaseBlock.h"
+#include "microscopy/manager/ImageEncoder.h"
 #include "microscopy/manager/ViewManager.h"
 
-#include <QBuffer>
 #include <QCryptographicHash>
 #include <QDir>
 #include <QImageReader>
+#include <QRandomGenerator>
+#include <QRegExp>
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
 
 inline QString md5(QByteArray input) {
     QString result = QString(QCryptographicHash::hash(input, QCryptographicHash::Md5).toHex());
     return result;
 }
 
+static_assert(CellRasterizer::SHAPE_RADII == CellDatabaseConstants::RADII_COUNT, "shape size mismatch");
+
+
+namespace {
+
+    // the cells as they are needed for rendering, copied in the main thread
+    struct CellData {
+        std::vector<CellRasterizer::Shape> shapes;  // white
+        std::vector<int> indexes;  // in the database, for the labels
+        std::vector<float> featureValues;  // relative to the max. value
+    };
+
+    struct RenderOptions {
+        bool largeNoise = true;
+        bool smallNoise = true;
+    };
+
+    // featureId is only used if it is not -1
+    CellData cellData(const CellDatabaseBlock* db, const QVector<int>& ids, int featureId, double maxFeatureValue) {
+        CellData cells;
+        cells.shapes.reserve(std::size_t(ids.size()));
+        for (int idx: ids) {
+            CellRasterizer::Shape shape;
+            shape.x = float(db->getFeature(CellDatabaseConstants::X_POS, idx));
+            shape.y = float(db->getFeature(CellDatabaseConstants::Y_POS, idx));
+            shape.radius = float(db->getFeature(CellDatabaseConstants::RADIUS, idx));
+            shape.radii = db->getShape(idx);
+            cells.shapes.push_back(shape);
+            cells.indexes.push_back(idx);
+            cells.featureValues.push_back(featureId >= 0 ? float(db->getFeature(featureId, idx) / maxFeatureValue) : 0.0f);
+        }
+        return cells;
+    }
+
+    // like CellRendererBlock::randomRadii()
+    std::array<float, CellRasterizer::SHAPE_RADII> randomRadii(std::mt19937& random, float ellipseFactor, float variance) {
+        std::uniform_real_distribution<float> sizeVarianceDist(variance, 1.0f);
+        std::uniform_real_distribution<float> ellipseDist(ellipseFactor, 1.0);
+        std::uniform_real_distribution<float> rotationDist(0.0f, 1.0f);
+        std::array<float, CellRasterizer::SHAPE_RADII> radii;
+
+        const float rotation = rotationDist(random);
+        const float ellipseStrength = ellipseDist(random);
+        for (std::size_t j = 0; j < radii.size(); ++j) {
+            const float pos = j / float(CellDatabaseConstants::RADII_COUNT - 1);
+            const float angle = (rotation + pos) * float(M_PI) * 2;
+            const float ellipseRadius = ellipseStrength / std::sqrt(std::pow(std::sin(angle), 2.0f) + std::pow(ellipseFactor, 2.0f) * std::pow(std::cos(angle), 2.0f));
+            radii[j] = ellipseRadius * sizeVarianceDist(random);
+        }
+        return radii;
+    }
+
+    // a noise shape with the top left corner at x, y like the IrregularCircles in the QML renderers
+    CellRasterizer::Shape noiseShape(std::mt19937& random, float x, float y, float width, float outerValue, float innerValue) {
+        CellRasterizer::Shape shape;
+        shape.x = x + width / 2;
+        shape.y = y + width / 2;
+        shape.radius = width / 2;
+        shape.radii = randomRadii(random, 0.9f, 0.8f);
+        shape.outerValue = outerValue;
+        shape.innerValue = innerValue;
+        return shape;
+    }
+
+    /**
+     * The same scenes as DapiRenderer.qml, LamiRenderer.qml, MaskRenderer.qml etc.,
+     * all random values are taken from the seed.
+     */
+    std::vector<CellRasterizer::Layer> createLayers(const CellData& cells, QString renderType, QSize size,
+                                                    quint32 seed, const RenderOptions& options) {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        auto rand = [&random, &uniform]() { return uniform(random); };
+        const float width = size.width();
+        const float height = size.height();
+        std::vector<CellRasterizer::Layer> layers;
+
+        if (renderType == "DAPI" || renderType == "LAMI") {
+            const bool dapi = renderType == "DAPI";
+            CellRasterizer::Layer blurred;
+            blurred.blurRadius = dapi ? 5 : 3;
+            if (options.largeNoise) {
+                // debris / uneven background
+                for (int i = 0; i < std::lround(width / 200); ++i) {
+                    const float shapeWidth = 150 + rand() * 400;
+                    const float x = rand() * width;
+                    const float y = rand() * height;
+                    const float outerValue = dapi ? rand() * 0.15f : rand() * 0.1f;
+                    const float innerValue = dapi ? 0.12f + rand() * 0.08f : 0.05f + rand() * 0.05f;
+                    blurred.shapes.push_back(noiseShape(random, x, y, shapeWidth, outerValue, innerValue));
+                }
+            }
+            for (CellRasterizer::Shape shape: cells.shapes) {
+                if (dapi) {
+                    const bool inverse = rand() > 0.5f;  // aka coffee stain
+                    shape.outerValue = inverse ? std::min(0.5f + rand() * 0.8f, 1.0f) : 0.1f + rand() * 0.9f;
+                    shape.outerAlpha = 0.8f;
+                    shape.innerValue = inverse ? rand() * 0.4f : std::min(0.4f + rand() * 0.8f, 1.0f);
+                } else {
+                    shape.outerValue = 0.1f + rand() * 0.5f;
+                    shape.innerValue = rand() * 0.08f;
+                    if (rand() <= 0.5f) continue;
+                }
+                blurred.shapes.push_back(shape);
+            }
+            if (options.smallNoise || !dapi) {
+                // small dots / dust
+                for (int i = 0; i < std::lround(width / 10); ++i) {
+                    const float shapeWidth = rand() * 5;
+                    const float x = rand() * width;
+                    const float y = rand() * height;
+                    const float outerValue = rand();
+                    blurred.shapes.push_back(noiseShape(random, x, y, shapeWidth, outerValue, 0.5f + rand() * 0.5f));
+                }
+            }
+            if (options.smallNoise && dapi) {
+                // cutouts / black spots
+                for (int i = 0; i < std::lround(width / 20); ++i) {
+                    const float shapeWidth = rand() * 8;
+                    const float x = rand() * width;
+                    const float y = rand() * height;
+                    blurred.shapes.push_back(noiseShape(random, x, y, shapeWidth, 0.0f, 0.0f));
+                }
+            }
+            layers.push_back(blurred);
+
+            CellRasterizer::Layer sharp;
+            if (options.smallNoise) {
+                // sharp small dots / salt and pepper noise
+                for (int i = 0; i < std::lround(width / 15); ++i) {
+                    const float shapeWidth = rand() * 3;
+                    const float x = rand() * width;
+                    const float y = rand() * height;
+                    const float value = rand();
+                    sharp.shapes.push_back(noiseShape(random, x, y, shapeWidth, value, value));
+                }
+            }
+            layers.push_back(sharp);
+            return layers;
+        }
+
+        CellRasterizer::Layer layer;
+        layer.shapes.reserve(cells.shapes.size());
+        for (std::size_t i = 0; i < cells.shapes.size(); ++i) {
+            CellRasterizer::Shape shape = cells.shapes[i];
+            if (renderType == "Center") {
+                shape.radius *= 0.4f;
+            } else if (renderType == "Feature") {
+                shape.innerValue = shape.outerValue = cells.featureValues[i];
+            } else if (renderType == "Label <255") {
+                shape.innerValue = shape.outerValue = (cells.indexes[i] + 1) / 255.0f;
+            } else if (renderType == "Label 16-bit") {
+                shape.innerValue = shape.outerValue = (cells.indexes[i] + 1) / 65535.0f;
+            }
+            layer.shapes.push_back(shape);
+        }
+        layers.push_back(layer);
+        return layers;
+    }
+
+    // file name suffix of the render type, i.e. "Label255" for "Label <255"
+    QString typeSuffix(QString renderType) {
+        return renderType.remove(QRegExp("[^A-Za-z0-9]"));
+    }
+
+}  // namespace
+
 
 bool CellRendererBlock::s_registered = BlockList::getInstance().addBlock(CellRendererBlock::info());
 
@@ -33,13 +210,18 @@ CellRendererBlock::CellRendererBlock(CoreController* controller, QString uid)
     , m_relativeOutputPath(this, "relativeOutputPath")
     , m_preferredWidth(this, "preferredWidth", -1, -1, std::numeric_limits<int>::max())
     , m_preferredHeight(this, "preferredHeight", -1, -1, std::numeric_limits<int>::max())
+    , m_sixteenBit(this, "sixteenBit", false)
+    , m_batchCount(this, "batchCount", 100, 1, 100000)
+    , m_batchInputType(this, "batchInputType", "DAPI")
+    , m_batchTargetType(this, "batchTargetType", "Mask")
     , m_maxFeatureValue(this, "maxFeatureValue", 1.0, 0.000001, std::numeric_limits<double>::max(), /*persistent*/ false)
+    , m_running(this, "running", false, /*persistent*/ false)
 {
     m_runNode = createInputNode("run");
     m_runNode->enableImpulseDetection();
     connect(m_runNode, &NodeBase::impulseBegin, this, [this]() {
         updateReferenceSize();
-        QTimer::singleShot(300, this, &CellRendererBlock::triggerRendering);
+        render();
     });
 
     m_referenceImageNode = createInputNode("referenceImage");
@@ -76,36 +258,98 @@ QObject* CellRendererBlock::dbQml() const {
     return m_inputNode->constData().referenceObject<CellDatabaseBlock>();
 }
 
-void CellRendererBlock::saveRenderedImage(QImage image, QString type) {
+void CellRendererBlock::render() {
+    if (m_running) return;
+    CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
+    if (!db) return;
+    const QString renderType = m_renderType;
+    const int feature = featureId(renderType);
+    const CellData cells = cellData(db, m_inputNode->constData().ids(), feature, m_maxFeatureValue);
+    const QSize size = outputSize();
+    const RenderOptions options = {m_largeNoise, m_smallNoise};
+    const QImage::Format format = imageFormat(renderType);
+    const quint32 seed = QRandomGenerator::global()->generate();
+
+    // with a reference image, the file is stored next to it and no block is created:
+    QString path;
     auto* referenceImage = m_referenceImageNode->getConnectedBlock<TissueImageBlock>();
     if (referenceImage) {
         auto info = QFileInfo(referenceImage->filePath());
-        QString path = info.path() + "/" + m_relativeOutputPath;
+        path = info.path() + "/" + m_relativeOutputPath;
         if (!QDir(path).exists()) {
             QDir().mkpath(path);
         }
         path = path + info.baseName() + ".png";
-        image.save(path, "PNG", 80);
-        m_outputNode->sendImpulse();
-    } else {
-        QByteArray imageData;
-        QBuffer buffer(&imageData);
-        buffer.open(QIODevice::WriteOnly);
-        image.save(&buffer, "PNG", 80);
-        QString hash = md5(imageData);
-        QString path = m_controller->dao()->saveFile("renderedImages", hash + ".png", imageData);
-
-        auto* block = m_controller->blockManager()->addNewBlock<TissueImageBlock>();
-        if (!block) {
-            qWarning() << "Could not create TissueImageBlock.";
-            return;
+    }
+
+    m_running = true;
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    status->m_title = "Rendering Cells...";
+
+    auto run = [this, cells, renderType, size, seed, options, format, path]() {
+        auto begin = HighResTime::now();
+        const QImage image = CellRasterizer::render(size, createLayers(cells, renderType, size, seed, options), format);
+        qDebug() << "Rendered" << cells.shapes.size() << "cells in" << HighResTime::getElapsedSecAndUpdate(begin) << "s";
+        const QByteArray imageData = ImageEncoder::encode(image, ImageEncoder::Codec::Png);
+        QString outputPath = path;
+        if (outputPath.isEmpty()) {
+            outputPath = m_controller->dao()->saveFile("renderedImages", md5(imageData) + ".png", imageData);
+        } else {
+            m_controller->dao()->saveLocalFile(outputPath, imageData);
         }
-        block->focus();
-        block->loadLocalFile(path);
-        static_cast<StringAttribute*>(block->attr("label"))->setValue(type);
-        static_cast<BoolAttribute*>(block->attr("ownsFile"))->setValue(true);
-        block->onCreatedByUser();
+        QMetaObject::invokeMethod(this, "finishRendering", Qt::QueuedConnection,
+                                  Q_ARG(QString, outputPath), Q_ARG(QString, renderType), Q_ARG(bool, path.isEmpty()));
+    };
+#ifdef THREADS_ENABLED
+    QtConcurrent::run(run);
+#else
+    run();
+#endif
+}
+
+void CellRendererBlock::renderBatch(QString folder) {
+    if (m_running) return;
+    CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
+    if (!db) return;
+    folder = m_controller->dao()->withoutFilePrefix(folder);
+    if (!QDir(folder).exists()) {
+        QDir().mkpath(folder);
+    }
+    const QStringList renderTypes = {m_batchInputType, m_batchTargetType};
+    const int feature = renderTypes.contains("Feature") ? featureId("Feature") : -1;
+    const CellData cells = cellData(db, m_inputNode->constData().ids(), feature, m_maxFeatureValue);
+    const QSize size = outputSize();
+    const RenderOptions options = {m_largeNoise, m_smallNoise};
+    const int count = m_batchCount;
+    const quint32 seed = QRandomGenerator::global()->generate();
+    QVector<QImage::Format> formats;
+    for (const QString& renderType: renderTypes) {
+        formats.append(imageFormat(renderType));
     }
+
+    m_running = true;
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    status->m_title = "Rendering Slides...";
+
+    auto run = [this, folder, cells, size, options, renderTypes, formats, count, seed]() {
+        auto begin = HighResTime::now();
+        for (int slide = 0; slide < count; ++slide) {
+            for (int i = 0; i < renderTypes.size(); ++i) {
+                // the slides differ in the random values, input and target of a slide use the same ones:
+                const QImage image = CellRasterizer::render(size, createLayers(cells, renderTypes[i], size, seed + quint32(slide), options), formats[i]);
+                const QString filename = QString("slide_%1_%2.png").arg(slide + 1, 4, 10, QChar('0')).arg(typeSuffix(renderTypes[i]));
+                m_controller->dao()->saveLocalFile(QDir(folder).filePath(filename), ImageEncoder::encode(image, ImageEncoder::Codec::Png));
+            }
+            QMetaObject::invokeMethod(this, "updateProgress", Qt::QueuedConnection, Q_ARG(double, double(slide + 1) / count));
+        }
+        qDebug() << "Rendered" << count << "slides in" << HighResTime::getElapsedSecAndUpdate(begin) << "s";
+        QMetaObject::invokeMethod(this, "finishBatch", Qt::QueuedConnection, Q_ARG(QString, folder), Q_ARG(int, count));
+    };
+#ifdef THREADS_ENABLED
+    QtConcurrent::run(run);
+#else
+    run();
+#endif
 }
 
 QVector<double> CellRendererBlock::randomRadii(float ellipseFactor, float variance) const {
@@ -146,6 +390,55 @@ void CellRendererBlock::updateFeatureMax() {
     }
 }
 
+void CellRendererBlock::updateProgress(double progress) {
+    m_controller->manager<StatusManager>("statusManager")->getStatus(getUid())->m_progress = progress;
+}
+
+void CellRendererBlock::finishRendering(QString path, QString type, bool createBlock) {
+    m_running = false;
+    m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+    if (!createBlock) {
+        m_outputNode->sendImpulse();
+        return;
+    }
+    auto* block = m_controller->blockManager()->addNewBlock<TissueImageBlock>();
+    if (!block) {
+        qWarning() << "Could not create TissueImageBlock.";
+        return;
+    }
+    block->focus();
+    block->loadLocalFile(path);
+    static_cast<StringAttribute*>(block->attr("label"))->setValue(type);
+    static_cast<BoolAttribute*>(block->attr("ownsFile"))->setValue(true);
+    block->onCreatedByUser();
+}
+
+void CellRendererBlock::finishBatch(QString folder, int count) {
+    m_running = false;
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    status->m_title = "Slides Rendered ✓";
+    status->closeIn(3000);
+    m_controller->guiManager()->showToast(QString("%1 slides rendered to %2").arg(count).arg(folder));
+}
+
+QSize CellRendererBlock::outputSize() const {
+    // the same as the size of the QML renderers:
+    const int size = int(areaSize());
+    return QSize(m_preferredWidth > 0 ? m_preferredWidth : size, m_preferredHeight > 0 ? m_preferredHeight : size);
+}
+
+int CellRendererBlock::featureId(QString renderType) {
+    if (renderType != "Feature" || m_feature.getValue().isEmpty()) return -1;
+    CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
+    if (!db) return -1;
+    updateFeatureMax();
+    return db->getOrCreateFeatureId(m_feature);
+}
+
+QImage::Format CellRendererBlock::imageFormat(QString renderType) const {
+    return (m_sixteenBit || renderType == "Label 16-bit") ? QImage::Format_Grayscale16 : QImage::Format_Grayscale8;
+}
+
 void CellRendererBlock::updateReferenceSize() {
     bool referenceSizeAvailable = false;
     if (m_referenceImageNode->isConnected()) {
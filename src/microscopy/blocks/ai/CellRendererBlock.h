@@ -34,7 +34,11 @@ public:
                         "The 'Label <255' render type creates an image where each cells pixels "
                         "have a pixel value according to there index. As it is an 8-bit image, "
                         "it is limited to 255 cells. This render type is useful to export a "
-                        "segmentation result for an external application.";
+                        "segmentation result for an external application. 'Label 16-bit' "
+                        "works the same way for up to 65535 cells.\n\n"
+                        "The images are rendered on the CPU in the background. 'Batch' renders "
+                        "the given number of slides with different random noise, each as an "
+                        "input and a target image, into a folder.";
         info.qmlFile = "qrc:/microscopy/blocks/ai/CellRendererBlock.qml";
         info.orderHint = 1000 + 200 + 3;
         info.complete<CellRendererBlock>();
@@ -43,9 +47,6 @@ public:
 
     explicit CellRendererBlock(CoreController* controller, QString uid);
 
-signals:
-    void triggerRendering();
-
 public slots:
     virtual BlockInfo getBlockInfo() const override { return info(); }
 
@@ -53,7 +54,10 @@ public slots:
     QVariantList indexes() const;
     QObject* dbQml() const;
 
-    void saveRenderedImage(QImage image, QString type);
+    // renders the image of the current render type and stores it (see help text)
+    void render();
+    // renders batchCount slides of the batch input and target types into the folder
+    void renderBatch(QString folder);
 
     QVector<double> randomRadii(float ellipseFactor, float variance) const;
 
@@ -62,6 +66,15 @@ public slots:
 
 private slots:
     void updateReferenceSize();
+    void updateProgress(double progress);
+    void finishRendering(QString path, QString type, bool createBlock);
+    void finishBatch(QString folder, int count);
+
+protected:
+    QSize outputSize() const;
+    // the id of the feature if the render type is "Feature", otherwise -1
+    int featureId(QString renderType);
+    QImage::Format imageFormat(QString renderType) const;
 
 protected:
     std::random_device m_rd;
@@ -77,9 +90,14 @@ protected:
     StringAttribute m_relativeOutputPath;
     IntegerAttribute m_preferredWidth;
     IntegerAttribute m_preferredHeight;
+    BoolAttribute m_sixteenBit;
+    IntegerAttribute m_batchCount;
+    StringAttribute m_batchInputType;
+    StringAttribute m_batchTargetType;
 
     // runtime:
     DoubleAttribute m_maxFeatureValue;
+    BoolAttribute m_running;
 };
 
 #endif // CELLRENDERERBLOCK_H
@@ -1,4 +1,5 @@
 import QtQuick 2.12
+import QtQuick.Dialogs 1.2
 import CustomElements 1.0
 import CustomStyle 1.0
 import "qrc:/core/ui/items"
@@ -15,28 +16,18 @@ BlockBase {
         "Center": "qrc:/microscopy/blocks/ai/CenterRenderer.qml",
         "Feature": "qrc:/microscopy/blocks/ai/FeatureRenderer.qml",
         "Label <255": "qrc:/microscopy/blocks/ai/LabelRenderer.qml",
+        "Label 16-bit": "qrc:/microscopy/blocks/ai/LabelRenderer.qml",
         "DAPI": "qrc:/microscopy/blocks/ai/DapiRenderer.qml",
         "LAMI": "qrc:/microscopy/blocks/ai/LamiRenderer.qml",
     }
 
-    Connections {
-        target: block
-        onTriggerRendering: render()
-    }
-
+    // the QML renderers are only used for the preview, the images are rendered by the block
     function refresh() {
+        block.updateFeatureMax()
         loader.active = false
         loader.active = true
     }
 
-    function render() {
-        block.updateFeatureMax()
-        refresh()
-        loader.item.grabToImage(function(result) {
-            block.saveRenderedImage(result.image, block.attr("renderType").val)
-        });
-    }
-
     StretchColumn {
         id: mainCol
         anchors.fill: parent
@@ -61,7 +52,8 @@ BlockBase {
             ButtonBottomLine {
                 text: "Save ▻"
                 allUpperCase: false
-                onPress: render()
+                enabled: !block.attr("running").val
+                onPress: block.render()
             }
             OutputNode {
                 node: block.node("outputNode")
@@ -136,6 +128,77 @@ BlockBase {
             }
         }
 
+        BlockRow {
+            leftMargin: 5*dp
+            StretchText {
+                text: "16-bit:"
+            }
+            AttributeCheckbox {
+                width: 30*dp
+                attr: block.attr("sixteenBit")
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            StretchText {
+                text: "Batch:"
+            }
+            AttributeNumericInput {
+                width: 70*dp
+                implicitWidth: 0
+                attr: block.attr("batchCount")
+            }
+        }
+
+        BlockRow {
+            AttributeOptionPicker {
+                attr: block.attr("batchInputType")
+                optionListGetter: function () { return Object.keys(renderTypes) }
+                openToLeft: true
+            }
+            AttributeOptionPicker {
+                attr: block.attr("batchTargetType")
+                optionListGetter: function () { return Object.keys(renderTypes) }
+                openToLeft: true
+            }
+        }
+
+        BlockRow {
+            ButtonBottomLine {
+                text: "Render Batch ▻"
+                allUpperCase: false
+                enabled: !block.attr("running").val
+                onPress: batchDialog.active = true
+
+                Loader {
+                    id: batchDialog
+                    active: false
+
+                    sourceComponent: FileDialog {
+                        title: "Choose folder for the slides:"
+                        folder: shortcuts.documents
+                        selectMultiple: false
+                        selectFolder: true
+                        onAccepted: {
+                            if (fileUrl) {
+                                block.renderBatch(fileUrl)
+                            }
+                            batchDialog.active = false
+                        }
+                        onRejected: {
+                            batchDialog.active = false
+                        }
+                        Component.onCompleted: {
+                            // don't set visible to true before component is complete
+                            // because otherwise the dialog will not be configured correctly
+                            visible = true
+                        }
+                    }
+                }
+            }
+        }
+
         BlockRow {
             InputNode {
                 node: block.node("referenceImage")
@@ -3,10 +3,13 @@
 #include "core/CoreController.h"
 #include "core/manager/BlockList.h"
 #include "core/manager/BlockManager.h"
+#include "core/manager/GuiManager.h"
 #include "core/manager/StatusManager.h"
 #include "core/connections/Nodes.h"
 
 #include "microscopy/manager/BackendManager.h"
+#include "microscopy/manager/BlobCache.h"
+#include "microscopy/manager/ImageEncoder.h"
 #include "microscopy/blocks/basic/CellDatabaseBlock.h"
 #include "microscopy/blocks/basic/TissueImageBlock.h"
 #include "microscopy/blocks/selection/RectangularAreaBlock.h"
@@ -14,13 +17,22 @@
 
 #include "core/helpers/utils.h"
 
-#include <QBuffer>
+#include <QCryptographicHash>
+#include <QThreadPool>
+
+#include <algorithm>
 
 #ifdef THREADS_ENABLED
 #include <QtConcurrent>
 #endif
 
 
+inline QString md5(QByteArray input) {
+    QString result = QString(QCryptographicHash::hash(input, QCryptographicHash::Md5).toHex());
+    return result;
+}
+
+
 bool CnnInferenceBlock::s_registered = BlockList::getInstance().addBlock(CnnInferenceBlock::info());
 
 CnnInferenceBlock::CnnInferenceBlock(CoreController* controller, QString uid)
@@ -48,18 +60,24 @@ CnnInferenceBlock::CnnInferenceBlock(CoreController* controller, QString uid)
 }
 
 void CnnInferenceBlock::runInference(QImage image) {
+    if (m_backend->useLocalUnet(selectedModelId())) {
+        runLocalInference(image);
+        return;
+    }
+    if (m_backend->serverSupportsTiledInference()) {
+        runTiledInference(image);
+        return;
+    }
+    const ImageEncoder::Codec codec = m_backend->imageCodec();
 #ifdef THREADS_ENABLED
-    QtConcurrent::run([this, image]() {
+    QtConcurrent::run([this, image, codec]() {
         qDebug() << "runInference";
         Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
         status->m_title = "Compressing Image...";
         status->m_running = true;
         auto begin = HighResTime::now();
         m_networkProgress = 0.1;
-        QByteArray imageData;
-        QBuffer buffer(&imageData);
-        buffer.open(QIODevice::WriteOnly);
-        image.save(&buffer, "PNG", 80);  // 80 is the compression level here, 100 is uncompressed
+        const QByteArray imageData = ImageEncoder::encode(image, codec);
         qDebug() << "Save image to buffer:" << HighResTime::getElapsedSecAndUpdate(begin);
 
         // backend->uploadFile() needs to be called in main thread:
@@ -80,6 +98,14 @@ void CnnInferenceBlock::updateSources() {
     m_inputSources.valueChanged();
 }
 
+void CnnInferenceBlock::cancel() {
+    ++m_tiledRun;
+    if (m_jobId.isEmpty()) return;
+    m_backend->cancelJob(m_jobId);
+    m_jobId.clear();
+    m_running = false;
+}
+
 QRect CnnInferenceBlock::area() const {
     // for compatibility with TrainingDataPreprocessingBlock and shader code
     QRect area(0, 0, std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
@@ -98,51 +124,194 @@ void CnnInferenceBlock::doInference(QByteArray imageData) {
         m_running = true;
         m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
 
-        QString modelId = "default";
-        if (m_inputNode->isConnected()) {
-            const auto* modelBlock = m_inputNode->getConnectedBlock<CnnModelBlock>();
-            if (modelBlock) {
-                modelId = modelBlock->modelId();
-            }
-        }
-        QRect area(0, 0, 0, 0);
-        if (m_areaNode->isConnected()) {
-            const auto* areaBlock = m_areaNode->getConnectedBlock<RectangularAreaBlock>();
-            if (areaBlock) {
-                area = areaBlock->area();
-            }
+        // only the result of the latest run is used:
+        cancel();
+        m_running = true;
+        m_jobId = m_backend->applyUnet(serverHash, selectedArea(), selectedModelId(), [this](QCborMap cbor) {
+            handleResult(cbor);
+        });
+    });
+}
+
+void CnnInferenceBlock::runLocalInference(QImage image) {
+    // only the result of the latest run is used:
+    cancel();
+    m_running = true;
+    m_jobId = m_backend->applyUnetLocally(image, selectedArea(), selectedModelId(), [this](QCborMap cbor) {
+        handleResult(cbor);
+    });
+}
+
+void CnnInferenceBlock::handleResult(QCborMap cbor) {
+    m_running = false;
+    m_jobId.clear();
+    if (cbor.isEmpty()) {
+        m_controller->guiManager()->showToast("CNN Inference failed.");
+        return;
+    }
+    importResult(cbor);
+    showOutputImage(cbor["outputImageHash"_q].toString());
+}
+
+void CnnInferenceBlock::runTiledInference(QImage image) {
+    cancel();
+    const int tiledRun = ++m_tiledRun;
+    const int tileSize = BackendManager::INFERENCE_TILE_SIZE;
+    const QRect area = selectedArea();
+
+    // The network looks at up to one patch around each pixel, the tiles next to the area
+    // are sent as well:
+    QRect requiredArea = image.rect();
+    if (area.width() > 0 && area.height() > 0) {
+        requiredArea = area.adjusted(-tileSize, -tileSize, tileSize, tileSize).intersected(image.rect());
+    }
+    // row by row, in the order the server processes them:
+    QVector<QPoint> tiles;
+    for (int row = requiredArea.top() / tileSize; row <= requiredArea.bottom() / tileSize; ++row) {
+        for (int column = requiredArea.left() / tileSize; column <= requiredArea.right() / tileSize; ++column) {
+            tiles.append(QPoint(column, row));
         }
+    }
+    if (tiles.isEmpty()) return;
 
-        m_backend->applyUnet(serverHash, area, modelId, [this](QCborMap cbor) {
-            m_running = false;
+    m_outputImage = QImage(image.size(), QImage::Format_RGB32);
+    m_outputImage.fill(Qt::black);
+    m_uploadedTiles = 0;
+    m_receivedOutputTiles = 0;
+    m_tileCount = tiles.size();
+    m_running = true;
+    m_networkProgress = 0.0;
 
-            QString resultHash = cbor["outputImageHash"_q].toString();
+    m_jobId = m_backend->applyUnetTiled(image.size(), tiles, area, selectedModelId(), [this](QPoint tile, QByteArray pngData) {
+        addOutputTile(tile, pngData);
+    }, [this](QCborMap cbor) {
+        ++m_tiledRun;
+        m_running = false;
+        m_networkProgress = 0.0;
+        m_jobId.clear();
+        if (cbor.isEmpty()) {
+            m_controller->guiManager()->showToast("CNN Inference failed.");
+            return;
+        }
+        importResult(cbor);
+        if (m_receivedOutputTiles < m_tileCount) {
+            // not all output tiles were received:
+            showOutputImage(cbor["outputImageHash"_q].toString());
+            return;
+        }
+#ifdef THREADS_ENABLED
+        const QImage outputImage = m_outputImage;
+        QtConcurrent::run([this, outputImage]() {
+            const QByteArray imageData = ImageEncoder::encode(outputImage, ImageEncoder::Codec::Png);
+            // the blob cache needs to be used in main thread:
+            QMetaObject::invokeMethod(this,
+                                      "storeOutputImage",
+                                      Qt::QueuedConnection,
+                                      Q_ARG(QByteArray, imageData));
+        });
+#endif
+    });
+    const QString jobId = m_jobId;
+    const ImageEncoder::Codec codec = m_backend->imageCodec();
 
-            auto centers = cbor["cellCenters"_q].toMap();
-            auto* database = m_outputNode->getConnectedBlock<CellDatabaseBlock>();
-            if (!database) {
-                database = m_controller->blockManager()->addNewBlock<CellDatabaseBlock>();
-                if (!database) {
-                    qWarning() << "Could not create CellDatabaseBlock.";
-                    return;
-                }
-            }
-            database->importCenterData(centers);
-
-            auto* imageBlock = m_outputImageNode->getConnectedBlock<TissueImageBlock>();
-            bool newImageBlockCreated = false;
-            if (!imageBlock) {
-                imageBlock = m_controller->blockManager()->addNewBlock<TissueImageBlock>();
-                if (!imageBlock) {
-                    qWarning() << "Could not create TissueImageBlock.";
-                    return;
-                }
-                newImageBlockCreated = true;
+#ifdef THREADS_ENABLED
+    // the tiles are encoded and uploaded while the server already processes the first ones:
+    QtConcurrent::run([this, image, tiles, tiledRun, jobId, codec]() {
+        // several tiles are encoded in parallel, but they are uploaded in order:
+        const int maxEncodingTiles = 2 * ImageEncoder::threadPool()->maxThreadCount();
+        QVector<QFuture<QByteArray>> encodedTiles;
+        for (int i = 0; i < tiles.size(); ++i) {
+            if (m_tiledRun != tiledRun) return;  // cancelled
+            for (int next = encodedTiles.size(); next < qMin(tiles.size(), i + maxEncodingTiles); ++next) {
+                const QRect rect(tiles[next].x() * tileSize, tiles[next].y() * tileSize, tileSize, tileSize);
+                encodedTiles.append(ImageEncoder::encodeAsync(image.copy(rect.intersected(image.rect())), codec));
             }
-            imageBlock->focus();
-            imageBlock->attribute<StringAttribute>("label")->setValue("CNN Output");
-            imageBlock->loadRemoteFile(resultHash);
-            if (newImageBlockCreated) imageBlock->onCreatedByUser();
-        });
+            const QByteArray imageData = encodedTiles[i].result();
+            encodedTiles[i] = QFuture<QByteArray>();  // releases the data
+            // backend->uploadTile() needs to be called in main thread:
+            QMetaObject::invokeMethod(this,
+                                      "uploadTile",
+                                      Qt::QueuedConnection,
+                                      Q_ARG(QString, jobId),
+                                      Q_ARG(QPoint, tiles[i]),
+                                      Q_ARG(QByteArray, imageData));
+        }
     });
+#endif
+}
+
+void CnnInferenceBlock::uploadTile(QString jobId, QPoint tile, QByteArray imageData) {
+    if (jobId != m_jobId) return;
+    m_backend->uploadTile(jobId, tile, imageData);
+    ++m_uploadedTiles;
+    m_networkProgress = double(m_uploadedTiles) / m_tileCount;
+}
+
+void CnnInferenceBlock::storeOutputImage(QByteArray imageData) {
+    // the image block loads it from the cache instead of downloading the output of the server:
+    const QString hash = md5(imageData);
+    m_backend->blobCache()->store(hash, imageData);
+    showOutputImage(hash);
+}
+
+void CnnInferenceBlock::addOutputTile(QPoint tile, QByteArray pngData) {
+    const QImage tileImage = QImage::fromData(pngData, "PNG").convertToFormat(QImage::Format_RGB32);
+    const int tileSize = BackendManager::INFERENCE_TILE_SIZE;
+    const QRect rect = QRect(tile.x() * tileSize, tile.y() * tileSize, tileImage.width(), tileImage.height())
+            .intersected(m_outputImage.rect());
+    for (int y = 0; y < rect.height(); ++y) {
+        std::copy_n(reinterpret_cast<const QRgb*>(tileImage.constScanLine(y)), rect.width(),
+                    reinterpret_cast<QRgb*>(m_outputImage.scanLine(rect.top() + y)) + rect.left());
+    }
+    ++m_receivedOutputTiles;
+}
+
+QString CnnInferenceBlock::selectedModelId() const {
+    if (m_inputNode->isConnected()) {
+        const auto* modelBlock = m_inputNode->getConnectedBlock<CnnModelBlock>();
+        if (modelBlock) {
+            return modelBlock->modelId();
+        }
+    }
+    return "default";
+}
+
+QRect CnnInferenceBlock::selectedArea() const {
+    if (m_areaNode->isConnected()) {
+        const auto* areaBlock = m_areaNode->getConnectedBlock<RectangularAreaBlock>();
+        if (areaBlock) {
+            return areaBlock->area();
+        }
+    }
+    return QRect(0, 0, 0, 0);
+}
+
+void CnnInferenceBlock::importResult(QCborMap cbor) {
+    auto centers = cbor["cellCenters"_q].toMap();
+    auto* database = m_outputNode->getConnectedBlock<CellDatabaseBlock>();
+    if (!database) {
+        database = m_controller->blockManager()->addNewBlock<CellDatabaseBlock>();
+        if (!database) {
+            qWarning() << "Could not create CellDatabaseBlock.";
+            return;
+        }
+    }
+    database->importCenterData(centers);
+}
+
+void CnnInferenceBlock::showOutputImage(QString hash) {
+    auto* imageBlock = m_outputImageNode->getConnectedBlock<TissueImageBlock>();
+    bool newImageBlockCreated = false;
+    if (!imageBlock) {
+        imageBlock = m_controller->blockManager()->addNewBlock<TissueImageBlock>();
+        if (!imageBlock) {
+            qWarning() << "Could not create TissueImageBlock.";
+            return;
+        }
+        newImageBlockCreated = true;
+    }
+    imageBlock->focus();
+    imageBlock->attribute<StringAttribute>("label")->setValue("CNN Output");
+    imageBlock->loadRemoteFile(hash);
+    if (newImageBlockCreated) imageBlock->onCreatedByUser();
 }
@@ -3,6 +3,8 @@
 
 #include "core/block_basics/InOutBlock.h"
 
+#include <QAtomicInt>
+#include <QCborMap>
 #include <QImage>
 #include <QRect>
 
@@ -29,7 +31,9 @@ public:
                         "Dataset is created for it.<br><br>"
                         "The model to use for the neural network can be specified and the area "
                         "to apply the network on can be restricted (for example to reduce the "
-                        "computation time).";
+                        "computation time).<br><br>"
+                        "Models that were downloaded for offline use can also be applied on this "
+                        "computer without the server (see the backend settings).";
         info.qmlFile = "qrc:/microscopy/blocks/ai/CnnInferenceBlock.qml";
         info.orderHint = 1000 + 200 + 1;
         info.complete<CnnInferenceBlock>();
@@ -45,6 +49,7 @@ public slots:
     virtual BlockInfo getBlockInfo() const override { return info(); }
 
     void runInference(QImage image);
+    void cancel();
 
     void updateSources();
 
@@ -52,6 +57,20 @@ public slots:
 
 protected slots:
     void doInference(QByteArray imageData);
+    void uploadTile(QString jobId, QPoint tile, QByteArray imageData);
+    void storeOutputImage(QByteArray imageData);
+
+protected:
+    // streams the image tile by tile to servers that support it:
+    void runTiledInference(QImage image);
+    // without the server, see BackendManager::useLocalUnet():
+    void runLocalInference(QImage image);
+    void handleResult(QCborMap cbor);
+    void addOutputTile(QPoint tile, QByteArray pngData);
+    QString selectedModelId() const;
+    QRect selectedArea() const;
+    void importResult(QCborMap cbor);
+    void showOutputImage(QString hash);
 
 protected:
     BackendManager* m_backend;
@@ -67,6 +86,14 @@ protected:
     VariantListAttribute m_inputSources;
     DoubleAttribute m_networkProgress;
     BoolAttribute m_running;
+    QString m_jobId;
+
+    // tile-streamed inference:
+    QAtomicInt m_tiledRun;  // incremented to stop encoding the tiles of the previous run
+    int m_uploadedTiles = 0;
+    int m_receivedOutputTiles = 0;
+    int m_tileCount = 0;
+    QImage m_outputImage;
 
 };
 
@@ -49,9 +49,9 @@ BlockBase {
         }
 
         ButtonBottomLine {
-            text: "Run ▻"
+            text: block.attr("running").val ? "Cancel ✗" : "Run ▻"
             allUpperCase: false
-            onPress: captureInput()
+            onPress: block.attr("running").val ? block.cancel() : captureInput()
             OutputNodeCommand {
                 node: block.node("outputNode")
             }
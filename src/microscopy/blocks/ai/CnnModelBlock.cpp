@@ -2,13 +2,39 @@
 
 #include "core/CoreController.h"
 #include "core/manager/BlockList.h"
+#include "core/manager/GuiManager.h"
+
+#include "microscopy/manager/BackendManager.h"
+
+#include <QFile>
 
 
 bool CnnModelBlock::s_registered = BlockList::getInstance().addBlock(CnnModelBlock::info());
 
 CnnModelBlock::CnnModelBlock(CoreController* controller, QString uid)
     : OneOutputBlock(controller, uid)
+    , m_backend(m_controller->manager<BackendManager>("backendManager"))
     , m_modelName(this, "modelName", "")
     , m_modelId(this, "modelId", "")
+    , m_offlineAvailable(this, "offlineAvailable", false, /*persistent*/ false)
+    , m_downloadProgress(this, "downloadProgress", 0.0, 0.0, 1.0, /*persistent*/ false)
 {
+    connect(&m_modelId, &StringAttribute::valueChanged, this, &CnnModelBlock::updateOfflineAvailability);
+}
+
+void CnnModelBlock::downloadForOfflineUse() {
+    if (m_modelId.getValue().isEmpty()) return;
+    m_backend->downloadUnetModel(m_modelId, [this](double progress) {
+        m_downloadProgress = progress;
+    }, [this](bool success) {
+        m_downloadProgress = 0.0;
+        updateOfflineAvailability();
+        if (!success) {
+            m_controller->guiManager()->showToast("Could not download the model.", true);
+        }
+    });
+}
+
+void CnnModelBlock::updateOfflineAvailability() {
+    m_offlineAvailable = !m_modelId.getValue().isEmpty() && QFile::exists(m_backend->localModelPath(m_modelId));
 }
@@ -3,6 +3,7 @@
 
 #include "core/block_basics/OneOutputBlock.h"
 
+class BackendManager;
 
 class CnnModelBlock : public OneOutputBlock {
 
@@ -15,7 +16,8 @@ public:
         static BlockInfo info;
         info.typeName = "CNN Model";
         info.category << "Neural Network";
-        info.helpText = "Represents a trained CNN model.";
+        info.helpText = "Represents a trained CNN model.<br><br>"
+                        "The model can be downloaded to apply it without the server.";
         info.qmlFile = "qrc:/microscopy/blocks/ai/CnnModelBlock.qml";
         info.visibilityRequirements << VisibilityRequirement::InvisibleBlock;
         info.complete<CnnModelBlock>();
@@ -33,10 +35,22 @@ public slots:
     StringAttribute& modelId() { return m_modelId; }
     const StringAttribute& modelId() const { return m_modelId; }
 
+    // for BackendManager::applyUnetLocally()
+    void downloadForOfflineUse();
+
+protected:
+    void updateOfflineAvailability();
+
 protected:
+    BackendManager* m_backend;
+
     StringAttribute m_modelName;
     StringAttribute m_modelId;
 
+    // runtime:
+    BoolAttribute m_offlineAvailable;
+    DoubleAttribute m_downloadProgress;
+
 };
 
 #endif // CNNMODELBLOCK_H
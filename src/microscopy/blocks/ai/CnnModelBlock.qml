@@ -7,7 +7,7 @@ import "qrc:/core/ui/controls"
 BlockBase {
     id: root
     width: 180*dp
-    height: 3*30*dp
+    height: 4*30*dp
 
     StretchColumn {
         anchors.fill: parent
@@ -44,6 +44,19 @@ BlockBase {
             }
         }
 
+        ButtonBottomLine {
+            text: block.attr("offlineAvailable").val ? "Available Offline ✓" : "Download for Offline Use"
+            allUpperCase: false
+            enabled: !block.attr("offlineAvailable").val && block.attr("downloadProgress").val === 0.0
+            onPress: block.downloadForOfflineUse()
+
+            DotProgressIndicator {
+                anchors.right: parent.right
+                anchors.rightMargin: 15*dp
+                progress: block.attr("downloadProgress").val
+            }
+        }
+
         DragArea {
             text: "CNN Model"
 
@@ -11,6 +11,10 @@
 #include "microscopy/blocks/ai/TrainingDataBlock.h"
 #include "microscopy/blocks/ai/CnnModelBlock.h"
 
+#include <QFileInfo>
+
+#include <memory>
+
 
 bool CnnTrainingBlock::s_registered = BlockList::getInstance().addBlock(CnnTrainingBlock::info());
 
@@ -33,54 +37,83 @@ void CnnTrainingBlock::run() {
     const auto* validDataBlock = m_valDataNode->getConnectedBlock<TrainingDataBlock>();
     if (!validDataBlock) return;
     QString evalDataPath = m_controller->dao()->withoutFilePrefix(validDataBlock->path());
-    if (trainDataPath.isEmpty()) return;
+    if (evalDataPath.isEmpty()) return;
 
-    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
-    status->m_title = "Uploading Training Data...";
-    QByteArray trainData = m_controller->dao()->loadLocalFile(trainDataPath);
-    if (trainData.isEmpty()) {
-        m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+    if (QFileInfo(trainDataPath).size() == 0) {
         qWarning() << "Training data is empty";
         return;
     }
-    m_backend->uploadFile(trainData, [this, status](double progress){
+    if (QFileInfo(evalDataPath).size() == 0) {
+        qWarning() << "Evaluation data is empty";
+        return;
+    }
+
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    status->m_title = "Uploading Training and Evaluation Data...";
+
+    // both files are uploaded at the same time, the training starts when both are complete:
+    struct Uploads {
+        QStringList trainDataHashes;
+        QStringList validDataHashes;
+        double trainProgress = 0.0;
+        double validProgress = 0.0;
+        int finished = 0;
+        bool failed = false;
+    };
+    auto uploads = std::make_shared<Uploads>();
+
+    auto onProgress = [this, status, uploads]() {
+        const double progress = (uploads->trainProgress + uploads->validProgress) / 2;
         status->m_progress = progress;
-        m_networkProgress = progress * 0.5;
-    }, [this, evalDataPath, status](QString trainDataHash) {
-        QByteArray evalData = m_controller->dao()->loadLocalFile(evalDataPath);
-        if (evalData.isEmpty()) {
-            m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
-            qWarning() << "Evaluation data is empty";
+        m_networkProgress = progress;
+    };
+
+    auto onFinished = [this, status, uploads]() {
+        uploads->finished += 1;
+        if (uploads->finished < 2) return;
+        m_networkProgress = 0.0;
+        if (uploads->failed) {
+            status->m_title = "Error During Upload ✗";
+            status->closeIn(3000);
             return;
         }
-        status->m_title = "Uploading Evaluation Data...";
-        status->m_progress = 0.0;
-        m_backend->uploadFile(evalData, [this, status](double progress) {
-            status->m_progress = progress;
-            m_networkProgress = 0.5 + progress * 0.5;
-        }, [this, trainDataHash](QString validDataHash) {
-            m_networkProgress = 0.0;
-            m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
-
-            QString baseModel = "";
-            if (m_baseModelNode->isConnected()) {
-                const auto* baseModelBlock = m_baseModelNode->getConnectedBlock<CnnModelBlock>();
-                if (baseModelBlock) {
-                    baseModel = baseModelBlock->modelId();
-                }
+        m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+
+        QString baseModel = "";
+        if (m_baseModelNode->isConnected()) {
+            const auto* baseModelBlock = m_baseModelNode->getConnectedBlock<CnnModelBlock>();
+            if (baseModelBlock) {
+                baseModel = baseModelBlock->modelId();
             }
+        }
 
-            m_backend->trainUnet(m_modelName, baseModel, m_epochs, trainDataHash, validDataHash,
-                                 [this](QString modelId) {
-                auto* block = m_controller->blockManager()->addNewBlock<CnnModelBlock>();
-                if (!block) {
-                    qWarning() << "Could not create CnnModelBlock.";
-                    return;
-                }
-                block->focus();
-                block->modelName().setValue(m_modelName);
-                block->modelId().setValue(modelId);
-            });
+        m_backend->trainUnet(m_modelName, baseModel, m_epochs, uploads->trainDataHashes, uploads->validDataHashes,
+                             [this](QString modelId) {
+            auto* block = m_controller->blockManager()->addNewBlock<CnnModelBlock>();
+            if (!block) {
+                qWarning() << "Could not create CnnModelBlock.";
+                return;
+            }
+            block->focus();
+            block->modelName().setValue(m_modelName);
+            block->modelId().setValue(modelId);
         });
+    };
+
+    m_backend->uploadTrainingData(trainDataPath, [uploads, onProgress](double progress) {
+        uploads->trainProgress = progress;
+        onProgress();
+    }, [uploads, onFinished](QStringList trainDataHashes) {
+        uploads->trainDataHashes = trainDataHashes;
+        uploads->failed |= trainDataHashes.isEmpty();
+        onFinished();
+    });
+    m_backend->uploadTrainingData(evalDataPath, [uploads, onProgress](double progress) {
+        uploads->validProgress = progress;
+        onProgress();
+    }, [uploads, onFinished](QStringList validDataHashes) {
+        uploads->validDataHashes = validDataHashes;
+        uploads->failed |= validDataHashes.isEmpty();
+        onFinished();
     });
 }
@@ -2,13 +2,147 @@
 
 #include "core/CoreController.h"
 #include "core/manager/BlockList.h"
+#include "core/manager/GuiManager.h"
+#include "core/manager/StatusManager.h"
 #include "core/connections/Nodes.h"
+#include "core/helpers/utils.h"
+#include "microscopy/algorithms/ParallelFor.h"
+#include "microscopy/blocks/basic/CellDatabaseBlock.h"
+#include "microscopy/blocks/basic/TissueImageBlock.h"
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
+#include <algorithm>
+#include <cmath>
 
 
 bool FindCentersBlock::s_registered = BlockList::getInstance().addBlock(FindCentersBlock::info());
 
+namespace {
+
+    ConnectedComponents::Channel channelFromName(const QString& name) {
+        if (name == "Red") return ConnectedComponents::Channel::Red;
+        if (name == "Blue") return ConnectedComponents::Channel::Blue;
+        return ConnectedComponents::Channel::Green;
+    }
+
+    // for Format_Grayscale16 images and 16 bit images with the MSB in red and the LSB in green
+    std::vector<uchar> sixteenBitMask(const QImage& image, quint16 threshold) {
+        const int width = image.width();
+        const int height = image.height();
+        const bool grayscale = image.format() == QImage::Format_Grayscale16;
+        const QImage source = grayscale ? image : image.convertToFormat(QImage::Format_RGB32);
+        std::vector<uchar> mask(std::size_t(width) * std::size_t(height), 0);
+        parallelForChunks(height, [&](int, int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                uchar* maskLine = mask.data() + std::size_t(y) * std::size_t(width);
+                if (grayscale) {
+                    const quint16* line = reinterpret_cast<const quint16*>(source.constScanLine(y));
+                    for (int x = 0; x < width; ++x) {
+                        maskLine[x] = line[x] > threshold ? 1 : 0;
+                    }
+                } else {
+                    const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+                    for (int x = 0; x < width; ++x) {
+                        maskLine[x] = qRed(line[x]) * 256 + qGreen(line[x]) > threshold ? 1 : 0;
+                    }
+                }
+            }
+        }, /*minChunkSize*/ 64);
+        return mask;
+    }
+
+}  // namespace
+
 FindCentersBlock::FindCentersBlock(CoreController* controller, QString uid)
     : OneInputBlock(controller, uid)
+    , m_threshold(this, "threshold", 0.5)
+    , m_channel(this, "channel", "Green")
+    , m_minArea(this, "minArea", 1, 1, 100000)
+    , m_running(this, "running", false, /*persistent*/ false)
 {
     m_centerChannelNode = createInputNode("centerChannel");
 }
+
+void FindCentersBlock::run() {
+    if (m_running) return;
+    CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
+    auto* imageBlock = m_centerChannelNode->getConnectedBlock<TissueImageBlock>();
+    if (!db || !imageBlock) {
+        m_controller->guiManager()->showToast("Please connect an image and a dataset.");
+        return;
+    }
+    imageBlock->preparePixelAccess();
+    const QImage image = imageBlock->image();
+    if (image.isNull()) return;
+    const bool sixteenBit = image.format() == QImage::Format_Grayscale16
+            || static_cast<BoolAttribute*>(imageBlock->attr("interpretAs16Bit"))->getValue();
+    const double threshold = m_threshold;
+    const ConnectedComponents::Channel channel = channelFromName(m_channel);
+    const int minArea = m_minArea;
+
+    m_running = true;
+    m_targetDb = db;
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    status->m_title = "Finding Centers...";
+
+    auto run = [this, image, sixteenBit, threshold, channel, minArea]() {
+        auto begin = HighResTime::now();
+        std::vector<ConnectedComponents::Component> components;
+        if (sixteenBit) {
+            const std::vector<uchar> mask = sixteenBitMask(image, quint16(std::lround(threshold * 65535.0)));
+            components = ConnectedComponents::find(mask, image.width(), image.height());
+        } else {
+            // 0.5 is the same threshold of 127 as in get_cell_centers() in server/apply_unet.py:
+            components = ConnectedComponents::find(image, channel, int(threshold * 255.0));
+        }
+        components.erase(std::remove_if(components.begin(), components.end(), [minArea](const auto& component) {
+            return component.area < minArea;
+        }), components.end());
+        m_components = std::move(components);
+        qDebug() << "Found" << m_components.size() << "centers in" << HighResTime::getElapsedSecAndUpdate(begin) << "s";
+
+        // the dataset has to be modified in the main thread:
+        QMetaObject::invokeMethod(this, "applyResult", Qt::QueuedConnection);
+    };
+#ifdef THREADS_ENABLED
+    QtConcurrent::run(run);
+#else
+    run();
+#endif
+}
+
+void FindCentersBlock::applyResult() {
+    m_running = false;
+    m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+    std::vector<ConnectedComponents::Component> components = std::move(m_components);
+    m_components.clear();
+    CellDatabaseBlock* db = m_targetDb;
+    // the dataset could have been deleted in the meantime:
+    if (!db) return;
+
+    const int areaFeature = db->getOrCreateFeatureId("Area");
+    const int widthFeature = db->getOrCreateFeatureId("Bounding Box Width");
+    const int heightFeature = db->getOrCreateFeatureId("Bounding Box Height");
+    const int count = int(components.size());
+    QVector<QVector<double>> columns(std::max({areaFeature, widthFeature, heightFeature}) + 1);
+    for (int featureId: {int(CellDatabaseConstants::X_POS), int(CellDatabaseConstants::Y_POS),
+                         int(CellDatabaseConstants::RADIUS), areaFeature, widthFeature, heightFeature}) {
+        columns[featureId].reserve(count);
+    }
+    for (const auto& component: components) {
+        columns[CellDatabaseConstants::X_POS].append(component.x);
+        columns[CellDatabaseConstants::Y_POS].append(component.y);
+        // the radius of a circle with the same area:
+        columns[CellDatabaseConstants::RADIUS].append(std::sqrt(component.area / M_PI));
+        columns[areaFeature].append(component.area);
+        columns[widthFeature].append(component.bounds.width());
+        columns[heightFeature].append(component.bounds.height());
+    }
+    CellShape circle;
+    circle.fill(1.0f);
+    db->replaceCells(columns, QVector<CellShape>(count, circle));
+    m_controller->guiManager()->showToast(QString("%1 centers found ✓").arg(count));
+}
@@ -2,6 +2,9 @@
 #define FINDCENTERSBLOCK_H
 
 #include "core/block_basics/OneInputBlock.h"
+#include "microscopy/algorithms/ConnectedComponents.h"
+
+class CellDatabaseBlock;
 
 
 class FindCentersBlock : public OneInputBlock {
@@ -14,11 +17,16 @@ public:
     static BlockInfo info() {
         static BlockInfo info;
         info.typeName = "Find Centers";
-        info.nameInUi = "Dot Finder [n/a]";
+        info.nameInUi = "Dot Finder";
         info.category << "Actions";
-        info.helpText = "[Not implemented in the client yet, use the result of the server.]<br>"
-                        "Finds nuclei centers by looking for connected components in the "
-                        "provided image and stores their centroids in connected dataset.";
+        info.helpText = "Finds nuclei centers by looking for connected components in the "
+                        "provided image and stores their centroids in connected dataset.<br><br>"
+                        "A pixel belongs to a component if the value of the selected channel is "
+                        "larger than the threshold (for 16 bit images the 16 bit value is used). "
+                        "Components smaller than 'Min. Area' are ignored. The radius of each "
+                        "cell is estimated from the area of the component, the area and the size "
+                        "of the bounding box are stored as features.<br><br>"
+                        "The existing cells of the dataset are replaced.";
         info.qmlFile = "qrc:/microscopy/blocks/ai/FindCentersBlock.qml";
         info.orderHint = 1000 + 100 + 3;
         info.complete<FindCentersBlock>();
@@ -32,9 +40,25 @@ signals:
 public slots:
     virtual BlockInfo getBlockInfo() const override { return info(); }
 
+    void run();
+
+private slots:
+    void applyResult();
+
 protected:
     QPointer<NodeBase> m_centerChannelNode;
 
+    DoubleAttribute m_threshold;
+    StringAttribute m_channel;
+    IntegerAttribute m_minArea;
+
+    // runtime:
+    BoolAttribute m_running;
+
+    // only used by the worker thread while m_running is true:
+    std::vector<ConnectedComponents::Component> m_components;
+    QPointer<CellDatabaseBlock> m_targetDb;
+
 };
 
 #endif // FINDCENTERSBLOCK_H
@@ -7,7 +7,7 @@ import "qrc:/core/ui/controls"
 BlockBase {
     id: root
     width: 160*dp
-    height: 4*30*dp
+    height: 7*30*dp
 
     StretchColumn {
         anchors.fill: parent
@@ -15,6 +15,47 @@ BlockBase {
         ButtonBottomLine {
             text: "Run ▻"
             allUpperCase: false
+            enabled: !block.attr("running").val
+            onPress: block.run()
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            StretchText {
+                text: "Threshold:"
+            }
+            AttributeDotSlider {
+                width: 30*dp
+                implicitWidth: 0
+                attr: block.attr("threshold")
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            StretchText {
+                text: "Channel:"
+            }
+            AttributeOptionPicker {
+                width: 60*dp
+                implicitWidth: 0
+                attr: block.attr("channel")
+                optionListGetter: function () { return ["Red", "Green", "Blue"] }
+                openToLeft: true
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            StretchText {
+                text: "Min. Area:"
+            }
+            AttributeNumericInput {
+                width: 50*dp
+                implicitWidth: 0
+                attr: block.attr("minArea")
+                suffix: "px"
+            }
         }
 
         BlockRow {
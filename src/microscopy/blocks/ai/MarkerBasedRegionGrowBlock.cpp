@@ -28,20 +28,27 @@ MarkerBasedRegionGrowBlock::MarkerBasedRegionGrowBlock(CoreController* controlle
 }
 
 void MarkerBasedRegionGrowBlock::run() {
-    // TODO: this is dangerous and definitely not thread safe
+    if (m_isRunning) return;
+    if (!m_inputNode->isConnected()) return;
+    const QVector<int> cells = m_inputNode->constData().ids();
+    if (cells.isEmpty()) return;
+    CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
+    if (!db) return;
+    auto* imageBlock = m_maskNode->getConnectedBlock<TissueImageBlock>();
+    if (!imageBlock) return;
+
+    // the dataset is only read and modified in the main thread, the worker uses a copy of the centers:
+    QHash<int, QPoint> centers;
+    centers.reserve(cells.size());
+    for (int idx: cells) {
+        centers[idx] = QPoint(int(db->getFeature(CellDatabaseConstants::X_POS, idx)),
+                              int(db->getFeature(CellDatabaseConstants::Y_POS, idx)));
+    }
+    QPointer<CellDatabaseBlock> dbPointer(db);
 
 #ifdef THREADS_ENABLED
-    QtConcurrent::run([this]() {
-        if (!m_inputNode->isConnected()) return;
-        const auto& cells = m_inputNode->constData().ids();
-        if (cells.isEmpty()) return;
-        CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
-        if (!db) return;
-        auto* imageBlock = m_maskNode->getConnectedBlock<TissueImageBlock>();
-        if (!imageBlock) return;
-
-        if (m_isRunning) return;
-        m_isRunning = true;
+    m_isRunning = true;
+    QtConcurrent::run([this, cells, centers, dbPointer, imageBlock]() {
         Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
         status->m_title = "Region Grow...";
 
@@ -55,7 +62,8 @@ void MarkerBasedRegionGrowBlock::run() {
         for (int watershedStep = 1; watershedStep < maxSize; ++watershedStep) {
             m_progress = double(watershedStep) / 60;  // 60 is typically the max cell size, doesn't hurt if not
             status->m_progress = double(watershedStep) / 60;
-            const int cellsChanged = regionGrowStep(watershedStep, cells, db, imageBlock);
+            const int cellsChanged = regionGrowStep(watershedStep, cells, centers, imageBlock);
+            storeShapes(cells, dbPointer);
             if (cellsChanged <= 0) {
                 break;
             }
@@ -72,7 +80,7 @@ void MarkerBasedRegionGrowBlock::run() {
 #endif
 }
 
-int MarkerBasedRegionGrowBlock::regionGrowStep(int watershedStep, const QVector<int>& cells, CellDatabaseBlock* db, TissueImageBlock* imageBlock) {
+int MarkerBasedRegionGrowBlock::regionGrowStep(int watershedStep, const QVector<int>& cells, const QHash<int, QPoint>& centers, TissueImageBlock* imageBlock) {
     const int radiiCount = CellDatabaseConstants::RADII_COUNT;
     // TODO: check if this is actually called watershed or region grow
     // 12s for 12k cells
@@ -85,18 +93,18 @@ int MarkerBasedRegionGrowBlock::regionGrowStep(int watershedStep, const QVector<
         if (done) continue;
         ++cellsChanged;
 
-        const int centerX = int(db->getFeature(CellDatabaseConstants::X_POS, nucleusIdx));
-        const int centerY = int(db->getFeature(CellDatabaseConstants::Y_POS, nucleusIdx));
+        const int centerX = centers[nucleusIdx].x();
+        const int centerY = centers[nucleusIdx].y();
 
         // find neighbours:
         QVector<int> neighbours;
         for (int neighbourIdx: cells) {
             if (neighbourIdx == nucleusIdx) continue;
             // check if manhatten distance:
-            const int neighbourX = int(db->getFeature(CellDatabaseConstants::X_POS, neighbourIdx));
+            const int neighbourX = centers[neighbourIdx].x();
             if (std::abs(neighbourX - centerX) >= maxNeighbourDistance) continue;
 
-            const int neighbourY = int(db->getFeature(CellDatabaseConstants::Y_POS, neighbourIdx));
+            const int neighbourY = centers[neighbourIdx].y();
             if (std::abs(neighbourY - centerY) >= maxNeighbourDistance) continue;
 
             neighbours.append(neighbourIdx);
@@ -118,8 +126,8 @@ int MarkerBasedRegionGrowBlock::regionGrowStep(int watershedStep, const QVector<
             } else {
                 // radius is still on the mask but maybe touches another cell:
                 for (int neighbourIdx: neighbours) {
-                    const int neighbourX = int(db->getFeature(CellDatabaseConstants::X_POS, neighbourIdx));
-                    const int neighbourY = int(db->getFeature(CellDatabaseConstants::Y_POS, neighbourIdx));
+                    const int neighbourX = centers[neighbourIdx].x();
+                    const int neighbourY = centers[neighbourIdx].y();
                     const int dx = radiusEndpointX - neighbourX;
                     const int dy = radiusEndpointY - neighbourY;
                     // angle from neighbour center to radius endpoint, between 0 and 2*pi
@@ -143,23 +151,35 @@ int MarkerBasedRegionGrowBlock::regionGrowStep(int watershedStep, const QVector<
         }
     }
 
-    // 6ms for 12k cells
-    for (int idx: cells) {
+    qDebug() << watershedStep << cellsChanged;
+    return cellsChanged;
+}
+
+void MarkerBasedRegionGrowBlock::storeShapes(const QVector<int>& cells, QPointer<CellDatabaseBlock> db) {
+    const int radiiCount = CellDatabaseConstants::RADII_COUNT;
+    QVector<double> radii(cells.size());
+    QVector<CellShape> shapes(cells.size());
+    for (int i = 0; i < cells.size(); ++i) {
+        const auto& intermediate = m_radiiIntermediate[cells[i]];
         int maxValue = 0;
         for (std::size_t radiusIndex = 0; radiusIndex < radiiCount; ++radiusIndex) {
-            maxValue = std::max(maxValue, m_radiiIntermediate[idx][radiusIndex]);
+            maxValue = std::max(maxValue, intermediate[radiusIndex]);
         }
-
-        db->setFeature(CellDatabaseConstants::RADIUS, idx, double(maxValue));
-        CellShape shape;
+        radii[i] = double(maxValue);
         for (std::size_t radiusIndex = 0; radiusIndex < radiiCount; ++radiusIndex) {
-            shape[radiusIndex] = m_radiiIntermediate[idx][radiusIndex] / float(maxValue);
+            shapes[i][radiusIndex] = intermediate[radiusIndex] / float(maxValue);
         }
-        db->setShape(idx, shape);
     }
 
-    db->dataWasModified();
-    emit db->existingDataChanged();
-    qDebug() << watershedStep << cellsChanged;
-    return cellsChanged;
+    // the dataset has to be modified in the main thread, all cells of a step are one update:
+    QMetaObject::invokeMethod(this, [db, cells, radii, shapes]() {
+        if (!db) return;
+        // cells could have been removed in the meantime:
+        if (!cells.isEmpty() && *std::max_element(cells.begin(), cells.end()) >= db->getCount()) return;
+        CellDatabaseBlock::Transaction transaction(db);
+        db->setFeatureValues(CellDatabaseConstants::RADIUS, cells, radii);
+        for (int i = 0; i < cells.size(); ++i) {
+            db->setShape(cells[i], shapes[i]);
+        }
+    }, Qt::QueuedConnection);
 }
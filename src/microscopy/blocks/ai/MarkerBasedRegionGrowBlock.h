@@ -5,6 +5,8 @@
 
 #include "microscopy/blocks/basic/CellDatabaseBlock.h"
 
+#include <QPoint>
+
 class TissueImageBlock;
 
 
@@ -42,7 +44,10 @@ public slots:
     void run();
 
 protected:
-    int regionGrowStep(int watershedStep, const QVector<int>& cells, CellDatabaseBlock* db, TissueImageBlock* imageBlock);
+    // only uses the worker's own state, the dataset is not accessed:
+    int regionGrowStep(int watershedStep, const QVector<int>& cells, const QHash<int, QPoint>& centers, TissueImageBlock* imageBlock);
+    // applies the current radii to the dataset in the main thread:
+    void storeShapes(const QVector<int>& cells, QPointer<CellDatabaseBlock> db);
 
     QPointer<NodeBase> m_maskNode;
 
@@ -2,14 +2,26 @@
 
 #include "core/CoreController.h"
 #include "core/manager/BlockList.h"
+#include "core/manager/StatusManager.h"
 #include "core/connections/Nodes.h"
+#include "core/helpers/utils.h"
 #include "microscopy/blocks/basic/CellDatabaseBlock.h"
 
-#include <random>
+#include <QRandomGenerator>
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 
 bool RandomCellGeneratorBlock::s_registered = BlockList::getInstance().addBlock(RandomCellGeneratorBlock::info());
 
+static_assert(RandomCells::SHAPE_RADII == CellDatabaseConstants::RADII_COUNT, "Shape sizes have to match");
+
 RandomCellGeneratorBlock::RandomCellGeneratorBlock(CoreController* controller, QString uid)
     : OneInputBlock(controller, uid)
     , m_areaSize(this, "areaSize", 2000, 10, 32000)
@@ -18,74 +30,82 @@ RandomCellGeneratorBlock::RandomCellGeneratorBlock(CoreController* controller, Q
     , m_maxCellRadius(this, "maxCellRadius", 25, 1, 500)
     , m_twinCount(this, "twinCount", 2, 0, 10)
     , m_elongated(this, "elongated", 0.3)
+    , m_overlap(this, "overlap", 0.1)
+    , m_seed(this, "seed", 0, 0, std::numeric_limits<int>::max())
+    , m_running(this, "running", false, /*persistent*/ false)
 {
     m_examplesNode = createInputNode("examples");
 }
 
 void RandomCellGeneratorBlock::run() {
+    if (m_running) return;
     CellDatabaseBlock* db = m_inputNode->constData().referenceObject<CellDatabaseBlock>();
     if (!db) return;
 
+    // the examples can only be read in the main thread:
+    std::vector<RandomCells::Example> examples;
     CellDatabaseBlock* examplesDb = m_examplesNode->constData().referenceObject<CellDatabaseBlock>();
+    if (examplesDb) {
+        for (int i = 0; i < examplesDb->getCount(); ++i) {
+            RandomCells::Example example;
+            example.radius = float(examplesDb->getFeature(CellDatabaseConstants::RADIUS, i));
+            example.shape = examplesDb->getShape(i);
+            const float maxShapeValue = *std::max_element(example.shape.begin(), example.shape.end());
+            // cells without a shape can't be used:
+            if (example.radius <= 0.0f || maxShapeValue <= 0.0f) continue;
+            examples.push_back(example);
+        }
+    }
+
+    RandomCells::Parameters parameters;
+    parameters.areaSize = float(m_areaSize.getValue());
+    parameters.count = int(std::pow(m_areaSize / 100, 2) * m_density * 10);
+    parameters.minRadius = float(m_minCellRadius.getValue());
+    parameters.maxRadius = float(m_maxCellRadius.getValue());
+    parameters.maxTwins = m_twinCount;
+    parameters.elongated = float(m_elongated.getValue());
+    parameters.overlap = float(m_overlap.getValue());
+    parameters.seed = m_seed.getValue() > 0 ? quint32(m_seed.getValue()) : QRandomGenerator::global()->generate();
 
-    const int minCellRadius = examplesDb ? int(examplesDb->featureMin(CellDatabaseConstants::RADIUS)) : m_minCellRadius;
-    const int maxCellRadius = examplesDb ? int(examplesDb->featureMax(CellDatabaseConstants::RADIUS)) : m_maxCellRadius;
+    m_running = true;
+    m_targetDb = db;
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    status->m_title = "Generating Cells...";
 
-    std::uniform_real_distribution<double> positionDist(0, m_areaSize);
-    std::uniform_int_distribution<int> twinDist(0, m_twinCount);
-    std::uniform_real_distribution<double> sizeDist(minCellRadius, maxCellRadius);
-    std::uniform_real_distribution<float> roundEllipseDist(0.7f, 1.0f);
-    std::uniform_real_distribution<float> elongatedEllipseDist(0.17f, 0.4f);
-    std::uniform_real_distribution<double> normDist(0.0, 1.0);
-    std::uniform_real_distribution<float> normDistF(0.0f, 1.0f);
-    std::uniform_real_distribution<float> shapeRoughnessDist(0.9f, 1.0f);
-    std::uniform_real_distribution<double> twinOffsetDist(0.9, 1.3);
+    auto run = [this, parameters, examples]() {
+        auto begin = HighResTime::now();
+        m_generatedCells = RandomCells::generate(parameters, examples);
+        qDebug() << "Generated" << m_generatedCells.size() << "cells in" << HighResTime::getElapsedSecAndUpdate(begin) << "s";
+
+        // the dataset has to be modified in the main thread:
+        QMetaObject::invokeMethod(this, "addGeneratedCells", Qt::QueuedConnection);
+    };
+#ifdef THREADS_ENABLED
+    QtConcurrent::run(run);
+#else
+    run();
+#endif
+}
+
+void RandomCellGeneratorBlock::addGeneratedCells() {
+    m_running = false;
+    m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+    RandomCells::Cells cells = std::move(m_generatedCells);
+    m_generatedCells = RandomCells::Cells();
+    CellDatabaseBlock* db = m_targetDb;
+    // the dataset could have been deleted in the meantime:
+    if (!db) return;
 
     const int elongatedFeature = db->getOrCreateFeatureId("elongated");
-    qDebug() << elongatedFeature;
-
-    const int count = int(std::pow(m_areaSize / 100, 2) * m_density * 10);
-    for (int i = 0; i < count; ++i) {
-        const double x = positionDist(m_engine);
-        const double y = positionDist(m_engine);
-        const bool elongated = normDist(m_engine) < m_elongated;
-        const double radius = elongated ? sizeDist(m_engine) * 1.3 : sizeDist(m_engine);
-        const int idx = db->addCenter(x, y);
-        db->setFeature(CellDatabaseConstants::RADIUS, idx, radius);
-        db->setFeature(elongatedFeature, idx, elongated ? 1.0 : 0.0);
-
-        const float ellipseFactor = elongated ? elongatedEllipseDist(m_engine) : roundEllipseDist(m_engine);
-        const float rotation = normDistF(m_engine);
-        CellShape shape;
-        // TODO: get shape from examples
-        for (std::size_t j = 0; j < CellDatabaseConstants::RADII_COUNT; ++j) {
-            const float pos = j / float(CellDatabaseConstants::RADII_COUNT - 1);
-            // from https://math.stackexchange.com/a/432907 with a = 1 and b = ellipseStrength
-            const float angle = (rotation + pos) * float(M_PI) * 2;
-            const float ellipseRadius = ellipseFactor / std::sqrt(std::pow(std::sin(angle), 2.0f) + std::pow(ellipseFactor, 2.0f) * std::pow(std::cos(angle), 2.0f));
-            shape[j] = ellipseRadius * shapeRoughnessDist(m_engine);
-        }
-        db->setShape(idx, shape);
-
-        const int twinCount = twinDist(m_engine);
-        for (int j = 0; j < twinCount; ++j) {
-            const double twinAngle = normDist(m_engine) * M_PI * 2;
-            const double offset = twinOffsetDist(m_engine);
-            const double dx = std::cos(twinAngle) * radius * 2 * offset;
-            const double dy = std::sin(twinAngle) * radius * 2 * offset;
-            const int twinIdx = db->addCenter(x + dx, y + dy);
-            db->setFeature(CellDatabaseConstants::RADIUS, twinIdx, radius);
-            db->setFeature(elongatedFeature, twinIdx, elongated ? 1.0 : 0.0);
-            CellShape twinShape;
-            for (std::size_t j = 0; j < CellDatabaseConstants::RADII_COUNT; ++j) {
-                const float pos = j / float(CellDatabaseConstants::RADII_COUNT - 1);
-                // from https://math.stackexchange.com/a/432907 with a = 1 and b = ellipseStrength
-                const float angle = (rotation + pos) * float(M_PI) * 2 * float(offset);
-                const float ellipseRadius = ellipseFactor / std::sqrt(std::pow(std::sin(angle), 2.0f) + std::pow(ellipseFactor, 2.0f) * std::pow(std::cos(angle), 2.0f));
-                twinShape[j] = ellipseRadius * shapeRoughnessDist(m_engine);
-            }
-            db->setShape(twinIdx, twinShape);
-        }
+    const int count = cells.size();
+    QVector<QVector<double>> columns(elongatedFeature + 1);
+    columns[CellDatabaseConstants::X_POS] = QVector<double>(cells.x.begin(), cells.x.end());
+    columns[CellDatabaseConstants::Y_POS] = QVector<double>(cells.y.begin(), cells.y.end());
+    columns[CellDatabaseConstants::RADIUS] = QVector<double>(cells.radius.begin(), cells.radius.end());
+    columns[elongatedFeature].reserve(count);
+    for (char elongated: cells.elongated) {
+        columns[elongatedFeature].append(elongated ? 1.0 : 0.0);
     }
-    db->dataWasModified();
+    const QVector<CellShape> shapes(cells.shapes.begin(), cells.shapes.end());
+    db->appendCells(columns, shapes);
 }
@@ -2,8 +2,9 @@
 #define RANDOMCELLGENERATORBLOCK_H
 
 #include "core/block_basics/OneInputBlock.h"
+#include "microscopy/algorithms/RandomCells.h"
 
-#include <random>
+class CellDatabaseBlock;
 
 
 class RandomCellGeneratorBlock : public OneInputBlock {
@@ -28,7 +29,13 @@ public:
                         "dataset can be provided that will be used to calculate the min and max "
                         "radius. 'Elongated' specifies how many percent of the cells will be "
                         "elongated. 'Twins' is the maximum amount of twin cells that will be "
-                        "generated per cell.";
+                        "generated per cell.<br><br>"
+                        "If the example dataset contains cell shapes, the shapes and radii of the "
+                        "new cells are drawn from it. 'Overlap' is how much two cells may overlap, "
+                        "relative to the sum of their radii. Cells that don't fit are skipped, so "
+                        "the count can be lower than the density suggests.<br><br>"
+                        "The same seed always generates the same cells, 0 uses a new random seed "
+                        "each time.";
         info.qmlFile = "qrc:/microscopy/blocks/ai/RandomCellGeneratorBlock.qml";
         info.orderHint = 1000 + 200 + 2;
         info.complete<RandomCellGeneratorBlock>();
@@ -44,6 +51,9 @@ public slots:
 
     void run();
 
+private slots:
+    void addGeneratedCells();
+
 protected:
     QPointer<NodeBase> m_examplesNode;
 
@@ -53,11 +63,15 @@ protected:
     IntegerAttribute m_maxCellRadius;
     IntegerAttribute m_twinCount;
     DoubleAttribute m_elongated;
+    DoubleAttribute m_overlap;
+    IntegerAttribute m_seed;
 
     // runtime:
+    BoolAttribute m_running;
 
-    std::random_device m_rd;
-    mutable std::default_random_engine m_engine;
+    // only used by the worker thread while m_running is true:
+    RandomCells::Cells m_generatedCells;
+    QPointer<CellDatabaseBlock> m_targetDb;
 
 };
 
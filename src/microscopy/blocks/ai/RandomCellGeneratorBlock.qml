@@ -7,7 +7,7 @@ import "qrc:/core/ui/controls"
 BlockBase {
     id: root
     width: 170*dp
-    height: 9*30*dp
+    height: 11*30*dp
 
     StretchColumn {
         anchors.fill: parent
@@ -15,6 +15,7 @@ BlockBase {
         ButtonBottomLine {
             text: "Generate ▻"
             allUpperCase: false
+            enabled: !block.attr("running").val
             onPress: block.run()
         }
 
@@ -89,6 +90,30 @@ BlockBase {
             }
         }
 
+        BlockRow {
+            leftMargin: 5*dp
+            StretchText {
+                text: "Overlap:"
+            }
+            AttributeDotSlider {
+                width: 30*dp
+                implicitWidth: 0
+                attr: block.attr("overlap")
+            }
+        }
+
+        BlockRow {
+            leftMargin: 5*dp
+            StretchText {
+                text: "Seed:"
+            }
+            AttributeNumericInput {
+                width: 90*dp
+                implicitWidth: 0
+                attr: block.attr("seed")
+            }
+        }
+
         BlockRow {
             InputNodeCommand {
                 node: block.node("examples")
@@ -15,8 +15,8 @@ public:
         static BlockInfo info;
         info.typeName = "Training Data";
         info.category << "Neural Network";
-        info.helpText = "Points to a .cbor file that contains the input and target images "
-                        "to train a CNN.";
+        info.helpText = "Points to a .tdata file (or an older .cbor file) that contains the "
+                        "input and target images to train a CNN.";
         info.qmlFile = "qrc:/microscopy/blocks/ai/TrainingDataBlock.qml";
         info.visibilityRequirements << VisibilityRequirement::InvisibleBlock;
         info.complete<TrainingDataBlock>();
@@ -57,7 +57,7 @@ BlockBase {
                         folder: shortcuts.documents
                         selectMultiple: false
                         selectExisting: true
-                        nameFilters: "CBOR Files (*.cbor)"
+                        nameFilters: "Training Data (*.tdata *.cbor)"
                         onAccepted: {
                             if (fileUrl) {
                                 block.attr("path").val = fileUrl
@@ -10,9 +10,46 @@
 #include "microscopy/blocks/ai/TrainingDataBlock.h"
 #include "microscopy/blocks/basic/TissueImageBlock.h"
 #include "microscopy/blocks/selection/RectangularAreaBlock.h"
+#include "microscopy/manager/BackendManager.h"
+#include "microscopy/manager/ImageEncoder.h"
+#include "microscopy/manager/TrainingDataFile.h"
+#include "microscopy/algorithms/ParallelFor.h"
+#include "microscopy/algorithms/PatchAugmentation.h"
 
-#include <QBuffer>
-#include <QImageWriter>
+#include "core/helpers/utils.h"
+
+#include <QRandomGenerator>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
+
+namespace {
+
+    const static int PATCHES_PER_BATCH = 64;
+
+    // the display settings of the block, as they are used by TissueChannelUi.qml
+    PatchAugmentation::ChannelSource channelSource(TissueImageBlock* block) {
+        PatchAugmentation::ChannelSource source;
+        if (!block) return source;
+        block->preparePixelAccess();
+        source.image = block->image();
+        source.interpretAs16Bit = static_cast<BoolAttribute*>(block->attr("interpretAs16Bit"))->getValue();
+        source.blackLevel = float(std::pow(static_cast<DoubleAttribute*>(block->attr("blackLevel"))->getValue(), 2.0));
+        source.whiteLevel = float(static_cast<DoubleAttribute*>(block->attr("whiteLevel"))->getValue());
+        source.gamma = float(static_cast<DoubleAttribute*>(block->attr("gamma"))->getValue());
+        source.opacity = float(static_cast<DoubleAttribute*>(block->attr("opacity"))->getValue());
+        const QColor color = static_cast<HsvAttribute*>(block->attr("color"))->getQColor();
+        source.color = {{float(color.redF()), float(color.greenF()), float(color.blueF())}};
+        return source;
+    }
+
+}  // namespace
 
 
 bool TrainingDataPreprocessingBlock::s_registered = BlockList::getInstance().addBlock(TrainingDataPreprocessingBlock::info());
@@ -24,6 +61,8 @@ TrainingDataPreprocessingBlock::TrainingDataPreprocessingBlock(CoreController* c
     , m_imagesToGenerate(this, "imagesToGenerate", 100, 1, 10000)
     , m_inputSources(this, "inputSources", {{}, {}, {}}, /*persistent*/ false)
     , m_targetSources(this, "targetSources", {{}, {}, {}}, /*persistent*/ false)
+    , m_running(this, "running", false, /*persistent*/ false)
+    , m_progress(this, "progress", 0.0, 0.0, 1.0, /*persistent*/ false)
 {
     m_input1Node = createInputNode("input1");
     m_input2Node = createInputNode("input2");
@@ -55,45 +94,93 @@ void TrainingDataPreprocessingBlock::updateSources() {
     m_targetSources.valueChanged();
 }
 
-void TrainingDataPreprocessingBlock::createNewDataFile(QString filename) {
-    if (!filename.endsWith(".cbor")) {
-        filename.append(".cbor");
+void TrainingDataPreprocessingBlock::generateDataFile(QString filename) {
+    if (m_running) return;
+    if (!filename.endsWith(TrainingDataFile::EXTENSION)) {
+        filename.append(TrainingDataFile::EXTENSION);
+    }
+    filename = m_controller->dao()->withoutFilePrefix(filename);
+
+    std::array<PatchAugmentation::ChannelSource, 3> inputs;
+    std::array<PatchAugmentation::ChannelSource, 3> targets;
+    const std::array<NodeBase*, 3> inputNodes = {{m_input1Node, m_input2Node, m_input3Node}};
+    const std::array<NodeBase*, 3> targetNodes = {{m_target1Node, m_target2Node, m_target3Node}};
+    for (std::size_t i = 0; i < 3; ++i) {
+        inputs[i] = channelSource(inputNodes[i]->getConnectedBlock<TissueImageBlock>());
+        targets[i] = channelSource(targetNodes[i]->getConnectedBlock<TissueImageBlock>());
     }
-    m_currentDataFilename = filename;
-    m_inputImages.clear();
-    m_targetImages.clear();
+    const QRect area = this->area();
+    const int count = m_imagesToGenerate;
+    const double maxNoise = m_noise;
+    const double maxBrightnessChange = m_brightness;
+    const quint32 seed = QRandomGenerator::global()->generate();
+    // the file is read by the server later, the codec has to be supported by it:
+    const ImageEncoder::Codec codec = m_controller->manager<BackendManager>("backendManager")->imageCodec();
+
+    m_running = true;
+    m_progress = 0.0;
     Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
     status->m_title = "Generating Patches...";
-}
 
-void TrainingDataPreprocessingBlock::addInputImage(QImage image) {
-    // 40ms 16MB PNG, 8ms PNG uncompressed 50MB, 0.5ms 50MB TIF, 4ms 13MB JPG 100
-    // JPG always does chroma subsampling, even at quality 100
-    QByteArray pngData;
-    QBuffer buffer(&pngData);
-    buffer.open(QIODevice::WriteOnly);
-    image.save(&buffer, "PNG", 80);
-    m_inputImages.append(pngData);
-}
+    auto run = [this, filename, inputs, targets, area, count, maxNoise, maxBrightnessChange, seed, codec]() {
+        auto begin = HighResTime::now();
+        const PatchAugmentation::Renderer renderer(inputs, targets, area);
+        // Qoi is not compressed as much as the other codecs:
+        TrainingDataFile::Writer writer(filename, /*compressed*/ codec == ImageEncoder::Codec::Qoi);
+        // the patches are generated in parallel batch by batch and written in order,
+        // only one batch is in memory at a time:
+        std::vector<QByteArray> inputImages(std::size_t(PATCHES_PER_BATCH));
+        std::vector<QByteArray> targetImages(std::size_t(PATCHES_PER_BATCH));
+        for (int batchBegin = 0; batchBegin < count && writer.isOpen(); batchBegin += PATCHES_PER_BATCH) {
+            const int batchSize = std::min(PATCHES_PER_BATCH, count - batchBegin);
+            parallelForChunks(batchSize, [&](int, int first, int end) {
+                for (int i = first; i < end; ++i) {
+                    // one generator per patch, so that the result doesn't depend on the number of threads:
+                    std::mt19937 random(seed + quint32(batchBegin + i));
+                    const auto parameters = PatchAugmentation::randomParameters(random, maxNoise, maxBrightnessChange);
+                    inputImages[std::size_t(i)] = ImageEncoder::encode(renderer.renderInput(parameters), codec);
+                    targetImages[std::size_t(i)] = ImageEncoder::encode(renderer.renderTarget(parameters), codec);
+                }
+            }, /*minChunkSize*/ 4);
+            for (int i = 0; i < batchSize; ++i) {
+                writer.append(inputImages[std::size_t(i)], targetImages[std::size_t(i)]);
+            }
+            QMetaObject::invokeMethod(this,
+                                      "updateProgress",
+                                      Qt::QueuedConnection,
+                                      Q_ARG(double, double(batchBegin + batchSize) / count));
+        }
+        const bool success = writer.finish();
+        qDebug() << "Generated" << writer.recordCount() << "patches in" << HighResTime::getElapsedSecAndUpdate(begin) << "s";
 
-void TrainingDataPreprocessingBlock::addTargetImage(QImage image) {
-    QByteArray pngData;
-    QBuffer buffer(&pngData);
-    buffer.open(QIODevice::WriteOnly);
-    image.save(&buffer, "PNG", 80);
-    m_targetImages.append(pngData);
+        // blocks have to be created in main thread:
+        QMetaObject::invokeMethod(this,
+                                  "addTrainingDataBlock",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(QString, success ? filename : QString()));
+    };
+#ifdef THREADS_ENABLED
+    QtConcurrent::run(run);
+#else
+    run();
+#endif
 }
 
-void TrainingDataPreprocessingBlock::writeDataFile() {
-    QString filename = m_controller->dao()->withoutFilePrefix(m_currentDataFilename);
-    auto data = QCborMap();
-    data["inputImages"_q] = m_inputImages;
-    data["targetImages"_q] = m_targetImages;
-    m_controller->dao()->saveLocalFile(filename, data.toCborValue().toCbor());
-    m_currentDataFilename.clear();
-    m_inputImages.clear();
-    m_targetImages.clear();
+void TrainingDataPreprocessingBlock::updateProgress(double progress) {
+    if (!m_running) return;
+    m_progress = progress;
+    m_controller->manager<StatusManager>("statusManager")->getStatus(getUid())->m_progress = progress;
+}
 
+void TrainingDataPreprocessingBlock::addTrainingDataBlock(QString filename) {
+    m_running = false;
+    m_progress = 0.0;
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    if (filename.isEmpty()) {
+        status->m_title = "Error While Writing Training Data ✗";
+        status->closeIn(3000);
+        return;
+    }
     auto* block = m_controller->blockManager()->addNewBlock<TrainingDataBlock>();
     if (!block) {
         qWarning() << "Could not create TrainingDataBlock.";
@@ -101,7 +188,6 @@ void TrainingDataPreprocessingBlock::writeDataFile() {
     }
     block->focus();
     block->path().setValue(filename);
-    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
     status->m_title = "Training Data Complete ✓";
     status->closeIn(3000);
 }
@@ -3,8 +3,6 @@
 
 #include "core/block_basics/OneInputBlock.h"
 
-#include <QImage>
-
 
 class TrainingDataPreprocessingBlock : public OneInputBlock {
 
@@ -19,8 +17,10 @@ public:
         info.nameInUi = "Train Data Preproc.";
         info.category << "Neural Network";
         info.helpText = "Splits input images and their corresponding target images in random "
-                        "patches, augments them and stores them in a .cbor file, ready to be "
-                        "used to train a network.";
+                        "patches, augments them and stores them in a training data file, ready to be "
+                        "used to train a network.<br><br>"
+                        "The preview shows an example patch, the patches of the file are "
+                        "generated in the background in the same way.";
         info.qmlFile = "qrc:/microscopy/blocks/ai/TrainingDataPreprocessingBlock.qml";
         info.orderHint = 1000 + 200 + 4;
         info.complete<TrainingDataPreprocessingBlock>();
@@ -36,15 +36,15 @@ public slots:
 
     void updateSources();
 
-    void createNewDataFile(QString filename);
-
-    void addInputImage(QImage image);
-    void addTargetImage(QImage image);
-
-    void writeDataFile();
+    // generates the patches on the CPU in parallel, see PatchAugmentation::Renderer
+    void generateDataFile(QString filename);
 
     QRect area() const;
 
+protected slots:
+    void updateProgress(double progress);
+    void addTrainingDataBlock(QString filename);
+
 protected:
     QPointer<NodeBase> m_input1Node;
     QPointer<NodeBase> m_input2Node;
@@ -60,10 +60,8 @@ protected:
     // runtime:
     VariantListAttribute m_inputSources;
     VariantListAttribute m_targetSources;
-
-    QString m_currentDataFilename;
-    QCborArray m_inputImages;
-    QCborArray m_targetImages;
+    BoolAttribute m_running;
+    DoubleAttribute m_progress;
 
 };
 
@@ -17,14 +17,7 @@ BlockBase {
     property real noise: 0.0
     property real brightness: 1.0
 
-    property int alreadyGenerated: 0
-
-    function startGenerating(filename) {
-        block.createNewDataFile(filename)
-        alreadyGenerated = 0
-        refresh()
-    }
-
+    // only for the preview, the patches of the file are generated by the block in the same way
     function setNewRandomValues() {
         xOffset = Math.random()
         yOffset = Math.random()
@@ -33,40 +26,6 @@ BlockBase {
         brightness =  1 - (Math.random() * 1.3 - 0.3) * block.attr("brightness").val
     }
 
-    function refresh() {
-        setNewRandomValues()
-        waitForRenderingTimer.start()
-    }
-
-    Timer {
-        id: waitForRenderingTimer
-        interval: 30
-        repeat: false
-        running:  false
-        onTriggered: captureInput()
-    }
-
-    function captureInput() {
-        inputImageArea.grabToImage(function(result) {
-            block.addInputImage(result.image)
-            captureTarget()
-        }, Qt.size(256, 256));
-    }
-
-    function captureTarget() {
-        targetImageArea.grabToImage(function(result) {
-            block.addTargetImage(result.image)
-            alreadyGenerated = alreadyGenerated + 1
-            statusManager.getStatus(block.getUid()).attr("progress").val = alreadyGenerated / block.attr("imagesToGenerate").val
-            if (alreadyGenerated < block.attr("imagesToGenerate").val) {
-                refresh()
-            } else {
-                block.writeDataFile()
-                alreadyGenerated = 0
-            }
-        }, Qt.size(256, 256));
-    }
-
     StretchColumn {
         anchors.fill: parent
 
@@ -109,7 +68,7 @@ BlockBase {
             height: 2*dp
             Rectangle {
                 height: parent.height
-                width: parent.width * (alreadyGenerated / block.attr("imagesToGenerate").val)
+                width: parent.width * block.attr("progress").val
                 color: "lightgreen"
             }
         }
@@ -132,6 +91,7 @@ BlockBase {
             ButtonBottomLine {
                 text: "Generate all ▻"
                 allUpperCase: false
+                enabled: !block.attr("running").val
                 onPress: saveDialog.active = true
 
                 Loader {
@@ -143,9 +103,9 @@ BlockBase {
                         folder: shortcuts.documents
                         selectMultiple: false
                         selectExisting: false
-                        nameFilters: "CBOR Files (*.cbor)"
+                        nameFilters: "Training Data (*.tdata)"
                         onAccepted: {
-                            startGenerating(fileUrl)
+                            block.generateDataFile(fileUrl)
                             saveDialog.active = false
                         }
                         onRejected: {
@@ -9,12 +9,17 @@
 #include <QCborMap>
 #include <QCborArray>
 #include <QImage>
+#include <QThread>
 
 #include <algorithm>
+#include <numeric>
 
 
 bool CellDatabaseBlock::s_registered = BlockList::getInstance().addBlock(CellDatabaseBlock::info());
 
+// when there are more changes, consumers reload all cells, which is faster at that point anyway
+static const int MAX_GEOMETRY_CHANGES = 10000;
+
 template<typename T, std::size_t N>
 QByteArray arrayToBytes(const std::array<T, N>& data) {
     const auto buffer = reinterpret_cast<const char*>(data.begin());
@@ -93,18 +98,22 @@ void CellDatabaseBlock::setAdditionalState(const QCborMap& state) {
     for (auto ref: shapesArr) {
         m_shapes.append(bytesToArray<float, CellDatabaseConstants::RADII_COUNT>(ref.toByteArray()));
     }
+    resetGeometryChanges();
     m_count = m_data.at(CellDatabaseConstants::X_POS).size();
 }
 
 void CellDatabaseBlock::clear() {
-    m_count = 0;
+    Transaction transaction(this);
     m_data.clear();
     m_shapes.clear();
     m_features->clear();
     getOrCreateFeatureId("x");
     getOrCreateFeatureId("y");
     getOrCreateFeatureId("radius");
-    emit existingDataChanged();
+    resetGeometryChanges();
+    allCellsChanged();
+    updateCount();
+    notifyExistingDataChanged();
 }
 
 void CellDatabaseBlock::importNNResult(QString positionsFilePath, QString maskFilePath) {
@@ -196,20 +205,12 @@ void CellDatabaseBlock::importNNResult(QString positionsFilePath, QString maskFi
 
     qDebug() << "Watershed" << HighResTime::getElapsedSecAndUpdate(begin);
 
-    auto& xPos = m_data[CellDatabaseConstants::X_POS];
-    auto& yPos = m_data[CellDatabaseConstants::Y_POS];
-    xPos.resize(nucleusCount);
-    for (int i = 0; i < nucleusCount; ++i) {
-        xPos[i] = double(xPositions[i]);
-    }
-    yPos.resize(nucleusCount);
-    for (int i = 0; i < nucleusCount; ++i) {
-        yPos[i] = double(yPositions[i]);
-    }
-
-    auto& sizes = m_data[CellDatabaseConstants::RADIUS];
+    QVector<QVector<double>> columns(CellDatabaseConstants::RADIUS + 1);
+    columns[CellDatabaseConstants::X_POS] = QVector<double>(xPositions.begin(), xPositions.end());
+    columns[CellDatabaseConstants::Y_POS] = QVector<double>(yPositions.begin(), yPositions.end());
+    auto& sizes = columns[CellDatabaseConstants::RADIUS];
     sizes.resize(nucleusCount);
-    m_shapes.resize(nucleusCount);
+    QVector<CellShape> shapes(nucleusCount);
     for (int idx = 0; idx < nucleusCount; ++idx) {
         int maxValue = 0;
         for (std::size_t radiusIndex = 0; radiusIndex < radiiCount; ++radiusIndex) {
@@ -221,10 +222,10 @@ void CellDatabaseBlock::importNNResult(QString positionsFilePath, QString maskFi
         for (std::size_t radiusIndex = 0; radiusIndex < radiiCount; ++radiusIndex) {
             shape[radiusIndex] = radii[radiusIndex][idx] / float(maxValue);
         }
-        m_shapes[idx] = shape;
+        shapes[idx] = shape;
     }
     qDebug() << "Normalize radii" << HighResTime::getElapsedSecAndUpdate(begin);
-    m_count = nucleusCount;
+    replaceCells(columns, shapes);
 }
 
 void CellDatabaseBlock::importCenters(QString positionsFilePath) {
@@ -248,23 +249,64 @@ void CellDatabaseBlock::importCenterData(QCborMap data) {
         qWarning() << "importNNResult(): nuclei positions file invalid";
         return;
     }
-    const int nucleusCount = xPositions.size();
-    auto& xPos = m_data[CellDatabaseConstants::X_POS];
-    auto& yPos = m_data[CellDatabaseConstants::Y_POS];
-    xPos.resize(nucleusCount);
-    for (int i = 0; i < nucleusCount; ++i) {
-        xPos[i] = double(xPositions[i]);
-    }
-    yPos.resize(nucleusCount);
-    for (int i = 0; i < nucleusCount; ++i) {
-        yPos[i] = double(yPositions[i]);
-    }
-    m_data[CellDatabaseConstants::RADIUS].clear();
-    m_data[CellDatabaseConstants::RADIUS].resize(nucleusCount);
-    m_shapes.clear();
-    m_shapes.resize(nucleusCount);
-    m_count = nucleusCount;
-    emit existingDataChanged();
+    QVector<QVector<double>> columns(CellDatabaseConstants::Y_POS + 1);
+    columns[CellDatabaseConstants::X_POS] = QVector<double>(xPositions.begin(), xPositions.end());
+    columns[CellDatabaseConstants::Y_POS] = QVector<double>(yPositions.begin(), yPositions.end());
+    // the radius and shape are set to 0 by replaceCells():
+    replaceCells(columns, {});
+}
+
+void CellDatabaseBlock::beginUpdate() {
+    if (m_updateDepth == 0) {
+        m_countBeforeUpdate = m_data[CellDatabaseConstants::X_POS].size();
+    }
+    ++m_updateDepth;
+}
+
+void CellDatabaseBlock::endUpdate() {
+    if (m_updateDepth <= 0) {
+        qWarning() << "CellDatabaseBlock::endUpdate() called without beginUpdate()";
+        return;
+    }
+    if (--m_updateDepth > 0 || !m_modified) return;
+
+    QVector<int> cells = std::move(m_changedCells);
+    QVector<int> featureIds = std::move(m_changedFeatures);
+    const bool allCells = m_allCellsChanged;
+    const bool allFeatures = m_allFeaturesChanged;
+    const bool existingChanged = m_existingDataChanged;
+    m_changedCells = QVector<int>();
+    m_changedFeatures = QVector<int>();
+    m_modified = false;
+    m_allCellsChanged = false;
+    m_allFeaturesChanged = false;
+    m_existingDataChanged = false;
+
+    const int count = m_data[CellDatabaseConstants::X_POS].size();
+    if (m_count.getValue() != count) {
+        // updates the ids of the output and notifies it:
+        m_count = count;
+    } else {
+        m_outputNode->dataWasModifiedByBlock();
+    }
+    if (existingChanged) {
+        emit existingDataChanged();
+    }
+
+    if (allCells) {
+        cells.clear();
+    } else {
+        std::sort(cells.begin(), cells.end());
+        cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    }
+    if (allFeatures) {
+        featureIds.resize(m_data.size());
+        std::iota(featureIds.begin(), featureIds.end(), 0);
+    } else {
+        std::sort(featureIds.begin(), featureIds.end());
+        featureIds.erase(std::unique(featureIds.begin(), featureIds.end()), featureIds.end());
+    }
+    emit cellsChanged(cells, featureIds, allCells);
 }
 
 void CellDatabaseBlock::reserve(int count) {
@@ -274,6 +316,7 @@ void CellDatabaseBlock::reserve(int count) {
 }
 
 int CellDatabaseBlock::addCenter(double x, double y) {
+    Transaction transaction(this);
     m_data[CellDatabaseConstants::X_POS].append(x);
     m_data[CellDatabaseConstants::Y_POS].append(y);
     const int count = m_data[CellDatabaseConstants::X_POS].size();
@@ -281,19 +324,69 @@ int CellDatabaseBlock::addCenter(double x, double y) {
         m_data[i].resize(count);
     }
     m_shapes.resize(count);
-    m_count = count;
+    recordGeometryChange(CellChange::Added, count - 1);
+    cellChanged(count - 1, -1);
+    updateCount();
     return count - 1;
 }
 
+int CellDatabaseBlock::appendCells(const QVector<QVector<double>>& columns, const QVector<CellShape>& shapes) {
+    const int first = m_data[CellDatabaseConstants::X_POS].size();
+    const int added = columns.value(CellDatabaseConstants::X_POS).size();
+    if (added == 0) return first;
+    Transaction transaction(this);
+    for (int i = 0; i < m_data.size(); ++i) {
+        if (i < columns.size() && columns[i].size() == added) {
+            m_data[i].append(columns[i]);
+        } else {
+            m_data[i].resize(first + added);
+        }
+    }
+    m_shapes.resize(first);
+    m_shapes.append(shapes.mid(0, added));
+    m_shapes.resize(first + added);
+    if (m_geometryChanges.size() + added > MAX_GEOMETRY_CHANGES) {
+        resetGeometryChanges();
+    } else {
+        for (int i = first; i < first + added; ++i) {
+            recordGeometryChange(CellChange::Added, i);
+        }
+    }
+    cellRangeChanged(first, added, -1);
+    updateCount();
+    return first;
+}
+
+void CellDatabaseBlock::replaceCells(const QVector<QVector<double>>& columns, const QVector<CellShape>& shapes) {
+    Transaction transaction(this);
+    const int count = columns.value(CellDatabaseConstants::X_POS).size();
+    for (int i = 0; i < m_data.size(); ++i) {
+        if (i < columns.size() && columns[i].size() == count) {
+            m_data[i] = columns[i];
+        } else {
+            m_data[i] = QVector<double>(count, 0.0);
+        }
+    }
+    m_shapes = shapes.mid(0, count);
+    m_shapes.resize(count);
+    resetGeometryChanges();
+    allCellsChanged();
+    updateCount();
+    notifyExistingDataChanged();
+}
+
 void CellDatabaseBlock::setShape(int cellIndex, const CellShape& shape) {
     if (m_shapes.size() <= cellIndex) {
         m_shapes.resize(cellIndex + 1);
     }
     m_shapes[cellIndex] = shape;
+    recordGeometryChange(CellChange::Modified, cellIndex);
+    cellChanged(cellIndex, CellDatabaseConstants::RADIUS);
 }
 
 void CellDatabaseBlock::removeCell(int index) {
     if (index < 0) return;
+    Transaction transaction(this);
     for (int i = 0; i < m_data.size(); ++i) {
         if (index >= m_data[i].size()) continue;
         m_data[i].remove(index);
@@ -301,8 +394,10 @@ void CellDatabaseBlock::removeCell(int index) {
     if (index < m_shapes.size()) {
         m_shapes.remove(index);
     }
-    m_count = m_data[CellDatabaseConstants::X_POS].size();
-    emit existingDataChanged();
+    recordGeometryChange(CellChange::Removed, index);
+    allCellsChanged();
+    updateCount();
+    notifyExistingDataChanged();
 }
 
 int CellDatabaseBlock::getOrCreateFeatureId(const QString& name) {
@@ -323,6 +418,31 @@ void CellDatabaseBlock::setFeature(int featureId, int cellIndex, double value) {
         featureVector.resize(cellIndex + 1);
     }
     featureVector[cellIndex] = value;
+    if (featureId <= CellDatabaseConstants::RADIUS) {
+        recordGeometryChange(CellChange::Modified, cellIndex);
+    }
+    cellChanged(cellIndex, featureId);
+}
+
+void CellDatabaseBlock::setFeatureValues(int featureId, const QVector<int>& cells, const QVector<double>& values) {
+    if (cells.size() != values.size()) {
+        qWarning() << "setFeatureValues(): the number of cells and values is different";
+        return;
+    }
+    if (cells.isEmpty()) return;
+    Transaction transaction(this);
+    auto& featureVector = m_data[featureId];
+    const int maxIndex = *std::max_element(cells.begin(), cells.end());
+    if (featureVector.size() <= maxIndex) {
+        featureVector.resize(maxIndex + 1);
+    }
+    for (int i = 0; i < cells.size(); ++i) {
+        featureVector[cells[i]] = values[i];
+        if (featureId <= CellDatabaseConstants::RADIUS) {
+            recordGeometryChange(CellChange::Modified, cells[i]);
+        }
+        cellChanged(cells[i], featureId);
+    }
 }
 
 double CellDatabaseBlock::featureMin(int featureId) const {
@@ -366,9 +486,13 @@ void CellDatabaseBlock::setShapePoint(int index, double dx, double dy) {
     const std::size_t radiusIdx = int(std::round((angle / float(2*M_PI)) * radiiCount)) % radiiCount;
     const double distance = std::sqrt(std::pow(dx, 2) + std::pow(dy, 2));
     shape[radiusIdx] = float(distance / radius);
+    recordGeometryChange(CellChange::Modified, index);
+    cellChanged(index, CellDatabaseConstants::RADIUS);
 }
 
 void CellDatabaseBlock::finishShapeModification(int index) {
+    // the end of an interactive edit, reported once with the new radius:
+    Transaction transaction(this);
     auto& shape = m_shapes[index];
     // normalize shape values to 0.0-1.0:
     const float maxShapeValue = *std::max_element(shape.begin(), shape.end());
@@ -379,9 +503,85 @@ void CellDatabaseBlock::finishShapeModification(int index) {
             shape[i] = shape[i] / maxShapeValue;
         }
     }
-    emit existingDataChanged();
+    notifyExistingDataChanged();
 }
 
 void CellDatabaseBlock::dataWasModified() {
+    if (m_updateDepth > 0) {
+        // the output is notified at the end of the update:
+        m_modified = true;
+        return;
+    }
     m_outputNode->dataWasModifiedByBlock();
 }
+
+bool CellDatabaseBlock::geometryChangesSince(qint64 revision, QVector<CellChange>& changes) const {
+    if (revision < m_geometryChangesStart || revision > m_geometryRevision) return false;
+    changes = m_geometryChanges.mid(int(revision - m_geometryChangesStart));
+    return true;
+}
+
+void CellDatabaseBlock::recordGeometryChange(CellChange::Type type, int index) {
+    // the journal is read by other blocks in the main thread without locking:
+    Q_ASSERT(QThread::currentThread() == thread());
+    if (m_geometryChanges.size() >= MAX_GEOMETRY_CHANGES) {
+        resetGeometryChanges();
+        return;
+    }
+    m_geometryChanges.append({type, index});
+    ++m_geometryRevision;
+}
+
+void CellDatabaseBlock::resetGeometryChanges() {
+    m_geometryChanges.clear();
+    ++m_geometryRevision;
+    m_geometryChangesStart = m_geometryRevision;
+}
+
+void CellDatabaseBlock::cellChanged(int index, int featureId) {
+    if (m_updateDepth == 0) return;
+    m_modified = true;
+    if (index < m_countBeforeUpdate) m_existingDataChanged = true;
+    if (!m_allCellsChanged) m_changedCells.append(index);
+    if (featureId < 0) {
+        m_allFeaturesChanged = true;
+    } else if (!m_allFeaturesChanged) {
+        m_changedFeatures.append(featureId);
+    }
+}
+
+void CellDatabaseBlock::cellRangeChanged(int first, int count, int featureId) {
+    if (m_updateDepth == 0) return;
+    if (!m_allCellsChanged) m_changedCells.reserve(m_changedCells.size() + count);
+    for (int i = first; i < first + count; ++i) {
+        cellChanged(i, featureId);
+    }
+}
+
+void CellDatabaseBlock::allCellsChanged() {
+    if (m_updateDepth == 0) return;
+    m_modified = true;
+    m_existingDataChanged = true;
+    m_allCellsChanged = true;
+    m_allFeaturesChanged = true;
+    m_changedCells.clear();
+    m_changedFeatures.clear();
+}
+
+void CellDatabaseBlock::updateCount() {
+    if (m_updateDepth > 0) {
+        // the count is updated at the end of the update:
+        m_modified = true;
+        return;
+    }
+    m_count = m_data[CellDatabaseConstants::X_POS].size();
+}
+
+void CellDatabaseBlock::notifyExistingDataChanged() {
+    if (m_updateDepth > 0) {
+        m_modified = true;
+        m_existingDataChanged = true;
+        return;
+    }
+    emit existingDataChanged();
+}
@@ -13,6 +13,13 @@ namespace CellDatabaseConstants {
 
 using CellShape = std::array<float, CellDatabaseConstants::RADII_COUNT>;
 
+// a change of the position, radius or shape of a cell, see CellDatabaseBlock::geometryChangesSince()
+struct CellChange {
+    enum Type { Added, Removed, Modified };
+    Type type;
+    int index;  // index of the cell at the time of the change
+};
+
 
 class CellDatabaseBlock : public InOutBlock {
 
@@ -47,6 +54,15 @@ public:
 signals:
     void existingDataChanged();
 
+    /**
+     * @brief cellsChanged is emitted once at the end of each update (see beginUpdate()).
+     * @param cells the indexes of the added or modified cells, sorted
+     * @param featureIds the modified features, sorted
+     * @param allCells true if cells were removed or all cells were replaced, the indexes
+     * of all cells could have changed in this case and cells is empty
+     */
+    void cellsChanged(QVector<int> cells, QVector<int> featureIds, bool allCells);
+
 public slots:
     virtual BlockInfo getBlockInfo() const override { return info(); }
 
@@ -57,9 +73,30 @@ public slots:
     void importCenters(QString positionsFilePath);
     void importCenterData(QCborMap data);
 
+    /**
+     * @brief beginUpdate starts a group of modifications: the count, the output and the signals
+     * are only updated once when the outermost endUpdate() is called, instead of after each
+     * modification. Calls can be nested, see also CellDatabaseBlock::Transaction.
+     * Modifications outside of an update don't notify anyone, except if the count changes.
+     * addCenter(), removeCell() and finishShapeModification() are updates on their own, so that
+     * each change of the geometry is reported by cellsChanged().
+     */
+    void beginUpdate();
+    void endUpdate();
+
     void reserve(int count);
 
     int addCenter(double x, double y);
+
+    /**
+     * @brief appendCells adds many cells at once, the count and the output are only updated once.
+     * @param columns the values of the new cells per feature id, missing features are set to 0.0
+     * @return the index of the first new cell
+     */
+    int appendCells(const QVector<QVector<double>>& columns, const QVector<CellShape>& shapes);
+
+    // replaces all cells, the columns and shapes are handled like in appendCells()
+    void replaceCells(const QVector<QVector<double>>& columns, const QVector<CellShape>& shapes);
     void setShape(int cellIndex, const CellShape& shape);
 
     void removeCell(int index);
@@ -67,6 +104,8 @@ public slots:
     int getOrCreateFeatureId(const QString& name);
 
     void setFeature(int featureId, int cellIndex, double value);
+    // sets the feature of many cells at once, values has to be as long as cells
+    void setFeatureValues(int featureId, const QVector<int>& cells, const QVector<double>& values);
     double getFeature(int featureId, int cellIndex) const {
         return m_data.at(featureId).at(cellIndex);
     }
@@ -85,12 +124,65 @@ public slots:
 
     void dataWasModified();
 
+    // incremented on each change of the position, radius or shape of a cell
+    qint64 geometryRevision() const { return m_geometryRevision; }
+
+    /**
+     * @brief geometryChangesSince returns the changes since the given revision in the order
+     * they happened, so that a consumer can update its own state instead of reloading all cells.
+     * The journal is not synchronized, the geometry may only be modified and read in the main thread.
+     * @return false if the changes are not available anymore (i.e. after a clear, an import or
+     * too many changes), in that case all cells have to be reloaded
+     */
+    bool geometryChangesSince(qint64 revision, QVector<CellChange>& changes) const;
+
+    /**
+     * @brief The Transaction class calls beginUpdate() on construction and endUpdate() when it
+     * goes out of scope, so that loops of modifications are only notified once.
+     */
+    class Transaction {
+    public:
+        explicit Transaction(CellDatabaseBlock* db) : m_db(db) { m_db->beginUpdate(); }
+        ~Transaction() { m_db->endUpdate(); }
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+    private:
+        CellDatabaseBlock* m_db;
+    };
+
+protected:
+    void recordGeometryChange(CellChange::Type type, int index);
+    void resetGeometryChanges();
+
+    // remember the changes of the current update, a featureId of -1 means all features
+    // (changes of the shape count as changes of the radius):
+    void cellChanged(int index, int featureId);
+    void cellRangeChanged(int first, int count, int featureId);
+    void allCellsChanged();
+    // these are applied immediately outside of an update:
+    void updateCount();
+    void notifyExistingDataChanged();
+
 protected:
     StringListAttribute m_features;
     QVector<QVector<double>> m_data;
     QVector<CellShape> m_shapes;
 
     IntegerAttribute m_count;
+
+    qint64 m_geometryRevision = 0;
+    qint64 m_geometryChangesStart = 0;  // revision before the first entry of m_geometryChanges
+    QVector<CellChange> m_geometryChanges;
+
+    // the changes of the current update (see beginUpdate()):
+    int m_updateDepth = 0;
+    int m_countBeforeUpdate = 0;
+    bool m_modified = false;
+    QVector<int> m_changedCells;
+    QVector<int> m_changedFeatures;
+    bool m_allCellsChanged = false;
+    bool m_allFeaturesChanged = false;
+    bool m_existingDataChanged = false;
 };
 
 #endif // CELLDATABASEBLOCK_H
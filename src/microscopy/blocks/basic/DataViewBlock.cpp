@@ -150,11 +150,10 @@ void DataViewBlock::addCenterAndGuessArea(int x, int y) {
         });
         if (it != candidates.end()) {
             if ((*it).first.second == 0.0f) continue;
+            CellDatabaseBlock::Transaction transaction(db);
             const int idx = db->addCenter(x, y);
             db->setFeature(CellDatabaseConstants::RADIUS, idx, (*it).second);
             db->setShape(idx, (*it).first.first);
-            db->dataWasModified();
-            emit db->existingDataChanged();
         }
     }
 }
@@ -168,13 +167,12 @@ void DataViewBlock::addCell(double x, double y, double radius, const QVector<dou
         m_controller->guiManager()->showToast("Please assign at least one connected visualize block.");
     }
     for (auto db: dbs) {
+        CellDatabaseBlock::Transaction transaction(db);
         const int idx = db->addCenter(x, y);
         db->setFeature(CellDatabaseConstants::RADIUS, idx, radius);
         CellShape cellShape;
         std::copy_n(shape.begin(), cellShape.size(), cellShape.begin());
         db->setShape(idx, cellShape);
-        db->dataWasModified();
-        emit db->existingDataChanged();
     }
 }
 
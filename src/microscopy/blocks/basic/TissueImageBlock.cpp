@@ -10,10 +10,14 @@
 
 #include "microscopy/manager/ViewManager.h"
 #include "microscopy/manager/BackendManager.h"
+#include "microscopy/manager/BlobCache.h"
+#include "microscopy/manager/ImageLoadScheduler.h"
+#include "microscopy/manager/ImageStack.h"
 #include "microscopy/blocks/basic/DataViewBlock.h"
 
 #include <QCryptographicHash>
 #include <QDir>
+#include <QPointer>
 
 #ifdef THREADS_ENABLED
 #include <QtConcurrent>
@@ -29,6 +33,31 @@ inline QString md5(QByteArray input) {
     return result;
 }
 
+// We will convert grascale 16 bit images to ARGB32
+// by storing the first (MSB) 8bit in the red 8bit channel
+// and the last (LSB) 8bit in the green 8bit channel.
+// This allows us to upload it as a normal RGBA texture to the GPU
+// and the fragment shader will later reconstruct the 16 bit value,
+// apply the preprocessing on it (white- and black level, gamma etc.)
+// and map it to a 8 bit value.
+static QImage convertGrayscale16(const QImage& image, quint16& minValue, quint16& maxValue) {
+    minValue = std::numeric_limits<quint16>::max();
+    maxValue = std::numeric_limits<quint16>::min();
+    QImage newImage(image.size(), QImage::Format_ARGB32_Premultiplied);
+
+    for (int y = 0; y < image.height(); ++y) {
+        const quint16* s = reinterpret_cast<const quint16*>(image.constScanLine(y));
+        QRgb* t = reinterpret_cast<QRgb*>(newImage.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            const quint16 value = s[x];
+            minValue = std::min(minValue, value);
+            maxValue = std::max(maxValue, value);
+            t[x] = qRgba(value / 256, value % 256, 0, 255);
+        }
+    }
+    return newImage;
+}
+
 
 bool TissueImageBlock::s_registered = BlockList::getInstance().addBlock(TissueImageBlock::info());
 
@@ -43,12 +72,15 @@ TissueImageBlock::TissueImageBlock(CoreController* controller, QString uid)
     , m_interpretAs16Bit(this, "interpretAs16Bit", false)
     , m_interactiveWatershed(this, "interactiveWatershed", false)
     , m_ownsFile(this, "ownsFile", false)
+    , m_channel(this, "channel", 0, 0, std::numeric_limits<int>::max())
+    , m_channelCount(this, "channelCount", 1, 1, std::numeric_limits<int>::max())
     , m_blackLevel(this, "blackLevel", 0.0, 0.0, 0.99)
     , m_whiteLevel(this, "whiteLevel", 1.0, 0.0001, 1.0)
     , m_gamma(this, "gamma", 1.0, 0.0, 3.0)
     , m_color(this, "color", {0.0, 0.0, 1.0})
     , m_opacity(this, "opacity", 1.0)
     , m_assignedViews(this, "assignedViews")
+    , m_channelNames(this, "channelNames", {}, /*persistent*/ false)
     , m_remotelyAvailable(this, "remotelyAvailable", false, /*persistent*/ false)
     , m_networkProgress(this, "networkProgress", 0.0, 0.0, 1.0, /*persistent*/ false)
 {
@@ -59,22 +91,30 @@ TissueImageBlock::TissueImageBlock(CoreController* controller, QString uid)
     connect(m_controller->projectManager(), &ProjectManager::projectLoadingFinished, this, [this]() {
         updateRemoteAvailability();
         if (locallyAvailable()) {
+            // marks a cached file as recently used:
+            m_backend->blobCache()->path(m_hashOfSelectedFile);
             if (!m_uiFilePath.getValue().isEmpty()) {
                 if (!QDir().exists(m_uiFilePath)) {
                     // -> ui file was deleted, try to recreate it:
-                    loadImageData();
+                    scheduleImageLoading();
                 }
             }
         } else {
             // file was deleted or this project was opened on a new computer
+            const QString cachedPath = m_backend->blobCache()->path(m_hashOfSelectedFile);
+            // projects of older versions stored downloaded files in the "downloads" directory:
             QString downloadPath = "file://" + m_controller->dao()->getDataDir("downloads") + m_hashOfSelectedFile;
-            if (QDir().exists(m_controller->dao()->withoutFilePrefix(downloadPath))) {
+            if (!cachedPath.isEmpty()) {
+                m_imageDataPath = "file://" + cachedPath;
+                scheduleImageLoading();
+            } else if (QDir().exists(m_controller->dao()->withoutFilePrefix(downloadPath))) {
                 m_imageDataPath = downloadPath;
-                loadImageData();
+                scheduleImageLoading();
             } else {
                 m_uiFilePath = "";
             }
         }
+        pinCachedFile();
     });
 
     connect(this, &TissueImageBlock::imageLoaded, m_outputNode, &NodeBase::sendImpulse);
@@ -89,6 +129,7 @@ void TissueImageBlock::onCreatedByUser() {
 }
 
 void TissueImageBlock::deletedByUser() {
+    m_backend->blobCache()->unpin(m_hashOfSelectedFile, getUid());
     if (m_ownsFile) {
         if (!m_imageDataPath.getValue().isEmpty()) {
             m_controller->dao()->deleteLocalFile(m_imageDataPath);
@@ -102,10 +143,19 @@ void TissueImageBlock::deletedByUser() {
 
 void TissueImageBlock::preparePixelAccess() {
     if (!m_image.isNull()) return;
+    if (m_channelCount > 1) {
+        // the channel is used directly from the stack, that is shared with the other channels:
+        const auto stack = ImageStack::open(m_controller->dao()->withoutFilePrefix(m_imageDataPath));
+        if (stack) {
+            m_image = stack->channelImage(std::min(int(m_channel), stack->channelCount() - 1));
+            return;
+        }
+    }
     if (QDir().exists(m_uiFilePath)) {
         m_image = QImage(m_uiFilePath);
     } else {
         // -> ui file was deleted, try to recreate it:
+        m_loadingDeferred = false;
         loadImageData();
         if (QDir().exists(m_uiFilePath)) {
             m_image = QImage(m_uiFilePath);
@@ -163,6 +213,9 @@ bool TissueImageBlock::isAssignedTo(QString uid) const {
 
 void TissueImageBlock::assignView(QString uid) {
     m_assignedViews.append(uid);
+    if (m_loadingDeferred) {
+        scheduleImageLoading();
+    }
     emit m_controller->manager<ViewManager>("viewManager")->imageAssignmentChanged();
 }
 
@@ -179,8 +232,7 @@ void TissueImageBlock::upload() {
     status->m_title = "Uploading Image...";
 
     auto dao = m_controller->dao();
-    const auto data = dao->loadLocalFile(dao->withoutFilePrefix(m_imageDataPath));
-    m_backend->uploadFile(data, [this, status](double progress) {
+    m_backend->uploadLocalFile(dao->withoutFilePrefix(m_imageDataPath), [this, status](double progress) {
         status->m_progress = progress;
         m_networkProgress = progress;
     }, [this, status](QString serverHash) {
@@ -203,16 +255,19 @@ void TissueImageBlock::download() {
     Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
     status->m_title = "Downloading Image...";
 
-    m_backend->downloadFile(m_hashOfSelectedFile, [this, status](double progress) {
+    m_backend->fetchFile(m_hashOfSelectedFile, [this, status](double progress) {
         status->m_progress = progress;
         m_networkProgress = progress;
-    }, [this, status](QByteArray data) {
+    }, [this, status](QString path) {
         m_networkProgress = 0.0;
+        if (path.isEmpty()) {
+            status->m_title = "Error During Download ✗";
+            status->closeIn(3000);
+            return;
+        }
         status->m_title = "Decompressing Image...";
-        auto dao = m_controller->dao();
-        dao->saveFile("downloads", m_hashOfSelectedFile, data);
-        QString imageDataPath = "file://" + dao->getDataDir("downloads") + m_hashOfSelectedFile;
-        m_imageDataPath = imageDataPath;
+        m_imageDataPath = "file://" + path;
+        pinCachedFile();
         loadImageData();
         status->m_progress = 1.0;
         status->m_title = "Loading Image Completed ✓";
@@ -238,6 +293,7 @@ void TissueImageBlock::loadLocalFile(QString filePath) {
 
     m_selectedFilePath = filePath;
     m_imageDataPath = filePath;
+    pinCachedFile();
     m_image = QImage();
 
     Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
@@ -252,6 +308,38 @@ void TissueImageBlock::loadLocalFile(QString filePath) {
 #endif
 }
 
+void TissueImageBlock::loadDecodedImage(const DecodedImage& decoded) {
+    if (decoded.filePath == m_selectedFilePath) {
+        // the file is already shown, but the connected blocks still expect an impulse for it
+        // (i.e. when an Image List runs all images again):
+        emit imageLoaded();
+        return;
+    }
+    m_selectedFilePath = decoded.filePath;
+    m_imageDataPath = decoded.filePath;
+    // the image is already decoded, it doesn't have to be loaded again by preparePixelAccess():
+    m_image = decoded.image;
+    applyDecodedImage(decoded);
+}
+
+void TissueImageBlock::addChannelBlocks() {
+    if (m_selectedFilePath.getValue().isEmpty()) return;
+    for (int channel = 0; channel < m_channelCount; ++channel) {
+        if (channel == m_channel) continue;
+        auto* block = m_controller->blockManager()->addNewBlock<TissueImageBlock>();
+        if (!block) {
+            qWarning() << "Could not create TissueImageBlock.";
+            return;
+        }
+        // before the file is loaded, so that only this channel is converted:
+        block->m_channel = channel;
+        block->loadLocalFile(m_selectedFilePath);
+        const QString name = m_channelNames->value(channel);
+        static_cast<StringAttribute*>(block->attr("label"))->setValue(name.isEmpty() ? QString("Channel %1").arg(channel + 1) : name);
+        block->onCreatedByUser();
+    }
+}
+
 void TissueImageBlock::loadRemoteFile(QString hash) {
     m_selectedFilePath = "";
     m_image = QImage();
@@ -259,6 +347,23 @@ void TissueImageBlock::loadRemoteFile(QString hash) {
     download();
 }
 
+void TissueImageBlock::pinCachedFile() {
+    // downloaded images are only stored in the BlobCache, they must not be evicted while a block uses them:
+    BlobCache* cache = m_backend->blobCache();
+    const QString cachedPath = cache->path(m_hashOfSelectedFile);
+    const bool inCache = !cachedPath.isEmpty()
+            && m_controller->dao()->withoutFilePrefix(m_imageDataPath) == cachedPath;
+    const QString hash = inCache ? m_hashOfSelectedFile.getValue() : QString();
+    if (hash == m_pinnedHash) return;
+    if (!m_pinnedHash.isEmpty()) {
+        cache->unpin(m_pinnedHash, getUid());
+    }
+    if (!hash.isEmpty()) {
+        cache->pin(hash, getUid());
+    }
+    m_pinnedHash = hash;
+}
+
 bool TissueImageBlock::locallyAvailable() const {
     return QDir().exists(m_controller->dao()->withoutFilePrefix(m_imageDataPath));
 }
@@ -276,14 +381,90 @@ void TissueImageBlock::updateRemoteAvailability() {
 
 void TissueImageBlock::loadImageData() {
     if (!locallyAvailable()) return;
+    applyDecodedImage(decodeImageFile(m_controller, m_imageDataPath, m_channel));
+}
+
+void TissueImageBlock::scheduleImageLoading() {
+    // images that are not shown in any view are loaded when they are assigned to one or their pixels are needed:
+    m_loadingDeferred = m_assignedViews->isEmpty();
+    if (m_loadingDeferred) return;
+
+    ImageLoadScheduler::Priority priority = ImageLoadScheduler::Hidden;
+    for (DataViewBlock* view: m_controller->manager<ViewManager>("viewManager")->views()) {
+        if (isAssignedTo(view->getUid()) && static_cast<BoolAttribute*>(view->attr("visible"))->getValue()) {
+            priority = ImageLoadScheduler::Visible;
+            break;
+        }
+    }
+
+    // the file is decoded in a worker thread, the result is applied in the main thread:
     const QString filePath = m_imageDataPath;
-    QByteArray imageData = m_controller->dao()->loadLocalFile(m_controller->dao()->withoutFilePrefix(filePath));
-    m_hashOfSelectedFile = md5(imageData);
-    // this method may be called in a different thread, but updateRemoteAvailability()
-    // must be called in the main thread:
-    QMetaObject::invokeMethod(this,
-                              "updateRemoteAvailability",
-                              Qt::QueuedConnection);
+    const int channel = m_channel;
+    CoreController* controller = m_controller;
+    QPointer<TissueImageBlock> block(this);
+    const QString name = filename();
+    m_controller->manager<ViewManager>("viewManager")->imageLoadScheduler()->schedule(name, priority, [=]() {
+        const DecodedImage decoded = decodeImageFile(controller, filePath, channel);
+        QMetaObject::invokeMethod(controller, [block, decoded]() {
+            if (block) block->applyDecodedImage(decoded);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void TissueImageBlock::setChannel(int channel) {
+    if (channel == m_channel) return;
+    m_channel = channel;
+    reloadImageData();
+}
+
+void TissueImageBlock::reloadImageData() {
+    if (m_imageDataPath.getValue().isEmpty()) return;
+    m_image = QImage();
+
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+    status->m_title = "Loading Image...";
+    status->m_running = true;
+
+#ifdef THREADS_ENABLED
+    QtConcurrent::run([this](){
+        loadImageData();
+        m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+    });
+#endif
+}
+
+DecodedImage TissueImageBlock::decodeImageFile(CoreController* controller, QString filePath, int channel) {
+    DecodedImage decoded;
+    decoded.filePath = filePath;
+
+    // multi-page TIFFs are only read once for the blocks of all channels:
+    const auto stack = ImageStack::open(controller->dao()->withoutFilePrefix(filePath));
+    if (stack) {
+        channel = std::min(std::max(channel, 0), stack->channelCount() - 1);
+        decoded.channel = channel;
+        decoded.hash = stack->hash();
+        decoded.channelCount = stack->channelCount();
+        for (int i = 0; i < stack->channelCount(); ++i) {
+            decoded.channelNames << stack->channelName(i);
+        }
+        decoded.image = stack->channelImage(channel);
+        decoded.interpretAs16Bit = true;
+        // the view still needs a file of each channel, see convertGrayscale16():
+        const QString convertedFilePath = QString("%1.c%2%3").arg(filePath).arg(channel + 1).arg(TissueImageBlockConstants::converted16BitSuffix);
+        if (!QDir().exists(controller->dao()->withoutFilePrefix(convertedFilePath))) {
+            quint16 minValue;
+            quint16 maxValue;
+            convertGrayscale16(decoded.image, minValue, maxValue).save(controller->dao()->withoutFilePrefix(convertedFilePath));
+            decoded.levelsChanged = true;
+            decoded.blackLevel = std::pow(minValue / double(256*256-1), 0.5);
+            decoded.whiteLevel = maxValue / double(256*256-1);
+        }
+        decoded.uiFilePath = controller->dao()->withoutFilePrefix(convertedFilePath);
+        return decoded;
+    }
+
+    QByteArray imageData = controller->dao()->loadLocalFile(controller->dao()->withoutFilePrefix(filePath));
+    decoded.hash = md5(imageData);
     QImage image = QImage::fromData(imageData);
 
     if (image.format() == QImage::Format_RGB32
@@ -291,47 +472,51 @@ void TissueImageBlock::loadImageData() {
             || image.format() == QImage::Format_ARGB32_Premultiplied) {
         // this is either a color image or a grayscale image stored as RGB
         // -> we can show it directly:
-        m_uiFilePath = m_controller->dao()->withoutFilePrefix(filePath);
-        m_interpretAs16Bit = false;
-        emit imageLoaded();
+        decoded.uiFilePath = controller->dao()->withoutFilePrefix(filePath);
+        decoded.image = image;
     } else if (image.format() == QImage::Format_Grayscale16) {
-        // We will convert this grascale 16 bit image to ARGB32
-        // by storing the first (MSB) 8bit in the red 8bit channel
-        // and the last (LSB) 8bit in the green 8bit channel.
-        // This allows us to upload it as a normal RGBA texture to the GPU
-        // and the fragment shader will later reconstruct the 16 bit value,
-        // apply the preprocessing on it (white- and black level, gamma etc.)
-        // and map it to a 8 bit value.
+        // see convertGrayscale16():
         QString convertedFilePath = filePath + TissueImageBlockConstants::converted16BitSuffix;
 
-        if (!QDir().exists(m_controller->dao()->withoutFilePrefix(convertedFilePath))) {
+        if (!QDir().exists(controller->dao()->withoutFilePrefix(convertedFilePath))) {
             // convert the image:
-            quint16 minValue = std::numeric_limits<quint16>::max();
-            quint16 maxValue = std::numeric_limits<quint16>::min();
-            QImage newImage(image.size(), QImage::Format_ARGB32_Premultiplied);
-
-            for (int y = 0; y < image.height(); ++y) {
-                const uchar * s = image.constScanLine(y);
-                for (int x = 0; x < image.width(); ++x) {
-                    quint16 value = quint16(reinterpret_cast<const quint16 *>(s)[x]);
-                    minValue = std::min(minValue, value);
-                    maxValue = std::max(maxValue, value);
-                    newImage.setPixel(x, y, qRgba(value / 256, value % 256, 0, 255));
-                }
-            }
-            newImage.save(m_controller->dao()->withoutFilePrefix(convertedFilePath));
+            quint16 minValue;
+            quint16 maxValue;
+            QImage newImage = convertGrayscale16(image, minValue, maxValue);
+            newImage.save(controller->dao()->withoutFilePrefix(convertedFilePath));
+            decoded.image = newImage;
 
             // while we are at it, we will at the same time normalize the image
             // by setting black- and whiteLevel to the min and max value of the image:
-            m_blackLevel = std::pow(minValue / double(256*256-1), 0.5);
-            m_whiteLevel = maxValue / double(256*256-1);
+            decoded.levelsChanged = true;
+            decoded.blackLevel = std::pow(minValue / double(256*256-1), 0.5);
+            decoded.whiteLevel = maxValue / double(256*256-1);
         }
-        m_interpretAs16Bit = true;
-        m_uiFilePath = m_controller->dao()->withoutFilePrefix(convertedFilePath);
-        emit imageLoaded();
+        decoded.interpretAs16Bit = true;
+        decoded.uiFilePath = controller->dao()->withoutFilePrefix(convertedFilePath);
     } else {
         qWarning() << "Image format not supported:" << image.format();
-        m_uiFilePath = "";
-        m_interpretAs16Bit = false;
+    }
+    return decoded;
+}
+
+void TissueImageBlock::applyDecodedImage(const DecodedImage& decoded) {
+    m_hashOfSelectedFile = decoded.hash;
+    // this method may be called in a different thread, but updateRemoteAvailability()
+    // must be called in the main thread:
+    QMetaObject::invokeMethod(this,
+                              "updateRemoteAvailability",
+                              Qt::QueuedConnection);
+    if (decoded.levelsChanged) {
+        m_blackLevel = decoded.blackLevel;
+        m_whiteLevel = decoded.whiteLevel;
+    }
+    m_interpretAs16Bit = decoded.interpretAs16Bit;
+    m_channel = decoded.channel;
+    m_channelCount = decoded.channelCount;
+    m_channelNames = decoded.channelNames;
+    m_uiFilePath = decoded.uiFilePath;
+    if (!decoded.uiFilePath.isEmpty()) {
+        emit imageLoaded();
     }
 }
@@ -5,10 +5,29 @@
 
 #include <QImage>
 #include <QFileInfo>
+#include <QStringList>
 
 class BackendManager;
 
 
+// the result of reading an image file, see TissueImageBlock::decodeImageFile()
+struct DecodedImage {
+    QString filePath;
+    QString hash;
+    QString uiFilePath;  // empty if the format is not supported
+    bool interpretAs16Bit = false;
+    // only set if a 16 bit image was converted, it is normalized to its min and max value then:
+    bool levelsChanged = false;
+    double blackLevel = 0.0;
+    double whiteLevel = 1.0;
+    QImage image;  // the image as shown in the UI, may be null if it wasn't decoded
+    // more than one for multi-page TIFFs, see ImageStack:
+    int channel = 0;
+    int channelCount = 1;
+    QStringList channelNames;
+};
+
+
 class TissueImageBlock : public InOutBlock {
 
     Q_OBJECT
@@ -27,6 +46,8 @@ public:
                         "It can be grayscale (8 or 16bit, for example one channel of a "
                         "multi-channel tissue image) or RGB colored (for example the result of a "
                         "neural network).<br><br>"
+                        "Multi-page TIFFs (i.e. OME-TIFF) are read only once, each channel "
+                        "can be shown by its own block.<br><br>"
                         "You can also drag'n'drop image files onto the application to easily "
                         "create one of these blocks.";
         info.qmlFile = "qrc:/microscopy/blocks/basic/TissueImageBlock.qml";
@@ -39,6 +60,18 @@ public:
 
     void onCreatedByUser() override;
 
+    // the image as shown in the UI (16 bit images are converted to RGB, channels of multi-page TIFFs
+    // are Format_Grayscale16 views of the ImageStack), call preparePixelAccess() first:
+    const QImage& image() const { return m_image; }
+
+    // reads and decodes the image file (and converts it if it is a 16 bit image),
+    // for multi-page TIFFs only the given channel is converted,
+    // doesn't modify any block and can therefore be called in any thread:
+    static DecodedImage decodeImageFile(CoreController* controller, QString filePath, int channel = 0);
+
+    // shows an image that was decoded in advance with decodeImageFile(), has to be called in the main thread:
+    void loadDecodedImage(const DecodedImage& decoded);
+
 signals:
     void filenameChanged();
     void locallyAvailableChanged();
@@ -69,11 +102,21 @@ public slots:
     void loadLocalFile(QString filePath);
     void loadRemoteFile(QString hash);
 
+    // shows another channel of a multi-page TIFF
+    void setChannel(int channel);
+    // creates a block for each other channel of a multi-page TIFF
+    void addChannelBlocks();
+
     bool locallyAvailable() const;
     void updateRemoteAvailability();
 
 protected:
     void loadImageData();
+    void reloadImageData();
+    void scheduleImageLoading();
+    // pins the file in the BlobCache if it was downloaded, unpins the previous one:
+    void pinCachedFile();
+    void applyDecodedImage(const DecodedImage& decoded);
 
 protected:
     BackendManager* m_backend;
@@ -85,6 +128,8 @@ protected:
     BoolAttribute m_interpretAs16Bit;
     BoolAttribute m_interactiveWatershed;
     BoolAttribute m_ownsFile;
+    IntegerAttribute m_channel;
+    IntegerAttribute m_channelCount;
 
     DoubleAttribute m_blackLevel;
     DoubleAttribute m_whiteLevel;
@@ -96,6 +141,9 @@ protected:
 
     // runtime data:
     QImage m_image;
+    bool m_loadingDeferred = false;
+    QString m_pinnedHash;  // the hash pinned in the BlobCache by this block in this session
+    StringListAttribute m_channelNames;
     BoolAttribute m_remotelyAvailable;
     DoubleAttribute m_networkProgress;
 
@@ -90,6 +90,35 @@ BlockBase {
             rightMargin: 15*dp
             defaultSize: 30*dp
 
+            BlockRow {
+                StretchText {
+                    property int channel: block.attr("channel").val
+                    property string channelName: block.attr("channelNames").val[channel] || ""
+                    text: "Channel: %1/%2 %3".arg(channel + 1).arg(block.attr("channelCount").val).arg(channelName)
+                }
+                ButtonSideLine {
+                    width: 30*dp
+                    implicitWidth: 0
+                    text: "<"
+                    enabled: block.attr("channel").val > 0
+                    onPress: block.setChannel(block.attr("channel").val - 1)
+                }
+                ButtonSideLine {
+                    width: 30*dp
+                    implicitWidth: 0
+                    text: ">"
+                    enabled: block.attr("channel").val < block.attr("channelCount").val - 1
+                    onPress: block.setChannel(block.attr("channel").val + 1)
+                }
+            }
+
+            ButtonBottomLine {
+                text: "Add Block per Channel"
+                allUpperCase: false
+                enabled: block.attr("channelCount").val > 1
+                onPress: block.addChannelBlocks()
+            }
+
             BlockRow {
                 StretchText {
                     text: "Interactive Watershed:"
@@ -3,62 +3,110 @@
 #include "core/CoreController.h"
 #include "core/manager/BlockList.h"
 #include "core/manager/BlockManager.h"
+#include "core/manager/FileSystemManager.h"
 
 #include "microscopy/blocks/basic/TissueImageBlock.h"
+#include "microscopy/manager/DirectoryScanner.h"
 
-#include <QDir>
 
+#include <algorithm>
+#include <vector>
 
-bool FolderViewBlock::s_registered = BlockList::getInstance().addBlock(FolderViewBlock::info());
 
-FolderViewBlock::FolderViewBlock(CoreController* controller, QString uid)
-    : BlockBase(controller, uid)
-    , m_path(this, "path", "")
-    , m_scene(this, "scene", "", /*persistent*/ false)
-    , m_images(this, "images", {}, /*persistent*/ false)
-{
-    connect(&m_path, &StringAttribute::valueChanged, this, &FolderViewBlock::updateContent);
-}
-
-void FolderViewBlock::updateContent() {
-    QDir dir(QUrl(m_path).toLocalFile());
-
-    QRegularExpression re("R(\\d+)_(\\w+)\\.(\\w+)\\.(\\w+)\\.(\\w+)_([\\w\\-]+)_c(\\d+)_ORG.tif\\Z", QRegularExpression::CaseInsensitiveOption);
-    //                        1      2        3         4        5        6         7
-    //                     round   markers                              scene      channel
+bool FolderViewBlock::s_registered = BlockList::getInstance().addBlock(FolderViewBlock::info());
 
-    QVariantList images;
+namespace {
 
-    for (const QFileInfo& info: dir.entryInfoList({QDir::Files})) {
-        QRegularExpressionMatch match = re.match(info.fileName());
-        if (!match.hasMatch()) continue;
+    QRegularExpression imageNameRegex() {
+        return QRegularExpression("R(\\d+)_(\\w+)\\.(\\w+)\\.(\\w+)\\.(\\w+)_([\\w\\-]+)_c(\\d+)_ORG.tif\\Z", QRegularExpression::CaseInsensitiveOption);
+        //                             1      2        3         4        5        6         7
+        //                          round   markers                              scene      channel
+    }
 
-        QVariantMap image;
-        image["path"] = info.filePath();
-        image["round"] = match.captured(1).toInt();
-        const QStringList markers = {"DAPI", match.captured(2), match.captured(3), match.captured(4), match.captured(5)};
-        image["scene"] = match.captured(6);
-        image["channel"] = match.captured(7).toInt() - 1;
-        image["marker"] = markers.at(image["channel"].toInt());
+    // is called in the thread of the DirectoryScanner:
+    QVariantList toImageList(const QVector<DirectoryScanner::Entry>& entries) {
+        const QRegularExpression re = imageNameRegex();
+
+        struct Image {
+            QString marker;  // lower case, used for sorting
+            int round;
+            QVariantMap map;
+        };
+        std::vector<Image> images;
+        images.reserve(std::size_t(entries.size()));
+
+        for (const DirectoryScanner::Entry& entry: entries) {
+            QRegularExpressionMatch match = re.match(entry.fileName);
+            if (!match.hasMatch()) continue;
+
+            const QStringList markers = {"DAPI", match.captured(2), match.captured(3), match.captured(4), match.captured(5)};
+            const int channel = match.captured(7).toInt() - 1;
+            if (channel < 0 || channel >= markers.size()) continue;
+
+            Image image;
+            image.marker = markers.at(channel).toLower();
+            image.round = match.captured(1).toInt();
+            image.map["key"] = entry.fileName;
+            image.map["path"] = entry.path;
+            image.map["round"] = image.round;
+            image.map["scene"] = match.captured(6);
+            image.map["channel"] = channel;
+            image.map["marker"] = markers.at(channel);
+            image.map["width"] = entry.imageSize.width();
+            image.map["height"] = entry.imageSize.height();
+
+            images.push_back(image);
+        }
 
-        images << image;
+        std::stable_sort(images.begin(), images.end(), [](const Image& lhs, const Image& rhs) {
+            if (lhs.marker != rhs.marker) {
+                return lhs.marker < rhs.marker;
+            } else {
+                return lhs.round < rhs.round;
+            }
+        });
+
+        QVariantList result;
+        result.reserve(int(images.size()));
+        for (const Image& image: images) {
+            result << image.map;
+        }
+        return result;
     }
 
-    if (!images.isEmpty()) {
-        m_scene = images.first().toMap().value("scene").toString();
-    }
+}  // namespace
 
-    std::sort(images.begin(), images.end(), [](const QVariant& lhs, const QVariant& rhs) {
-        const QString lMarker = lhs.toMap().value("marker").toString().toLower();
-        const QString rMarker = rhs.toMap().value("marker").toString().toLower();
-        if (lMarker != rMarker) {
-            return  lMarker < rMarker;
-        } else {
-            return lhs.toMap().value("round").toInt() < rhs.toMap().value("round").toInt();
+FolderViewBlock::FolderViewBlock(CoreController* controller, QString uid)
+    : BlockBase(controller, uid)
+    , m_path(this, "path", "")
+    , m_scene(this, "scene", "", /*persistent*/ false)
+    , m_images(this, "images", {}, /*persistent*/ false)
+    , m_scanning(this, "scanning", false, /*persistent*/ false)
+    , m_scanner(new DirectoryScanner(m_controller->dao()->getDataDir("directory_index"),
+                                     imageNameRegex(), toImageList, this))
+{
+    connect(&m_path, &StringAttribute::valueChanged, this, [this]() {
+        m_scanner->setDirectory(QUrl(m_path).toLocalFile());
+    });
+    connect(m_scanner, &DirectoryScanner::scanningChanged, this, [this]() {
+        m_scanning = m_scanner->isScanning();
+    });
+    connect(m_scanner, &DirectoryScanner::scanned, this, [this](QVariantList images) {
+        // the scene of the first file in the directory:
+        QString firstPath;
+        for (const QVariant& image: images) {
+            const QVariantMap map = image.toMap();
+            if (firstPath.isEmpty() || map.value("path").toString() < firstPath) {
+                firstPath = map.value("path").toString();
+                m_scene = map.value("scene").toString();
+            }
         }
+        m_images = images;
     });
+}
 
-    m_images = images;
+void FolderViewBlock::updateContent() {
+    m_scanner->refresh();
 }
 
 void FolderViewBlock::addImageBlock(QString path, QString label) {
@@ -3,6 +3,8 @@
 
 #include "core/block_basics/BlockBase.h"
 
+class DirectoryScanner;
+
 
 class FolderViewBlock : public BlockBase {
 
@@ -40,6 +42,9 @@ protected:
     // runtime:
     StringAttribute m_scene;
     VariantListAttribute m_images;
+    BoolAttribute m_scanning;
+
+    DirectoryScanner* m_scanner;
 
 };
 
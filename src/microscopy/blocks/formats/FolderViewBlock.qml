@@ -38,7 +38,7 @@ BlockBase {
         }
 
         DragArea {
-            text: block.attr("scene").val || "Folder"
+            text: block.attr("scanning").val ? "Scanning..." : (block.attr("scene").val || "Folder")
         }
     }
 
@@ -3,55 +3,116 @@
 #include "core/CoreController.h"
 #include "core/manager/BlockList.h"
 #include "core/manager/BlockManager.h"
+#include "core/manager/FileSystemManager.h"
+#include "core/manager/GuiManager.h"
+#include "core/manager/StatusManager.h"
 #include "core/connections/Nodes.h"
 
-#include "microscopy/blocks/basic/TissueImageBlock.h"
+#include "microscopy/manager/DirectoryScanner.h"
 
-#include <QDir>
+#include <QDateTime>
+#include <QFutureWatcher>
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
+#include <algorithm>
+#include <vector>
 
 
 bool ImageListBlock::s_registered = BlockList::getInstance().addBlock(ImageListBlock::info());
 
+namespace {
+
+    // is called in the thread of the DirectoryScanner:
+    QVariantList toImageList(const QVector<DirectoryScanner::Entry>& entries) {
+        QRegularExpression re("([\\w\\-\\_\\d]+)(.tif|.png)\\Z", QRegularExpression::CaseInsensitiveOption);
+
+        struct Image {
+            QString path;  // lower case, used for sorting
+            QVariantMap map;
+        };
+        std::vector<Image> images;
+        images.reserve(std::size_t(entries.size()));
+
+        for (const DirectoryScanner::Entry& entry: entries) {
+            QRegularExpressionMatch match = re.match(entry.fileName);
+            if (!match.hasMatch()) continue;
+
+            Image image;
+            image.path = entry.path.toLower();
+            image.map["key"] = entry.fileName;
+            image.map["path"] = entry.path;
+            image.map["name"] = match.captured(1);
+            image.map["width"] = entry.imageSize.width();
+            image.map["height"] = entry.imageSize.height();
+
+            images.push_back(image);
+        }
+
+        std::sort(images.begin(), images.end(), [](const Image& lhs, const Image& rhs) {
+            return lhs.path < rhs.path;
+        });
+
+        QVariantList result;
+        result.reserve(int(images.size()));
+        for (const Image& image: images) {
+            result << image.map;
+        }
+        return result;
+    }
+
+}  // namespace
+
 ImageListBlock::ImageListBlock(CoreController* controller, QString uid)
     : InOutBlock(controller, uid)
     , m_path(this, "path", "")
+    , m_prefetchCount(this, "prefetchCount", 2, 0, 8)
     , m_images(this, "images", {}, /*persistent*/ false)
     , m_currentIndex(this, "currentIndex", -1, -1, std::numeric_limits<int>::max())
+    , m_timings(this, "timings", {}, /*persistent*/ false)
+    , m_running(this, "running", false, /*persistent*/ false)
+    , m_scanning(this, "scanning", false, /*persistent*/ false)
+    // converted 16 bit images are not listed:
+    , m_scanner(new DirectoryScanner(m_controller->dao()->getDataDir("directory_index"),
+                                     QRegularExpression("^(?!.*\\.16bit_as_argb\\.tif$).*\\.(tif|png)$", QRegularExpression::CaseInsensitiveOption),
+                                     toImageList, this))
 {
-    connect(&m_path, &StringAttribute::valueChanged, this, &ImageListBlock::updateContent);
+    connect(&m_path, &StringAttribute::valueChanged, this, [this]() {
+        m_scanner->setDirectory(QUrl(m_path).toLocalFile());
+    });
+    connect(m_scanner, &DirectoryScanner::scanningChanged, this, [this]() {
+        m_scanning = m_scanner->isScanning();
+    });
+    connect(m_scanner, &DirectoryScanner::scanned, this, &ImageListBlock::setImages);
     m_inputNode->enableImpulseDetection();
     connect(m_inputNode, &NodeBase::impulseBegin, this, &ImageListBlock::next);
 }
 
 void ImageListBlock::updateContent() {
-    QDir dir(QUrl(m_path).toLocalFile());
-
-    QRegularExpression re("([\\w\\-\\_\\d]+)(.tif|.png)\\Z", QRegularExpression::CaseInsensitiveOption);
-
-    QVariantList images;
-
-    for (const QFileInfo& info: dir.entryInfoList({QDir::Files})) {
-        if (info.fileName().endsWith(".16bit_as_argb.tif")) continue;
-        QRegularExpressionMatch match = re.match(info.fileName());
-        if (!match.hasMatch()) continue;
-
-        QVariantMap image;
-        image["path"] = info.filePath();
-        image["name"] = match.captured(1);
-
-        images << image;
-    }
-
-    std::sort(images.begin(), images.end(), [](const QVariant& lhs, const QVariant& rhs) {
-        const QString lPath = lhs.toMap().value("path").toString().toLower();
-        const QString rPath = rhs.toMap().value("path").toString().toLower();
-        return  lPath < rPath;
-    });
+    m_scanner->refresh();
+}
 
+void ImageListBlock::setImages(const QVariantList& images) {
+    // the directory was scanned again, but nothing relevant changed:
+    if (images == m_images.getValue()) return;
+    m_prefetched.clear();
+    m_running = false;
+    m_timings = QVariantList();
     m_images = images;
 }
 
 void ImageListBlock::next() {
+    if (m_currentIndex >= 0 && m_processStart > 0) {
+        // the pipeline of the current image is complete:
+        setTiming(m_currentIndex, "process", (QDateTime::currentMSecsSinceEpoch() - m_processStart) / 1000.0);
+        m_processStart = 0;
+    }
+    if (m_running && m_currentIndex + 1 >= m_images->size()) {
+        finishRun();
+        return;
+    }
     loadImage(m_currentIndex + 1);
 }
 
@@ -60,8 +121,7 @@ void ImageListBlock::reset() {
 }
 
 void ImageListBlock::loadImage(int index) {
-    if (index >= m_images->size()) return;
-    QString path = m_images->at(index).toMap().value("path").toString();
+    if (index < 0 || index >= m_images->size()) return;
     QString label = m_images->at(index).toMap().value("label").toString();
     auto* imageBlock = m_outputNode->getConnectedBlock<TissueImageBlock>();
     bool newBlockCreated = false;
@@ -73,10 +133,126 @@ void ImageListBlock::loadImage(int index) {
         }
         newBlockCreated = true;
     }
-    imageBlock->loadLocalFile(path);
+    m_imageBlock = imageBlock;
     static_cast<StringAttribute*>(imageBlock->attr("label"))->setValue(label);
     if (newBlockCreated) {
         imageBlock->onCreatedByUser();
     }
     m_currentIndex = index;
+    m_loadStart = QDateTime::currentMSecsSinceEpoch();
+    m_processStart = 0;
+
+    // the image is probably already decoded by prefetch():
+    QFuture<DecodedImage> decoding = m_prefetched.contains(index) ? m_prefetched.take(index) : decodeAsync(index);
+    if (!decoding.isFinished()) {
+        Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(getUid());
+        status->m_title = "Loading Image...";
+        status->m_running = true;
+    }
+    auto* watcher = new QFutureWatcher<DecodedImage>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, index]() {
+        watcher->deleteLater();
+        // a different image could have been selected in the meantime:
+        if (index != m_currentIndex) return;
+        m_controller->manager<StatusManager>("statusManager")->removeStatus(getUid());
+        showDecodedImage(index, watcher->result());
+    });
+    watcher->setFuture(decoding);
+
+    // the following images are decoded while this one is processed:
+    prefetch(index);
+}
+
+void ImageListBlock::runAll() {
+    if (m_images->isEmpty()) return;
+    m_timings = QVariantList();
+    m_running = true;
+    m_runStart = QDateTime::currentMSecsSinceEpoch();
+    loadImage(0);
+}
+
+void ImageListBlock::stop() {
+    m_running = false;
+}
+
+QFuture<DecodedImage> ImageListBlock::decodeAsync(int index) {
+    const QString path = m_images->at(index).toMap().value("path").toString();
+    CoreController* controller = m_controller;
+#ifdef THREADS_ENABLED
+    return QtConcurrent::run([controller, path]() {
+        return TissueImageBlock::decodeImageFile(controller, path);
+    });
+#else
+    QFutureInterface<DecodedImage> result;
+    result.reportStarted();
+    result.reportResult(TissueImageBlock::decodeImageFile(controller, path));
+    result.reportFinished();
+    return result.future();
+#endif
+}
+
+void ImageListBlock::prefetch(int index) {
+    const int last = std::min(index + m_prefetchCount, m_images->size() - 1);
+    // images that are not needed anymore:
+    for (const int prefetched: m_prefetched.keys()) {
+        if (prefetched <= index || prefetched > last) {
+            m_prefetched.remove(prefetched);
+        }
+    }
+#ifdef THREADS_ENABLED
+    for (int i = index + 1; i <= last; ++i) {
+        if (!m_prefetched.contains(i)) {
+            m_prefetched[i] = decodeAsync(i);
+        }
+    }
+#endif
+}
+
+void ImageListBlock::showDecodedImage(int index, const DecodedImage& decoded) {
+    const double loadTime = (QDateTime::currentMSecsSinceEpoch() - m_loadStart) / 1000.0;
+    setTiming(index, "load", loadTime);
+    if (decoded.uiFilePath.isEmpty()) {
+        setTiming(index, "failed", true);
+        // the pipeline won't be triggered by this image, continue with the next one:
+        if (m_running) next();
+        return;
+    }
+    // the image block could have been deleted in the meantime:
+    if (!m_imageBlock) return;
+    m_processStart = QDateTime::currentMSecsSinceEpoch();
+    m_imageBlock->loadDecodedImage(decoded);
+}
+
+void ImageListBlock::setTiming(int index, QString key, QVariant value) {
+    QVariantList timings = m_timings;
+    while (timings.size() <= index) {
+        timings.append(QVariantMap());
+    }
+    QVariantMap timing = timings[index].toMap();
+    timing[key] = value;
+    timings[index] = timing;
+    m_timings = timings;
+}
+
+void ImageListBlock::finishRun() {
+    m_running = false;
+    const double totalTime = (QDateTime::currentMSecsSinceEpoch() - m_runStart) / 1000.0;
+    int processed = 0;
+    double loadTime = 0.0;
+    double processTime = 0.0;
+    for (int i = 0; i < m_timings->size(); ++i) {
+        const QVariantMap timing = m_timings->at(i).toMap();
+        const QString name = m_images->at(i).toMap().value("name").toString();
+        if (timing.value("failed").toBool()) {
+            qDebug() << name << "could not be loaded";
+            continue;
+        }
+        qDebug() << name << "loaded in" << timing.value("load").toDouble() << "s, processed in" << timing.value("process").toDouble() << "s";
+        ++processed;
+        loadTime += timing.value("load").toDouble();
+        processTime += timing.value("process").toDouble();
+    }
+    qDebug() << "Processed" << processed << "images in" << totalTime << "s, loading:" << loadTime << "s, processing:" << processTime << "s";
+    m_controller->guiManager()->showToast(QString("%1 of %2 images processed in %3 s ✓")
+                                          .arg(processed).arg(m_images->size()).arg(totalTime, 0, 'f', 1));
 }
@@ -2,6 +2,13 @@
 #define IMAGELISTBLOCK_H
 
 #include "core/block_basics/InOutBlock.h"
+#include "microscopy/blocks/basic/TissueImageBlock.h"
+
+#include <QFuture>
+#include <QMap>
+#include <QPointer>
+
+class DirectoryScanner;
 
 
 class ImageListBlock : public InOutBlock {
@@ -19,7 +26,10 @@ public:
                         "May be useful to apply an image pipeline to all images in a folder.\n\n"
                         "Connect an Image block to the output. It will be set to the selected "
                         "image. End the pipeline with a Cycle block and connect it to the input "
-                        "of this block. It will trigger the next image.";
+                        "of this block. It will trigger the next image.\n\n"
+                        "The following images are decoded in the background while the "
+                        "current one is processed. 'Run All' processes all images and "
+                        "shows how long each one took.";
         info.qmlFile = "qrc:/microscopy/blocks/formats/ImageListBlock.qml";
         info.orderHint = 1000 + 7;
         info.complete<ImageListBlock>();
@@ -28,8 +38,6 @@ public:
 
     explicit ImageListBlock(CoreController* controller, QString uid);
 
-signals:
-
 public slots:
     virtual BlockInfo getBlockInfo() const override { return info(); }
 
@@ -41,12 +49,38 @@ public slots:
 
     void loadImage(int index);
 
+    void runAll();
+
+    void stop();
+
+private:
+    void setImages(const QVariantList& images);
+    QFuture<DecodedImage> decodeAsync(int index);
+    void prefetch(int index);
+    void showDecodedImage(int index, const DecodedImage& decoded);
+    void setTiming(int index, QString key, QVariant value);
+    void finishRun();
+
 protected:
     StringAttribute m_path;
+    IntegerAttribute m_prefetchCount;
 
     // runtime:
     VariantListAttribute m_images;
     IntegerAttribute m_currentIndex;
+    // for each image: the seconds it took to load and to process it
+    VariantListAttribute m_timings;
+    BoolAttribute m_running;
+    BoolAttribute m_scanning;
+
+    DirectoryScanner* m_scanner;
+
+    QPointer<TissueImageBlock> m_imageBlock;
+    // decoded images that follow the current one:
+    QMap<int, QFuture<DecodedImage>> m_prefetched;
+    qint64 m_loadStart = 0;
+    qint64 m_processStart = 0;
+    qint64 m_runStart = 0;
 
 };
 
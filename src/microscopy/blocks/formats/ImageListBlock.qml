@@ -29,6 +29,15 @@ BlockBase {
                     text: "%1".arg(modelData.name)
                     font.bold: index === block.attr("currentIndex").val
                 }
+                StretchText {
+                    property var timing: block.attr("timings").val[index]
+                    width: 50*dp
+                    implicitWidth: 0
+                    hAlign: Text.AlignRight
+                    text: !timing ? "" : timing.failed ? "failed"
+                                    : timing.process !== undefined ? "%1 s".arg((timing.load + timing.process).toFixed(1))
+                                    : ""
+                }
                 ButtonSideLine {
                     width: 30*dp
                     implicitWidth: 0
@@ -38,8 +47,15 @@ BlockBase {
             }
         }
 
+        ButtonBottomLine {
+            text: block.attr("running").val ? "Stop" : "Run All ▻"
+            allUpperCase: false
+            onPress: block.attr("running").val ? block.stop() : block.runAll()
+        }
+
         DragArea {
-            text: "%1/%2 Images".arg(block.attr("currentIndex").val + 1).arg(block.attr("images").val.length)
+            text: block.attr("scanning").val ? "Scanning..."
+                  : "%1/%2 Images".arg(block.attr("currentIndex").val + 1).arg(block.attr("images").val.length)
 
             InputNode {
                 node: block.node("inputNode")
@@ -96,6 +112,17 @@ BlockBase {
                 text: "Reset"
                 onPress: block.reset()
             }
+
+            BlockRow {
+                StretchText {
+                    text: "Decode in Advance:"
+                }
+                AttributeNumericInput {
+                    width: 60*dp
+                    implicitWidth: 0
+                    attr: block.attr("prefetchCount")
+                }
+            }
         }
     }  // settings component
 }
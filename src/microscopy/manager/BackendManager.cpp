@@ -6,13 +6,41 @@
 #include "core/manager/ProjectManager.h"
 #include "core/manager/StatusManager.h"
 #include "core/helpers/qstring_literal.h"
+#include "microscopy/manager/BlobCache.h"
+#include "microscopy/manager/ChunkedUpload.h"
+#include "microscopy/manager/LocalUnet.h"
+#include "microscopy/algorithms/ConnectedComponents.h"
 
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QQmlApplicationEngine>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
+#include <QSaveFile>
+#include <QUrlQuery>
+#include <QUuid>
+#include <QVersionNumber>
 
+#include <algorithm>
+#include <limits>
 #include <functional>
+#include <memory>
 
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
+
+// request bodies larger than this are sent compressed
+static const int COMPRESSION_THRESHOLD = 64 * 1024;
+static const int MAX_TILE_RETRIES = 3;
+// cell positions per request of the streamed autoencoder inference
+static const int CELL_CHUNK_SIZE = 4096;
+static const int MAX_CHUNK_RETRIES = 3;
 
 inline QString md5(QByteArray input) {
     QString result = QString(QCryptographicHash::hash(input, QCryptographicHash::Md5).toHex());
@@ -25,7 +53,11 @@ BackendManager::BackendManager(CoreController* controller)
     , ObjectWithAttributes(this)
     , m_controller(controller)
     , m_nam(m_controller->networkAccessManager())
+    , m_blobCache(new BlobCache(m_controller->dao()->getDataDir("blobs"), this))
     , m_serverUrl(this, "serverUrl", "?")
+    , m_blobCacheSize(this, "blobCacheSize", 2048, 100, std::numeric_limits<int>::max())
+    , m_imageCodec(this, "imageCodec", "qoi")
+    , m_unetBackend(this, "unetBackend", "auto")
     , m_version(this, "version", "", /*persistent*/ false)
     , m_secureConnection(this, "secureConnection", false, /*persistent*/ false)
     , m_inferenceProgress(this, "inferenceProgress", 0.0, 0.0, 1.0, /*persistent*/ false)
@@ -63,13 +95,56 @@ BackendManager::BackendManager(CoreController* controller)
         }
     });
     connect(&m_serverUrl, &StringAttribute::valueChanged, this, &BackendManager::updateVersion);
+    connect(&m_blobCacheSize, &IntegerAttribute::valueChanged, this, [this]() {
+        m_blobCache->setMaxSize(qint64(m_blobCacheSize.getValue()) * 1024 * 1024);
+    });
+
+    // only used for servers without the /events channel:
+    m_progressPollTimer.setInterval(500);
+    m_progressPollTimer.setSingleShot(false);
+    connect(&m_progressPollTimer, &QTimer::timeout, this, &BackendManager::updateInferenceProgress);
+    connect(&m_progressPollTimer, &QTimer::timeout, this, &BackendManager::updateTrainingProgress);
+
+    m_eventReconnectTimer.setSingleShot(true);
+    connect(&m_eventReconnectTimer, &QTimer::timeout, this, &BackendManager::connectEvents);
+
+    m_jobPollTimer.setInterval(1000);
+    m_jobPollTimer.setSingleShot(false);
+    connect(&m_jobPollTimer, &QTimer::timeout, this, &BackendManager::pollJobs);
+
+    m_fileCheckTimer.setInterval(0);
+    m_fileCheckTimer.setSingleShot(true);
+    connect(&m_fileCheckTimer, &QTimer::timeout, this, &BackendManager::sendPendingFileChecks);
+}
+
+QNetworkRequest BackendManager::createRequest(const QUrl& url) {
+    QNetworkRequest request(url);
+    // negotiated with ALPN, i.e. only for https:
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+    return request;
+}
+
+bool BackendManager::serverSupportsTiledInference() const {
+    return QVersionNumber::fromString(m_version) >= QVersionNumber(1, 2);
+}
+
+ImageEncoder::Codec BackendManager::imageCodec() const {
+    // older servers only read PNG (or the formats of the original image files):
+    if (QVersionNumber::fromString(m_version) < QVersionNumber(1, 3)) {
+        return ImageEncoder::Codec::Png;
+    }
+    return ImageEncoder::codecFromName(m_imageCodec.getValue());
+}
+
+bool BackendManager::useLocalUnet(QString modelId) const {
+    if (!LocalUnet::isSupported() || m_unetBackend.getValue() == "server") return false;
+    if (m_unetBackend.getValue() == "local") return true;
+    // the server is usually faster (GPU), the local model is only used when it isn't available:
+    return m_version.getValue().isEmpty() && QFile::exists(localModelPath(modelId));
+}
 
-    QTimer* updateProgressTimer = new QTimer();
-    updateProgressTimer->setInterval(500);
-    updateProgressTimer->setSingleShot(false);
-    connect(updateProgressTimer, &QTimer::timeout, this, &BackendManager::updateInferenceProgress);
-    connect(updateProgressTimer, &QTimer::timeout, this, &BackendManager::updateTrainingProgress);
-    updateProgressTimer->start();
+QString BackendManager::localModelPath(QString modelId) const {
+    return QDir(m_controller->dao()->getDataDir("models")).filePath(modelId + ".onnx");
 }
 
 QObject* BackendManager::attr(QString name) {
@@ -79,8 +154,7 @@ QObject* BackendManager::attr(QString name) {
 void BackendManager::updateVersion() {
     m_version = "";
     m_secureConnection = false;
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/version"));
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/version"));
     auto reply = m_nam->get(request);
     connect(reply, &QNetworkReply::finished, this, [this, reply]() {
         QString version = reply->readAll();
@@ -92,6 +166,8 @@ void BackendManager::updateVersion() {
             }
 #endif
             qDebug() << "Backend server found, version" << m_version  << "Secure:" << m_secureConnection;
+            m_eventReconnectAttempts = 0;
+            connectEvents();
         } else {
             qWarning() << "Backend server not available.";
             m_controller->guiManager()->showToast("Backend server is not available.", true);
@@ -101,8 +177,7 @@ void BackendManager::updateVersion() {
 }
 
 void BackendManager::updateInferenceProgress() {
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/inference_progress"));
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/inference_progress"));
     auto reply = m_nam->get(request);
     connect(reply, &QNetworkReply::finished, this, [this, reply]() {
         QString val = reply->readAll();
@@ -122,8 +197,7 @@ void BackendManager::updateInferenceProgress() {
 }
 
 void BackendManager::updateTrainingProgress() {
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/training_progress"));
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/training_progress"));
     auto reply = m_nam->get(request);
     connect(reply, &QNetworkReply::finished, this, [this, reply]() {
         QString val = reply->readAll();
@@ -143,93 +217,340 @@ void BackendManager::updateTrainingProgress() {
 }
 
 void BackendManager::checkFile(QString hash, std::function<void (bool)> onSuccess) {
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/data/check/" + hash));
-    auto reply = m_nam->get(request);
-    connect(reply, &QNetworkReply::finished, this, [reply, onSuccess]() {
-        QByteArray result = reply->readAll();
-        bool fileExists = QString::fromUtf8(result) == "1";
-        onSuccess(fileExists);
+    if (m_blobCache->isKnownRemote(m_serverUrl, hash)) {
+        onSuccess(true);
+        return;
+    }
+    m_pendingFileChecks[hash].append(onSuccess);
+    if (!m_fileCheckTimer.isActive()) m_fileCheckTimer.start();
+}
+
+void BackendManager::sendPendingFileChecks() {
+    const auto pendingChecks = m_pendingFileChecks;
+    m_pendingFileChecks.clear();
+    checkFiles(pendingChecks.keys(), [pendingChecks](QSet<QString> existing) {
+        for (auto it = pendingChecks.cbegin(); it != pendingChecks.cend(); ++it) {
+            for (const auto& onSuccess: it.value()) {
+                onSuccess(existing.contains(it.key()));
+            }
+        }
+    });
+}
+
+void BackendManager::checkFiles(QStringList hashes, std::function<void (QSet<QString>)> onSuccess) {
+    QSet<QString> existing;
+    QStringList unknown;
+    for (const QString& hash: hashes) {
+        if (m_blobCache->isKnownRemote(m_serverUrl, hash)) {
+            existing.insert(hash);
+        } else {
+            unknown.append(hash);
+        }
+    }
+    if (unknown.isEmpty()) {
+        onSuccess(existing);
+        return;
+    }
+    QCborMap params;
+    params["hashes"_q] = QCborArray::fromStringList(unknown);
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/data/check"));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/cbor");
+    auto reply = m_nam->post(request, params.toCborValue().toCbor());
+    const QString serverUrl = m_serverUrl;
+    connect(reply, &QNetworkReply::finished, this, [this, reply, unknown, existing, serverUrl, onSuccess]() mutable {
         reply->deleteLater();
+        const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatus == 404 || httpStatus == 405) {
+            // server version without batched checks
+            checkFilesIndividually(unknown, existing, onSuccess);
+            return;
+        }
+        if (reply->error() != QNetworkReply::NoError) {
+            qWarning() << "Could not check files:" << reply->errorString();
+            onSuccess(existing);
+            return;
+        }
+        const QCborArray result = QCborValue::fromCbor(reply->readAll()).toMap()["exists"_q].toArray();
+        for (int i = 0; i < unknown.size() && i < result.size(); ++i) {
+            const bool fileExists = result.at(i).toBool();
+            m_blobCache->setKnownRemote(serverUrl, unknown.at(i), fileExists);
+            if (fileExists) existing.insert(unknown.at(i));
+        }
+        onSuccess(existing);
     });
 }
 
+void BackendManager::checkFilesIndividually(QStringList hashes, QSet<QString> existing, std::function<void (QSet<QString>)> onSuccess) {
+    auto remaining = std::make_shared<int>(hashes.size());
+    auto result = std::make_shared<QSet<QString>>(existing);
+    const QString serverUrl = m_serverUrl;
+    for (const QString& hash: hashes) {
+        QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/data/check/" + hash));
+        auto reply = m_nam->get(request);
+        connect(reply, &QNetworkReply::finished, this, [this, reply, hash, serverUrl, remaining, result, onSuccess]() {
+            reply->deleteLater();
+            const bool fileExists = QString::fromUtf8(reply->readAll()) == "1";
+            if (reply->error() == QNetworkReply::NoError) {
+                m_blobCache->setKnownRemote(serverUrl, hash, fileExists);
+            }
+            if (fileExists) result->insert(hash);
+            if (--*remaining == 0) onSuccess(*result);
+        });
+    }
+}
+
 void BackendManager::uploadFile(QByteArray data, std::function<void (double)> onProgress, std::function<void (QString)> onSuccess) {
     QString hash = md5(data);
-    checkFile(hash, [this, data, onProgress, onSuccess, hash](bool exists) {
-        if (exists) {
-            onProgress(1.0);
-            onSuccess(hash);
-        } else {
-            QNetworkRequest request;
-            request.setUrl(QUrl(m_serverUrl + "/data"));
-            request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
-            auto reply = m_nam->post(request, data);
-            connect(reply, &QNetworkReply::uploadProgress, this, [onProgress](qint64 bytesSent, qint64 bytesTotal) {
-                double progress = bytesTotal ? (double(bytesSent) / bytesTotal) : 0.0;
-                onProgress(progress);
-            });
-            connect(reply, &QNetworkReply::finished, this, [reply, onSuccess]() {
-                QString serverHash = QString::fromUtf8(reply->readAll());
-                onSuccess(serverHash);
-                reply->deleteLater();
-            });
+    if (m_blobCache->isKnownRemote(m_serverUrl, hash)) {
+        onProgress(1.0);
+        onSuccess(hash);
+        return;
+    }
+    QBuffer* buffer = new QBuffer();
+    buffer->setData(data);
+    buffer->open(QIODevice::ReadOnly);
+    const QString serverUrl = m_serverUrl;
+    auto upload = new ChunkedUpload(m_nam, m_serverUrl, buffer, hash, onProgress, [this, serverUrl, hash, onSuccess](QString uploadedHash) {
+        // only files that were stored with the expected content are remembered:
+        if (uploadedHash == hash) {
+            m_blobCache->setKnownRemote(serverUrl, hash, true);
+        }
+        onSuccess(uploadedHash);
+    }, this);
+    enqueueUpload(upload);
+}
+
+void BackendManager::uploadLocalFile(QString path, std::function<void (double)> onProgress, std::function<void (QString)> onSuccess) {
+    // reading a large file takes a while, it is hashed in another thread:
+    auto run = [path]() -> QString {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) return "";
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        hash.addData(&file);
+        return hash.result().toHex();
+    };
+#ifdef THREADS_ENABLED
+    auto* watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, path, onProgress, onSuccess]() {
+        watcher->deleteLater();
+        uploadHashedFile(path, watcher->result(), onProgress, onSuccess);
+    });
+    watcher->setFuture(QtConcurrent::run(run));
+#else
+    uploadHashedFile(path, run(), onProgress, onSuccess);
+#endif
+}
+
+void BackendManager::uploadHashedFile(QString path, QString fileHash, std::function<void (double)> onProgress, std::function<void (QString)> onSuccess) {
+    if (fileHash.isEmpty()) {
+        qWarning() << "Can't open file for upload:" << path;
+        onSuccess("");
+        return;
+    }
+    if (m_blobCache->isKnownRemote(m_serverUrl, fileHash)) {
+        onProgress(1.0);
+        onSuccess(fileHash);
+        return;
+    }
+    QFile* file = new QFile(path);
+    if (!file->open(QIODevice::ReadOnly)) {
+        qWarning() << "Can't open file for upload:" << path;
+        delete file;
+        onSuccess("");
+        return;
+    }
+    const QString serverUrl = m_serverUrl;
+    auto upload = new ChunkedUpload(m_nam, m_serverUrl, file, fileHash, onProgress, [this, serverUrl, fileHash, onSuccess](QString uploadedHash) {
+        // only files that were stored with the expected content are remembered:
+        if (uploadedHash == fileHash) {
+            m_blobCache->setKnownRemote(serverUrl, fileHash, true);
         }
+        onSuccess(uploadedHash);
+    }, this);
+    enqueueUpload(upload);
+}
+
+void BackendManager::uploadTrainingData(QString path, std::function<void (double)> onProgress, std::function<void (QStringList)> onSuccess) {
+    if (!TrainingDataFile::isTrainingDataFile(path)) {
+        // old CBOR file:
+        uploadLocalFile(path, onProgress, [onSuccess](QString hash) {
+            onSuccess(hash.isEmpty() ? QStringList() : QStringList({hash}));
+        });
+        return;
+    }
+    if (!serverSupportsTrainingDataFiles()) {
+        qWarning() << "Training data files require server version 1.6, the server has version" << m_version;
+        onSuccess({});
+        return;
+    }
+    const QVector<TrainingDataFile::Shard> shards = TrainingDataFile::readShards(path);
+    if (shards.isEmpty()) {
+        onSuccess({});
+        return;
+    }
+    uploadShards(path, shards, {}, onProgress, onSuccess);
+}
+
+void BackendManager::uploadShards(QString path, QVector<TrainingDataFile::Shard> shards, QStringList hashes,
+                                  std::function<void (double)> onProgress, std::function<void (QStringList)> onSuccess) {
+    if (hashes.size() == shards.size()) {
+        onSuccess(hashes);
+        return;
+    }
+    const TrainingDataFile::Shard shard = shards[hashes.size()];
+    QFile file(path);
+    QByteArray data;
+    if (file.open(QIODevice::ReadOnly) && file.seek(shard.offset)) {
+        data = file.read(shard.size);
+    }
+    if (data.size() != shard.size) {
+        qWarning() << "Can't read training data file:" << path;
+        onSuccess({});
+        return;
+    }
+    // the progress is relative to the size of all shards:
+    const qint64 totalSize = shards.last().offset + shards.last().size - shards.first().offset;
+    const qint64 uploadedSize = shard.offset - shards.first().offset;
+    // shards that are already on the server (i.e. of the unchanged part of a file) are not uploaded again:
+    uploadFile(data, [onProgress, totalSize, uploadedSize, shard](double progress) {
+        onProgress((uploadedSize + progress * shard.size) / totalSize);
+    }, [this, path, shards, hashes, onProgress, onSuccess](QString hash) {
+        if (hash.isEmpty()) {
+            onSuccess({});
+            return;
+        }
+        uploadShards(path, shards, hashes + QStringList({hash}), onProgress, onSuccess);
+    });
+}
+
+void BackendManager::enqueueUpload(ChunkedUpload* upload) {
+    // the upload deletes itself when it is finished:
+    connect(upload, &QObject::destroyed, this, [this]() {
+        --m_runningUploads;
+        startQueuedUploads();
     });
+    m_queuedUploads.enqueue(upload);
+    startQueuedUploads();
+}
+
+void BackendManager::startQueuedUploads() {
+    while (m_runningUploads < MAX_CONCURRENT_UPLOADS && !m_queuedUploads.isEmpty()) {
+        QPointer<ChunkedUpload> upload = m_queuedUploads.dequeue();
+        if (!upload) continue;
+        ++m_runningUploads;
+        upload->start();
+    }
 }
 
 void BackendManager::downloadFile(QString hash, std::function<void (double)> onProgress, std::function<void (QByteArray)> onSuccess) {
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/data/" + hash));
+    const QString cachedPath = m_blobCache->path(hash);
+    if (!cachedPath.isEmpty()) {
+        QFile file(cachedPath);
+        if (file.open(QIODevice::ReadOnly)) {
+            const QByteArray data = file.readAll();
+            onProgress(1.0);
+            onSuccess(data);
+            return;
+        }
+    }
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/data/" + hash));
     auto reply = m_nam->get(request);
     connect(reply, &QNetworkReply::downloadProgress, this, [onProgress](qint64 bytesSent, qint64 bytesTotal) {
         double progress = bytesTotal ? (double(bytesSent) / bytesTotal) : 0.0;
         onProgress(progress);
     });
-    connect(reply, &QNetworkReply::finished, this, [reply, onSuccess]() {
-        onSuccess(reply->readAll());
+    const QString serverUrl = m_serverUrl;
+    connect(reply, &QNetworkReply::finished, this, [this, reply, hash, serverUrl, onSuccess]() {
+        const QByteArray data = reply->readAll();
+        if (reply->error() == QNetworkReply::NoError && md5(data) == hash) {
+            m_blobCache->store(hash, data);
+            m_blobCache->setKnownRemote(serverUrl, hash, true);
+        }
+        onSuccess(data);
         reply->deleteLater();
     });
 }
 
+void BackendManager::fetchFile(QString hash, std::function<void (double)> onProgress, std::function<void (QString)> onSuccess) {
+    const QString cachedPath = m_blobCache->path(hash);
+    if (!cachedPath.isEmpty()) {
+        onProgress(1.0);
+        onSuccess(cachedPath);
+        return;
+    }
+    downloadFile(hash, onProgress, [this, hash, onSuccess](QByteArray) {
+        // the file is in the cache if the download was successful:
+        onSuccess(m_blobCache->path(hash));
+    });
+}
+
 void BackendManager::removeFile(QString hash, std::function<void ()> onSuccess) {
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/data/" + hash));
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/data/" + hash));
     auto reply = m_nam->deleteResource(request);
+    m_blobCache->setKnownRemote(m_serverUrl, hash, false);
     connect(reply, &QNetworkReply::finished, this, [reply, onSuccess]() {
         onSuccess();
         reply->deleteLater();
     });
 }
 
-void BackendManager::applyUnet(QString imageHash, QRect area, QString modelId, std::function<void (QCborMap)> onSuccess) {
-    QNetworkRequest request;
-    QString url = "%1/model/%2/prediction/%3/%4/%5/%6/%7";
-    url = url.arg(m_serverUrl).arg(modelId).arg(imageHash);
+QString BackendManager::applyUnet(QString imageHash, QRect area, QString modelId, std::function<void (QCborMap)> onSuccess) {
+    QCborMap params;
+    params["type"_q] = "unet";
+    params["modelId"_q] = modelId;
+    params["imageHash"_q] = imageHash;
     if (area.width() > 0 && area.height() > 0) {
-        url = url.arg(area.left()).arg(area.top()).arg(area.right()).arg(area.bottom());
-    } else {
-        url = url.arg(0).arg(0).arg(0).arg(0);
+        params["area"_q] = QCborArray({area.left(), area.top(), area.right(), area.bottom()});
     }
-    request.setUrl(QUrl(url));
-    auto reply = m_nam->get(request);
-    connect(reply, &QNetworkReply::finished, this, [this, reply, onSuccess]() {
-        m_inferenceProgress = 0.0;
-        auto result = QCborValue::fromCbor(reply->readAll()).toMap();
-        onSuccess(result);
-        reply->deleteLater();
+    return submitInferenceJob(params, "unet_inference", [onSuccess](QCborValue result) {
+        onSuccess(result.toMap());
+    }, [this, imageHash, area, modelId](QString jobId) {
+        requestUnetSynchronously(jobId, imageHash, area, modelId);
     });
 }
 
-void BackendManager::trainUnet(QString modelName, QString baseModel, int epochs, QString trainHash, QString validHash, std::function<void (QString)> onSuccess) {
+QString BackendManager::applyUnetTiled(QSize imageSize, QVector<QPoint> tiles, QRect area, QString modelId,
+                                       std::function<void (QPoint, QByteArray)> onOutputTile, std::function<void (QCborMap)> onSuccess) {
+    QCborMap params;
+    params["type"_q] = "unet_tiles";
+    params["modelId"_q] = modelId;
+    params["width"_q] = imageSize.width();
+    params["height"_q] = imageSize.height();
+    params["tileSize"_q] = INFERENCE_TILE_SIZE;
+    QCborArray tileList;
+    for (const QPoint& tile: tiles) {
+        tileList.append(QCborArray({tile.x(), tile.y()}));
+    }
+    params["tiles"_q] = tileList;
+    if (area.width() > 0 && area.height() > 0) {
+        params["area"_q] = QCborArray({area.left(), area.top(), area.right(), area.bottom()});
+    }
+    const QString jobId = submitInferenceJob(params, "unet_inference", [onSuccess](QCborValue result) {
+        onSuccess(result.toMap());
+    }, [this](QString jobId) {
+        // servers before version 1.2, see serverSupportsTiledInference()
+        finishInferenceJob(jobId, QCborValue());
+    });
+    m_inferenceJobs[jobId].onOutputTile = onOutputTile;
+    m_inferenceJobs[jobId].tiles = tiles;
+    return jobId;
+}
+
+void BackendManager::uploadTile(QString jobId, QPoint tile, QByteArray imageData) {
+    sendTile(jobId, tile, imageData, 0);
+}
+
+void BackendManager::trainUnet(QString modelName, QString baseModel, int epochs, QStringList trainHashes, QStringList validHashes, std::function<void (QString)> onSuccess) {
     QCborMap params;
     params["modelName"_q] = modelName;
     params["baseModel"_q] = baseModel;
     params["epochs"_q] = epochs;
-    params["trainDataHash"_q] = trainHash;
-    params["validDataHash"_q] = validHash;
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/model/unet"));
+    // older servers only read the first (and only) file:
+    params["trainDataHash"_q] = trainHashes.value(0);
+    params["validDataHash"_q] = validHashes.value(0);
+    params["trainDataHashes"_q] = QCborArray::fromStringList(trainHashes);
+    params["validDataHashes"_q] = QCborArray::fromStringList(validHashes);
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/model/unet"));
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/cbor");
     auto reply = m_nam->post(request, params.toCborValue().toCbor());
     connect(reply, &QNetworkReply::finished, this, [this, reply, onSuccess]() {
@@ -240,34 +561,163 @@ void BackendManager::trainUnet(QString modelName, QString baseModel, int epochs,
     });
 }
 
-void BackendManager::applyAutoencoder(QString imageHash, QString modelId, QCborArray cellPositions, std::function<void (QCborArray)> onSuccess) {
-    QCborMap params;
-    params["cellPositions"_q] = cellPositions;  // [(x, y), (x, y), ...] in pixels
-    QNetworkRequest request;
-    QString url = "%1/model/%2/encode/%3";
-    url = url.arg(m_serverUrl).arg(modelId).arg(imageHash);
-    request.setUrl(QUrl(url));
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/cbor");
-    auto reply = m_nam->post(request, params.toCborValue().toCbor());
-    connect(reply, &QNetworkReply::finished, this, [this, reply, onSuccess]() {
-        m_inferenceProgress = 0.0;
-        auto result = QCborValue::fromCbor(reply->readAll()).toArray();
-        onSuccess(result);
+QString BackendManager::applyUnetLocally(QImage image, QRect area, QString modelId, std::function<void (QCborMap)> onSuccess) {
+    const QString jobId = QUuid::createUuid().toString(QUuid::Id128);
+    InferenceJob job;
+    job.kind = "unet_inference";
+    job.onResult = [onSuccess](QCborValue result) {
+        onSuccess(result.toMap());
+    };
+    job.localCancelled = std::make_shared<std::atomic<bool>>(false);
+    m_inferenceJobs[jobId] = job;
+    updateLocalJob(jobId, "running", 0.0);
+
+    const QString path = localModelPath(modelId);
+    const auto cancelled = job.localCancelled;
+    auto run = [this, jobId, image, area, modelId, path, cancelled]() {
+        QByteArray outputImageData;
+        QCborMap cellCenters;
+        const QImage output = localUnet(modelId, path)->predict(image, area, [this, jobId, cancelled](double progress) {
+            QMetaObject::invokeMethod(this,
+                                      "updateLocalJob",
+                                      Qt::QueuedConnection,
+                                      Q_ARG(QString, jobId),
+                                      Q_ARG(QString, "running"),
+                                      Q_ARG(double, progress));
+            return !*cancelled;
+        });
+        if (!output.isNull()) {
+            outputImageData = ImageEncoder::encode(output, ImageEncoder::Codec::Png);
+            // the same as get_cell_centers() in server/apply_unet.py:
+            QCborArray xPositions;
+            QCborArray yPositions;
+            for (const auto& component: ConnectedComponents::find(output, ConnectedComponents::Channel::Green)) {
+                xPositions.append(component.x);
+                yPositions.append(component.y);
+            }
+            cellCenters["xPositions"_q] = xPositions;
+            cellCenters["yPositions"_q] = yPositions;
+        }
+        // the blob cache needs to be used in main thread:
+        QMetaObject::invokeMethod(this,
+                                  "finishLocalUnetJob",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(QString, jobId),
+                                  Q_ARG(QByteArray, outputImageData),
+                                  Q_ARG(QCborMap, cellCenters));
+    };
+#ifdef THREADS_ENABLED
+    QtConcurrent::run(run);
+#else
+    run();
+#endif
+    return jobId;
+}
+
+void BackendManager::downloadUnetModel(QString modelId, std::function<void (double)> onProgress, std::function<void (bool)> onSuccess) {
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/model/unet/" + modelId + "/onnx"));
+    auto reply = m_nam->get(request);
+    connect(reply, &QNetworkReply::downloadProgress, this, [onProgress](qint64 bytesReceived, qint64 bytesTotal) {
+        double progress = bytesTotal ? (double(bytesReceived) / bytesTotal) : 0.0;
+        onProgress(progress);
+    });
+    const QString path = localModelPath(modelId);
+    connect(reply, &QNetworkReply::finished, this, [this, reply, modelId, path, onSuccess]() {
         reply->deleteLater();
+        if (reply->error() != QNetworkReply::NoError) {
+            qWarning() << "Could not download model" << modelId << reply->errorString();
+            onSuccess(false);
+            return;
+        }
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(reply->readAll()) < 0 || !file.commit()) {
+            qWarning() << "Could not store model" << modelId << "in" << path;
+            onSuccess(false);
+            return;
+        }
+        // a previous version of the model is reloaded on next use:
+        QMutexLocker lock(&m_localModelsLock);
+        m_localModels.remove(modelId);
+        lock.unlock();
+        onSuccess(true);
     });
 }
 
-void BackendManager::trainAutoencoder(QString modelName, QString baseModel, int epochs, QString imageHash, QCborArray cellPositions, std::function<void (QString)> onSuccess) {
+QString BackendManager::applyAutoencoder(QString imageHash, QString modelId, FloatMatrix cellPositions,
+                                         std::function<void (int, FloatMatrix)> onFeatureVectors, std::function<void (FloatMatrix)> onSuccess) {
+    if (serverSupportsStreamedAutoencoder() && !cellPositions.isEmpty()) {
+        QCborMap params;
+        params["type"_q] = "autoencoder_batches";
+        params["modelId"_q] = modelId;
+        params["imageHash"_q] = imageHash;
+        params["cellCount"_q] = cellPositions.rows;
+        const int cellCount = cellPositions.rows;
+        // the feature vectors of the batches are collected while the job is running:
+        auto featureVectors = std::make_shared<FloatMatrix>();
+        const QString jobId = submitInferenceJob(params, "autoencoder_inference", [onSuccess, featureVectors, cellCount](QCborValue result) {
+            const bool complete = result.isMap() && featureVectors->rows == cellCount;
+            onSuccess(complete ? *featureVectors : FloatMatrix());
+        }, [this](QString jobId) {
+            // servers before version 1.4, see serverSupportsStreamedAutoencoder()
+            finishInferenceJob(jobId, QCborValue());
+        });
+        m_inferenceJobs[jobId].onFeatureVectors = [featureVectors, onFeatureVectors, cellCount](int firstRow, FloatMatrix vectors) {
+            if (featureVectors->isEmpty()) {
+                featureVectors->cols = vectors.cols;
+                featureVectors->values.reserve(cellCount * vectors.cols);
+            }
+            featureVectors->values.append(vectors.values);
+            featureVectors->rows += vectors.rows;
+            if (onFeatureVectors) onFeatureVectors(firstRow, vectors);
+        };
+        m_inferenceJobs[jobId].onAccepted = [this, jobId, cellPositions]() {
+            sendCellPositions(jobId, cellPositions, 0, 0);
+        };
+        return jobId;
+    }
+
+    QCborMap params;
+    params["type"_q] = "autoencoder";
+    params["modelId"_q] = modelId;
+    params["imageHash"_q] = imageHash;
+    params["cellPositions"_q] = CborTypedArray::encode(cellPositions);
+    return submitInferenceJob(params, "autoencoder_inference", [onSuccess](QCborValue result) {
+        onSuccess(CborTypedArray::decode(result));
+    }, [this, imageHash, modelId, cellPositions](QString jobId) {
+        requestAutoencoderSynchronously(jobId, imageHash, modelId, cellPositions);
+    });
+}
+
+void BackendManager::cancelJob(QString jobId) {
+    if (!m_inferenceJobs.contains(jobId)) return;
+    if (m_inferenceJobs[jobId].isLocal()) {
+        // the worker threads stop after their current patch:
+        *m_inferenceJobs[jobId].localCancelled = true;
+        updateLocalJob(jobId, "cancelled", 0.0);
+        m_inferenceJobs.remove(jobId);
+        return;
+    }
+    const bool legacy = m_inferenceJobs[jobId].legacy;
+    m_inferenceJobs.remove(jobId);
+    updateJobPollTimer();
+    // old servers can't cancel jobs, the result is just ignored:
+    if (legacy) return;
+    requestJobCancellation(jobId);
+}
+
+void BackendManager::trainAutoencoder(QString modelName, QString baseModel, int epochs, QString imageHash, FloatMatrix cellPositions, std::function<void (QString)> onSuccess) {
     QCborMap params;
     params["modelName"_q] = modelName;
     params["baseModel"_q] = baseModel;
     params["epochs"_q] = epochs;
     params["imgHash"_q] = imageHash;
-    params["cellPositions"_q] = cellPositions;  // [(x, y), (x, y), ...] in pixels
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/model/autoencoder"));
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/cbor");
-    auto reply = m_nam->post(request, params.toCborValue().toCbor());
+    if (serverSupportsTypedArrays()) {
+        params["cellPositions"_q] = CborTypedArray::encode(cellPositions);
+    } else {
+        params["cellPositions"_q] = CborTypedArray::toNestedArrays(cellPositions);
+    }
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/model/autoencoder"));
+    auto reply = m_nam->post(request, encodeRequestBody(request, params));
     connect(reply, &QNetworkReply::finished, this, [this, reply, onSuccess]() {
         m_trainingProgress = 0.0;
         QString modelId = QString::fromUtf8(reply->readAll());
@@ -278,8 +728,7 @@ void BackendManager::trainAutoencoder(QString modelName, QString baseModel, int
 
 void BackendManager::loadRemoteProject(QString name) {
     qDebug() << "Loading remote project:" << name;
-    QNetworkRequest request;
-    request.setUrl(QUrl(m_serverUrl + "/projects/" + name + ".lpr"));
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/projects/" + name + ".lpr"));
     auto reply = m_nam->get(request);
     connect(reply, &QNetworkReply::finished, this, [this, reply, name]() {
         qDebug() << "Remote project received";
@@ -291,3 +740,488 @@ void BackendManager::loadRemoteProject(QString name) {
         });
     });
 }
+
+bool BackendManager::serverSupportsTypedArrays() const {
+    return QVersionNumber::fromString(m_version) >= QVersionNumber(1, 1);
+}
+
+bool BackendManager::serverSupportsStreamedAutoencoder() const {
+    return QVersionNumber::fromString(m_version) >= QVersionNumber(1, 4);
+}
+
+bool BackendManager::serverSupportsTrainingDataFiles() const {
+    return QVersionNumber::fromString(m_version) >= QVersionNumber(1, 6);
+}
+
+QByteArray BackendManager::encodeRequestBody(QNetworkRequest& request, const QCborMap& params) const {
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/cbor");
+    const QByteArray data = params.toCborValue().toCbor();
+    if (data.size() < COMPRESSION_THRESHOLD || !serverSupportsTypedArrays()) {
+        return data;
+    }
+    request.setRawHeader("Content-Encoding", "deflate");
+    // qCompress() prepends the uncompressed size to the zlib stream:
+    return qCompress(data, 1).mid(4);
+}
+
+void BackendManager::connectEvents() {
+    if (m_eventStream) {
+        m_eventStream->disconnect(this);
+        m_eventStream->abort();
+        m_eventStream->deleteLater();
+    }
+    m_eventBuffer.clear();
+
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/events"));
+    request.setRawHeader("Accept", "text/event-stream");
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+    auto reply = m_nam->get(request);
+    m_eventStream = reply;
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200) return;
+        m_eventReconnectAttempts = 0;
+        m_progressPollTimer.stop();
+        if (m_jobPollTimer.isActive()) {
+            // jobs may have finished while the channel was not connected:
+            m_jobPollTimer.stop();
+            pollJobs();
+        }
+        handleEventStreamData();
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        reply->deleteLater();
+        if (m_eventStream == reply) {
+            m_eventStream.clear();
+        }
+        updateJobPollTimer();
+        if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 404) {
+            // server version without the event channel
+            m_progressPollTimer.start();
+            return;
+        }
+        // the connection was lost, the server reports all running jobs again after reconnecting:
+        for (auto it = m_runningJobs.cbegin(); it != m_runningJobs.cend(); ++it) {
+            m_controller->manager<StatusManager>("statusManager")->removeStatus("job_" + it.key());
+        }
+        m_runningJobs.clear();
+        updateJobProgressAttributes();
+        if (m_version.getValue().isEmpty()) return;
+
+        const int delay = std::min(30000, 1000 << std::min(m_eventReconnectAttempts, 5));
+        ++m_eventReconnectAttempts;
+        m_eventReconnectTimer.start(delay);
+    });
+}
+
+void BackendManager::handleEventStreamData() {
+    m_eventBuffer.append(m_eventStream->readAll());
+    m_eventBuffer.replace("\r\n", "\n");
+    // events are separated by an empty line:
+    int end = m_eventBuffer.indexOf("\n\n");
+    while (end >= 0) {
+        const QByteArray block = m_eventBuffer.left(end);
+        m_eventBuffer.remove(0, end + 2);
+        end = m_eventBuffer.indexOf("\n\n");
+
+        QByteArray data;
+        for (const QByteArray& line: block.split('\n')) {
+            if (!line.startsWith("data:")) continue;  // i.e. event type or keepalive comment
+            if (!data.isEmpty()) data.append('\n');
+            data.append(line.mid(5).trimmed());
+        }
+        const QJsonDocument document = QJsonDocument::fromJson(data);
+        if (document.isObject()) {
+            handleJobEvent(document.object());
+        }
+    }
+}
+
+void BackendManager::handleJobEvent(const QJsonObject& event) {
+    const QString jobId = event["id"].toString();
+    const QString kind = event["kind"].toString();
+    const QString state = event["state"].toString();
+    const double progress = event["progress"].toDouble();
+    if (jobId.isEmpty()) return;
+
+    const bool training = kind.endsWith("_training");
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus("job_" + jobId);
+    if (state == "queued") {
+        m_runningJobs[jobId] = {kind, 0.0};
+        status->m_title = "Waiting for Server...";
+        status->m_progress = 0.0;
+    } else if (state == "running") {
+        m_runningJobs[jobId] = {kind, progress};
+        if (event.contains("loss")) {
+            status->m_title = QString("Training Neural Network (Epoch %1/%2, Loss %3)...")
+                    .arg(event["epoch"].toInt()).arg(event["epochs"].toInt()).arg(event["loss"].toDouble(), 0, 'g', 3);
+        } else {
+            status->m_title = training ? "Training Neural Network..." : "Applying Neural Network...";
+        }
+        status->m_progress = progress;
+    } else {
+        m_runningJobs.remove(jobId);
+        status->m_progress = 0.0;
+        if (state == "done") {
+            status->m_title = training ? "Training Completed ✓" : "Inference Completed ✓";
+        } else if (state == "cancelled") {
+            status->m_title = training ? "Training Cancelled" : "Inference Cancelled";
+        } else {
+            status->m_title = training ? "Training Failed ✗" : "Inference Failed ✗";
+        }
+        status->closeIn(3000);
+    }
+    updateJobProgressAttributes();
+
+    if (m_inferenceJobs.contains(jobId) && !m_inferenceJobs[jobId].legacy && !m_inferenceJobs[jobId].isLocal()) {
+        m_inferenceJobs[jobId].state = state;
+        if (event.contains("outputRows") && m_inferenceJobs[jobId].onOutputTile) {
+            fetchOutputTiles(jobId, event["outputRows"].toInt());
+        }
+        if (event.contains("outputCells") && m_inferenceJobs[jobId].onFeatureVectors) {
+            fetchFeatureVectors(jobId, event["outputCells"].toInt());
+        }
+        if (state == "done") {
+            fetchJobResult(jobId);
+        } else if (state == "failed" || state == "cancelled") {
+            finishInferenceJob(jobId, QCborValue());
+        }
+    }
+    emit jobChanged(jobId, kind, state, progress);
+}
+
+void BackendManager::updateJobProgressAttributes() {
+    double inferenceProgress = 0.0;
+    double trainingProgress = 0.0;
+    for (const Job& job: m_runningJobs) {
+        if (job.kind.endsWith("_training")) {
+            trainingProgress = std::max(trainingProgress, job.progress);
+        } else {
+            inferenceProgress = std::max(inferenceProgress, job.progress);
+        }
+    }
+    m_inferenceProgress = inferenceProgress;
+    m_trainingProgress = trainingProgress;
+}
+
+QString BackendManager::submitInferenceJob(QCborMap params, QString kind, std::function<void (QCborValue)> onResult,
+                                           std::function<void (QString)> legacyRequest) {
+    const QString jobId = QUuid::createUuid().toString(QUuid::Id128);
+    params["jobId"_q] = jobId;
+    // added before sending the request because the first events can arrive before the reply:
+    InferenceJob job;
+    job.kind = kind;
+    job.onResult = onResult;
+    m_inferenceJobs[jobId] = job;
+
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/jobs"));
+    auto reply = m_nam->post(request, encodeRequestBody(request, params));
+    const QString imageHash = params["imageHash"_q].toString();
+    const QString serverUrl = m_serverUrl;
+    connect(reply, &QNetworkReply::finished, this, [this, reply, jobId, imageHash, serverUrl, legacyRequest]() {
+        reply->deleteLater();
+        if (!m_inferenceJobs.contains(jobId)) return;  // cancelled or already finished
+        const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatus == 404 || httpStatus == 405) {
+            // server version without job queue
+            m_inferenceJobs[jobId].legacy = true;
+            legacyRequest(jobId);
+        } else if (httpStatus == 422) {
+            // the image was removed from the server, it is uploaded again next time:
+            m_blobCache->setKnownRemote(serverUrl, imageHash, false);
+            m_controller->guiManager()->showToast("The image is not available on the server anymore, please try again.");
+            finishInferenceJob(jobId, QCborValue());
+        } else if (httpStatus == 503) {
+            m_controller->guiManager()->showToast("The server is busy, please try again later.");
+            finishInferenceJob(jobId, QCborValue());
+        } else if (reply->error() != QNetworkReply::NoError) {
+            qWarning() << "Could not submit job:" << reply->errorString();
+            finishInferenceJob(jobId, QCborValue());
+        } else if (m_inferenceJobs[jobId].onAccepted) {
+            m_inferenceJobs[jobId].onAccepted();
+        }
+        updateJobPollTimer();
+    });
+    return jobId;
+}
+
+void BackendManager::requestUnetSynchronously(QString jobId, QString imageHash, QRect area, QString modelId) {
+    QString url = "%1/model/%2/prediction/%3/%4/%5/%6/%7";
+    url = url.arg(m_serverUrl).arg(modelId).arg(imageHash);
+    if (area.width() > 0 && area.height() > 0) {
+        url = url.arg(area.left()).arg(area.top()).arg(area.right()).arg(area.bottom());
+    } else {
+        url = url.arg(0).arg(0).arg(0).arg(0);
+    }
+    // the progress of this job is reported with this id in the event channel:
+    QUrlQuery query;
+    query.addQueryItem("job", jobId);
+    QUrl jobUrl(url);
+    jobUrl.setQuery(query);
+    QNetworkRequest request = createRequest(jobUrl);
+    auto reply = m_nam->get(request);
+    connect(reply, &QNetworkReply::finished, this, [this, reply, jobId]() {
+        m_inferenceProgress = 0.0;
+        finishInferenceJob(jobId, QCborValue::fromCbor(reply->readAll()));
+        reply->deleteLater();
+    });
+}
+
+void BackendManager::requestAutoencoderSynchronously(QString jobId, QString imageHash, QString modelId, FloatMatrix cellPositions) {
+    QCborMap params;
+    params["cellPositions"_q] = CborTypedArray::toNestedArrays(cellPositions);  // [(x, y), (x, y), ...] in pixels
+    QString url = "%1/model/%2/encode/%3";
+    url = url.arg(m_serverUrl).arg(modelId).arg(imageHash);
+    QUrlQuery query;
+    query.addQueryItem("job", jobId);
+    QUrl jobUrl(url);
+    jobUrl.setQuery(query);
+    QNetworkRequest request = createRequest(jobUrl);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/cbor");
+    auto reply = m_nam->post(request, params.toCborValue().toCbor());
+    connect(reply, &QNetworkReply::finished, this, [this, reply, jobId]() {
+        m_inferenceProgress = 0.0;
+        finishInferenceJob(jobId, QCborValue::fromCbor(reply->readAll()));
+        reply->deleteLater();
+    });
+}
+
+void BackendManager::sendTile(QString jobId, QPoint tile, QByteArray imageData, int attempt) {
+    if (!m_inferenceJobs.contains(jobId)) return;
+    QNetworkRequest request = createRequest(QUrl(QString("%1/jobs/%2/tiles/%3/%4").arg(m_serverUrl).arg(jobId).arg(tile.x()).arg(tile.y())));
+    // the server detects the codec of the image:
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    auto reply = m_nam->put(request, imageData);
+    connect(reply, &QNetworkReply::finished, this, [this, reply, jobId, tile, imageData, attempt]() {
+        reply->deleteLater();
+        if (reply->error() == QNetworkReply::NoError || !m_inferenceJobs.contains(jobId)) return;
+        const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatus == 410) return;  // the job is already finished
+        if (httpStatus == 404 || httpStatus == 422 || attempt >= MAX_TILE_RETRIES) {
+            qWarning() << "Could not upload tile" << tile << "of job" << jobId << reply->errorString();
+            // the job would wait for the tile, it is finished by the cancelled event:
+            requestJobCancellation(jobId);
+            return;
+        }
+        QTimer::singleShot(500 << attempt, this, [this, jobId, tile, imageData, attempt]() {
+            sendTile(jobId, tile, imageData, attempt + 1);
+        });
+    });
+}
+
+void BackendManager::fetchOutputTiles(QString jobId, int rows) {
+    if (!m_inferenceJobs.contains(jobId)) return;
+    InferenceJob& job = m_inferenceJobs[jobId];
+    for (const QPoint& tile: job.tiles) {
+        if (tile.y() < job.fetchedOutputRows || tile.y() >= rows) continue;
+        ++job.pendingOutputTiles;
+        QNetworkRequest request = createRequest(QUrl(QString("%1/jobs/%2/output/%3/%4").arg(m_serverUrl).arg(jobId).arg(tile.x()).arg(tile.y())));
+        auto reply = m_nam->get(request);
+        connect(reply, &QNetworkReply::finished, this, [this, reply, jobId, tile]() {
+            reply->deleteLater();
+            if (!m_inferenceJobs.contains(jobId)) return;
+            --m_inferenceJobs[jobId].pendingOutputTiles;
+            if (reply->error() == QNetworkReply::NoError) {
+                const auto onOutputTile = m_inferenceJobs[jobId].onOutputTile;
+                onOutputTile(tile, reply->readAll());
+            } else {
+                qWarning() << "Could not get output tile" << tile << "of job" << jobId << reply->errorString();
+            }
+            // the callback may have cancelled the job:
+            if (!m_inferenceJobs.contains(jobId)) return;
+            if (m_inferenceJobs[jobId].pendingOutputTiles == 0 && m_inferenceJobs[jobId].resultRequested) {
+                fetchJobResult(jobId);
+            }
+        });
+    }
+    job.fetchedOutputRows = std::max(job.fetchedOutputRows, rows);
+}
+
+void BackendManager::sendCellPositions(QString jobId, FloatMatrix cellPositions, int offset, int attempt) {
+    if (!m_inferenceJobs.contains(jobId) || offset >= cellPositions.rows) return;
+    const int rows = std::min(CELL_CHUNK_SIZE, cellPositions.rows - offset);
+    FloatMatrix chunk(rows, cellPositions.cols);
+    std::copy_n(cellPositions.values.constData() + offset * cellPositions.cols, rows * cellPositions.cols, chunk.values.data());
+    QCborMap params;
+    params["cellPositions"_q] = CborTypedArray::encode(chunk);
+    QNetworkRequest request = createRequest(QUrl(QString("%1/jobs/%2/cells/%3").arg(m_serverUrl).arg(jobId).arg(offset)));
+    auto reply = m_nam->post(request, encodeRequestBody(request, params));
+    connect(reply, &QNetworkReply::finished, this, [this, reply, jobId, cellPositions, offset, rows, attempt]() {
+        reply->deleteLater();
+        if (!m_inferenceJobs.contains(jobId)) return;
+        if (reply->error() == QNetworkReply::NoError) {
+            // the chunks have to arrive in order, the next one is sent after this one was accepted:
+            sendCellPositions(jobId, cellPositions, offset + rows, 0);
+            return;
+        }
+        const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatus == 410) return;  // the job is already finished
+        if (httpStatus == 404 || httpStatus == 422 || attempt >= MAX_CHUNK_RETRIES) {
+            qWarning() << "Could not upload cell positions" << offset << "of job" << jobId << reply->errorString();
+            // the job would wait for the positions, it is finished by the cancelled event:
+            requestJobCancellation(jobId);
+            return;
+        }
+        QTimer::singleShot(500 << attempt, this, [this, jobId, cellPositions, offset, attempt]() {
+            sendCellPositions(jobId, cellPositions, offset, attempt + 1);
+        });
+    });
+}
+
+void BackendManager::fetchFeatureVectors(QString jobId, int availableCells) {
+    if (!m_inferenceJobs.contains(jobId)) return;
+    InferenceJob& job = m_inferenceJobs[jobId];
+    job.availableCells = std::max(job.availableCells, availableCells);
+    // one request at a time, it gets all feature vectors that are available:
+    if (job.fetchingFeatures || job.fetchedCells >= job.availableCells) return;
+    job.fetchingFeatures = true;
+    QNetworkRequest request = createRequest(QUrl(QString("%1/jobs/%2/features/%3").arg(m_serverUrl).arg(jobId).arg(job.fetchedCells)));
+    auto reply = m_nam->get(request);
+    connect(reply, &QNetworkReply::finished, this, [this, reply, jobId]() {
+        reply->deleteLater();
+        if (!m_inferenceJobs.contains(jobId)) return;
+        InferenceJob& job = m_inferenceJobs[jobId];
+        job.fetchingFeatures = false;
+        const FloatMatrix vectors = reply->error() == QNetworkReply::NoError
+                ? CborTypedArray::decode(QCborValue::fromCbor(reply->readAll())) : FloatMatrix();
+        if (vectors.isEmpty()) {
+            // 409: no new feature vectors yet
+            if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 409) {
+                qWarning() << "Could not get feature vectors of job" << jobId << reply->errorString();
+            }
+            job.availableCells = job.fetchedCells;
+        } else {
+            const int firstRow = job.fetchedCells;
+            job.fetchedCells += vectors.rows;
+            const auto onFeatureVectors = job.onFeatureVectors;
+            onFeatureVectors(firstRow, vectors);
+        }
+        // the callback may have cancelled the job:
+        if (!m_inferenceJobs.contains(jobId)) return;
+        const InferenceJob& current = m_inferenceJobs[jobId];
+        if (current.resultRequested && current.fetchedCells >= current.availableCells) {
+            fetchJobResult(jobId);
+        } else {
+            fetchFeatureVectors(jobId, 0);
+        }
+    });
+}
+
+void BackendManager::requestJobCancellation(QString jobId) {
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/jobs/" + jobId));
+    auto reply = m_nam->deleteResource(request);
+    connect(reply, &QNetworkReply::finished, reply, &QNetworkReply::deleteLater);
+}
+
+void BackendManager::fetchJobResult(QString jobId) {
+    if (!m_inferenceJobs.contains(jobId) || m_inferenceJobs[jobId].fetching) return;
+    if (m_inferenceJobs[jobId].onOutputTile) {
+        // the remaining output tiles are received before the result:
+        fetchOutputTiles(jobId, std::numeric_limits<int>::max());
+        if (m_inferenceJobs[jobId].pendingOutputTiles > 0) {
+            m_inferenceJobs[jobId].resultRequested = true;
+            return;
+        }
+    }
+    if (m_inferenceJobs[jobId].onFeatureVectors) {
+        // the remaining feature vectors are received before the result (they are not part of it):
+        if (!m_inferenceJobs[jobId].resultRequested) {
+            m_inferenceJobs[jobId].resultRequested = true;
+            fetchFeatureVectors(jobId, std::numeric_limits<int>::max());
+        }
+        if (m_inferenceJobs[jobId].fetchingFeatures) return;
+    }
+    m_inferenceJobs[jobId].fetching = true;
+    QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/jobs/" + jobId + "/result"));
+    auto reply = m_nam->get(request);
+    connect(reply, &QNetworkReply::finished, this, [this, reply, jobId]() {
+        reply->deleteLater();
+        if (reply->error() != QNetworkReply::NoError) {
+            qWarning() << "Could not get result of job" << jobId << reply->errorString();
+            finishInferenceJob(jobId, QCborValue());
+            return;
+        }
+        finishInferenceJob(jobId, QCborValue::fromCbor(reply->readAll()));
+    });
+}
+
+void BackendManager::finishInferenceJob(QString jobId, QCborValue result) {
+    if (!m_inferenceJobs.contains(jobId)) return;
+    const InferenceJob job = m_inferenceJobs.take(jobId);
+    updateJobPollTimer();
+    job.onResult(result);
+}
+
+void BackendManager::updateLocalJob(QString jobId, QString state, double progress) {
+    if (!m_inferenceJobs.contains(jobId)) return;  // cancelled
+    // local jobs are shown like the ones of the server:
+    QJsonObject event;
+    event["id"] = jobId;
+    event["kind"] = m_inferenceJobs[jobId].kind;
+    event["state"] = state;
+    event["progress"] = progress;
+    handleJobEvent(event);
+}
+
+void BackendManager::finishLocalUnetJob(QString jobId, QByteArray outputImageData, QCborMap cellCenters) {
+    if (!m_inferenceJobs.contains(jobId)) return;  // cancelled
+    if (outputImageData.isEmpty()) {
+        updateLocalJob(jobId, "failed", 0.0);
+        finishInferenceJob(jobId, QCborValue());
+        return;
+    }
+    // the image block loads it from the cache like a downloaded output of the server:
+    const QString hash = md5(outputImageData);
+    m_blobCache->store(hash, outputImageData);
+    QCborMap result;
+    result["outputImageHash"_q] = hash;
+    result["cellCenters"_q] = cellCenters;
+    updateLocalJob(jobId, "done", 1.0);
+    finishInferenceJob(jobId, result);
+}
+
+std::shared_ptr<LocalUnet> BackendManager::localUnet(QString modelId, QString path) {
+    QMutexLocker lock(&m_localModelsLock);
+    if (m_localModels.contains(modelId)) return m_localModels[modelId];
+    auto model = std::make_shared<LocalUnet>(path);
+    // a missing model file can be added later:
+    if (model->isValid()) m_localModels[modelId] = model;
+    return model;
+}
+
+void BackendManager::pollJobs() {
+    for (auto it = m_inferenceJobs.cbegin(); it != m_inferenceJobs.cend(); ++it) {
+        if (it->legacy || it->isLocal() || it->fetching) continue;
+        const QString jobId = it.key();
+        QNetworkRequest request = createRequest(QUrl(m_serverUrl + "/jobs/" + jobId));
+        auto reply = m_nam->get(request);
+        connect(reply, &QNetworkReply::finished, this, [this, reply, jobId]() {
+            reply->deleteLater();
+            if (!m_inferenceJobs.contains(jobId)) return;
+            if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 404) {
+                // the server was restarted or the result expired
+                finishInferenceJob(jobId, QCborValue());
+                return;
+            }
+            if (reply->error() != QNetworkReply::NoError) return;  // try again with the next poll
+            const QString state = QCborValue::fromCbor(reply->readAll()).toMap()["state"_q].toString();
+            if (state.isEmpty() || state == m_inferenceJobs[jobId].state) return;
+            QJsonObject event;
+            event["id"] = jobId;
+            event["kind"] = m_inferenceJobs[jobId].kind;
+            event["state"] = state;
+            event["progress"] = m_runningJobs.value(jobId).progress;
+            handleJobEvent(event);
+        });
+    }
+}
+
+void BackendManager::updateJobPollTimer() {
+    const bool waiting = std::any_of(m_inferenceJobs.cbegin(), m_inferenceJobs.cend(), [](const InferenceJob& job) {
+        return !job.legacy && !job.isLocal();
+    });
+    if (waiting && !m_eventStream) {
+        if (!m_jobPollTimer.isActive()) m_jobPollTimer.start();
+    } else {
+        m_jobPollTimer.stop();
+    }
+}
@@ -3,56 +3,232 @@
 
 #include "core/helpers/SmartAttribute.h"
 #include "core/helpers/ObjectWithAttributes.h"
+#include "microscopy/manager/CborTypedArray.h"
+#include "microscopy/manager/ImageEncoder.h"
+#include "microscopy/manager/TrainingDataFile.h"
 
 #include <QObject>
 #include <QCborMap>
 #include <QRect>
+#include <QSize>
+#include <QPoint>
+#include <QVector>
 #include <QCborArray>
-
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QPointer>
+#include <QQueue>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+#include <atomic>
+#include <memory>
+
+class BlobCache;
+class ChunkedUpload;
 class CoreController;
+class LocalUnet;
 class QNetworkAccessManager;
+class QNetworkReply;
+class QNetworkRequest;
+class QJsonObject;
+class QUrl;
 
 class BackendManager : public QObject, public ObjectWithAttributes {
 
     Q_OBJECT
 
 public:
+    // size of the tiles of tile-streamed inference (see server/tile_inference.py)
+    static constexpr int INFERENCE_TILE_SIZE = 256;
+    // uploads that run at the same time, the others wait in a queue
+    static constexpr int MAX_CONCURRENT_UPLOADS = 3;
+
+    // all requests to the backend server are created with this,
+    // HTTP/2 is used if the server supports it, all requests share one connection then
+    static QNetworkRequest createRequest(const QUrl& url);
+
     explicit BackendManager(CoreController* controller);
 
+    // servers since version 1.2 can start the inference while the image is uploaded tile by tile
+    bool serverSupportsTiledInference() const;
+
+    // codec of the images sent to the server, the selected one if the server supports it, otherwise Png
+    ImageEncoder::Codec imageCodec() const;
+
+    // true if the U-Net inference runs in this process instead of on the server (see LocalUnet),
+    // depends on the "unetBackend" setting, "auto" only uses it if the server is not available
+    bool useLocalUnet(QString modelId) const;
+    // path of the ONNX file of the model for local inference
+    QString localModelPath(QString modelId) const;
+
 signals:
+    // state is "queued", "running", "done", "failed" or "cancelled"
+    void jobChanged(QString jobId, QString kind, QString state, double progress);
 
 public slots:
     QObject* attr(QString name);
 
+    BlobCache* blobCache() const { return m_blobCache; }
+
     void updateVersion();
     void updateInferenceProgress();
     void updateTrainingProgress();
 
+    // the checks of one event loop iteration (i.e. of all images of a project) are sent in one request:
     void checkFile(QString hash, std::function<void(bool)> onSuccess);
+    // onSuccess gets the hashes of the files that are available on the server
+    void checkFiles(QStringList hashes, std::function<void(QSet<QString>)> onSuccess);
 
     void uploadFile(QByteArray data, std::function<void(double)> onProgress, std::function<void(QString)> onSuccess);
+    // streams the file from disk instead of loading it completely, it is hashed in another thread first:
+    void uploadLocalFile(QString path, std::function<void(double)> onProgress, std::function<void(QString)> onSuccess);
+    // Training data files (see TrainingDataFile) are uploaded shard by shard, older CBOR files at once.
+    // onSuccess gets the hashes of the uploaded files in order, an empty list if the upload failed.
+    void uploadTrainingData(QString path, std::function<void(double)> onProgress, std::function<void(QStringList)> onSuccess);
     void downloadFile(QString hash, std::function<void(double)> onProgress, std::function<void(QByteArray)> onSuccess);
+    // returns the path of the file in the local cache, downloads it if necessary (empty path on failure):
+    void fetchFile(QString hash, std::function<void(double)> onProgress, std::function<void(QString)> onSuccess);
     void removeFile(QString hash, std::function<void(void)> onSuccess);
 
-    void applyUnet(QString imageHash, QRect area, QString modelId, std::function<void(QCborMap)> onSuccess);
-    void trainUnet(QString modelName, QString baseModel, int epochs, QString trainHash, QString valHash, std::function<void(QString)> onSuccess);
-
-    void applyAutoencoder(QString imageHash, QString modelId, QCborArray cellPositions, std::function<void(QCborArray)> onSuccess);
-    void trainAutoencoder(QString modelName, QString baseModel, int epochs, QString imageHash, QCborArray cellPositions, std::function<void(QString)> onSuccess);
+    // The inference methods queue a job on the server and return its id.
+    // onSuccess gets an empty result if the job failed, it isn't called after cancelJob().
+    QString applyUnet(QString imageHash, QRect area, QString modelId, std::function<void(QCborMap)> onSuccess);
+    // The input tiles (column, row) have to be sent in this order with uploadTile() after this call,
+    // the PNG encoded output tiles are passed to onOutputTile while the job is running.
+    QString applyUnetTiled(QSize imageSize, QVector<QPoint> tiles, QRect area, QString modelId,
+                           std::function<void(QPoint, QByteArray)> onOutputTile, std::function<void(QCborMap)> onSuccess);
+    void uploadTile(QString jobId, QPoint tile, QByteArray imageData);
+    // the hashes are the result of uploadTrainingData()
+    void trainUnet(QString modelName, QString baseModel, int epochs, QStringList trainHashes, QStringList valHashes, std::function<void(QString)> onSuccess);
+    // Like applyUnet() but runs the model on the CPU of this computer, the output image is stored in the blob cache.
+    // The result has the same format and the job can be cancelled with cancelJob() as well.
+    QString applyUnetLocally(QImage image, QRect area, QString modelId, std::function<void(QCborMap)> onSuccess);
+    // downloads the model as ONNX file for local inference (servers since version 1.5)
+    void downloadUnetModel(QString modelId, std::function<void(double)> onProgress, std::function<void(bool)> onSuccess);
+
+    // cellPositions has one row (x, y) in pixels per cell, the result one feature vector per cell.
+    // Servers since version 1.4 encode the cells in batches, onFeatureVectors gets the feature vectors
+    // of each batch (first row, vectors) while the job is running.
+    QString applyAutoencoder(QString imageHash, QString modelId, FloatMatrix cellPositions,
+                             std::function<void(int, FloatMatrix)> onFeatureVectors, std::function<void(FloatMatrix)> onSuccess);
+    void cancelJob(QString jobId);
+    void trainAutoencoder(QString modelName, QString baseModel, int epochs, QString imageHash, FloatMatrix cellPositions, std::function<void(QString)> onSuccess);
 
     void loadRemoteProject(QString name);
 
+protected slots:
+    void updateLocalJob(QString jobId, QString state, double progress);
+    void finishLocalUnetJob(QString jobId, QByteArray outputImageData, QCborMap cellCenters);
+
+protected:
+    // servers since version 1.1 understand typed arrays and compressed request bodies
+    bool serverSupportsTypedArrays() const;
+    // servers since version 1.4 accept the cell positions in chunks while the autoencoder is running
+    bool serverSupportsStreamedAutoencoder() const;
+    // servers since version 1.6 read training data files (see TrainingDataFile)
+    bool serverSupportsTrainingDataFiles() const;
+    QByteArray encodeRequestBody(QNetworkRequest& request, const QCborMap& params) const;
+
+    void sendPendingFileChecks();
+    void checkFilesIndividually(QStringList hashes, QSet<QString> existing, std::function<void(QSet<QString>)> onSuccess);
+    void enqueueUpload(ChunkedUpload* upload);
+    // continues uploadLocalFile() when the hash is known, an empty hash if the file can't be read:
+    void uploadHashedFile(QString path, QString fileHash, std::function<void(double)> onProgress, std::function<void(QString)> onSuccess);
+    // uploads the shards one after another, only one of them is in memory at a time:
+    void uploadShards(QString path, QVector<TrainingDataFile::Shard> shards, QStringList hashes,
+                      std::function<void(double)> onProgress, std::function<void(QStringList)> onSuccess);
+    void startQueuedUploads();
+
+    void connectEvents();
+    void handleEventStreamData();
+    void handleJobEvent(const QJsonObject& event);
+    void updateJobProgressAttributes();
+
+    QString submitInferenceJob(QCborMap params, QString kind, std::function<void(QCborValue)> onResult,
+                               std::function<void(QString)> legacyRequest);
+    void requestUnetSynchronously(QString jobId, QString imageHash, QRect area, QString modelId);
+    void requestAutoencoderSynchronously(QString jobId, QString imageHash, QString modelId, FloatMatrix cellPositions);
+    void sendTile(QString jobId, QPoint tile, QByteArray imageData, int attempt);
+    void fetchOutputTiles(QString jobId, int rows);
+    void sendCellPositions(QString jobId, FloatMatrix cellPositions, int offset, int attempt);
+    void fetchFeatureVectors(QString jobId, int availableCells);
+    void requestJobCancellation(QString jobId);
+    void fetchJobResult(QString jobId);
+    void finishInferenceJob(QString jobId, QCborValue result);
+    void pollJobs();
+    void updateJobPollTimer();
+    // loads the model on first use, can be called from any thread:
+    std::shared_ptr<LocalUnet> localUnet(QString modelId, QString path);
+
 protected:
     CoreController* const m_controller;
     QNetworkAccessManager* m_nam;
+    BlobCache* m_blobCache;
 
     StringAttribute m_serverUrl;
+    IntegerAttribute m_blobCacheSize;  // in MB
+    StringAttribute m_imageCodec;  // "png", "qoi" or "raw"
+    StringAttribute m_unetBackend;  // "auto", "server" or "local"
 
     // runtime:
     StringAttribute m_version;
     BoolAttribute m_secureConnection;
     DoubleAttribute m_inferenceProgress;
     DoubleAttribute m_trainingProgress;
+
+    // progress of the jobs is pushed by the server as Server-Sent Events,
+    // older servers are polled with m_progressPollTimer instead:
+    QPointer<QNetworkReply> m_eventStream;
+    QByteArray m_eventBuffer;
+    QTimer m_eventReconnectTimer;
+    int m_eventReconnectAttempts = 0;
+    QTimer m_progressPollTimer;
+
+    struct Job {
+        QString kind;
+        double progress = 0.0;
+    };
+    QHash<QString, Job> m_runningJobs;
+
+    // inference jobs of this client that wait for their result,
+    // they are polled with m_jobPollTimer while the event channel is not connected:
+    struct InferenceJob {
+        QString kind;
+        std::function<void(QCborValue)> onResult;
+        QString state;
+        bool legacy = false;  // server without job queue, the result is the reply of the request
+        std::shared_ptr<std::atomic<bool>> localCancelled;  // only set for jobs running in this process
+        bool isLocal() const { return bool(localCancelled); }
+        bool fetching = false;
+        std::function<void()> onAccepted;  // after the server queued the job
+
+        // tile-streamed inference:
+        std::function<void(QPoint, QByteArray)> onOutputTile;
+        QVector<QPoint> tiles;
+        int fetchedOutputRows = 0;
+        int pendingOutputTiles = 0;
+        bool resultRequested = false;  // after all output tiles or feature vectors are received
+
+        // streamed autoencoder inference:
+        std::function<void(int, FloatMatrix)> onFeatureVectors;
+        int fetchedCells = 0;
+        int availableCells = 0;
+        bool fetchingFeatures = false;
+    };
+    QHash<QString, InferenceJob> m_inferenceJobs;
+    QTimer m_jobPollTimer;
+
+    QHash<QString, QVector<std::function<void(bool)>>> m_pendingFileChecks;
+    QTimer m_fileCheckTimer;
+
+    QQueue<QPointer<ChunkedUpload>> m_queuedUploads;
+    int m_runningUploads = 0;
+
+    QHash<QString, std::shared_ptr<LocalUnet>> m_localModels;
+    QMutex m_localModelsLock;
 };
 
 #endif // BACKENDMANAGER_H
@@ -0,0 +1,221 @@
+#include "BlobCache.h"
+
+#include "core/helpers/qstring_literal.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QtDebug>
+
+#include <algorithm>
+#include <vector>
+
+
+namespace BlobCacheConstants {
+    static const QString indexFilename = "index.cbor";
+}
+
+
+BlobCache::BlobCache(QString directory, QObject* parent)
+    : QObject(parent)
+    , m_directory(directory.endsWith("/") ? directory : directory + "/")
+{
+    m_saveTimer.setInterval(1000);
+    m_saveTimer.setSingleShot(true);
+    connect(&m_saveTimer, &QTimer::timeout, this, &BlobCache::save);
+
+    QDir().mkpath(m_directory);
+    load();
+}
+
+BlobCache::~BlobCache() {
+    if (m_saveTimer.isActive()) {
+        save();
+    }
+}
+
+void BlobCache::setMaxSize(qint64 bytes) {
+    m_maxSize = bytes;
+    evict();
+}
+
+QString BlobCache::path(QString hash) {
+    if (!m_blobs.contains(hash)) return "";
+    const QString path = filePath(hash);
+    if (!QFile::exists(path)) {
+        // removed from outside
+        m_totalSize -= m_blobs.take(hash).size;
+        scheduleSave();
+        return "";
+    }
+    m_blobs[hash].lastUsed = QDateTime::currentMSecsSinceEpoch();
+    scheduleSave();
+    return path;
+}
+
+QString BlobCache::store(QString hash, const QByteArray& data) {
+    if (!isValidHash(hash)) return "";
+    const QString path = filePath(hash);
+    if (!m_blobs.contains(hash) || !QFile::exists(path)) {
+        // written to a temporary file first, so that there are never incomplete files in the cache:
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+            qWarning() << "Could not store file in cache:" << path;
+            return "";
+        }
+        m_totalSize -= m_blobs.value(hash).size;
+        m_totalSize += data.size();
+    }
+    m_blobs[hash] = {data.size(), QDateTime::currentMSecsSinceEpoch()};
+    evict();
+    scheduleSave();
+    return path;
+}
+
+void BlobCache::pin(QString hash, QString owner) {
+    if (!isValidHash(hash) || m_pins.value(hash).contains(owner)) return;
+    m_pins[hash].insert(owner);
+    scheduleSave();
+}
+
+void BlobCache::unpin(QString hash, QString owner) {
+    if (!m_pins.contains(hash)) return;
+    m_pins[hash].remove(owner);
+    if (m_pins[hash].isEmpty()) {
+        m_pins.remove(hash);
+    }
+    evict();
+    scheduleSave();
+}
+
+bool BlobCache::isKnownRemote(QString serverUrl, QString hash) const {
+    const qint64 confirmed = m_remote.value(serverUrl).value(hash, 0);
+    return confirmed && QDateTime::currentMSecsSinceEpoch() - confirmed < REMOTE_TTL;
+}
+
+void BlobCache::setKnownRemote(QString serverUrl, QString hash, bool exists) {
+    if (!isValidHash(hash)) return;
+    if (exists) {
+        m_remote[serverUrl][hash] = QDateTime::currentMSecsSinceEpoch();
+    } else if (m_remote.contains(serverUrl)) {
+        m_remote[serverUrl].remove(hash);
+    }
+    scheduleSave();
+}
+
+void BlobCache::load() {
+    QFile file(m_directory + BlobCacheConstants::indexFilename);
+    if (!file.open(QIODevice::ReadOnly)) return;
+    const QCborMap index = QCborValue::fromCbor(file.readAll()).toMap();
+
+    const QCborMap blobs = index["blobs"_q].toMap();
+    for (auto it = blobs.constBegin(); it != blobs.constEnd(); ++it) {
+        const QString hash = it.key().toString();
+        const QCborArray entry = it.value().toArray();
+        if (!isValidHash(hash) || !QFile::exists(filePath(hash))) continue;
+        m_blobs[hash] = {entry.at(0).toInteger(), entry.at(1).toInteger()};
+        m_totalSize += entry.at(0).toInteger();
+    }
+
+    const QCborMap pins = index["pins"_q].toMap();
+    for (auto it = pins.constBegin(); it != pins.constEnd(); ++it) {
+        for (const QCborValue& owner: it.value().toArray()) {
+            m_pins[it.key().toString()].insert(owner.toString());
+        }
+    }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const QCborMap remote = index["remote"_q].toMap();
+    for (auto server = remote.constBegin(); server != remote.constEnd(); ++server) {
+        const QCborMap hashes = server.value().toMap();
+        for (auto it = hashes.constBegin(); it != hashes.constEnd(); ++it) {
+            const qint64 confirmed = it.value().toInteger();
+            if (now - confirmed >= REMOTE_TTL) continue;
+            m_remote[server.key().toString()][it.key().toString()] = confirmed;
+        }
+    }
+}
+
+void BlobCache::save() {
+    m_saveTimer.stop();
+    QCborMap blobs;
+    for (auto it = m_blobs.cbegin(); it != m_blobs.cend(); ++it) {
+        blobs[it.key()] = QCborArray({it->size, it->lastUsed});
+    }
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QCborMap remote;
+    for (auto server = m_remote.cbegin(); server != m_remote.cend(); ++server) {
+        QCborMap hashes;
+        for (auto it = server->cbegin(); it != server->cend(); ++it) {
+            if (now - it.value() >= REMOTE_TTL) continue;
+            hashes[it.key()] = it.value();
+        }
+        if (!hashes.isEmpty()) {
+            remote[server.key()] = hashes;
+        }
+    }
+    QCborMap pins;
+    for (auto it = m_pins.cbegin(); it != m_pins.cend(); ++it) {
+        QCborArray owners;
+        for (const QString& owner: it.value()) owners.append(owner);
+        pins[it.key()] = owners;
+    }
+    QCborMap index;
+    index["blobs"_q] = blobs;
+    index["pins"_q] = pins;
+    index["remote"_q] = remote;
+
+    QSaveFile file(m_directory + BlobCacheConstants::indexFilename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write cache index:" << file.fileName();
+        return;
+    }
+    file.write(index.toCborValue().toCbor());
+    file.commit();
+}
+
+void BlobCache::scheduleSave() {
+    if (!m_saveTimer.isActive()) {
+        m_saveTimer.start();
+    }
+}
+
+void BlobCache::evict() {
+    // pinned files don't count towards the limit:
+    qint64 evictableSize = m_totalSize;
+    std::vector<std::pair<qint64, QString>> byAge;
+    byAge.reserve(size_t(m_blobs.size()));
+    for (auto it = m_blobs.cbegin(); it != m_blobs.cend(); ++it) {
+        if (m_pins.contains(it.key())) {
+            evictableSize -= it->size;
+        } else {
+            byAge.emplace_back(it->lastUsed, it.key());
+        }
+    }
+    if (evictableSize <= m_maxSize) return;
+    std::sort(byAge.begin(), byAge.end());
+    // the most recently used file is kept even if it is larger than the limit:
+    for (size_t i = 0; i + 1 < byAge.size() && evictableSize > m_maxSize; ++i) {
+        const QString& hash = byAge[i].second;
+        QFile::remove(filePath(hash));
+        const qint64 size = m_blobs.take(hash).size;
+        m_totalSize -= size;
+        evictableSize -= size;
+    }
+    scheduleSave();
+}
+
+QString BlobCache::filePath(QString hash) const {
+    return m_directory + hash;
+}
+
+bool BlobCache::isValidHash(const QString& hash) {
+    // the hash is used as filename
+    return hash.size() == 32 && std::all_of(hash.begin(), hash.end(), [](QChar c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+    });
+}
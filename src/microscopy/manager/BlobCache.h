@@ -0,0 +1,78 @@
+#ifndef BLOBCACHE_H
+#define BLOBCACHE_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+
+
+/**
+ * @brief The BlobCache class is a local content-addressed store for files exchanged with the
+ * backend server (i.e. downloaded images), shared by all projects.
+ *
+ * Each file is stored once under its md5 hash. If the total size exceeds the limit,
+ * the least recently used files are removed. Files that are pinned (i.e. the images of
+ * TissueImageBlocks in any project) are never removed and don't count towards the limit.
+ * It also remembers which hashes a server is known to have, so that uploads and checks
+ * of these files don't need a request. This information expires after REMOTE_TTL.
+ *
+ * The index is stored in the same directory and written shortly after each change.
+ * The methods have to be called from the main thread.
+ */
+class BlobCache : public QObject {
+
+    Q_OBJECT
+
+public:
+    static constexpr qint64 REMOTE_TTL = 24 * 60 * 60 * 1000;  // ms
+
+    explicit BlobCache(QString directory, QObject* parent);
+    ~BlobCache() override;
+
+    void setMaxSize(qint64 bytes);
+
+    // returns the local path of the file or an empty string, marks the file as recently used
+    QString path(QString hash);
+
+    // stores the data and returns its path, data has to match the hash
+    QString store(QString hash, const QByteArray& data);
+
+    // a pinned file is kept as long as at least one owner (i.e. a block uid) pins it:
+    void pin(QString hash, QString owner);
+    void unpin(QString hash, QString owner);
+
+    bool isKnownRemote(QString serverUrl, QString hash) const;
+    void setKnownRemote(QString serverUrl, QString hash, bool exists);
+
+    // true for lowercase hex md5 hashes
+    static bool isValidHash(const QString& hash);
+
+protected:
+    void load();
+    void save();
+    void scheduleSave();
+    void evict();
+    QString filePath(QString hash) const;
+
+protected:
+    const QString m_directory;
+    qint64 m_maxSize = 2LL * 1024 * 1024 * 1024;
+
+    struct Blob {
+        qint64 size = 0;
+        qint64 lastUsed = 0;  // ms since epoch
+    };
+    QHash<QString, Blob> m_blobs;
+    qint64 m_totalSize = 0;
+
+    // hash -> owners
+    QHash<QString, QSet<QString>> m_pins;
+
+    // server url -> hash -> time it was last confirmed that the server has it (ms since epoch)
+    QHash<QString, QHash<QString, qint64>> m_remote;
+
+    QTimer m_saveTimer;
+};
+
+#endif // BLOBCACHE_H
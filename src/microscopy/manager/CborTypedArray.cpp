@@ -0,0 +1,72 @@
+#include "CborTypedArray.h"
+
+#include <QtEndian>
+#include <QtDebug>
+
+#include <limits>
+
+
+namespace CborTypedArray {
+
+QCborValue encode(const FloatMatrix& matrix) {
+    QByteArray data(int(matrix.values.size() * sizeof(float)), Qt::Uninitialized);
+    qToLittleEndian<float>(matrix.values.constData(), matrix.values.size(), data.data());
+    QCborArray array;
+    array.append(QCborArray({matrix.rows, matrix.cols}));
+    array.append(QCborValue(QCborTag(TAG_FLOAT32_LE), data));
+    return QCborValue(QCborTag(TAG_MULTI_DIM_ARRAY), array);
+}
+
+FloatMatrix decode(const QCborValue& value) {
+    if (value.isTag() && value.tag() == QCborTag(TAG_MULTI_DIM_ARRAY)) {
+        const QCborArray array = value.taggedValue().toArray();
+        const QCborArray shape = array.at(0).toArray();
+        const QCborValue data = array.at(1);
+        if (shape.size() != 2 || !data.isTag()) return {};
+        const quint64 tag = quint64(data.tag());
+        const QByteArray bytes = data.taggedValue().toByteArray();
+        // the shape is checked against the data before anything is allocated, it comes from the network:
+        const qint64 rows = shape.at(0).toInteger(-1);
+        const qint64 cols = shape.at(1).toInteger(-1);
+        if ((tag != TAG_FLOAT32_LE && tag != TAG_FLOAT32_BE)
+                || rows < 0 || cols < 0 || rows > std::numeric_limits<int>::max() || cols > std::numeric_limits<int>::max()
+                || bytes.size() % qint64(sizeof(float)) != 0
+                || rows * cols != bytes.size() / qint64(sizeof(float))) {
+            qWarning() << "Unsupported or invalid typed array.";
+            return {};
+        }
+        FloatMatrix matrix(int(rows), int(cols));
+        if (tag == TAG_FLOAT32_LE) {
+            qFromLittleEndian<float>(bytes.constData(), matrix.values.size(), matrix.values.data());
+        } else {
+            qFromBigEndian<float>(bytes.constData(), matrix.values.size(), matrix.values.data());
+        }
+        return matrix;
+    }
+
+    if (!value.isArray()) return {};
+    const QCborArray rows = value.toArray();
+    if (rows.isEmpty()) return {};
+    FloatMatrix matrix(int(rows.size()), int(rows.at(0).toArray().size()));
+    for (int row = 0; row < matrix.rows; ++row) {
+        const QCborArray values = rows.at(row).toArray();
+        for (int col = 0; col < matrix.cols; ++col) {
+            matrix(row, col) = float(values.at(col).toDouble());
+        }
+    }
+    return matrix;
+}
+
+QCborArray toNestedArrays(const FloatMatrix& matrix) {
+    QCborArray rows;
+    for (int row = 0; row < matrix.rows; ++row) {
+        QCborArray values;
+        for (int col = 0; col < matrix.cols; ++col) {
+            values.append(double(matrix(row, col)));
+        }
+        rows.append(values);
+    }
+    return rows;
+}
+
+}  // namespace CborTypedArray
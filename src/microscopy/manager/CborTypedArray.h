@@ -0,0 +1,49 @@
+#ifndef CBORTYPEDARRAY_H
+#define CBORTYPEDARRAY_H
+
+#include <QCborArray>
+#include <QCborValue>
+#include <QVector>
+
+
+/**
+ * @brief The FloatMatrix struct is a row-major matrix of float values,
+ * i.e. one row per cell with the x and y position or the feature vector of it.
+ */
+struct FloatMatrix {
+    int rows = 0;
+    int cols = 0;
+    QVector<float> values;
+
+    FloatMatrix() {}
+    FloatMatrix(int rows, int cols) : rows(rows), cols(cols), values(rows * cols) {}
+
+    float& operator()(int row, int col) { return values[row * cols + col]; }
+    float operator()(int row, int col) const { return values.at(row * cols + col); }
+    bool isEmpty() const { return rows == 0 || cols == 0; }
+};
+
+
+/**
+ * Matrices are transferred to and from the backend server as RFC 8746 typed arrays:
+ * a multi-dimensional array (tag 40) of the shape and the float32 values in a single
+ * byte string (tag 85, little endian) instead of one CBOR item per value.
+ * See server/typed_arrays.py for the other side.
+ */
+namespace CborTypedArray {
+
+    const static quint64 TAG_MULTI_DIM_ARRAY = 40;
+    const static quint64 TAG_FLOAT32_BE = 81;
+    const static quint64 TAG_FLOAT32_LE = 85;
+
+    QCborValue encode(const FloatMatrix& matrix);
+
+    // also accepts nested arrays of numbers (from older servers),
+    // returns an empty matrix if the value is neither of both
+    FloatMatrix decode(const QCborValue& value);
+
+    // [[a, b, ...], [c, d, ...], ...] for servers without typed arrays
+    QCborArray toNestedArrays(const FloatMatrix& matrix);
+}
+
+#endif // CBORTYPEDARRAY_H
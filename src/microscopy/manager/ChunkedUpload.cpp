@@ -0,0 +1,151 @@
+#include "ChunkedUpload.h"
+
+#include "core/helpers/qstring_literal.h"
+#include "microscopy/manager/BackendManager.h"
+#include "microscopy/manager/BlobCache.h"
+
+#include <QCborValue>
+#include <QCryptographicHash>
+#include <QIODevice>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QTimer>
+#include <QUrlQuery>
+#include <QtDebug>
+
+#include <algorithm>
+
+
+ChunkedUpload::ChunkedUpload(QNetworkAccessManager* nam, QString serverUrl, QIODevice* device, QString hash,
+                             std::function<void(double)> onProgress, std::function<void(QString)> onSuccess,
+                             QObject* parent)
+    : QObject(parent)
+    , m_nam(nam)
+    , m_serverUrl(serverUrl)
+    , m_device(device)
+    , m_hash(hash)
+    , m_size(device->size())
+    , m_onProgress(onProgress)
+    , m_onSuccess(onSuccess)
+{
+    m_device->setParent(this);
+}
+
+void ChunkedUpload::requestStatus() {
+    QCborMap params;
+    params["hash"_q] = m_hash;
+    params["size"_q] = m_size;
+    QNetworkRequest request = BackendManager::createRequest(QUrl(m_serverUrl + "/data/uploads"));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/cbor");
+    auto reply = m_nam->post(request, params.toCborValue().toCbor());
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        reply->deleteLater();
+        const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatus == 404 || httpStatus == 405) {
+            // server version without chunked uploads
+            uploadAtOnce();
+        } else if (reply->error() != QNetworkReply::NoError) {
+            retry();
+        } else {
+            handleAcknowledgement(QCborValue::fromCbor(reply->readAll()).toMap());
+        }
+    });
+}
+
+void ChunkedUpload::sendChunk() {
+    const qint64 offset = m_received;
+    if (!m_device->seek(offset)) {
+        qWarning() << "Upload failed, can't read file at offset" << offset;
+        finish("");
+        return;
+    }
+    const QByteArray chunk = m_device->read(std::min(CHUNK_SIZE, m_size - offset));
+    if (chunk.size() != std::min(CHUNK_SIZE, m_size - offset)) {
+        qWarning() << "Upload failed, can't read file at offset" << offset;
+        finish("");
+        return;
+    }
+
+    QUrlQuery query;
+    query.addQueryItem("offset", QString::number(offset));
+    query.addQueryItem("size", QString::number(m_size));
+    QUrl url(m_serverUrl + "/data/uploads/" + m_hash);
+    url.setQuery(query);
+    QNetworkRequest request = BackendManager::createRequest(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    request.setRawHeader("X-Chunk-Hash", QCryptographicHash::hash(chunk, QCryptographicHash::Md5).toHex());
+    auto reply = m_nam->put(request, chunk);
+    connect(reply, &QNetworkReply::uploadProgress, this, [this, offset](qint64 bytesSent, qint64) {
+        m_onProgress(m_size ? (double(offset + bytesSent) / m_size) : 0.0);
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        reply->deleteLater();
+        if (reply->error() != QNetworkReply::NoError) {
+            // the server may have stored the chunk anyway, it reports the acknowledged bytes:
+            retry();
+            return;
+        }
+        m_retries = 0;
+        handleAcknowledgement(QCborValue::fromCbor(reply->readAll()).toMap());
+    });
+}
+
+void ChunkedUpload::handleAcknowledgement(const QCborMap& reply) {
+    if (reply["complete"_q].toBool()) {
+        finish(m_hash);
+        return;
+    }
+    const qint64 received = reply["received"_q].toInteger(-1);
+    if (received < 0 || received > m_size) {
+        retry();
+        return;
+    }
+    // if all bytes were received (i.e. of an empty file, or the server stopped before it finalized
+    // the file), the next chunk is empty and lets the server verify and finalize the file:
+    m_received = received;
+    m_onProgress(m_size ? (double(m_received) / m_size) : 0.0);
+    sendChunk();
+}
+
+void ChunkedUpload::retry() {
+    ++m_retries;
+    if (m_retries > MAX_RETRIES) {
+        qWarning() << "Upload failed after" << MAX_RETRIES << "retries.";
+        finish("");
+        return;
+    }
+    const int delay = 250 << m_retries;  // 0.5s to 16s
+    qDebug() << "Upload interrupted, resuming in" << delay << "ms";
+    QTimer::singleShot(delay, this, &ChunkedUpload::requestStatus);
+}
+
+void ChunkedUpload::uploadAtOnce() {
+    m_device->seek(0);
+    QNetworkRequest request = BackendManager::createRequest(QUrl(m_serverUrl + "/data"));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    auto reply = m_nam->post(request, m_device);
+    connect(reply, &QNetworkReply::uploadProgress, this, [this](qint64 bytesSent, qint64 bytesTotal) {
+        m_onProgress(bytesTotal ? (double(bytesSent) / bytesTotal) : 0.0);
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        reply->deleteLater();
+        const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        const QString hash = QString::fromUtf8(reply->readAll()).trimmed();
+        // i.e. the error page of a server that couldn't store the file:
+        if (reply->error() != QNetworkReply::NoError || httpStatus < 200 || httpStatus >= 300
+                || !BlobCache::isValidHash(hash)) {
+            qWarning() << "Upload failed:" << httpStatus << reply->errorString();
+            finish("");
+            return;
+        }
+        finish(hash);
+    });
+}
+
+void ChunkedUpload::finish(QString hash) {
+    if (!hash.isEmpty()) {
+        m_onProgress(1.0);
+    }
+    m_onSuccess(hash);
+    deleteLater();
+}
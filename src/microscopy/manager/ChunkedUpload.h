@@ -0,0 +1,61 @@
+#ifndef CHUNKEDUPLOAD_H
+#define CHUNKEDUPLOAD_H
+
+#include <QObject>
+#include <QCborMap>
+
+#include <functional>
+
+class QIODevice;
+class QNetworkAccessManager;
+class QNetworkReply;
+
+
+/**
+ * @brief The ChunkedUpload class uploads a file to the backend server in chunks,
+ * the protocol is described in server/data_store.py.
+ *
+ * The data is read chunk by chunk from the device, so that the file doesn't have to be
+ * in memory at once. Each chunk is sent with its hash. If a request fails, the upload is
+ * resumed from the number of bytes the server acknowledged.
+ * Servers without chunked uploads get the whole file in one request.
+ *
+ * The object deletes itself after calling onSuccess (with an empty hash if the upload failed).
+ */
+class ChunkedUpload : public QObject {
+
+    Q_OBJECT
+
+public:
+    static constexpr qint64 CHUNK_SIZE = 8 * 1024 * 1024;
+    static constexpr int MAX_RETRIES = 6;
+
+    // takes ownership of the device, which has to be opened for reading
+    explicit ChunkedUpload(QNetworkAccessManager* nam, QString serverUrl, QIODevice* device, QString hash,
+                           std::function<void(double)> onProgress, std::function<void(QString)> onSuccess,
+                           QObject* parent);
+
+    void start() { requestStatus(); }
+
+protected:
+    void requestStatus();
+    void sendChunk();
+    void handleAcknowledgement(const QCborMap& reply);
+    void retry();
+    void uploadAtOnce();
+    void finish(QString hash);
+
+protected:
+    QNetworkAccessManager* const m_nam;
+    const QString m_serverUrl;
+    QIODevice* const m_device;
+    const QString m_hash;
+    const qint64 m_size;
+    std::function<void(double)> m_onProgress;
+    std::function<void(QString)> m_onSuccess;
+
+    qint64 m_received = 0;  // bytes acknowledged by the server
+    int m_retries = 0;  // failed requests since the last acknowledged chunk
+};
+
+#endif // CHUNKEDUPLOAD_H
@@ -0,0 +1,181 @@
+#include "DirectoryScanner.h"
+
+#include "core/helpers/qstring_literal.h"
+#include "core/helpers/utils.h"
+#include "microscopy/algorithms/ParallelFor.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QtDebug>
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
+
+namespace {
+
+    // one index file per scanned directory and filter, so that blocks with different filters don't overwrite each other:
+    QString indexFilePath(const QString& directory, const QString& indexDirectory, const QRegularExpression& filter) {
+        const QByteArray key = (directory + "\n" + filter.pattern()).toUtf8();
+        const QString hash = QCryptographicHash::hash(key, QCryptographicHash::Md5).toHex();
+        return QDir(indexDirectory).filePath(hash + ".cbor");
+    }
+
+    QHash<QString, DirectoryScanner::Entry> loadIndex(const QString& path, const QString& directory) {
+        QHash<QString, DirectoryScanner::Entry> entries;
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) return entries;
+        const QCborMap index = QCborValue::fromCbor(file.readAll()).toMap();
+        // in the unlikely case of a hash collision:
+        if (index["directory"_q].toString() != directory) return entries;
+
+        const QCborMap files = index["files"_q].toMap();
+        for (auto it = files.constBegin(); it != files.constEnd(); ++it) {
+            const QCborArray values = it.value().toArray();
+            DirectoryScanner::Entry entry;
+            entry.fileName = it.key().toString();
+            entry.size = values.at(0).toInteger();
+            entry.modified = values.at(1).toInteger();
+            entry.imageSize = QSize(int(values.at(2).toInteger(-1)), int(values.at(3).toInteger(-1)));
+            entries[entry.fileName] = entry;
+        }
+        return entries;
+    }
+
+    void saveIndex(const QString& path, const QString& directory, const QVector<DirectoryScanner::Entry>& entries) {
+        QCborMap files;
+        for (const DirectoryScanner::Entry& entry: entries) {
+            files[entry.fileName] = QCborArray({entry.size, entry.modified, entry.imageSize.width(), entry.imageSize.height()});
+        }
+        QCborMap index;
+        index["directory"_q] = directory;
+        index["files"_q] = files;
+
+        // several blocks could scan the same directory at the same time, QSaveFile replaces the file atomically:
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning() << "Could not write directory index:" << file.fileName();
+            return;
+        }
+        file.write(index.toCborValue().toCbor());
+        file.commit();
+    }
+
+}  // namespace
+
+
+DirectoryScanner::DirectoryScanner(QString indexDirectory, QRegularExpression filter, Converter converter, QObject* parent)
+    : QObject(parent)
+    , m_indexDirectory(indexDirectory)
+    , m_filter(filter)
+    , m_converter(converter)
+{
+    m_refreshTimer.setInterval(1000);
+    m_refreshTimer.setSingleShot(true);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &DirectoryScanner::refresh);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, &m_refreshTimer, QOverload<>::of(&QTimer::start));
+}
+
+void DirectoryScanner::setDirectory(QString directory) {
+    if (!m_watcher.directories().isEmpty()) {
+        m_watcher.removePaths(m_watcher.directories());
+    }
+    m_directory = directory;
+    if (!m_directory.isEmpty() && QDir(m_directory).exists()) {
+        m_watcher.addPath(m_directory);
+    }
+    refresh();
+}
+
+void DirectoryScanner::refresh() {
+    m_refreshTimer.stop();
+    const int scanId = ++m_scanId;
+    if (m_directory.isEmpty()) {
+        onScanFinished(scanId, {});
+        return;
+    }
+    if (!m_scanning) {
+        m_scanning = true;
+        emit scanningChanged();
+    }
+
+    const QString directory = m_directory;
+    const QString indexDirectory = m_indexDirectory;
+    const QRegularExpression filter = m_filter;
+    const Converter converter = m_converter;
+    auto run = [directory, indexDirectory, filter, converter]() {
+        return converter(scan(directory, indexDirectory, filter));
+    };
+#ifdef THREADS_ENABLED
+    auto* watcher = new QFutureWatcher<QVariantList>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, scanId]() {
+        watcher->deleteLater();
+        onScanFinished(scanId, watcher->result());
+    });
+    watcher->setFuture(QtConcurrent::run(run));
+#else
+    onScanFinished(scanId, run());
+#endif
+}
+
+QVector<DirectoryScanner::Entry> DirectoryScanner::scan(QString directory, QString indexDirectory, const QRegularExpression& filter) {
+    auto begin = HighResTime::now();
+    const QString indexPath = indexFilePath(directory, indexDirectory, filter);
+    const QHash<QString, Entry> index = loadIndex(indexPath, directory);
+
+    QVector<Entry> entries;
+    QVector<int> unknown;
+    // sorted by name by default:
+    for (const QFileInfo& info: QDir(directory).entryInfoList(QDir::Files)) {
+        if (!filter.match(info.fileName()).hasMatch()) continue;
+        Entry entry;
+        entry.path = info.filePath();
+        entry.fileName = info.fileName();
+        entry.size = info.size();
+        entry.modified = info.lastModified().toMSecsSinceEpoch();
+        const auto known = index.constFind(entry.fileName);
+        if (known != index.constEnd() && known->size == entry.size && known->modified == entry.modified) {
+            entry.imageSize = known->imageSize;
+        } else {
+            unknown.append(entries.size());
+        }
+        entries.append(entry);
+    }
+
+    // reading the image headers is mostly waiting for the file system, several files are read at once:
+    Entry* data = entries.data();
+    parallelForChunks(unknown.size(), [&](int, int first, int end) {
+        for (int i = first; i < end; ++i) {
+            Entry& entry = data[unknown.at(i)];
+            entry.imageSize = QImageReader(entry.path).size();
+        }
+    }, /*minChunkSize*/ 8);
+
+    if (!unknown.isEmpty() || index.size() != entries.size()) {
+        QDir().mkpath(indexDirectory);
+        saveIndex(indexPath, directory, entries);
+    }
+    qDebug() << "Scanned" << entries.size() << "files (" << unknown.size() << "new or changed) in"
+             << HighResTime::getElapsedSecAndUpdate(begin) << "s";
+    return entries;
+}
+
+void DirectoryScanner::onScanFinished(int scanId, const QVariantList& items) {
+    // the directory was changed or scanned again in the meantime:
+    if (scanId != m_scanId) return;
+    if (m_scanning) {
+        m_scanning = false;
+        emit scanningChanged();
+    }
+    emit scanned(items);
+}
@@ -0,0 +1,79 @@
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QRegularExpression>
+#include <QSize>
+#include <QTimer>
+#include <QVariantList>
+#include <QVector>
+
+#include <functional>
+
+
+/**
+ * @brief The DirectoryScanner class lists the image files of a directory in a background thread
+ * and watches the directory, so that the list is refreshed when files are added or changed.
+ *
+ * The size, modification time and image dimensions of the files are stored in an index per
+ * directory (in indexDirectory, not in the scanned directory, which may be read-only).
+ * Unchanged files are taken from the index, so that only new or modified files have to be
+ * opened again, which is slow for network shares with thousands of files.
+ *
+ * The entries are converted by the converter function in the background thread as well,
+ * the result is emitted with scanned().
+ */
+class DirectoryScanner : public QObject {
+
+    Q_OBJECT
+
+public:
+    struct Entry {
+        QString path;
+        QString fileName;
+        qint64 size = 0;
+        qint64 modified = 0;  // ms since epoch
+        QSize imageSize;  // invalid if the file couldn't be read as an image
+    };
+
+    // is called in a background thread and must not access any blocks:
+    using Converter = std::function<QVariantList(const QVector<Entry>&)>;
+
+    explicit DirectoryScanner(QString indexDirectory, QRegularExpression filter, Converter converter, QObject* parent);
+
+    // scans the directory and watches it for changes, an empty path clears the result:
+    void setDirectory(QString directory);
+
+    // scans the directory again, unchanged files are not read again
+    void refresh();
+
+    bool isScanning() const { return m_scanning; }
+
+    // lists the files in the directory whose names match the filter, sorted by name,
+    // blocking, but can be called in any thread:
+    static QVector<Entry> scan(QString directory, QString indexDirectory, const QRegularExpression& filter);
+
+signals:
+    void scanned(QVariantList items);
+    void scanningChanged();
+
+protected:
+    void onScanFinished(int scanId, const QVariantList& items);
+
+protected:
+    const QString m_indexDirectory;
+    const QRegularExpression m_filter;
+    const Converter m_converter;
+
+    QString m_directory;
+    // results of outdated scans are ignored:
+    int m_scanId = 0;
+    bool m_scanning = false;
+
+    QFileSystemWatcher m_watcher;
+    // many files are usually changed at once, e.g. while copying:
+    QTimer m_refreshTimer;
+};
+
+#endif // DIRECTORYSCANNER_H
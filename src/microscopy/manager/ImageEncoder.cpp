@@ -0,0 +1,243 @@
+#include "ImageEncoder.h"
+
+#include "core/helpers/utils.h"
+
+#include <QBuffer>
+#include <QImageWriter>
+#include <QThreadPool>
+#include <QtDebug>
+#include <QtEndian>
+
+#ifdef THREADS_ENABLED
+#include <QtConcurrent>
+#endif
+
+
+namespace ImageEncoder {
+
+namespace {
+
+    // 80 is mapped to zlib level 1 by Qt, 100 is uncompressed
+    const static int PNG_QUALITY = 80;
+    // size of the uncompressed stripes of RawDeflate that are compressed in parallel
+    const static int RAW_STRIPE_BYTES = 1024 * 1024;
+    // single images are only logged if they are larger than this
+    const static qint64 LOG_THRESHOLD = 16 * 1024 * 1024;
+
+    void logThroughput(QString what, qint64 rawBytes, qint64 encodedBytes, double seconds) {
+        const double megabytes = rawBytes / (1024.0 * 1024.0);
+        qDebug().noquote() << QString("%1: %2 MB -> %3 MB in %4 s (%5 MB/s)")
+                              .arg(what)
+                              .arg(megabytes, 0, 'f', 1)
+                              .arg(encodedBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                              .arg(seconds, 0, 'f', 3)
+                              .arg(seconds > 0.0 ? megabytes / seconds : 0.0, 0, 'f', 0);
+    }
+
+    QByteArray encodePng(const QImage& image) {
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        QImageWriter writer(&buffer, "PNG");
+        writer.setQuality(PNG_QUALITY);
+        if (!writer.write(image)) {
+            qWarning() << "Could not encode PNG:" << writer.errorString();
+            return {};
+        }
+        return data;
+    }
+
+    // see https://qoiformat.org/qoi-specification.pdf
+    QByteArray encodeQoi(const QImage& rgbImage) {
+        const int width = rgbImage.width();
+        const int height = rgbImage.height();
+        QByteArray data;
+        // worst case is 4 bytes per pixel:
+        data.reserve(14 + width * height * 4 + 8);
+        data.append("qoif", 4);
+        char size[8];
+        qToBigEndian<quint32>(quint32(width), size);
+        qToBigEndian<quint32>(quint32(height), size + 4);
+        data.append(size, 8);
+        data.append(char(3));  // RGB
+        data.append(char(0));  // sRGB with linear alpha
+
+        quint32 index[64] = {};
+        quint8 pr = 0, pg = 0, pb = 0;
+        int run = 0;
+        const qint64 pixelCount = qint64(width) * height;
+        qint64 pixel = 0;
+        for (int y = 0; y < height; ++y) {
+            const quint8* line = rgbImage.constScanLine(y);
+            for (int x = 0; x < width; ++x, ++pixel) {
+                const quint8 r = line[x * 3];
+                const quint8 g = line[x * 3 + 1];
+                const quint8 b = line[x * 3 + 2];
+                if (r == pr && g == pg && b == pb) {
+                    ++run;
+                    if (run == 62 || pixel == pixelCount - 1) {
+                        data.append(char(0xc0 | (run - 1)));
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run > 0) {
+                    data.append(char(0xc0 | (run - 1)));
+                    run = 0;
+                }
+                const quint32 rgba = (quint32(r) << 24) | (quint32(g) << 16) | (quint32(b) << 8) | 0xff;
+                const int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+                if (index[hash] == rgba) {
+                    data.append(char(hash));
+                } else {
+                    index[hash] = rgba;
+                    const qint8 vr = qint8(r - pr);
+                    const qint8 vg = qint8(g - pg);
+                    const qint8 vb = qint8(b - pb);
+                    const int vgr = vr - vg;
+                    const int vgb = vb - vg;
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        data.append(char(0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2)));
+                    } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                        data.append(char(0x80 | (vg + 32)));
+                        data.append(char(((vgr + 8) << 4) | (vgb + 8)));
+                    } else {
+                        data.append(char(0xfe));
+                        data.append(char(r));
+                        data.append(char(g));
+                        data.append(char(b));
+                    }
+                }
+                pr = r;
+                pg = g;
+                pb = b;
+            }
+        }
+        data.append("\0\0\0\0\0\0\0\1", 8);
+        return data;
+    }
+
+    QByteArray compressStripe(const QImage& rgbImage, int firstRow, int rows) {
+        const int lineBytes = rgbImage.width() * 3;
+        QByteArray raw(lineBytes * rows, Qt::Uninitialized);
+        for (int y = 0; y < rows; ++y) {
+            memcpy(raw.data() + y * lineBytes, rgbImage.constScanLine(firstRow + y), size_t(lineBytes));
+        }
+        // without the 4 byte length prefix of qCompress, this is a zlib stream:
+        return qCompress(raw, 1).mid(4);
+    }
+
+    QByteArray encodeRawDeflate(const QImage& rgbImage) {
+        const int width = rgbImage.width();
+        const int height = rgbImage.height();
+        const int stripeRows = qMax(1, RAW_STRIPE_BYTES / qMax(1, width * 3));
+        const int stripeCount = (height + stripeRows - 1) / stripeRows;
+
+        QVector<QByteArray> stripes(stripeCount);
+#ifdef THREADS_ENABLED
+        QVector<QFuture<QByteArray>> futures;
+        for (int i = 0; i < stripeCount; ++i) {
+            futures.append(QtConcurrent::run(threadPool(), [rgbImage, i, stripeRows, height]() {
+                return compressStripe(rgbImage, i * stripeRows, qMin(stripeRows, height - i * stripeRows));
+            }));
+        }
+        for (int i = 0; i < stripeCount; ++i) {
+            stripes[i] = futures[i].result();
+        }
+#else
+        for (int i = 0; i < stripeCount; ++i) {
+            stripes[i] = compressStripe(rgbImage, i * stripeRows, qMin(stripeRows, height - i * stripeRows));
+        }
+#endif
+
+        // header: magic, width, height, rows per stripe, number of stripes, compressed size of each stripe
+        QByteArray header(20 + 4 * stripeCount, Qt::Uninitialized);
+        memcpy(header.data(), RAW_DEFLATE_MAGIC, 4);
+        qToLittleEndian<quint32>(quint32(width), header.data() + 4);
+        qToLittleEndian<quint32>(quint32(height), header.data() + 8);
+        qToLittleEndian<quint32>(quint32(stripeRows), header.data() + 12);
+        qToLittleEndian<quint32>(quint32(stripeCount), header.data() + 16);
+        int size = header.size();
+        for (int i = 0; i < stripeCount; ++i) {
+            qToLittleEndian<quint32>(quint32(stripes[i].size()), header.data() + 20 + 4 * i);
+            size += stripes[i].size();
+        }
+        QByteArray data;
+        data.reserve(size);
+        data.append(header);
+        for (const QByteArray& stripe: stripes) {
+            data.append(stripe);
+        }
+        return data;
+    }
+}
+
+Codec codecFromName(const QString& name) {
+    if (name == "qoi") return Codec::Qoi;
+    if (name == "raw") return Codec::RawDeflate;
+    return Codec::Png;
+}
+
+QByteArray encode(const QImage& image, Codec codec) {
+    auto begin = HighResTime::now();
+    QByteArray data;
+    switch (codec) {
+    case Codec::Png:
+        data = encodePng(image);
+        break;
+    case Codec::Qoi:
+        data = encodeQoi(image.convertToFormat(QImage::Format_RGB888));
+        break;
+    case Codec::RawDeflate:
+        data = encodeRawDeflate(image.convertToFormat(QImage::Format_RGB888));
+        break;
+    }
+    const qint64 rawBytes = qint64(image.width()) * image.height() * 3;
+    if (rawBytes >= LOG_THRESHOLD) {
+        logThroughput("Encoded image", rawBytes, data.size(), HighResTime::getElapsedSecAndUpdate(begin));
+    }
+    return data;
+}
+
+QFuture<QByteArray> encodeAsync(const QImage& image, Codec codec) {
+#ifdef THREADS_ENABLED
+    return QtConcurrent::run(threadPool(), [image, codec]() {
+        return encode(image, codec);
+    });
+#else
+    QFutureInterface<QByteArray> result;
+    result.reportStarted();
+    result.reportResult(encode(image, codec));
+    result.reportFinished();
+    return result.future();
+#endif
+}
+
+QVector<QByteArray> encodeAll(const QVector<QImage>& images, Codec codec) {
+    auto begin = HighResTime::now();
+    QVector<QFuture<QByteArray>> futures;
+    futures.reserve(images.size());
+    for (const QImage& image: images) {
+        futures.append(encodeAsync(image, codec));
+    }
+    QVector<QByteArray> result;
+    result.reserve(images.size());
+    qint64 rawBytes = 0;
+    qint64 encodedBytes = 0;
+    for (int i = 0; i < images.size(); ++i) {
+        result.append(futures[i].result());
+        rawBytes += qint64(images[i].width()) * images[i].height() * 3;
+        encodedBytes += result.last().size();
+    }
+    logThroughput(QString("Encoded %1 images").arg(images.size()), rawBytes, encodedBytes,
+                  HighResTime::getElapsedSecAndUpdate(begin));
+    return result;
+}
+
+QThreadPool* threadPool() {
+    // separate from the global pool, so that long running tasks there don't delay the encoding:
+    static QThreadPool pool;
+    return &pool;
+}
+
+}  // namespace ImageEncoder
@@ -0,0 +1,42 @@
+#ifndef IMAGEENCODER_H
+#define IMAGEENCODER_H
+
+#include <QByteArray>
+#include <QFuture>
+#include <QImage>
+#include <QString>
+#include <QVector>
+
+class QThreadPool;
+
+
+/**
+ * Lossless encoding of the images that are sent to the backend server or stored in files.
+ * The images are encoded on a shared thread pool instead of one after another:
+ *  - Png: zlib level 1, readable by everything, but the slowest
+ *  - Qoi: the "Quite OK Image" format, about as small as Png and much faster to encode
+ *  - RawDeflate: RGB values in horizontal stripes that are deflate compressed in parallel,
+ *    see server/image_codecs.py for the layout
+ * Qoi and RawDeflate are only understood by servers since version 1.3.
+ */
+namespace ImageEncoder {
+
+    enum class Codec { Png, Qoi, RawDeflate };
+
+    const static char RAW_DEFLATE_MAGIC[] = "RIMG";
+
+    // "png", "qoi" or "raw", unknown names are Png
+    Codec codecFromName(const QString& name);
+
+    QByteArray encode(const QImage& image, Codec codec);
+
+    // the result is ready immediately if threads are not enabled
+    QFuture<QByteArray> encodeAsync(const QImage& image, Codec codec);
+
+    // encodes all images in parallel, the order of the result is the same as of the images
+    QVector<QByteArray> encodeAll(const QVector<QImage>& images, Codec codec);
+
+    QThreadPool* threadPool();
+}
+
+#endif // IMAGEENCODER_H
@@ -0,0 +1,111 @@
+#include "ImageLoadScheduler.h"
+
+#include "core/CoreController.h"
+#include "core/manager/ProjectManager.h"
+#include "core/manager/StatusManager.h"
+
+#include <QDateTime>
+#include <QRunnable>
+#include <QtDebug>
+
+#include <algorithm>
+
+
+namespace {
+
+    const static QString STATUS_UID = "imageLoading";
+
+    class FunctionTask : public QRunnable {
+    public:
+        explicit FunctionTask(std::function<void()> function) : m_function(function) {}
+        void run() override { m_function(); }
+    protected:
+        const std::function<void()> m_function;
+    };
+
+}  // namespace
+
+
+ImageLoadScheduler::ImageLoadScheduler(CoreController* controller, QObject* parent)
+    : QObject(parent)
+    , m_controller(controller)
+{
+    connect(m_controller->projectManager(), &ProjectManager::projectLoadingFinished, this, [this]() {
+        // the blocks schedule their images in their own handlers of this signal, which are called later:
+        if (m_pending == 0) {
+            m_tasks.clear();
+            m_timelineStart = QDateTime::currentMSecsSinceEpoch();
+        }
+    });
+}
+
+void ImageLoadScheduler::schedule(QString name, Priority priority, std::function<void()> work) {
+#ifdef THREADS_ENABLED
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (m_timelineStart == 0) {
+        m_timelineStart = now;
+    }
+    const int task = m_tasks.size();
+    m_tasks.append({name, priority, now, 0, 0});
+    ++m_pending;
+    if (priority == Visible) ++m_pendingVisible;
+
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(STATUS_UID);
+    status->m_title = "Loading Images...";
+    status->m_running = true;
+
+    m_pool.start(new FunctionTask([this, task, work]() {
+        const qint64 started = QDateTime::currentMSecsSinceEpoch();
+        work();
+        const qint64 finished = QDateTime::currentMSecsSinceEpoch();
+        QMetaObject::invokeMethod(this, [this, task, started, finished]() {
+            onTaskFinished(task, started, finished);
+        }, Qt::QueuedConnection);
+    }), int(priority));
+#else
+    Q_UNUSED(name)
+    Q_UNUSED(priority)
+    work();
+#endif
+}
+
+void ImageLoadScheduler::onTaskFinished(int task, qint64 started, qint64 finished) {
+    m_tasks[task].started = started;
+    m_tasks[task].finished = finished;
+    --m_pending;
+
+    if (m_tasks[task].priority == Visible && --m_pendingVisible == 0) {
+        qDebug() << "Images of visible views loaded after" << (finished - m_timelineStart) / 1000.0 << "s";
+    }
+
+    const int done = m_tasks.size() - m_pending;
+    Status* status = m_controller->manager<StatusManager>("statusManager")->getStatus(STATUS_UID);
+    status->m_progress = double(done) / m_tasks.size();
+    if (m_pending > 0) return;
+
+    status->m_title = "Loading Images Completed ✓";
+    status->closeIn(1000);
+    logTimeline();
+    m_tasks.clear();
+    m_timelineStart = 0;
+}
+
+void ImageLoadScheduler::logTimeline() {
+    QVector<Task> tasks = m_tasks;
+    std::sort(tasks.begin(), tasks.end(), [](const Task& lhs, const Task& rhs) {
+        return lhs.started < rhs.started;
+    });
+    qint64 end = m_timelineStart;
+    qDebug() << "Timeline of image loading:";
+    for (const Task& task: tasks) {
+        qDebug().noquote() << QString("  %1 s - %2 s (waited %3 s) %4%5")
+                              .arg((task.started - m_timelineStart) / 1000.0, 6, 'f', 2)
+                              .arg((task.finished - m_timelineStart) / 1000.0, 6, 'f', 2)
+                              .arg((task.started - task.queued) / 1000.0, 0, 'f', 2)
+                              .arg(task.name)
+                              .arg(task.priority == Visible ? "" : " (hidden)");
+        end = std::max(end, task.finished);
+    }
+    qDebug() << "Loaded" << tasks.size() << "images in" << (end - m_timelineStart) / 1000.0 << "s using"
+             << m_pool.maxThreadCount() << "threads";
+}
@@ -0,0 +1,56 @@
+#ifndef IMAGELOADSCHEDULER_H
+#define IMAGELOADSCHEDULER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QVector>
+
+#include <functional>
+
+class CoreController;
+
+
+/**
+ * @brief The ImageLoadScheduler class decodes the images of a project after it was opened.
+ *
+ * The work (hashing, decoding and converting of TissueImageBlocks) runs in its own thread pool,
+ * the images of visible views first, so that the project is usable before all images are ready.
+ * A timeline of the loading is written to the log when everything is finished.
+ * The methods have to be called from the main thread.
+ */
+class ImageLoadScheduler : public QObject {
+
+    Q_OBJECT
+
+public:
+    // used as QThreadPool priority, higher values are run first:
+    enum Priority { Hidden = 0, Visible = 1 };
+
+    explicit ImageLoadScheduler(CoreController* controller, QObject* parent);
+
+    // runs the work in a background thread, the name is used in the timeline:
+    void schedule(QString name, Priority priority, std::function<void()> work);
+
+protected:
+    void onTaskFinished(int task, qint64 started, qint64 finished);
+    void logTimeline();
+
+protected:
+    CoreController* const m_controller;
+    QThreadPool m_pool;
+
+    struct Task {
+        QString name;
+        Priority priority;
+        qint64 queued;  // all times in ms since epoch
+        qint64 started;
+        qint64 finished;
+    };
+    QVector<Task> m_tasks;
+    // the start of the timeline, when the project was loaded or the first task was scheduled, 0 if idle:
+    qint64 m_timelineStart = 0;
+    int m_pending = 0;
+    int m_pendingVisible = 0;
+};
+
+#endif // IMAGELOADSCHEDULER_H
@@ -0,0 +1,380 @@
+#include "ImageStack.h"
+
+#include "core/helpers/utils.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QtDebug>
+#include <QtEndian>
+
+#include <algorithm>
+
+
+namespace {
+
+    // TIFF tags:
+    const static quint16 NEW_SUBFILE_TYPE = 254;
+    const static quint16 IMAGE_WIDTH = 256;
+    const static quint16 IMAGE_LENGTH = 257;
+    const static quint16 BITS_PER_SAMPLE = 258;
+    const static quint16 COMPRESSION = 259;
+    const static quint16 PHOTOMETRIC_INTERPRETATION = 262;
+    const static quint16 IMAGE_DESCRIPTION = 270;
+    const static quint16 STRIP_OFFSETS = 273;
+    const static quint16 SAMPLES_PER_PIXEL = 277;
+    const static quint16 STRIP_BYTE_COUNTS = 279;
+    const static quint16 TILE_WIDTH = 322;
+    const static quint16 SAMPLE_FORMAT = 339;
+
+    // protects against loops in the chain of pages:
+    const static int MAX_PAGES = 100000;
+
+    struct Page {
+        int index = 0;  // in the chain of pages, as used by QImageReader::jumpToImage()
+        quint64 width = 0;
+        quint64 height = 0;
+        quint64 bitsPerSample = 1;
+        quint64 compression = 1;
+        quint64 photometric = 1;
+        quint64 samplesPerPixel = 1;
+        quint64 sampleFormat = 1;
+        quint64 subfileType = 0;
+        bool tiled = false;
+        std::vector<quint64> stripOffsets;
+        std::vector<quint64> stripByteCounts;
+        QByteArray description;
+    };
+
+    // reads the structure of a classic TIFF or BigTIFF file, but not the image data
+    class TiffReader {
+
+    public:
+        TiffReader(const uchar* data, qint64 size) : m_data(data), m_size(size) {
+            if (size < 8) return;
+            if (data[0] == 'I' && data[1] == 'I') {
+                m_bigEndian = false;
+            } else if (data[0] == 'M' && data[1] == 'M') {
+                m_bigEndian = true;
+            } else {
+                return;
+            }
+            const quint64 version = read(2, 2);
+            if (version == 42) {
+                m_bigTiff = false;
+                m_firstPage = read(4, 4);
+            } else if (version == 43 && read(4, 2) == 8) {
+                m_bigTiff = true;
+                m_firstPage = read(8, 8);
+            } else {
+                return;
+            }
+            m_valid = !m_error;
+        }
+
+        bool isBigEndian() const { return m_bigEndian; }
+
+        // all pages of the main chain, empty if the file is not valid:
+        std::vector<Page> pages() {
+            std::vector<Page> pages;
+            if (!m_valid) return pages;
+            quint64 offset = m_firstPage;
+            while (offset != 0 && int(pages.size()) < MAX_PAGES && !m_error) {
+                Page page;
+                page.index = int(pages.size());
+                offset = readPage(offset, page);
+                pages.push_back(page);
+            }
+            if (m_error) pages.clear();
+            return pages;
+        }
+
+    protected:
+        quint64 read(quint64 offset, int bytes) {
+            if (offset + quint64(bytes) > quint64(m_size)) {
+                m_error = true;
+                return 0;
+            }
+            const uchar* p = m_data + offset;
+            switch (bytes) {
+            case 1: return p[0];
+            case 2: return m_bigEndian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+            case 4: return m_bigEndian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+            default: return m_bigEndian ? qFromBigEndian<quint64>(p) : qFromLittleEndian<quint64>(p);
+            }
+        }
+
+        static int typeSize(quint64 type) {
+            switch (type) {
+            case 1: case 2: case 6: case 7: return 1;  // BYTE, ASCII, SBYTE, UNDEFINED
+            case 3: case 8: return 2;  // SHORT, SSHORT
+            case 4: case 9: case 11: case 13: return 4;  // LONG, SLONG, FLOAT, IFD
+            default: return 8;  // RATIONAL, DOUBLE, LONG8 etc.
+            }
+        }
+
+        // returns the offset of the next page
+        quint64 readPage(quint64 offset, Page& page) {
+            const int countSize = m_bigTiff ? 8 : 2;
+            const int entrySize = m_bigTiff ? 20 : 12;
+            const int valueSize = m_bigTiff ? 8 : 4;
+            const quint64 entryCount = read(offset, countSize);
+            if (entryCount > quint64(m_size) / quint64(entrySize)) {
+                m_error = true;
+                return 0;
+            }
+            for (quint64 i = 0; i < entryCount && !m_error; ++i) {
+                const quint64 entry = offset + quint64(countSize) + i * quint64(entrySize);
+                const quint16 tag = quint16(read(entry, 2));
+                const quint64 type = read(entry + 2, 2);
+                const quint64 count = read(entry + 4, valueSize);
+                const int size = typeSize(type);
+                // the values are stored in the entry if they fit into it:
+                const quint64 valueOffset = count * quint64(size) <= quint64(valueSize)
+                        ? entry + 4 + quint64(valueSize) : read(entry + 4 + quint64(valueSize), valueSize);
+                auto values = [&]() {
+                    std::vector<quint64> result;
+                    if (count > quint64(m_size)) {
+                        m_error = true;
+                        return result;
+                    }
+                    result.reserve(std::size_t(count));
+                    for (quint64 j = 0; j < count && !m_error; ++j) {
+                        result.push_back(read(valueOffset + j * quint64(size), size));
+                    }
+                    return result;
+                };
+                auto value = [&]() { return read(valueOffset, size); };
+
+                switch (tag) {
+                case NEW_SUBFILE_TYPE: page.subfileType = value(); break;
+                case IMAGE_WIDTH: page.width = value(); break;
+                case IMAGE_LENGTH: page.height = value(); break;
+                case BITS_PER_SAMPLE: page.bitsPerSample = value(); break;
+                case COMPRESSION: page.compression = value(); break;
+                case PHOTOMETRIC_INTERPRETATION: page.photometric = value(); break;
+                case SAMPLES_PER_PIXEL: page.samplesPerPixel = value(); break;
+                case SAMPLE_FORMAT: page.sampleFormat = value(); break;
+                case TILE_WIDTH: page.tiled = true; break;
+                case STRIP_OFFSETS: page.stripOffsets = values(); break;
+                case STRIP_BYTE_COUNTS: page.stripByteCounts = values(); break;
+                case IMAGE_DESCRIPTION:
+                    if (valueOffset + count <= quint64(m_size)) {
+                        page.description = QByteArray(reinterpret_cast<const char*>(m_data + valueOffset), int(std::min(count, quint64(64 * 1024 * 1024))));
+                    }
+                    break;
+                default: break;
+                }
+            }
+            return read(offset + quint64(countSize) + entryCount * quint64(entrySize), valueSize);
+        }
+
+    protected:
+        const uchar* m_data;
+        const qint64 m_size;
+        bool m_bigEndian = false;
+        bool m_bigTiff = false;
+        quint64 m_firstPage = 0;
+        bool m_valid = false;
+        bool m_error = false;
+    };
+
+    // true for 16 bit grayscale pages, colored pages and other bit depths (i.e. of time series)
+    // are not regarded as channels:
+    bool isChannel(const Page& page) {
+        return page.samplesPerPixel == 1 && page.bitsPerSample == 16 && page.sampleFormat == 1
+                && (page.photometric == 0 || page.photometric == 1);  // min-is-white or min-is-black
+    }
+
+    // true if the page can be used directly from the mapped file
+    bool isMappable(const Page& page, qint64 fileSize) {
+        if (page.compression != 1 || page.bitsPerSample != 16 || page.samplesPerPixel != 1
+                || page.sampleFormat != 1 || page.tiled) return false;
+        if (page.stripOffsets.empty() || page.stripOffsets.size() != page.stripByteCounts.size()) return false;
+        // the strips have to follow each other without gaps:
+        quint64 end = page.stripOffsets.front();
+        for (std::size_t i = 0; i < page.stripOffsets.size(); ++i) {
+            if (page.stripOffsets[i] != end) return false;
+            end += page.stripByteCounts[i];
+        }
+        return page.stripOffsets.front() % 2 == 0
+                && end - page.stripOffsets.front() >= page.width * page.height * 2
+                && end <= quint64(fileSize);
+    }
+
+    QStringList omeChannelNames(const QByteArray& description) {
+        QStringList names;
+        if (!description.contains("<OME")) return names;
+        const QRegularExpression re("<Channel\\b[^>]*\\bName=\"([^\"]*)\"");
+        auto it = re.globalMatch(QString::fromUtf8(description));
+        while (it.hasNext()) {
+            names << it.next().captured(1);
+        }
+        return names;
+    }
+
+    struct CacheEntry {
+        QMutex mutex;  // held while the stack is loaded, so that it is only loaded once
+        std::weak_ptr<const ImageStack> stack;
+        qint64 modified = 0;
+    };
+
+    struct Cache {
+        QMutex mutex;
+        QHash<QString, std::shared_ptr<CacheEntry>> entries;
+        // the blocks of the channels usually open the stack one after another:
+        std::shared_ptr<const ImageStack> lastOpened;
+    };
+
+    Cache& cache() {
+        static Cache cache;
+        return cache;
+    }
+
+}  // namespace
+
+
+std::shared_ptr<const ImageStack> ImageStack::open(const QString& path) {
+    const QFileInfo info(path);
+    const QString suffix = info.suffix().toLower();
+    if ((suffix != "tif" && suffix != "tiff") || !info.exists()) return nullptr;
+
+    std::shared_ptr<CacheEntry> entry;
+    {
+        QMutexLocker locker(&cache().mutex);
+        // removes the entries of stacks that are not used anymore and not being loaded by another thread
+        // (entries are only copied while the mutex is held):
+        for (auto it = cache().entries.begin(); it != cache().entries.end();) {
+            if (it.value().use_count() == 1 && it.value()->stack.expired()) {
+                it = cache().entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::shared_ptr<CacheEntry>& cached = cache().entries[info.absoluteFilePath()];
+        if (!cached) cached = std::make_shared<CacheEntry>();
+        entry = cached;
+    }
+    QMutexLocker entryLocker(&entry->mutex);
+    const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    std::shared_ptr<const ImageStack> existing = entry->stack.lock();
+    if (existing && entry->modified == modified) return existing;
+
+    auto begin = HighResTime::now();
+    std::shared_ptr<ImageStack> stack(new ImageStack());
+    if (!stack->load(path)) return nullptr;
+    qDebug() << (stack->isMapped() ? "Mapped" : "Decoded") << stack->channelCount() << "channels of" << path
+             << "in" << HighResTime::getElapsedSecAndUpdate(begin) << "s";
+    entry->stack = stack;
+    entry->modified = modified;
+    QMutexLocker locker(&cache().mutex);
+    cache().lastOpened = stack;
+    return stack;
+}
+
+QImage ImageStack::channelImage(int channel) const {
+    if (channel < 0 || channel >= channelCount()) return QImage();
+    // deleted by the image when it is not used anymore:
+    auto* owner = new std::shared_ptr<const ImageStack>(shared_from_this());
+    return QImage(reinterpret_cast<const uchar*>(m_channels[std::size_t(channel)]), m_width, m_height, m_width * 2,
+                  QImage::Format_Grayscale16,
+                  [](void* info) { delete static_cast<std::shared_ptr<const ImageStack>*>(info); }, owner);
+}
+
+bool ImageStack::load(const QString& path) {
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+    const qint64 size = m_file.size();
+    uchar* data = m_file.map(0, size);
+    if (!data) {
+        // not all file systems support mapping:
+        m_file.close();
+        return decode(path, {});
+    }
+
+    TiffReader reader(data, size);
+    std::vector<Page> pages = reader.pages();
+    if (!pages.empty()) {
+        m_channelNames = omeChannelNames(pages.front().description);
+    }
+    // pyramid levels of the channels:
+    pages.erase(std::remove_if(pages.begin(), pages.end(), [](const Page& page) {
+        return page.subfileType & 1;
+    }), pages.end());
+    if (pages.size() <= 1 || !std::all_of(pages.begin(), pages.end(), isChannel)) {
+        m_file.unmap(data);
+        m_file.close();
+        return false;
+    }
+
+    const bool mappable = !reader.isBigEndian() && QSysInfo::ByteOrder == QSysInfo::LittleEndian
+            && std::all_of(pages.begin(), pages.end(), [&](const Page& page) {
+        return page.width == pages.front().width && page.height == pages.front().height && isMappable(page, size);
+    });
+    if (!mappable) {
+        m_file.unmap(data);
+        m_file.close();
+        std::vector<int> indexes;
+        for (const Page& page: pages) indexes.push_back(page.index);
+        return decode(path, indexes);
+    }
+
+    m_width = int(pages.front().width);
+    m_height = int(pages.front().height);
+    for (const Page& page: pages) {
+        m_channels.push_back(reinterpret_cast<const quint16*>(data + page.stripOffsets.front()));
+    }
+    m_mapped = data;
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    const qint64 chunkSize = 64 * 1024 * 1024;
+    for (qint64 offset = 0; offset < size; offset += chunkSize) {
+        hash.addData(reinterpret_cast<const char*>(data + offset), int(std::min(chunkSize, size - offset)));
+    }
+    m_hash = QString(hash.result().toHex());
+    return true;
+}
+
+bool ImageStack::decode(const QString& path, const std::vector<int>& pages) {
+    QImageReader reader(path);
+    std::vector<int> indexes = pages;
+    if (indexes.empty()) {
+        for (int i = 0; i < reader.imageCount(); ++i) indexes.push_back(i);
+    }
+    if (indexes.size() <= 1) return false;
+
+    for (std::size_t c = 0; c < indexes.size(); ++c) {
+        if (!reader.jumpToImage(indexes[c])) return false;
+        QImage image = reader.read();
+        if (image.isNull()) return false;
+        // the pages of a file that couldn't be mapped are not checked yet:
+        if (image.format() != QImage::Format_Grayscale16) return false;
+        if (c == 0) {
+            m_width = image.width();
+            m_height = image.height();
+            m_decoded.resize(std::size_t(m_width) * std::size_t(m_height) * indexes.size());
+        } else if (image.width() != m_width || image.height() != m_height) {
+            qWarning() << "The pages of" << path << "have different sizes.";
+            return false;
+        }
+        quint16* target = m_decoded.data() + c * std::size_t(m_width) * std::size_t(m_height);
+        for (int y = 0; y < m_height; ++y) {
+            const quint16* line = reinterpret_cast<const quint16*>(image.constScanLine(y));
+            std::copy(line, line + m_width, target + std::size_t(y) * std::size_t(m_width));
+        }
+    }
+    for (std::size_t c = 0; c < indexes.size(); ++c) {
+        m_channels.push_back(m_decoded.data() + c * std::size_t(m_width) * std::size_t(m_height));
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(&file);
+    m_hash = QString(hash.result().toHex());
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef IMAGESTACK_H
+#define IMAGESTACK_H
+
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <QStringList>
+
+#include <memory>
+#include <vector>
+
+
+/**
+ * @brief The ImageStack class holds all channels of a multi-page TIFF (i.e. an OME-TIFF of a
+ * multiplexed panel) as planar 16 bit data, so that the channels don't have to be decoded
+ * one by one for each TissueImageBlock.
+ *
+ * Only files whose pages are all 16 bit grayscale are regarded as stacks, other multi-page
+ * files (i.e. colored or 8 bit time series) are loaded like single images.
+ * Uncompressed little endian stacks (classic TIFF and BigTIFF) that are stored in contiguous
+ * strips are memory-mapped and used without copying them. All other stacks are decoded once
+ * with QImageReader. Pages with a reduced resolution (pyramid levels) are skipped, all other
+ * pages are channels.
+ *
+ * Stacks are shared: open() returns the same object for the same file as long as it is used
+ * somewhere (and the last opened one a bit longer), it can be called from any thread.
+ * The data is read-only.
+ */
+class ImageStack : public std::enable_shared_from_this<ImageStack> {
+
+public:
+    // returns nullptr if the file is not a TIFF with more than one 16 bit grayscale page or can't be read:
+    static std::shared_ptr<const ImageStack> open(const QString& path);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int channelCount() const { return int(m_channels.size()); }
+    bool isMapped() const { return m_mapped != nullptr; }
+
+    // the md5 hash of the file, the same as of TissueImageBlock::m_hashOfSelectedFile
+    QString hash() const { return m_hash; }
+
+    // from the OME-XML metadata, empty strings for unnamed channels
+    QString channelName(int channel) const { return m_channelNames.value(channel); }
+
+    // width() * height() values, row by row
+    const quint16* channel(int channel) const { return m_channels.at(std::size_t(channel)); }
+
+    // a Format_Grayscale16 image that uses the data of the stack without copying it,
+    // it keeps the stack alive as long as it exists:
+    QImage channelImage(int channel) const;
+
+    ImageStack(const ImageStack&) = delete;
+    ImageStack& operator=(const ImageStack&) = delete;
+
+protected:
+    ImageStack() = default;
+
+    bool load(const QString& path);
+    bool decode(const QString& path, const std::vector<int>& pages);
+
+protected:
+    int m_width = 0;
+    int m_height = 0;
+    QString m_hash;
+    QStringList m_channelNames;
+    // pointers to the data of each channel, either in the mapped file or in m_decoded:
+    std::vector<const quint16*> m_channels;
+
+    QFile m_file;
+    uchar* m_mapped = nullptr;
+    std::vector<quint16> m_decoded;
+};
+
+#endif // IMAGESTACK_H
@@ -0,0 +1,199 @@
+#include "LocalUnet.h"
+
+#include "microscopy/algorithms/ParallelFor.h"
+
+#include "core/helpers/utils.h"
+
+#include <QtDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#ifdef ONNXRUNTIME_ENABLED
+#include <onnxruntime_cxx_api.h>
+
+#include <array>
+#include <string>
+#endif
+
+
+struct LocalUnet::Session {
+#ifdef ONNXRUNTIME_ENABLED
+    Ort::Env env{ORT_LOGGING_LEVEL_WARNING, "luminosus"};
+    std::unique_ptr<Ort::Session> session;
+    std::string inputName;
+    std::string outputName;
+#endif
+};
+
+namespace LocalUnetConstants {
+    // the output of the outer pixels of a patch is less reliable, each patch only
+    // contributes the pixels at least half of the overlap away from its border
+    const static int PATCH_STRIDE = LocalUnet::PATCH_SIZE - LocalUnet::PATCH_OVERLAP;
+    const static int PATCH_MARGIN = LocalUnet::PATCH_OVERLAP / 2;
+}
+
+
+bool LocalUnet::isSupported() {
+#ifdef ONNXRUNTIME_ENABLED
+    return true;
+#else
+    return false;
+#endif
+}
+
+LocalUnet::LocalUnet(QString modelPath)
+    : m_session(new Session())
+{
+#ifdef ONNXRUNTIME_ENABLED
+    try {
+        Ort::SessionOptions options;
+        // the patches are processed in parallel, each one in a single thread:
+        options.SetIntraOpNumThreads(1);
+        options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+#ifdef Q_OS_WIN
+        m_session->session = std::make_unique<Ort::Session>(m_session->env, modelPath.toStdWString().c_str(), options);
+#else
+        m_session->session = std::make_unique<Ort::Session>(m_session->env, modelPath.toStdString().c_str(), options);
+#endif
+        Ort::AllocatorWithDefaultOptions allocator;
+        m_session->inputName = m_session->session->GetInputNameAllocated(0, allocator).get();
+        m_session->outputName = m_session->session->GetOutputNameAllocated(0, allocator).get();
+    } catch (const Ort::Exception& exception) {
+        m_session->session.reset();
+        m_errorString = QString::fromUtf8(exception.what());
+        qWarning() << "Could not load U-Net model" << modelPath << ":" << m_errorString;
+    }
+#else
+    Q_UNUSED(modelPath)
+    m_errorString = "Built without ONNX Runtime.";
+#endif
+}
+
+LocalUnet::~LocalUnet() = default;
+
+bool LocalUnet::isValid() const {
+#ifdef ONNXRUNTIME_ENABLED
+    return bool(m_session->session);
+#else
+    return false;
+#endif
+}
+
+QImage LocalUnet::predict(const QImage& image, QRect area, std::function<bool(double)> onProgress) const {
+    if (!isValid() || image.isNull()) return QImage();
+    auto begin = HighResTime::now();
+    const QImage rgbImage = image.convertToFormat(QImage::Format_RGB888);
+    const int width = rgbImage.width();
+    const int height = rgbImage.height();
+
+    // the last patch ends at or after the border of the image:
+    auto patchCount = [](int size) {
+        return 1 + std::max(0, (size - PATCH_SIZE + LocalUnetConstants::PATCH_STRIDE - 1) / LocalUnetConstants::PATCH_STRIDE);
+    };
+    // the core of a patch is the part of the output it contributes, the cores don't overlap:
+    auto coreBegin = [](int index) {
+        return index == 0 ? 0 : index * LocalUnetConstants::PATCH_STRIDE + LocalUnetConstants::PATCH_MARGIN;
+    };
+    const int columns = patchCount(width);
+    const int rows = patchCount(height);
+
+    struct Patch {
+        QPoint origin;
+        QRect core;
+    };
+    std::vector<Patch> patches;
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            const QPoint origin(column * LocalUnetConstants::PATCH_STRIDE, row * LocalUnetConstants::PATCH_STRIDE);
+            if (area.isValid() && !QRect(origin, QSize(PATCH_SIZE, PATCH_SIZE)).intersects(area)) {
+                // outside of relevant area
+                continue;
+            }
+            const int right = column == columns - 1 ? width : coreBegin(column + 1);
+            const int bottom = row == rows - 1 ? height : coreBegin(row + 1);
+            patches.push_back({origin, QRect(QPoint(coreBegin(column), coreBegin(row)), QPoint(right - 1, bottom - 1))});
+        }
+    }
+
+    QImage output(rgbImage.size(), QImage::Format_RGB32);
+    output.fill(Qt::black);
+    // the patches write to different pixels, but must not detach the image in parallel:
+    uchar* outputBits = output.bits();
+    const int outputBytesPerLine = output.bytesPerLine();
+
+    std::atomic<int> finishedPatches{0};
+    std::atomic<bool> stopped{false};
+    parallelForChunks(int(patches.size()), [&](int, int first, int end) {
+        for (int i = first; i < end && !stopped; ++i) {
+            const Patch& patch = patches[std::size_t(i)];
+            if (!predictPatch(rgbImage, patch.origin, patch.core, outputBits, outputBytesPerLine)) {
+                stopped = true;
+                return;
+            }
+            if (!onProgress(double(++finishedPatches) / patches.size())) {
+                stopped = true;
+            }
+        }
+    }, /*minChunkSize*/ 1);
+    if (stopped) return QImage();
+
+    qDebug() << "Local U-Net inference of" << patches.size() << "patches:" << HighResTime::getElapsedSecAndUpdate(begin) << "s";
+    return output;
+}
+
+bool LocalUnet::predictPatch(const QImage& rgbImage, QPoint origin, QRect core, uchar* output, int outputBytesPerLine) const {
+#ifdef ONNXRUNTIME_ENABLED
+    const int planeSize = PATCH_SIZE * PATCH_SIZE;
+    // (channel, y, x) from 0.0 to 1.0, padded with black at the border of the image:
+    std::vector<float> input(std::size_t(3 * planeSize), 0.0f);
+    const QRect inside = QRect(origin, QSize(PATCH_SIZE, PATCH_SIZE)).intersected(rgbImage.rect());
+    for (int y = inside.top(); y <= inside.bottom(); ++y) {
+        const uchar* line = rgbImage.constScanLine(y);
+        float* target = input.data() + (y - origin.y()) * PATCH_SIZE - origin.x();
+        for (int x = inside.left(); x <= inside.right(); ++x) {
+            target[x] = line[x * 3] / 255.0f;
+            target[planeSize + x] = line[x * 3 + 1] / 255.0f;
+            target[2 * planeSize + x] = line[x * 3 + 2] / 255.0f;
+        }
+    }
+
+    try {
+        const std::array<int64_t, 4> shape = {1, 3, PATCH_SIZE, PATCH_SIZE};
+        const Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        Ort::Value inputTensor = Ort::Value::CreateTensor<float>(memoryInfo, input.data(), input.size(),
+                                                                 shape.data(), shape.size());
+        const char* inputNames[] = {m_session->inputName.c_str()};
+        const char* outputNames[] = {m_session->outputName.c_str()};
+        // Session::Run() can be called from several threads at the same time:
+        auto outputs = m_session->session->Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, 1);
+        if (outputs.front().GetTensorTypeAndShapeInfo().GetElementCount() != input.size()) {
+            qWarning() << "Unexpected output shape of the U-Net model.";
+            return false;
+        }
+        const float* result = outputs.front().GetTensorData<float>();
+        auto toByte = [](float value) {
+            return int(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+        };
+        for (int y = core.top(); y <= core.bottom(); ++y) {
+            QRgb* line = reinterpret_cast<QRgb*>(output + y * outputBytesPerLine);
+            const float* source = result + (y - origin.y()) * PATCH_SIZE - origin.x();
+            for (int x = core.left(); x <= core.right(); ++x) {
+                line[x] = qRgb(toByte(source[x]), toByte(source[planeSize + x]), toByte(source[2 * planeSize + x]));
+            }
+        }
+    } catch (const Ort::Exception& exception) {
+        qWarning() << "Error during local U-Net inference:" << exception.what();
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(rgbImage)
+    Q_UNUSED(origin)
+    Q_UNUSED(core)
+    Q_UNUSED(output)
+    Q_UNUSED(outputBytesPerLine)
+    return false;
+#endif
+}
@@ -0,0 +1,52 @@
+#ifndef LOCALUNET_H
+#define LOCALUNET_H
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+
+#include <functional>
+#include <memory>
+
+
+/**
+ * @brief The LocalUnet class applies a U-Net model exported by the server as ONNX file
+ * (see server/export_onnx.py) on the CPU, without a connection to the server.
+ *
+ * The image is split into overlapping patches like in server/apply_unet.py, each output pixel
+ * is taken from the patch it is most central in. The patches are processed in parallel.
+ * Only available if the application is built with ONNX Runtime (CONFIG += onnxruntime).
+ */
+class LocalUnet {
+
+public:
+    // the model input is (batch, 3, PATCH_SIZE, PATCH_SIZE) RGB from 0.0 to 1.0, the output the same
+    static constexpr int PATCH_SIZE = 256;
+    static constexpr int PATCH_OVERLAP = 64;
+
+    static bool isSupported();
+
+    explicit LocalUnet(QString modelPath);
+    ~LocalUnet();
+
+    bool isValid() const;
+    QString errorString() const { return m_errorString; }
+
+    /**
+     * @brief predict returns the output image of the network. If area is valid, the patches
+     * outside of it are skipped and stay black. onProgress is called from the worker threads,
+     * if it returns false the prediction is stopped and a null image is returned.
+     */
+    QImage predict(const QImage& image, QRect area, std::function<bool(double)> onProgress) const;
+
+protected:
+    // writes the output of the patch at origin inside of core to the RGB32 output pixels
+    bool predictPatch(const QImage& rgbImage, QPoint origin, QRect core, uchar* output, int outputBytesPerLine) const;
+
+protected:
+    struct Session;
+    std::unique_ptr<Session> m_session;
+    QString m_errorString;
+};
+
+#endif // LOCALUNET_H
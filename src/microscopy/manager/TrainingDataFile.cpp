@@ -0,0 +1,128 @@
+#include "TrainingDataFile.h"
+
+#include <QFile>
+#include <QtDebug>
+
+
+namespace TrainingDataFile {
+
+namespace {
+
+    const static int HEADER_SIZE = 32;
+    const static int SHARD_HEADER_SIZE = 16;
+
+}  // namespace
+
+
+bool isTrainingDataFile(QString path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    return file.read(4) == QByteArray(FILE_MAGIC, 4);
+}
+
+QVector<Shard> readShards(QString path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return {};
+    if (file.read(4) != QByteArray(FILE_MAGIC, 4)) return {};
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    quint32 version, flags, recordCount, shardCount, reserved;
+    quint64 indexOffset;
+    stream >> version >> flags >> recordCount >> shardCount >> reserved >> indexOffset;
+    if (stream.status() != QDataStream::Ok || version > VERSION || indexOffset == 0) {
+        qWarning() << "Training data file is incomplete or from a newer version:" << path;
+        return {};
+    }
+    if (!file.seek(qint64(indexOffset))) return {};
+    QVector<Shard> shards;
+    for (quint32 i = 0; i < shardCount; ++i) {
+        quint64 offset, size;
+        quint32 count;
+        stream >> offset >> size >> count >> reserved;
+        shards.append({qint64(offset), qint64(size), int(count)});
+    }
+    if (stream.status() != QDataStream::Ok) return {};
+    return shards;
+}
+
+Writer::Writer(QString path, bool compressed)
+    : m_file(path)
+    , m_flags(compressed ? COMPRESSED : 0)
+{
+    if (!m_file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Can't write training data file:" << path << m_file.errorString();
+        return;
+    }
+    m_stream.setDevice(&m_file);
+    m_stream.setByteOrder(QDataStream::LittleEndian);
+    writeHeader(0);
+}
+
+bool Writer::append(const QByteArray& input, const QByteArray& target) {
+    if (!isOpen()) return false;
+    if (!m_shardStarted) startShard();
+    const QByteArray storedInput = stored(input);
+    const QByteArray storedTarget = stored(target);
+    m_recordOffsets.append(m_file.pos());
+    m_stream << quint32(storedInput.size()) << quint32(storedTarget.size());
+    m_stream.writeRawData(storedInput.constData(), storedInput.size());
+    m_stream.writeRawData(storedTarget.constData(), storedTarget.size());
+    m_currentShard.recordCount += 1;
+    if (m_file.pos() - m_currentShard.offset >= SHARD_SIZE) {
+        finishShard();
+    }
+    return m_stream.status() == QDataStream::Ok;
+}
+
+bool Writer::finish() {
+    if (!isOpen()) return false;
+    if (m_shardStarted) finishShard();
+    const qint64 indexOffset = m_file.pos();
+    for (const Shard& shard: m_shards) {
+        m_stream << quint64(shard.offset) << quint64(shard.size) << quint32(shard.recordCount) << quint32(0);
+    }
+    for (qint64 offset: m_recordOffsets) {
+        m_stream << quint64(offset);
+    }
+    writeHeader(indexOffset);
+    if (m_stream.status() != QDataStream::Ok) {
+        m_file.cancelWriting();
+    }
+    return m_file.commit();
+}
+
+void Writer::writeHeader(qint64 indexOffset) {
+    const qint64 end = m_file.pos();
+    m_file.seek(0);
+    m_stream.writeRawData(FILE_MAGIC, 4);
+    m_stream << VERSION << m_flags << quint32(m_recordOffsets.size()) << quint32(m_shards.size())
+             << quint32(0) << quint64(indexOffset);
+    if (end > HEADER_SIZE) m_file.seek(end);
+}
+
+void Writer::startShard() {
+    m_currentShard = Shard();
+    m_currentShard.offset = m_file.pos();
+    m_stream.writeRawData(SHARD_MAGIC, 4);
+    // the record count is set in finishShard():
+    m_stream << VERSION << m_flags << quint32(0);
+    m_shardStarted = true;
+}
+
+void Writer::finishShard() {
+    const qint64 end = m_file.pos();
+    m_currentShard.size = end - m_currentShard.offset;
+    m_file.seek(m_currentShard.offset + SHARD_HEADER_SIZE - 4);
+    m_stream << quint32(m_currentShard.recordCount);
+    m_file.seek(end);
+    m_shards.append(m_currentShard);
+    m_shardStarted = false;
+}
+
+QByteArray Writer::stored(const QByteArray& image) const {
+    if (!(m_flags & COMPRESSED)) return image;
+    // qCompress() prepends the uncompressed size (big endian), the rest is a zlib stream:
+    return qCompress(image, 6).mid(4);
+}
+
+}  // namespace TrainingDataFile
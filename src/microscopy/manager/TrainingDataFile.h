@@ -0,0 +1,82 @@
+#ifndef TRAININGDATAFILE_H
+#define TRAININGDATAFILE_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QString>
+#include <QVector>
+
+
+/**
+ * Training data files contain the encoded input and target patches of TrainingDataPreprocessingBlock.
+ * They are written record by record while the patches are generated and are read by the server
+ * without loading the whole file (see server/training_data.py). All numbers are little endian:
+ *  - header (32 bytes): 'LTDF', version, flags, record count, shard count, reserved (uint32),
+ *    offset of the index (uint64, 0 until the file is complete)
+ *  - the shards: 'LTDS', version, flags, record count (uint32), followed by the records:
+ *    size of the input and target image (uint32), input image, target image
+ *  - index: offset, size (uint64), record count, reserved (uint32) of each shard,
+ *    followed by the offset (uint64) of each record
+ * Each shard can be read on its own, they are uploaded one by one as separate files.
+ * If the flag COMPRESSED is set, each image is stored as zlib stream.
+ * The old format (one CBOR map with the arrays "inputImages" and "targetImages") is still
+ * accepted everywhere.
+ */
+namespace TrainingDataFile {
+
+    const static char FILE_MAGIC[] = "LTDF";
+    const static char SHARD_MAGIC[] = "LTDS";
+    const static quint32 VERSION = 1;
+    const static quint32 COMPRESSED = 0x1;
+    const static char EXTENSION[] = ".tdata";
+    // a new shard is started when the current one reaches this size:
+    const static qint64 SHARD_SIZE = 32 * 1024 * 1024;
+
+    struct Shard {
+        qint64 offset = 0;
+        qint64 size = 0;
+        int recordCount = 0;
+    };
+
+    // true if the file starts with FILE_MAGIC, i.e. it is not an old CBOR file
+    bool isTrainingDataFile(QString path);
+
+    // returns an empty list if the file can't be read or is not complete
+    QVector<Shard> readShards(QString path);
+
+    /**
+     * @brief The Writer class appends the records to the file in the given order.
+     * An existing file is only replaced when finish() succeeds.
+     */
+    class Writer {
+
+    public:
+        explicit Writer(QString path, bool compressed = false);
+
+        bool isOpen() const { return m_file.isOpen(); }
+        int recordCount() const { return m_recordOffsets.size(); }
+
+        bool append(const QByteArray& input, const QByteArray& target);
+        // writes the index and commits the file
+        bool finish();
+
+    protected:
+        void writeHeader(qint64 indexOffset);
+        void startShard();
+        void finishShard();
+        QByteArray stored(const QByteArray& image) const;
+
+    protected:
+        QSaveFile m_file;
+        QDataStream m_stream;
+        const quint32 m_flags;
+        QVector<Shard> m_shards;
+        QVector<qint64> m_recordOffsets;
+        Shard m_currentShard;
+        bool m_shardStarted = false;
+    };
+
+}
+
+#endif // TRAININGDATAFILE_H
@@ -3,12 +3,14 @@
 #include "core/CoreController.h"
 #include "core/manager/BlockManager.h"
 #include "microscopy/blocks/basic/DataViewBlock.h"
+#include "microscopy/manager/ImageLoadScheduler.h"
 
 
 ViewManager::ViewManager(CoreController* controller)
     : QObject(controller)
     , ObjectWithAttributes(this)
     , m_controller(controller)
+    , m_imageLoadScheduler(new ImageLoadScheduler(controller, this))
     , m_dataViewHeight(this, "dataViewHeight", 400, 0, std::numeric_limits<int>::max())
 {
     QQmlEngine::setObjectOwnership(this, QQmlEngine::CppOwnership);
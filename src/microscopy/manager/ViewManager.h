@@ -11,6 +11,7 @@
 
 class CoreController;
 class DataViewBlock;
+class ImageLoadScheduler;
 
 class ViewManager : public QObject, public ObjectWithAttributes {
 
@@ -38,6 +39,8 @@ public slots:
 
     QStringList availableFeatures() const;
 
+    ImageLoadScheduler* imageLoadScheduler() const { return m_imageLoadScheduler; }
+
 protected:
     void updateViews();
 
@@ -46,6 +49,8 @@ protected:
 
     QList<DataViewBlock*> m_views;
 
+    ImageLoadScheduler* m_imageLoadScheduler;
+
     IntegerAttribute m_dataViewHeight;
 };
 
@@ -1,6 +1,17 @@
 
 
 HEADERS += \
+    $$PWD/algorithms/CellComparison.h \
+    $$PWD/algorithms/CellMatching.h \
+    $$PWD/algorithms/CellRasterizer.h \
+    $$PWD/algorithms/Clustering.h \
+    $$PWD/algorithms/ConnectedComponents.h \
+    $$PWD/algorithms/DistanceKernels.h \
+    $$PWD/algorithms/ParallelFor.h \
+    $$PWD/algorithms/PatchAugmentation.h \
+    $$PWD/algorithms/RandomCells.h \
+    $$PWD/algorithms/SegmentationMetrics.h \
+    $$PWD/algorithms/SpatialGrid.h \
     $$PWD/blocks/actions/ClusteringBlock.h \
     $$PWD/blocks/actions/CsvExportBlock.h \
     $$PWD/blocks/actions/DimensionalityReductionBlock.h \
@@ -28,12 +39,30 @@ HEADERS += \
     $$PWD/blocks/selection/FeatureSelectionBlock.h \
     $$PWD/blocks/selection/RectangularAreaBlock.h \
     $$PWD/manager/BackendManager.h \
+    $$PWD/manager/BlobCache.h \
+    $$PWD/manager/CborTypedArray.h \
+    $$PWD/manager/ChunkedUpload.h \
+    $$PWD/manager/DirectoryScanner.h \
+    $$PWD/manager/ImageEncoder.h \
+    $$PWD/manager/ImageLoadScheduler.h \
+    $$PWD/manager/ImageStack.h \
+    $$PWD/manager/LocalUnet.h \
+    $$PWD/manager/TrainingDataFile.h \
     $$PWD/manager/ViewManager.h \
+    $$PWD/multicore_tsne/distance_kernels.h \
     $$PWD/multicore_tsne/splittree.h \
     $$PWD/multicore_tsne/tsne.h \
     $$PWD/multicore_tsne/vptree.h
 
 SOURCES += \
+    $$PWD/algorithms/CellComparison.cpp \
+    $$PWD/algorithms/CellMatching.cpp \
+    $$PWD/algorithms/CellRasterizer.cpp \
+    $$PWD/algorithms/Clustering.cpp \
+    $$PWD/algorithms/ConnectedComponents.cpp \
+    $$PWD/algorithms/PatchAugmentation.cpp \
+    $$PWD/algorithms/RandomCells.cpp \
+    $$PWD/algorithms/SegmentationMetrics.cpp \
     $$PWD/blocks/actions/ClusteringBlock.cpp \
     $$PWD/blocks/actions/CsvExportBlock.cpp \
     $$PWD/blocks/actions/DimensionalityReductionBlock.cpp \
@@ -61,9 +90,27 @@ SOURCES += \
     $$PWD/blocks/selection/FeatureSelectionBlock.cpp \
     $$PWD/blocks/selection/RectangularAreaBlock.cpp \
     $$PWD/manager/BackendManager.cpp \
+    $$PWD/manager/BlobCache.cpp \
+    $$PWD/manager/CborTypedArray.cpp \
+    $$PWD/manager/ChunkedUpload.cpp \
+    $$PWD/manager/DirectoryScanner.cpp \
+    $$PWD/manager/ImageEncoder.cpp \
+    $$PWD/manager/ImageLoadScheduler.cpp \
+    $$PWD/manager/ImageStack.cpp \
+    $$PWD/manager/LocalUnet.cpp \
+    $$PWD/manager/TrainingDataFile.cpp \
     $$PWD/manager/ViewManager.cpp \
+    $$PWD/multicore_tsne/distance_kernels.cpp \
     $$PWD/multicore_tsne/splittree.cpp \
     $$PWD/multicore_tsne/tsne.cpp
 
 RESOURCES += \
     $$PWD/microscopy.qrc
+
+# Local U-Net inference without the server (see manager/LocalUnet.h) needs ONNX Runtime 1.13 or newer:
+# qmake CONFIG+=onnxruntime ONNXRUNTIME_DIR=/path/to/onnxruntime
+onnxruntime {
+    DEFINES += ONNXRUNTIME_ENABLED
+    INCLUDEPATH += $$ONNXRUNTIME_DIR/include
+    LIBS += -L$$ONNXRUNTIME_DIR/lib -lonnxruntime
+}
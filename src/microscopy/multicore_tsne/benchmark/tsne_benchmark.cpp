@@ -0,0 +1,161 @@
+/*
+ *  tsne_benchmark.cpp
+ *  Micro-benchmark of the t-SNE distance and gradient kernels.
+ *
+ *  Usage: tsne_benchmark [N] [D]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "distance_kernels.h"
+#include "splittree.h"
+#include "tsne.h"
+#include "vptree.h"
+
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double uniform() {
+    return rand() / ((double) RAND_MAX + 1);
+}
+
+// the distance loop of the nearest neighbor search, each point against `pairs` others
+static void benchmark_distances(int N, int D, int pairs) {
+    std::vector<double> X((size_t) N * D);
+    for (size_t i = 0; i < X.size(); i++) X[i] = uniform();
+    AlignedMatrix X_f(N, D);
+    for (int n = 0; n < N; n++) {
+        for (int d = 0; d < D; d++) X_f.row(n)[d] = (float) X[(size_t) n * D + d];
+    }
+    std::vector<int> others((size_t) N * pairs);
+    for (size_t i = 0; i < others.size(); i++) others[i] = rand() % N;
+
+    fprintf(stderr, "distances (N = %d, D = %d, %d pairs per point):\n", N, D, pairs);
+
+    auto start = std::chrono::steady_clock::now();
+    double sum = .0;
+    for (int n = 0; n < N; n++) {
+        DataPoint a(D, n, X.data() + (size_t) n * D);
+        for (int k = 0; k < pairs; k++) {
+            const int j = others[(size_t) n * pairs + k];
+            sum += euclidean_distance_squared(a, DataPoint(D, j, X.data() + (size_t) j * D));
+        }
+    }
+    const double reference = seconds_since(start);
+    fprintf(stderr, "  %-8s double  %8.2f ms  (sum %.4f)\n", "scalar", reference * 1000, sum);
+
+    const SimdLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_NEON };
+    for (int l = 0; l < 4; l++) {
+        if (levels[l] > detect_simd_level()) continue;
+        if (levels[l] == SIMD_NEON && detect_simd_level() != SIMD_NEON) continue;
+        if (levels[l] != SIMD_SCALAR && detect_simd_level() == SIMD_NEON && levels[l] != SIMD_NEON) continue;
+        squared_distance_f32_fn kernel = get_squared_distance_f32(levels[l]);
+        start = std::chrono::steady_clock::now();
+        double sum_f = .0;
+        for (int n = 0; n < N; n++) {
+            const float* a = X_f.row(n);
+            for (int k = 0; k < pairs; k++) {
+                sum_f += kernel(a, X_f.row(others[(size_t) n * pairs + k]), X_f.stride());
+            }
+        }
+        const double elapsed = seconds_since(start);
+        fprintf(stderr, "  %-8s float   %8.2f ms  (sum %.4f, %.2fx)\n", simd_level_name(levels[l]),
+                elapsed * 1000, sum_f, reference / elapsed);
+    }
+}
+
+// the attractive force loop of computeGradient for a 2D embedding
+static void benchmark_edge_forces(int N, int K, int repeats) {
+    std::vector<double> Y((size_t) N * 2);
+    for (size_t i = 0; i < Y.size(); i++) Y[i] = uniform() * 100.0 - 50.0;
+    std::vector<int> row_P(N + 1);
+    std::vector<int> col_P((size_t) N * K);
+    std::vector<double> val_P((size_t) N * K);
+    std::vector<float> val_P_f((size_t) N * K);
+    row_P[0] = 0;
+    for (int n = 0; n < N; n++) {
+        row_P[n + 1] = row_P[n] + K;
+        for (int k = 0; k < K; k++) {
+            // neighbors are mostly close in index, as after symmetrization
+            col_P[(size_t) n * K + k] = (n + rand() % 2000) % N;
+            val_P[(size_t) n * K + k] = uniform() / (N * K);
+            val_P_f[(size_t) n * K + k] = (float) val_P[(size_t) n * K + k];
+        }
+    }
+    std::vector<double> pos_f((size_t) N * 2);
+
+    fprintf(stderr, "edge forces (N = %d, K = %d, %d iterations):\n", N, K, repeats);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        std::fill(pos_f.begin(), pos_f.end(), .0);
+        for (int n = 0; n < N; n++) {
+            int ind1 = n * 2;
+            for (int i = row_P[n]; i < row_P[n + 1]; i++) {
+                double D = .0;
+                int ind2 = col_P[i] * 2;
+                for (int d = 0; d < 2; d++) {
+                    double t = Y[ind1 + d] - Y[ind2 + d];
+                    D += t * t;
+                }
+                D = val_P[i] / (1.0 + D);
+                for (int d = 0; d < 2; d++) {
+                    pos_f[ind1 + d] += D * (Y[ind1 + d] - Y[ind2 + d]);
+                }
+            }
+        }
+    }
+    const double reference = seconds_since(start);
+    fprintf(stderr, "  %-8s double P  %8.2f ms  (f[0] %.6g)\n", "scalar", reference * 1000, pos_f[0]);
+
+    const SimdLevel levels[] = { SIMD_SCALAR, detect_simd_level() };
+    for (int l = 0; l < 2; l++) {
+        if (l == 1 && get_edge_forces_2d(levels[1]) == get_edge_forces_2d(SIMD_SCALAR)) break;
+        edge_forces_2d_fn kernel = get_edge_forces_2d(levels[l]);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            std::fill(pos_f.begin(), pos_f.end(), .0);
+            for (int n = 0; n < N; n++) {
+                kernel(col_P.data(), val_P_f.data(), row_P[n], row_P[n + 1], Y.data(), n, pos_f.data() + n * 2);
+            }
+        }
+        const double elapsed = seconds_since(start);
+        fprintf(stderr, "  %-8s float P   %8.2f ms  (f[0] %.6g, %.2fx)\n", simd_level_name(levels[l]),
+                elapsed * 1000, pos_f[0], reference / elapsed);
+    }
+}
+
+// a complete run with float input
+static void benchmark_tsne(int N, int D) {
+    std::vector<float> X((size_t) N * D);
+    for (int n = 0; n < N; n++) {
+        // a few gaussian-ish blobs
+        const int blob = n % 5;
+        for (int d = 0; d < D; d++) {
+            X[(size_t) n * D + d] = (float) (blob * (d % 3) + uniform() + uniform() - 1.0);
+        }
+    }
+    std::vector<double> Y((size_t) N * 2);
+    fprintf(stderr, "t-SNE (N = %d, D = %d, 500 iterations):\n", N, D);
+    auto start = std::chrono::steady_clock::now();
+    double error = .0;
+    TSNE<SplitTree, euclidean_distance_squared> tsne;
+    tsne.run(X.data(), N, D, Y.data(), 2, 30, .5, 1, 500, 0, false, 0, 12, 200, &error);
+    fprintf(stderr, "  %8.2f ms  (error %.4f)\n", seconds_since(start) * 1000, error);
+}
+
+int main(int argc, char** argv) {
+    const int N = argc > 1 ? atoi(argv[1]) : 100000;
+    const int D = argc > 2 ? atoi(argv[2]) : 64;
+    srand(0);
+    fprintf(stderr, "detected: %s\n\n", simd_level_name(detect_simd_level()));
+    benchmark_distances(N, D, 64);
+    benchmark_edge_forces(N, 90, 10);
+    benchmark_tsne(N / 50, D);
+    return 0;
+}
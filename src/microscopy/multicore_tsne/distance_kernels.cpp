@@ -0,0 +1,253 @@
+/*
+ *  distance_kernels.cpp
+ *  Float32 storage and SIMD kernels for t-SNE, selected at runtime.
+ */
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include "distance_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TSNE_X86
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+// compile the AVX2 kernels with function level target attributes, so that the
+// rest of the library still runs on any x86_64 CPU
+#define TSNE_AVX2_TARGET __attribute__((target("avx2,fma")))
+#define TSNE_HAS_AVX2_KERNELS
+#elif defined(__AVX2__)
+#define TSNE_AVX2_TARGET
+#define TSNE_HAS_AVX2_KERNELS
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TSNE_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Without gather instructions, the auto-vectorizer emulates the indexed loads of the edge-force loop
+// with scalar loads and shuffles, which is slower than the plain loop, so it is
+// turned off for the scalar edge-force kernel
+#if defined(__clang__)
+#define TSNE_NO_VECTORIZE_FUNCTION
+#define TSNE_NO_VECTORIZE_LOOP _Pragma("clang loop vectorize(disable) interleave(disable)")
+#elif defined(__GNUC__)
+#define TSNE_NO_VECTORIZE_FUNCTION __attribute__((optimize("no-tree-vectorize")))
+#define TSNE_NO_VECTORIZE_LOOP
+#elif defined(_MSC_VER)
+#define TSNE_NO_VECTORIZE_FUNCTION
+#define TSNE_NO_VECTORIZE_LOOP __pragma(loop(no_vector))
+#else
+#define TSNE_NO_VECTORIZE_FUNCTION
+#define TSNE_NO_VECTORIZE_LOOP
+#endif
+
+
+AlignedMatrix::AlignedMatrix(int N, int D) {
+    _N = N;
+    _D = D;
+    _stride = ((D + TSNE_FLOAT_LANES - 1) / TSNE_FLOAT_LANES) * TSNE_FLOAT_LANES;
+    size_t bytes = (size_t) N * _stride * sizeof(float);
+    if (bytes == 0) bytes = TSNE_ALIGNMENT;
+#ifdef _WIN32
+    _data = (float*) _aligned_malloc(bytes, TSNE_ALIGNMENT);
+#else
+    void* ptr = NULL;
+    _data = posix_memalign(&ptr, TSNE_ALIGNMENT, bytes) == 0 ? (float*) ptr : NULL;
+#endif
+    if (_data == NULL) { fprintf(stderr, "Memory allocation failed!\n"); exit(1); }
+    memset(_data, 0, bytes);
+}
+
+AlignedMatrix::~AlignedMatrix() {
+#ifdef _WIN32
+    _aligned_free(_data);
+#else
+    free(_data);
+#endif
+}
+
+
+// ------------------------------ scalar ------------------------------
+
+static float squared_distance_f32_scalar(const float* a, const float* b, int padded_dims) {
+    float dd = .0f;
+    for (int d = 0; d < padded_dims; d++) {
+        float t = a[d] - b[d];
+        dd += t * t;
+    }
+    return dd;
+}
+
+TSNE_NO_VECTORIZE_FUNCTION
+static void edge_forces_2d_scalar(const int* col_P, const float* val_P, int begin, int end,
+                                  const double* Y, int n, double* pos_f) {
+    const double yx = Y[n * 2];
+    const double yy = Y[n * 2 + 1];
+    double fx = .0, fy = .0;
+    TSNE_NO_VECTORIZE_LOOP
+    for (int i = begin; i < end; i++) {
+        const int j = col_P[i];
+        const double dx = yx - Y[j * 2];
+        const double dy = yy - Y[j * 2 + 1];
+        const double q = val_P[i] / (1.0 + dx * dx + dy * dy);
+        fx += q * dx;
+        fy += q * dy;
+    }
+    pos_f[0] += fx;
+    pos_f[1] += fy;
+}
+
+
+// ------------------------------ SSE2 / AVX2 ------------------------------
+
+#ifdef TSNE_X86
+
+static float squared_distance_f32_sse2(const float* a, const float* b, int padded_dims) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int d = 0; d < padded_dims; d += 8) {
+        const __m128 t0 = _mm_sub_ps(_mm_load_ps(a + d), _mm_load_ps(b + d));
+        const __m128 t1 = _mm_sub_ps(_mm_load_ps(a + d + 4), _mm_load_ps(b + d + 4));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(t0, t0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(t1, t1));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    __m128 shuffled = _mm_shuffle_ps(acc0, acc0, _MM_SHUFFLE(2, 3, 0, 1));
+    acc0 = _mm_add_ps(acc0, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, acc0);
+    acc0 = _mm_add_ss(acc0, shuffled);
+    return _mm_cvtss_f32(acc0);
+}
+
+#ifdef TSNE_HAS_AVX2_KERNELS
+
+TSNE_AVX2_TARGET
+static float squared_distance_f32_avx2(const float* a, const float* b, int padded_dims) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int d = 0; d < padded_dims; d += 8) {
+        const __m256 t = _mm256_sub_ps(_mm256_load_ps(a + d), _mm256_load_ps(b + d));
+        acc = _mm256_fmadd_ps(t, t, acc);
+    }
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    __m128 shuffled = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1));
+    sum = _mm_add_ps(sum, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sum);
+    sum = _mm_add_ss(sum, shuffled);
+    return _mm_cvtss_f32(sum);
+}
+
+TSNE_AVX2_TARGET
+static void edge_forces_2d_avx2(const int* col_P, const float* val_P, int begin, int end,
+                                const double* Y, int n, double* pos_f) {
+    const __m256d yx = _mm256_set1_pd(Y[n * 2]);
+    const __m256d yy = _mm256_set1_pd(Y[n * 2 + 1]);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    __m256d fx = _mm256_setzero_pd();
+    __m256d fy = _mm256_setzero_pd();
+    int i = begin;
+    // four neighbours at a time, their coordinates are gathered from Y:
+    for (; i + 4 <= end; i += 4) {
+        __m128i idx = _mm_loadu_si128((const __m128i*) (col_P + i));
+        idx = _mm_add_epi32(idx, idx);
+        const __m256d dx = _mm256_sub_pd(yx, _mm256_mask_i32gather_pd(zero, Y, idx, all, 8));
+        const __m256d dy = _mm256_sub_pd(yy, _mm256_mask_i32gather_pd(zero, Y + 1, idx, all, 8));
+        const __m256d D = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+        const __m256d p = _mm256_cvtps_pd(_mm_loadu_ps(val_P + i));
+        const __m256d q = _mm256_div_pd(p, _mm256_add_pd(one, D));
+        fx = _mm256_fmadd_pd(q, dx, fx);
+        fy = _mm256_fmadd_pd(q, dy, fy);
+    }
+    double lanes_x[4], lanes_y[4];
+    _mm256_storeu_pd(lanes_x, fx);
+    _mm256_storeu_pd(lanes_y, fy);
+    pos_f[0] += lanes_x[0] + lanes_x[1] + lanes_x[2] + lanes_x[3];
+    pos_f[1] += lanes_y[0] + lanes_y[1] + lanes_y[2] + lanes_y[3];
+    edge_forces_2d_scalar(col_P, val_P, i, end, Y, n, pos_f);
+}
+
+#endif  // TSNE_HAS_AVX2_KERNELS
+#endif  // TSNE_X86
+
+
+// ------------------------------ NEON ------------------------------
+
+#ifdef TSNE_NEON
+
+static float squared_distance_f32_neon(const float* a, const float* b, int padded_dims) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (int d = 0; d < padded_dims; d += 8) {
+        const float32x4_t t0 = vsubq_f32(vld1q_f32(a + d), vld1q_f32(b + d));
+        const float32x4_t t1 = vsubq_f32(vld1q_f32(a + d + 4), vld1q_f32(b + d + 4));
+        acc0 = vmlaq_f32(acc0, t0, t0);
+        acc1 = vmlaq_f32(acc1, t1, t1);
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    return vgetq_lane_f32(acc0, 0) + vgetq_lane_f32(acc0, 1)
+         + vgetq_lane_f32(acc0, 2) + vgetq_lane_f32(acc0, 3);
+}
+
+#endif  // TSNE_NEON
+
+
+// ------------------------------ dispatch ------------------------------
+
+SimdLevel detect_simd_level() {
+#if defined(TSNE_X86)
+#if defined(TSNE_HAS_AVX2_KERNELS) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SIMD_AVX2;
+    }
+#elif defined(TSNE_HAS_AVX2_KERNELS)
+    return SIMD_AVX2;  // compiled with /arch:AVX2
+#endif
+    return SIMD_SSE2;
+#elif defined(TSNE_NEON)
+    return SIMD_NEON;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SIMD_SSE2: return "SSE2";
+    case SIMD_AVX2: return "AVX2";
+    case SIMD_NEON: return "NEON";
+    default: return "scalar";
+    }
+}
+
+squared_distance_f32_fn get_squared_distance_f32(SimdLevel level) {
+#if defined(TSNE_X86)
+#ifdef TSNE_HAS_AVX2_KERNELS
+    if (level >= SIMD_AVX2 && detect_simd_level() == SIMD_AVX2) return squared_distance_f32_avx2;
+#endif
+    if (level >= SIMD_SSE2) return squared_distance_f32_sse2;
+#elif defined(TSNE_NEON)
+    if (level == SIMD_NEON) return squared_distance_f32_neon;
+#endif
+    (void) level;
+    return squared_distance_f32_scalar;
+}
+
+edge_forces_2d_fn get_edge_forces_2d(SimdLevel level) {
+#if defined(TSNE_HAS_AVX2_KERNELS)
+    if (level >= SIMD_AVX2 && detect_simd_level() == SIMD_AVX2) return edge_forces_2d_avx2;
+#endif
+    // SSE2 and NEON have no gather instructions, the scalar loop is as fast there
+    (void) level;
+    return edge_forces_2d_scalar;
+}
+
+squared_distance_f32_fn squared_distance_f32 = get_squared_distance_f32(detect_simd_level());
+edge_forces_2d_fn edge_forces_2d = get_edge_forces_2d(detect_simd_level());
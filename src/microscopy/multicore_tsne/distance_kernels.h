@@ -0,0 +1,67 @@
+/*
+ *  distance_kernels.h
+ *  Float32 storage and SIMD kernels for t-SNE, selected at runtime.
+ */
+
+
+#include <cstddef>
+
+#ifndef DISTANCE_KERNELS_H
+#define DISTANCE_KERNELS_H
+
+// Rows of an AlignedMatrix are padded to a multiple of this many floats,
+// so that the distance kernels never need to handle a remainder.
+#define TSNE_FLOAT_LANES 8
+#define TSNE_ALIGNMENT 32
+
+// Row-major float matrix with 32 byte aligned, zero-padded rows
+class AlignedMatrix
+{
+public:
+    AlignedMatrix(int N, int D);
+    ~AlignedMatrix();
+
+    float* row(int n) { return _data + (size_t) n * _stride; }
+    const float* row(int n) const { return _data + (size_t) n * _stride; }
+    int rows() const { return _N; }
+    int dimensionality() const { return _D; }
+    int stride() const { return _stride; }
+
+private:
+    AlignedMatrix(const AlignedMatrix&);
+    AlignedMatrix& operator= (const AlignedMatrix&);
+
+    float* _data;
+    int _N;
+    int _D;
+    int _stride;
+};
+
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_NEON
+};
+
+// squared euclidean distance of two padded rows, padded_dims is a multiple of TSNE_FLOAT_LANES
+typedef float (*squared_distance_f32_fn)(const float* a, const float* b, int padded_dims);
+
+// attractive forces for point n in a 2D embedding: sums p_nj * q_nj * (y_n - y_j) over the
+// sparse row [begin, end) of P and adds the result to pos_f[0] and pos_f[1]
+typedef void (*edge_forces_2d_fn)(const int* col_P, const float* val_P, int begin, int end,
+                                  const double* Y, int n, double* pos_f);
+
+// best level supported by the CPU this is running on
+SimdLevel detect_simd_level();
+const char* simd_level_name(SimdLevel level);
+
+// return the kernel for the given level or the next best supported one
+squared_distance_f32_fn get_squared_distance_f32(SimdLevel level);
+edge_forces_2d_fn get_edge_forces_2d(SimdLevel level);
+
+// kernels for the detected level, initialized once at startup
+extern squared_distance_f32_fn squared_distance_f32;
+extern edge_forces_2d_fn edge_forces_2d;
+
+#endif
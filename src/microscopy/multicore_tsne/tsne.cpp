@@ -48,6 +48,80 @@ void TSNE<treeT, dist_fn>::run(double* X, int N, int D, double* Y,
                double early_exaggeration, double learning_rate,
                double *final_error) {
 
+    // Normalize input data (to prevent numerical problems)
+    zeroMean(X, N, D);
+    double max_X = .0;
+    for (int i = 0; i < N * D; i++) {
+        if (X[i] > max_X) max_X = X[i];
+    }
+    for (int i = 0; i < N * D; i++) {
+        X[i] /= max_X;
+    }
+
+    // Copy to float rows for the nearest neighbor search
+    AlignedMatrix X_f(N, D);
+    for (int n = 0; n < N; n++) {
+        float* row = X_f.row(n);
+        for (int d = 0; d < D; d++) {
+            row[d] = (float) X[n * D + d];
+        }
+    }
+
+    fit(X_f, Y, no_dims, perplexity, theta, num_threads, max_iter, random_state,
+        init_from_Y, verbose, early_exaggeration, learning_rate, final_error);
+}
+
+/*
+    Perform t-SNE on float data
+        X -- float matrix of size [N, D], is not modified
+*/
+template <class treeT, double (*dist_fn)( const DataPoint&, const DataPoint&)>
+void TSNE<treeT, dist_fn>::run(const float* X, int N, int D, double* Y,
+               int no_dims, double perplexity, double theta ,
+               int num_threads, int max_iter, int random_state,
+               bool init_from_Y, int verbose,
+               double early_exaggeration, double learning_rate,
+               double *final_error) {
+
+    // Normalize input data (to prevent numerical problems), the mean is accumulated in double
+    double* mean = (double*) calloc(D, sizeof(double));
+    if (mean == NULL) { fprintf(stderr, "Memory allocation failed!\n"); exit(1); }
+    for (int n = 0; n < N; n++) {
+        for (int d = 0; d < D; d++) {
+            mean[d] += X[(size_t) n * D + d];
+        }
+    }
+    for (int d = 0; d < D; d++) {
+        mean[d] /= (double) N;
+    }
+    double max_X = .0;
+    for (int n = 0; n < N; n++) {
+        for (int d = 0; d < D; d++) {
+            double x = X[(size_t) n * D + d] - mean[d];
+            if (x > max_X) max_X = x;
+        }
+    }
+
+    AlignedMatrix X_f(N, D);
+    for (int n = 0; n < N; n++) {
+        float* row = X_f.row(n);
+        for (int d = 0; d < D; d++) {
+            row[d] = (float) ((X[(size_t) n * D + d] - mean[d]) / max_X);
+        }
+    }
+    free(mean); mean = NULL;
+
+    fit(X_f, Y, no_dims, perplexity, theta, num_threads, max_iter, random_state,
+        init_from_Y, verbose, early_exaggeration, learning_rate, final_error);
+}
+
+template <class treeT, double (*dist_fn)( const DataPoint&, const DataPoint&)>
+void TSNE<treeT, dist_fn>::fit(const AlignedMatrix& X, double* Y, int no_dims, double perplexity, double theta,
+               int num_threads, int max_iter, int random_state, bool init_from_Y, int verbose,
+               double early_exaggeration, double learning_rate, double *final_error) {
+
+    const int N = X.rows();
+
     if (N - 1 < 3 * perplexity) {
         perplexity = (N - 1) / 3;
         if (verbose)
@@ -68,7 +142,7 @@ void TSNE<treeT, dist_fn>::run(double* X, int N, int D, double* Y,
     */
 
     if (verbose)
-        fprintf(stderr, "Using no_dims = %d, perplexity = %f, and theta = %f\n", no_dims, perplexity, theta);
+        fprintf(stderr, "Using no_dims = %d, perplexity = %f, and theta = %f (%s kernels)\n", no_dims, perplexity, theta, simd_level_name(detect_simd_level()));
 
     // Set learning parameters
     float total_time = .0;
@@ -86,35 +160,31 @@ void TSNE<treeT, dist_fn>::run(double* X, int N, int D, double* Y,
         gains[i] = 1.0;
     }
 
-    // Normalize input data (to prevent numerical problems)
     if (verbose)
         fprintf(stderr, "Computing input similarities...\n");
 
     start = time(0);
-    zeroMean(X, N, D);
-    double max_X = .0;
-    for (int i = 0; i < N * D; i++) {
-        if (X[i] > max_X) max_X = X[i];
-    }
-    for (int i = 0; i < N * D; i++) {
-        X[i] /= max_X;
-    }
 
     // Compute input similarities
-    int* row_P; int* col_P; double* val_P;
+    int* row_P; int* col_P; double* val_P_d;
 
     // Compute asymmetric pairwise input similarities
-    computeGaussianPerplexity(X, N, D, &row_P, &col_P, &val_P, perplexity, (int) (3 * perplexity), verbose);
+    computeGaussianPerplexity(X, &row_P, &col_P, &val_P_d, perplexity, (int) (3 * perplexity), verbose);
 
     // Symmetrize input similarities
-    symmetrizeMatrix(&row_P, &col_P, &val_P, N);
+    symmetrizeMatrix(&row_P, &col_P, &val_P_d, N);
     double sum_P = .0;
     for (int i = 0; i < row_P[N]; i++) {
-        sum_P += val_P[i];
+        sum_P += val_P_d[i];
     }
+
+    // P is read in every iteration of the gradient descent, store it as float to halve that traffic
+    float* val_P = (float*) malloc(row_P[N] * sizeof(float));
+    if (val_P == NULL) { fprintf(stderr, "Memory allocation failed!\n"); exit(1); }
     for (int i = 0; i < row_P[N]; i++) {
-        val_P[i] /= sum_P;
+        val_P[i] = (float) (val_P_d[i] / sum_P);
     }
+    free(val_P_d); val_P_d = NULL;
 
     end = time(0);
     if (verbose)
@@ -213,7 +283,7 @@ template class TSNE<SplitTree, euclidean_distance_squared>;
 
 // Compute gradient of the t-SNE cost function (using Barnes-Hut algorithm)
 template <class treeT, double (*dist_fn)( const DataPoint&, const DataPoint&)>
-double TSNE<treeT, dist_fn>::computeGradient(int* inp_row_P, int* inp_col_P, double* inp_val_P, double* Y, int N, int no_dims, double* dC, double theta, bool eval_error)
+double TSNE<treeT, dist_fn>::computeGradient(int* inp_row_P, int* inp_col_P, float* inp_val_P, double* Y, int N, int no_dims, double* dC, double theta, bool eval_error)
 {
     // Construct quadtree on current map
     treeT* tree = new treeT(Y, N, no_dims);
@@ -236,29 +306,35 @@ double TSNE<treeT, dist_fn>::computeGradient(int* inp_row_P, int* inp_col_P, dou
     for (int n = 0; n < N; n++) {
         // Edge forces
         int ind1 = n * no_dims;
-        for (int i = inp_row_P[n]; i < inp_row_P[n + 1]; i++) {
-
-            // Compute pairwise distance and Q-value
-            double D = .0;
-            int ind2 = inp_col_P[i] * no_dims;
-            for (int d = 0; d < no_dims; d++) {
-                double t = Y[ind1 + d] - Y[ind2 + d];
-                D += t * t;
-            }
+        if (no_dims == 2 && !eval_error) {
+            // common case, uses the SIMD kernel
+            edge_forces_2d(inp_col_P, inp_val_P, inp_row_P[n], inp_row_P[n + 1], Y, n, pos_f + ind1);
+        }
+        else {
+            for (int i = inp_row_P[n]; i < inp_row_P[n + 1]; i++) {
+
+                // Compute pairwise distance and Q-value
+                double D = .0;
+                int ind2 = inp_col_P[i] * no_dims;
+                for (int d = 0; d < no_dims; d++) {
+                    double t = Y[ind1 + d] - Y[ind2 + d];
+                    D += t * t;
+                }
             
-            // Sometimes we want to compute error on the go
-            if (eval_error) {
-                P_i_sum += inp_val_P[i];
-                C += inp_val_P[i] * log((inp_val_P[i] + FLT_MIN) / ((1.0 / (1.0 + D)) + FLT_MIN));
-            }
+                // Sometimes we want to compute error on the go
+                if (eval_error) {
+                    P_i_sum += inp_val_P[i];
+                    C += inp_val_P[i] * log((inp_val_P[i] + FLT_MIN) / ((1.0 / (1.0 + D)) + FLT_MIN));
+                }
 
-            D = inp_val_P[i] / (1.0 + D);
-            // Sum positive force
-            for (int d = 0; d < no_dims; d++) {
-                pos_f[ind1 + d] += D * (Y[ind1 + d] - Y[ind2 + d]);
+                D = inp_val_P[i] / (1.0 + D);
+                // Sum positive force
+                for (int d = 0; d < no_dims; d++) {
+                    pos_f[ind1 + d] += D * (Y[ind1 + d] - Y[ind2 + d]);
+                }
             }
         }
-        
+
         // NoneEdge forces
         double this_Q = .0;
         tree->computeNonEdgeForces(n, theta, neg_f + n * no_dims, &this_Q);
@@ -288,7 +364,7 @@ double TSNE<treeT, dist_fn>::computeGradient(int* inp_row_P, int* inp_col_P, dou
 
 // Evaluate t-SNE cost function (approximately)
 template <class treeT, double (*dist_fn)( const DataPoint&, const DataPoint&)>
-double TSNE<treeT, dist_fn>::evaluateError(int* row_P, int* col_P, double* val_P, double* Y, int N, int no_dims, double theta)
+double TSNE<treeT, dist_fn>::evaluateError(int* row_P, int* col_P, float* val_P, double* Y, int N, int no_dims, double theta)
 {
 
     // Get estimate of normalization term
@@ -324,12 +400,25 @@ double TSNE<treeT, dist_fn>::evaluateError(int* row_P, int* col_P, double* val_P
     return C;
 }
 
+// The float distance used for the nearest neighbor search, matching dist_fn
+template <double (*dist_fn)( const DataPoint&, const DataPoint&)>
+struct FloatDistance {
+    static double distance(const DataPointF& t1, const DataPointF& t2) { return euclidean_distance_squared_f32(t1, t2); }
+};
+
+template <>
+struct FloatDistance<euclidean_distance> {
+    static double distance(const DataPointF& t1, const DataPointF& t2) { return euclidean_distance_f32(t1, t2); }
+};
+
 // Compute input similarities with a fixed perplexity using ball trees (this function allocates memory another function should free)
 template <class treeT, double (*dist_fn)( const DataPoint&, const DataPoint&)>
-void TSNE<treeT, dist_fn>::computeGaussianPerplexity(double* X, int N, int D, int** _row_P, int** _col_P, double** _val_P, double perplexity, int K, int verbose) {
+void TSNE<treeT, dist_fn>::computeGaussianPerplexity(const AlignedMatrix& X, int** _row_P, int** _col_P, double** _val_P, double perplexity, int K, int verbose) {
 
     if (perplexity > K) fprintf(stderr, "Perplexity should be lower than K!\n");
 
+    const int N = X.rows();
+
     // Allocate the memory we need
     *_row_P = (int*)    malloc((N + 1) * sizeof(int));
     *_col_P = (int*)    calloc(N * K, sizeof(int));
@@ -352,10 +441,11 @@ void TSNE<treeT, dist_fn>::computeGaussianPerplexity(double* X, int N, int D, in
     }
 
     // Build ball tree on data set
-    VpTree<DataPoint, dist_fn>* tree = new VpTree<DataPoint, dist_fn>();
-    std::vector<DataPoint> obj_X(N, DataPoint(D, -1, X));
+    typedef VpTree<DataPointF, FloatDistance<dist_fn>::distance> FloatVpTree;
+    FloatVpTree* tree = new FloatVpTree();
+    std::vector<DataPointF> obj_X(N);
     for (int n = 0; n < N; n++) {
-        obj_X[n] = DataPoint(D, n, X + n * D);
+        obj_X[n] = DataPointF(X, n);
     }
     tree->create(obj_X);
 
@@ -370,7 +460,7 @@ void TSNE<treeT, dist_fn>::computeGaussianPerplexity(double* X, int N, int D, in
     for (int n = 0; n < N; n++)
     {
         std::vector<double> cur_P(K);
-        std::vector<DataPoint> indices;
+        std::vector<DataPointF> indices;
         std::vector<double> distances;
 
         // Find nearest neighbors
@@ -27,12 +27,22 @@ public:
                bool init_from_Y = false, int verbose = 0,
                double early_exaggeration = 12, double learning_rate = 200,
                double *final_error = NULL);
+    // same as above for float input, X is not modified
+    void run(const float* X, int N, int D, double* Y,
+               int no_dims = 2, double perplexity = 30, double theta = .5,
+               int num_threads = 1, int max_iter = 1000, int random_state = 0,
+               bool init_from_Y = false, int verbose = 0,
+               double early_exaggeration = 12, double learning_rate = 200,
+               double *final_error = NULL);
     void symmetrizeMatrix(int** row_P, int** col_P, double** val_P, int N);
 private:
-    double computeGradient(int* inp_row_P, int* inp_col_P, double* inp_val_P, double* Y, int N, int D, double* dC, double theta, bool eval_error);
-    double evaluateError(int* row_P, int* col_P, double* val_P, double* Y, int N, int no_dims, double theta);
+    void fit(const AlignedMatrix& X, double* Y, int no_dims, double perplexity, double theta,
+               int num_threads, int max_iter, int random_state, bool init_from_Y, int verbose,
+               double early_exaggeration, double learning_rate, double *final_error);
+    double computeGradient(int* inp_row_P, int* inp_col_P, float* inp_val_P, double* Y, int N, int D, double* dC, double theta, bool eval_error);
+    double evaluateError(int* row_P, int* col_P, float* val_P, double* Y, int N, int no_dims, double theta);
     void zeroMean(double* X, int N, int D);
-    void computeGaussianPerplexity(double* X, int N, int D, int** _row_P, int** _col_P, double** _val_P, double perplexity, int K, int verbose);
+    void computeGaussianPerplexity(const AlignedMatrix& X, int** _row_P, int** _col_P, double** _val_P, double perplexity, int K, int verbose);
     double randn();
 };
 
@@ -18,6 +18,8 @@
 #include <cfloat>
 #include <cmath>
 
+#include "distance_kernels.h"
+
 
 #ifndef VPTREE_H
 #define VPTREE_H
@@ -75,7 +77,34 @@ inline double euclidean_distance(const DataPoint &t1, const DataPoint &t2) {
 }
 
 
-template<typename T, double (*distance)( const DataPoint&, const DataPoint&)>
+// Point referencing a row of an AlignedMatrix, distances use the SIMD float kernels
+class DataPointF
+{
+    int _stride;
+    int _ind;
+    const float* _x;
+
+public:
+    DataPointF() : _stride(0), _ind(-1), _x(NULL) {}
+    DataPointF(const AlignedMatrix& matrix, int ind)
+        : _stride(matrix.stride()), _ind(ind), _x(matrix.row(ind)) {}
+
+    int index() const { return _ind; }
+    int stride() const { return _stride; }
+    const float* data() const { return _x; }
+};
+
+
+inline double euclidean_distance_squared_f32(const DataPointF &t1, const DataPointF &t2) {
+    return squared_distance_f32(t1.data(), t2.data(), t1.stride());
+}
+
+inline double euclidean_distance_f32(const DataPointF &t1, const DataPointF &t2) {
+    return sqrt(euclidean_distance_squared_f32(t1, t2));
+}
+
+
+template<typename T, double (*distance)( const T&, const T&)>
 class VpTree
 {
 public:
@@ -58,6 +58,50 @@ StretchColumn {
         }
     }
 
+    BlockRow {
+        Text {
+            text: "Images:"
+            width: 70*dp
+        }
+        ComboBox2 {
+            width: parent.width - 70*dp
+            values: ["qoi", "raw", "png"]
+            texts: ["QOI", "Raw + Deflate", "PNG"]
+            property bool initialized: false
+            Component.onCompleted: {
+                setValue(backendManager.attr("imageCodec").val)
+                initialized = true
+            }
+            onValueChanged: {
+                if (initialized && value !== backendManager.attr("imageCodec").val) {
+                    backendManager.attr("imageCodec").val = value
+                }
+            }
+        }
+    }
+
+    BlockRow {
+        Text {
+            text: "U-Net:"
+            width: 70*dp
+        }
+        ComboBox2 {
+            width: parent.width - 70*dp
+            values: ["auto", "server", "local"]
+            texts: ["Local if offline", "Server", "Local (CPU)"]
+            property bool initialized: false
+            Component.onCompleted: {
+                setValue(backendManager.attr("unetBackend").val)
+                initialized = true
+            }
+            onValueChanged: {
+                if (initialized && value !== backendManager.attr("unetBackend").val) {
+                    backendManager.attr("unetBackend").val = value
+                }
+            }
+        }
+    }
+
     BlockRow {
         height: 40*dp
         implicitHeight: 0